@@ -16,15 +16,54 @@
 #define ANALYTICSLOGGER_H__
 
 #include <sstream>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+
+#include "snmp_counter_table.h"
 
 class AnalyticsLogger
 {
 public:
+  /// Function that writes a single log, with its RFC3339 timestamp.
+  typedef std::function<void(const char* timestamp, const char* log)> WriteFn;
+
+  /// Constructs a logger that writes each analytics log to syslog on the
+  /// calling thread.
   AnalyticsLogger();
+
+  /// Constructs a logger that writes analytics logs to syslog on a dedicated
+  /// writer thread.  Each thread that logs gets its own lock-free ring buffer
+  /// of queue_size records, which the writer thread drains in batches.  If a
+  /// ring buffer is full the record is dropped and counted, rather than
+  /// blocking the logging thread.  A queue_size of 0 means logs are written
+  /// synchronously, as by the default constructor.
+  ///
+  /// @param queue_size        - The number of records to buffer per thread.
+  /// @param dropped_tbl       - Optional statistics table, incremented for
+  ///                            every record that is dropped.
+  /// @param write_fn          - Optional function that writes each log, in
+  ///                            place of writing it to syslog.  It is called
+  ///                            on the writer thread, so must stay valid
+  ///                            until the logger is stopped.
+  AnalyticsLogger(size_t queue_size,
+                  SNMP::CounterTable* dropped_tbl = NULL,
+                  const WriteFn& write_fn = WriteFn());
   virtual ~AnalyticsLogger();
 
+  /// Writes any queued logs and stops the writer thread.  No more logs may be
+  /// made after this is called.
+  void stop();
+
   void log_with_tag_and_timestamp(char* log);
 
+  /// Returns the number of records dropped because a ring buffer was full.
+  uint64_t dropped() const { return _dropped.load(); }
+
   virtual void registration(const std::string& aor,
                     const std::string& binding_id,
                     const std::string& contact,
@@ -52,6 +91,68 @@ public:
 
 private:
   static const int BUFFER_SIZE = 1000;
+
+  /// A log waiting to be written, with the time it was made.
+  struct Record
+  {
+    struct timespec ts;
+    char log[BUFFER_SIZE];
+  };
+
+  /// Single-producer, single-consumer ring buffer of records.  The owning
+  /// thread is the only writer of _tail, and the writer thread the only
+  /// writer of _head, so neither side needs to take a lock.
+  struct Ring
+  {
+    Ring(size_t size) : records(size), head(0), tail(0) {}
+
+    std::vector<Record> records;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+  };
+
+  /// Writes a single log, with its RFC3339 timestamp, to syslog.
+  static void write_to_syslog(const char* timestamp, const char* log);
+
+  static void format_timestamp(const struct timespec& ts, char* timestamp);
+
+  /// Returns the ring buffer for the calling thread, creating it if this is
+  /// the thread's first log.
+  Ring* get_ring();
+
+  static void* writer_thread(void* p);
+  void writer();
+
+  /// Moves all queued records into batch.  Returns false if there were none.
+  bool drain(std::vector<Record*>& batch, std::vector<std::pair<Ring*, size_t>>& drained);
+
+  /// Returns whether all ring buffers are empty.  Must be called with _lock
+  /// held.
+  bool rings_empty() const;
+
+  size_t _queue_size;
+  WriteFn _write_fn;
+
+  /// Unique identifier for this logger, so that a thread's cached ring
+  /// buffer is never used by a later logger at the same address.
+  uint64_t _id;
+
+  /// All ring buffers, protected by _lock.  Rings live as long as the logger,
+  /// which is fine since the threads that log are long-lived.  _cond is
+  /// signalled when a ring buffer goes from empty to non-empty, and when the
+  /// logger is stopped.
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  std::vector<std::unique_ptr<Ring>> _rings;
+  bool _terminated;
+  pthread_t _writer;
+
+  std::atomic<uint64_t> _dropped;
+  SNMP::CounterTable* _dropped_tbl;
+
+  /// The calling thread's ring buffers, indexed by the identifier of the
+  /// logger that owns them.
+  static thread_local std::unordered_map<uint64_t, Ring*> _thread_rings;
 };
 
 #endif
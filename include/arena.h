@@ -0,0 +1,132 @@
+/**
+ * @file arena.h  Bump allocator for objects that share a lifetime.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+extern "C" {
+#include <pjsip.h>
+}
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/// An Arena hands out memory from a PJSIP pool, and frees it all at once
+/// when the Arena is destroyed.  Freeing an individual allocation does
+/// nothing, so an Arena suits objects (such as the state of a single SIP
+/// transaction) that are all freed at about the same time, and avoids the
+/// cost of the global heap for each of them.
+///
+/// An Arena is not thread-safe - it must be protected by the same lock as
+/// the objects allocated from it.
+class Arena
+{
+public:
+  /// Constructor.
+  ///
+  /// @param endpt      - The endpoint to create the PJSIP pool from.
+  /// @param name       - The name of the pool, for diagnostics.
+  /// @param block_size - The size of each block of memory allocated.
+  Arena(pjsip_endpoint* endpt,
+        const char* name,
+        size_t block_size = DEFAULT_BLOCK_SIZE);
+
+  /// Destructor.  Frees all the memory allocated from the Arena.
+  virtual ~Arena();
+
+  static const size_t DEFAULT_BLOCK_SIZE = 4096;
+
+  /// Allocates memory with the specified alignment.  Throws std::bad_alloc
+  /// if the memory can't be allocated.
+  void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+  /// The number of bytes allocated from the Arena.
+  size_t bytes_allocated() const { return _bytes_allocated; }
+
+private:
+  pjsip_endpoint* _endpt;
+  pj_pool_t* _pool;
+  size_t _bytes_allocated;
+};
+
+/// Standard library allocator that allocates from an Arena, so that
+/// containers can be allocated from it.  Memory is only freed when the Arena
+/// is destroyed, so the Arena must outlive any container using it.
+template<class T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template<class U>
+  struct rebind
+  {
+    typedef ArenaAllocator<U> other;
+  };
+
+  ArenaAllocator(Arena* arena) : _arena(arena) {}
+
+  template<class U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other._arena) {}
+
+  T* allocate(size_t n, const void* hint = 0)
+  {
+    return (T*)_arena->allocate(n * sizeof(T), alignof(T));
+  }
+
+  void deallocate(T* p, size_t n)
+  {
+    // Memory is freed when the Arena is destroyed.
+  }
+
+  template<class U, class... Args>
+  void construct(U* p, Args&&... args)
+  {
+    ::new((void*)p) U(std::forward<Args>(args)...);
+  }
+
+  template<class U>
+  void destroy(U* p)
+  {
+    p->~U();
+  }
+
+  size_t max_size() const
+  {
+    return ((size_t)-1) / sizeof(T);
+  }
+
+  template<class U>
+  bool operator==(const ArenaAllocator<U>& other) const
+  {
+    return (_arena == other._arena);
+  }
+
+  template<class U>
+  bool operator!=(const ArenaAllocator<U>& other) const
+  {
+    return (_arena != other._arena);
+  }
+
+private:
+  template<class U> friend class ArenaAllocator;
+
+  Arena* _arena;
+};
+
+#endif
@@ -166,7 +166,6 @@ private:
   std::vector<Ifc> _fallback_ifcs;
   IFCConfiguration _ifc_configuration;
   bool _using_standard_ifcs;
-  rapidxml::xml_document<>* _root;
 
   // The S-CSCF URI for which this AsChain was created
   const std::string _scscf_uri;
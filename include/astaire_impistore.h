@@ -23,8 +23,11 @@
 /// simple KV store API with atomic write and record expiry semantics.  The
 /// underlying store can be any implementation that implements the Store API.
 ///
-/// We read and write a JSON object representing the full IMPI, including its
-/// authentication challenges, keyed solely off its private ID.
+/// We read and write a record representing the full IMPI, including its
+/// authentication challenges, keyed solely off its private ID.  The record is
+/// either a JSON object or, if the store is configured to write it, a compact
+/// versioned binary encoding.  Both encodings can always be read, so that the
+/// binary encoding can be turned on once every node has been upgraded.
 class AstaireImpiStore : public ImpiStore
 {
 public:
@@ -48,6 +51,9 @@ public:
     /// Serialization to JSON.
     std::string to_json();
 
+    /// Serialization to the compact binary encoding.
+    std::string to_binary();
+
     /// Memcached CAS value.
     uint64_t _cas;
 
@@ -57,7 +63,9 @@ public:
 
   /// Constructor.
   /// @param data_store    A pointer to the underlying data store.
-  AstaireImpiStore(Store* data_store);
+  /// @param binary        Whether to write IMPIs in the compact binary
+  ///                      encoding rather than as JSON.
+  AstaireImpiStore(Store* data_store, bool binary = false);
 
   /// Destructor.
   virtual ~AstaireImpiStore();
@@ -94,12 +102,28 @@ public:
   /// Deserialization from JSON.
   static AstaireImpiStore::Impi* from_json(const std::string& impi, rapidjson::Value* json);
 
+  /// Deserialization from the compact binary encoding.
+  static AstaireImpiStore::Impi* from_binary(const std::string& impi, const std::string& data);
+
+  /// Whether stored data is in the compact binary encoding rather than JSON.
+  static bool is_binary(const std::string& data);
+
+  /// The format of the data this store writes, so that the underlying store
+  /// logs it correctly.
+  Store::Format store_format() const
+  {
+    return _binary ? Store::Format::BINARY : Store::Format::JSON;
+  }
+
 private:
   /// Identifier for IMPI table.
   static const std::string TABLE_IMPI;
 
   /// The underlying data store.
   Store* _data_store;
+
+  /// Whether to write IMPIs in the compact binary encoding.
+  bool _binary;
 };
 
 #endif
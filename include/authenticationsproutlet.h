@@ -24,6 +24,7 @@ extern "C" {
 #include "acr.h"
 #include "sproutlet.h"
 #include "impistore.h"
+#include "impi_replicator.h"
 #include "hssconnection.h"
 #include "chronosconnection.h"
 #include "acr.h"
@@ -101,7 +102,8 @@ public:
                           AnalyticsLogger* analytics_logger,
                           SNMP::AuthenticationStatsTables* auth_stats_tbls,
                           bool nonce_count_supported_arg,
-                          int cfg_max_expires);
+                          int cfg_max_expires,
+                          ImpiReplicator* impi_replicator = NULL);
   ~AuthenticationSproutlet();
 
   bool init();
@@ -155,11 +157,11 @@ private:
   ///
   /// @return               - The result of writing the challenge to the local
   ///                         store.
-  Store::Status write_challenge_to_store(ImpiStore* store,
-                                         const std::string& impi,
-                                         ImpiStore::AuthChallenge* auth_challenge,
-                                         ImpiStore::Impi* impi_obj,
-                                         SAS::TrailId trail);
+  static Store::Status write_challenge_to_store(ImpiStore* store,
+                                                const std::string& impi,
+                                                ImpiStore::AuthChallenge* auth_challenge,
+                                                ImpiStore::Impi* impi_obj,
+                                                SAS::TrailId trail);
 
   friend class AuthenticationSproutletTsx;
 
@@ -179,6 +181,10 @@ private:
   ImpiStore* _impi_store;
   std::vector<ImpiStore*> _remote_impi_stores;
 
+  // Optional replicator used to access the remote IMPI stores concurrently.
+  // If this is NULL, the remote stores are accessed one at a time.
+  ImpiReplicator* _impi_replicator;
+
   // Analytics logger.
   AnalyticsLogger* _analytics;
 
@@ -220,11 +226,30 @@ public:
 protected:
   friend class AuthenticationSproutlet;
 
+  /// Gets an AV for the request and challenges it with rsp.  If the AV comes
+  /// from the HSS this completes asynchronously, so the response is always
+  /// sent (and req, rsp and acr freed) by this function or its continuation.
   void create_challenge(pjsip_digest_credential* credentials,
                         pj_bool_t stale,
                         std::string resync,
                         pjsip_msg* req,
-                        pjsip_msg* rsp);
+                        pjsip_msg* rsp,
+                        ACR* acr);
+
+  /// Adds the challenge for an AV to rsp and stores it in the IMPI store, or
+  /// sets a suitable error code on rsp if there is no AV.  Takes ownership of
+  /// av and impi_obj.
+  void add_challenge(AuthenticationVector* av,
+                     bool av_source_unavailable,
+                     pj_bool_t stale,
+                     const std::string& impi,
+                     const std::string& impu_for_hss,
+                     ImpiStore::Impi* impi_obj,
+                     pjsip_msg* req,
+                     pjsip_msg* rsp);
+
+  /// Sends a final response to the request, with its ACR.
+  void send_final_response(pjsip_msg* req, pjsip_msg* rsp, ACR* acr);
   int calculate_challenge_expiration_time(pjsip_msg* req);
   AuthenticationVector* verify_auth_vector(rapidjson::Document* av,
                                            const std::string& impi);
@@ -251,6 +276,10 @@ protected:
   // HSS. This field should not be changed once it has been set by the
   // on_rx_intial_request() call.
   std::string _scscf_uri;
+
+  // The result of the HSS query for an AV, filled in asynchronously.
+  HTTPCode _hss_rc;
+  rapidjson::Document* _hss_av_doc;
 };
 
 #endif
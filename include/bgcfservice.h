@@ -16,6 +16,7 @@
 #define BGCFSERVICE_H__
 
 #include <map>
+#include <memory>
 #include <string>
 #include <boost/regex.hpp>
 #include <boost/thread.hpp>
@@ -23,6 +24,7 @@
 #include <functional>
 #include "updater.h"
 #include "sas.h"
+#include "prefix_trie.h"
 
 class BgcfService
 {
@@ -39,14 +41,19 @@ public:
                                                  SAS::TrailId trail) const;
 
 private:
-  std::map<std::string, std::vector<std::string>> _domain_routes;
-  std::map<std::string, std::vector<std::string>> _number_routes;
+  struct Routes
+  {
+    std::map<std::string, std::vector<std::string>> domain_routes;
+    PrefixTrie<std::vector<std::string>> number_routes;
+  };
+
+  // The routes.  Each time the configuration is reloaded a new set of routes
+  // is built and swapped in atomically, so lookups just take a reference to
+  // the current routes rather than a lock.  This must only be accessed using
+  // std::atomic_load and std::atomic_store.
+  std::shared_ptr<const Routes> _routes;
   std::string _configuration;
   Updater<void, BgcfService>* _updater;
-
-  // Mark as mutable to flag that this can be modified without affecting the
-  // external behaviour of the class, allowing for locking in 'const' methods.
-  mutable boost::shared_mutex _routes_rw_lock;
 };
 
 #endif
@@ -0,0 +1,103 @@
+/**
+ * @file binding_target_cache.h  Process-wide cache of parsed bindings.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef BINDING_TARGET_CACHE_H_
+#define BINDING_TARGET_CACHE_H_
+
+extern "C" {
+#include <pjsip.h>
+}
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aor.h"
+#include "sharded_lru_cache.h"
+
+/// The contact URI and Path headers of a binding, parsed into pjsip
+/// structures.
+struct ParsedBinding
+{
+  ParsedBinding() : uri(NULL), paths(), bad_path() {}
+
+  /// Parses the binding's contact URI and Path headers, allocating from the
+  /// pool.
+  void parse(const Binding& binding, pj_pool_t* pool);
+
+  /// Copies the parsed structures, allocating from the pool.
+  void clone(pj_pool_t* pool, ParsedBinding& copy) const;
+
+  /// The contact URI, or NULL if it is badly formed.
+  pjsip_uri* uri;
+
+  /// The Path headers, as routes to the contact.
+  std::vector<pjsip_route_hdr*> paths;
+
+  /// The first badly formed Path header, if there is one.  Any Path headers
+  /// after it aren't parsed.
+  std::string bad_path;
+};
+
+/// Every terminating request routed to a subscriber turns the subscriber's
+/// bindings into targets, which means parsing the contact URI and Path headers
+/// stored for every binding, even though they only change when the subscriber
+/// registers.
+///
+/// BindingTargetCache is a bounded, thread-safe cache of parsed bindings,
+/// keyed on the stored contact URI and Path headers.  The registrar primes it
+/// when a binding is registered, so routing a request only has to copy the
+/// parsed structures into the request's pool.  It is a ShardedLruCache, so
+/// worker threads routing to different bindings don't contend.
+class BindingTargetCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param pool_factory      - The factory for the pools that cached
+  ///                            bindings are parsed into.
+  /// @param capacity          - The maximum number of bindings to cache.
+  /// @param num_shards        - The number of independently locked shards.
+  BindingTargetCache(pj_pool_factory* pool_factory,
+                     size_t capacity,
+                     int num_shards = DEFAULT_NUM_SHARDS);
+  virtual ~BindingTargetCache();
+
+  static const int DEFAULT_NUM_SHARDS = 16;
+
+  /// Returns the parsed form of the binding, parsing it if it isn't cached.
+  std::shared_ptr<const ParsedBinding> get(const Binding& binding);
+
+  /// Sets the process-wide cache used by lookup.  The caller retains
+  /// ownership.
+  static void set_instance(BindingTargetCache* cache) { _instance = cache; }
+
+  /// Returns the parsed form of the binding from the process-wide cache, or
+  /// NULL if there isn't one.
+  static std::shared_ptr<const ParsedBinding> lookup(const Binding& binding);
+
+  uint64_t hits() const { return _cache.hits(); }
+  uint64_t misses() const { return _cache.misses(); }
+  size_t size() { return _cache.size(); }
+
+private:
+  /// A cached parsed binding, which owns the pool it was parsed into.
+  class Entry;
+
+  static std::string key(const Binding& binding);
+
+  static BindingTargetCache* _instance;
+
+  pj_pool_factory* _pool_factory;
+  ShardedLruCache<std::string, std::shared_ptr<const Entry>> _cache;
+};
+
+#endif
@@ -84,6 +84,7 @@ struct options
   std::vector<std::string>             dns_servers;
   std::vector<std::string>             enum_servers;
   std::string                          enum_suffix;
+  int                                  enum_cache_size;
   std::string                          enum_file;
   bool                                 default_tel_uri_translation;
   bool                                 analytics_enabled;
@@ -93,6 +94,7 @@ struct options
   std::string                          http_address;
   int                                  http_port;
   int                                  http_threads;
+  int                                  pjsip_threads;
   std::string                          billing_cdf;
   bool                                 emerg_reg_accepted;
   int                                  worker_threads;
@@ -118,6 +120,7 @@ struct options
   int                                  session_terminated_timeout_ms;
   std::set<std::string>                stateless_proxies;
   int                                  max_sproutlet_depth;
+  bool                                 in_dialog_fast_path;
   std::string                          pbxes;
   std::string                          pbx_service_route;
   uint32_t                             non_register_auth_mode;
@@ -139,7 +142,16 @@ struct options
   std::string                          dummy_app_server;
   bool                                 http_acr_logging;
   int                                  homestead_timeout;
+  int                                  hss_cache_size;
+  int                                  hss_cache_ttl;
+  int                                  hss_threads;
+  int                                  icscf_cache_ttl;
+  int                                  analytics_queue_size;
+  int                                  remote_impi_threads;
+  bool                                 impi_binary_encoding;
   int                                  request_on_queue_timeout;
+  int                                  event_queue_shards;
+  bool                                 options_on_transport_thread;
   std::set<std::string>                blacklisted_scscfs;
   bool                                 enable_orig_sip_to_tel_coerce;
   bool                                 ram_record_everything;
@@ -19,6 +19,15 @@
 typedef std::map<std::string, std::string> FeatureSet;
 typedef std::pair<const std::string, std::string> Feature;
 
+// A feature predicate from an Accept-Contact or Reject-Contact header,
+// converted to strings once per request rather than once per binding.
+struct FeaturePredicate
+{
+  std::vector<Feature> features;
+  bool explicit_match;
+  bool required_match;
+};
+
 // Exception thrown if a feature rule doesn't parse
 class FeatureParseError {};
 
@@ -52,6 +61,12 @@ MatchResult match_feature_sets(const FeatureSet& contact_filter_set,
                                pjsip_accept_contact_hdr* accept);
 MatchResult match_feature_sets(const FeatureSet& contact_filter_set,
                                pjsip_reject_contact_hdr* reject);
+MatchResult match_accept_predicate(const FeatureSet& contact_filter_set,
+                                   const FeaturePredicate& accept);
+MatchResult match_reject_predicate(const FeatureSet& contact_filter_set,
+                                   const FeaturePredicate& reject);
+FeaturePredicate to_feature_predicate(pjsip_accept_contact_hdr* accept);
+FeaturePredicate to_feature_predicate(pjsip_reject_contact_hdr* reject);
 MatchResult match_feature(Feature matcher,
                           Feature matchee);
 MatchResult match_numeric(const std::string& matcher,
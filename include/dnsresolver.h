@@ -35,9 +35,13 @@ public:
   // Helper function wrapping the destructor for use as thread-local callbacks.
   static void destroy(DNSResolver* resolver);
   // Perform a NAPTR query for the specified domain, returning the results in
-  // the naptr_reply structure, and logging to the trail.  The caller must
-  // call free_naptr_reply when it has finished with naptr_reply.
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  // the naptr_reply structure, and logging to the trail.  On success, ttl is
+  // set to the lowest TTL of the NAPTR records.  The caller must call
+  // free_naptr_reply when it has finished with naptr_reply.
+  virtual int perform_naptr_query(const std::string& domain,
+                                  struct ares_naptr_reply*& naptr_reply,
+                                  int& ttl,
+                                  SAS::TrailId trail);
   // Free a naptr_reply structure.
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
 
@@ -57,6 +61,9 @@ private:
                      int timeouts,
                      unsigned char* abuf,
                      int alen);
+  // Find the lowest TTL of the NAPTR records in the answer section of a DNS
+  // response.
+  static int parse_naptr_ttl(const unsigned char* abuf, int alen);
 
   // The ares data structure that controls actually making the query.
   ares_channel _channel;
@@ -74,6 +81,10 @@ private:
   // The reply data structure.  Only valid between ares_callback and
   // perform_naptr_query returning, and only if _status is ARES_SUCCESS.
   struct ares_naptr_reply* _naptr_reply;
+  // The lowest TTL of the records in the reply.  Only valid between
+  // ares_callback and perform_naptr_query returning, and only if _status is
+  // ARES_SUCCESS.
+  int _ttl;
   // Pointer to a linked list of servers
   struct ares_addr_node _ares_addrs[3];
 
@@ -16,7 +16,10 @@
 #define ENUMSERVICE_H__
 
 #include <list>
+#include <map>
+#include <memory>
 #include <string>
+#include <pthread.h>
 #include <boost/regex.hpp>
 #include <boost/thread.hpp>
 #include <netinet/in.h>
@@ -26,6 +29,9 @@
 #include "dnsresolver.h"
 #include "communicationmonitor.h"
 #include "updater.h"
+#include "prefix_trie.h"
+#include "sharded_lru_cache.h"
+#include "singleflight.h"
 
 /// @class EnumService
 ///
@@ -95,21 +101,29 @@ private:
     std::string replace;
   };
 
-  std::vector<NumberPrefix> _number_prefixes;
-  std::map<std::string, NumberPrefix> _prefix_regex_map;
+  typedef PrefixTrie<NumberPrefix> NumberPrefixTrie;
+
+  // The number prefixes.  Each time the configuration is reloaded a new trie
+  // is built and swapped in atomically, so lookups just take a reference to
+  // the current trie rather than a lock.  This must only be accessed using
+  // std::atomic_load and std::atomic_store.
+  std::shared_ptr<const NumberPrefixTrie> _number_prefixes;
   std::string _configuration;
   Updater<void, JSONEnumService>* _updater;
 
-  // Mark as mutable to flag that this can be modified without affecting the
-  // external behaviour of the class, allowing for locking in 'const' methods.
-  mutable boost::shared_mutex _number_prefixes_rw_lock;
-
-  const NumberPrefix* prefix_match(const std::string& number) const;
+  static const NumberPrefix* prefix_match(const NumberPrefixTrie& number_prefixes,
+                                          const std::string& number);
 };
 
 /// @class DNSEnumService
 ///
 /// Provides an ENUM service based on DNS queries from an ENUM server.
+///
+/// If max_cache_entries is non-zero, the parsed rules for each ENUM domain are
+/// cached for the TTL of the NAPTR records (and NXDOMAIN responses are cached
+/// for NEGATIVE_CACHE_TTL), evicting the least recently used domain when the
+/// cache is full, and concurrent lookups of the same domain share a single DNS
+/// query.
 class DNSEnumService : public EnumService
 {
 public:
@@ -117,7 +131,8 @@ public:
                  const std::string& dns_suffix = ".e164.arpa",
                  const DNSResolverFactory* resolver_factory =
                                                        new DNSResolverFactory(),
-                 CommunicationMonitor* comm_monitor = NULL);
+                 CommunicationMonitor* comm_monitor = NULL,
+                 int max_cache_entries = 0);
   ~DNSEnumService();
 
   std::string lookup_uri_from_user(const std::string& user, SAS::TrailId trail) const;
@@ -160,9 +175,38 @@ private:
 
   };
 
+  // The result of a DNS query for an ENUM domain.  An expiry_ms of 0 means
+  // the result isn't cached.
+  struct CachedRules
+  {
+    CachedRules() : status(ARES_SUCCESS), rules(), expiry_ms(0) {}
+
+    int status;
+    std::shared_ptr<const std::vector<Rule>> rules;
+    unsigned long expiry_ms;
+  };
+
   // Maximum number of DNS queries per request.
   static const int MAX_DNS_QUERIES = 5;
 
+  // Time (in seconds) for which a domain that doesn't exist is cached.
+  static const int NEGATIVE_CACHE_TTL = 60;
+
+  // Number of independently locked shards in the cache.
+  static const int NUM_CACHE_SHARDS = 16;
+
+  // Gets the rules for the specified domain, from the cache if possible.
+  // Returns the status of the DNS query.
+  int get_rules(const std::string& domain,
+                std::shared_ptr<const std::vector<Rule>>& rules,
+                SAS::TrailId trail) const;
+  // Queries the DNS server for the rules for the specified domain.
+  int query_rules(const std::string& domain,
+                  std::shared_ptr<const std::vector<Rule>>& rules,
+                  int& ttl,
+                  SAS::TrailId trail) const;
+  static unsigned long now_ms();
+
   // Converts a key to an ENUM domain name.
   std::string key_to_domain(const std::string& key) const;
   // Gets a resolver (from thread-local data).
@@ -183,6 +227,13 @@ private:
   // Helper used to track enum communication state, and issue/clear alarms
   // based upon recent activity.
   CommunicationMonitor* _comm_monitor;
+
+  // The cache of rules by ENUM domain, and the DNS queries in progress.
+  // Threads that look up a domain that is already being queried wait for
+  // that query alone.
+  const size_t _max_cache_entries;
+  mutable ShardedLruCache<std::string, CachedRules> _cache;
+  mutable Singleflight<CachedRules> _inflight;
 };
 
 #endif
@@ -33,12 +33,13 @@ public:
   /// Updates the fallback iFCs.
   void update_fifcs();
 
-  /// Get the fallback iFCs
-  std::vector<Ifc> get_fallback_ifcs(rapidxml::xml_document<>* ifc_doc) const;
+  /// Get the fallback iFCs.  These are compiled when the configuration is
+  /// loaded.
+  std::vector<Ifc> get_fallback_ifcs() const;
 
 private:
   Alarm* _alarm;
-  std::vector<std::string> _fallback_ifcs;
+  std::vector<Ifc> _fallback_ifcs;
   std::string _configuration;
   Updater<void, FIFCService>* _updater;
 
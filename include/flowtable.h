@@ -24,6 +24,7 @@ extern "C" {
 #include <map>
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <atomic>
 
 #include "snmp_scalar.h"
@@ -83,7 +84,7 @@ private:
   void restart_timer(int id, int timeout);
   void expiry_timer();
 
-  void inc_ref();
+  bool try_inc_ref();
 
   FlowTable* _flow_table;
   pjsip_transport* _transport;
@@ -118,12 +119,13 @@ private:
   /// The default identity for this flow.
   std::string _default_id;
 
-  /// Counts the references to this Flow.  This can only be updated or tested
-  /// by a thread which currently holds the FlowTable::_flow_map_lock.
-  int _refs;
+  /// Counts the references to this Flow.  Once this has fallen to zero the
+  /// flow is being removed from the FlowTable, so a thread which finds it in
+  /// one of the FlowTable's maps must not take a new reference - see
+  /// try_inc_ref.
+  std::atomic_int _refs;
 
-  // Counts the number of active dialogs on this flow. This can be
-  // updated or tested without FlowTable::_flow_map_lock being held.
+  // Counts the number of active dialogs on this flow.
   std::atomic_long _dialogs;
 
   /// Timer identifiers - the timer either runs as an expiry timer (when there
@@ -140,12 +142,20 @@ private:
 };
 
 
+/// The flow table is split into shards, each with its own lock and hash
+/// table, so that threads handling messages on different flows don't contend
+/// with each other.  Flows are found in one shard by transport type and
+/// remote address, and in another by flow token.
 class FlowTable : public QuiesceFlowsInterface
 {
 public:
-  FlowTable(QuiescingManager* qm, SNMP::U32Scalar* connection_count);
+  FlowTable(QuiescingManager* qm,
+            SNMP::U32Scalar* connection_count,
+            int num_shards = DEFAULT_NUM_SHARDS);
   virtual ~FlowTable();
 
+  static const int DEFAULT_NUM_SHARDS = 64;
+
   /// Create a flow corresponding to the specified received message.
   /// This may be called with parameters that match an existing flow, in
   /// which case it will return the existing flow.
@@ -162,6 +172,9 @@ public:
   /// Removes a flow from the flow table.
   void remove_flow(Flow* flow);
 
+  /// Returns the number of flows in the flow table.
+  size_t flow_count() const { return _flow_count.load(); }
+
   // Functions for quiescing a Bono.
   void check_quiescing_state();
   void quiesce();
@@ -186,33 +199,48 @@ private:
     {
     }
 
-    /// Override operator< so this can be used as a map key.
-    bool operator< (const FlowKey& other) const
+    /// Override operator== so this can be used as a hash table key.
+    bool operator== (const FlowKey& other) const
     {
-      // Compare the transport type first.
-      if (_type < other._type)
-      {
-        return true;
-      }
-      else if (_type > other._type)
-      {
-        return false;
-      }
-      else
-      {
-        // The transport is the same, so check the remote addresses.
-        return (pj_sockaddr_cmp(&_raddr, &other._raddr) < 0);
-      }
+      return ((_type == other._type) &&
+              (pj_sockaddr_cmp(&_raddr, &other._raddr) == 0));
     }
 
+    /// Hashes the transport type, address family, address and port - the
+    /// fields compared by operator==.
+    struct Hash
+    {
+      size_t operator() (const FlowKey& key) const;
+    };
+
   private:
     int _type;
     pj_sockaddr _raddr;
   };
 
-  pthread_mutex_t _flow_map_lock;
-  std::map<FlowKey, Flow*> _tp2flow_map;        // map from transport addresses to flow
-  std::map<std::string, Flow*> _tk2flow_map;    // map from token to flow
+  /// A shard of the flow table, mapping keys of type K to flows.
+  template<class K, class H = std::hash<K>>
+  struct Shard
+  {
+    Shard() { pthread_mutex_init(&lock, NULL); }
+    ~Shard() { pthread_mutex_destroy(&lock); }
+
+    pthread_mutex_t lock;
+    std::unordered_map<K, Flow*, H> flows;
+  };
+
+  typedef Shard<FlowKey, FlowKey::Hash> AddressShard;
+  typedef Shard<std::string> TokenShard;
+
+  AddressShard* address_shard(const FlowKey& key) const;
+  TokenShard* token_shard(const std::string& token) const;
+
+  // A flow is in one address shard (from transport addresses to flow) and one
+  // token shard (from token to flow).  If both locks are needed, the address
+  // shard's lock must be taken first.
+  std::vector<AddressShard*> _address_shards;
+  std::vector<TokenShard*> _token_shards;
+  std::atomic<size_t> _flow_count;
 
   // Statistics
   void report_flow_count();
@@ -13,6 +13,8 @@
 #define HSSCONNECTION_H__
 
 #include <curl/curl.h>
+#include <functional>
+#include <atomic>
 #include "rapidjson/document.h"
 
 #include "httpconnection.h"
@@ -23,6 +25,11 @@
 #include "load_monitor.h"
 #include "associated_uris.h"
 #include "sifcservice.h"
+#include "threadpool.h"
+#include "exception_handler.h"
+#include "singleflight.h"
+
+namespace PJUtils { class Callback; }
 
 /// @class HSSConnection
 ///
@@ -32,6 +39,10 @@
 class HSSConnection
 {
 public:
+  /// The maximum number of asynchronous queries that can be waiting for (or
+  /// running on) the HSS threads.  Any more fail immediately.
+  static const uint64_t MAX_PENDING_REQUESTS = 1000;
+
   struct irs_query
   {
     std::string _public_id;
@@ -85,7 +96,11 @@ public:
                 SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                 CommunicationMonitor* comm_monitor,
                 SIFCService* sifc_service,
-                long homestead_timeout_ms);
+                long homestead_timeout_ms,
+                int async_threads = 0,
+                ExceptionHandler* exception_handler = NULL,
+                SNMP::CounterTable* issued_tbl = NULL,
+                SNMP::CounterTable* coalesced_tbl = NULL);
   virtual ~HSSConnection();
 
   HTTPCode get_auth_vector(const std::string& private_user_id,
@@ -117,6 +132,54 @@ public:
                                          SAS::TrailId trail);
   rapidxml::xml_document<>* parse_xml(std::string raw, const std::string& url);
 
+  /// Asynchronous versions of the queries above, for use by Sproutlets that
+  /// shouldn't block a worker thread for the length of an HSS round trip.
+  ///
+  /// The query is made on one of the HSS threads and, once it has completed
+  /// and the result (and rc) have been filled in, on_complete is run on a
+  /// worker thread.  The results must therefore remain valid until then.  If
+  /// there are no HSS threads the query is made (and on_complete run) before
+  /// the call returns.  If there are already MAX_PENDING_REQUESTS queries
+  /// pending, the query isn't made and on_complete is run straight away, with
+  /// rc left as HTTP_SERVER_UNAVAILABLE.
+  void get_auth_vector_async(const std::string& private_user_id,
+                             const std::string& public_user_id,
+                             const std::string& auth_type,
+                             const std::string& resync_auth,
+                             const std::string& server_name,
+                             HTTPCode& rc,
+                             rapidjson::Document*& object,
+                             SAS::TrailId trail,
+                             PJUtils::Callback* on_complete);
+  void get_user_auth_status_async(const std::string& private_user_identity,
+                                  const std::string& public_user_identity,
+                                  const std::string& visited_network,
+                                  const std::string& auth_type,
+                                  const bool& emergency,
+                                  HTTPCode& rc,
+                                  rapidjson::Document*& object,
+                                  SAS::TrailId trail,
+                                  PJUtils::Callback* on_complete);
+  void get_location_data_async(const std::string& public_user_identity,
+                               const bool& originating,
+                               const std::string& auth_type,
+                               HTTPCode& rc,
+                               rapidjson::Document*& object,
+                               SAS::TrailId trail,
+                               PJUtils::Callback* on_complete);
+
+  /// Runs request on one of the HSS threads, then runs on_complete on a
+  /// worker thread.  Used to build the asynchronous queries above.  If there
+  /// are too many queries pending, request isn't run at all.
+  virtual void run_async(std::function<void()> request,
+                         PJUtils::Callback* on_complete);
+
+  /// Concurrent identical requests to Homestead are coalesced, so that only
+  /// one of them is sent and the rest share its response.  These count the
+  /// requests that were sent and those that shared another's response.
+  uint64_t issued_requests() const { return _inflight.issued(); }
+  uint64_t coalesced_requests() const { return _inflight.coalesced(); }
+
   static const std::string REG;
   static const std::string CALL;
   static const std::string DEREG_USER;
@@ -126,6 +189,40 @@ public:
   static const std::string AUTH_FAIL;
 
 private:
+  /// A query to run on the HSS threads.
+  struct AsyncRequest
+  {
+    std::function<void()> request;
+    PJUtils::Callback* on_complete;
+    std::atomic<uint64_t>* pending;
+  };
+
+  static void exception_callback(AsyncRequest* work);
+
+  /// A response from Homestead, shared between the requests that were
+  /// coalesced into it.  Only one of xml and json is used.
+  struct HomesteadResponse
+  {
+    HTTPCode rc;
+    std::shared_ptr<rapidxml::xml_document<>> xml;
+    std::shared_ptr<rapidjson::Document> json;
+  };
+
+  /// @class Pool
+  /// The thread pool used for asynchronous queries.
+  class Pool : public ThreadPool<AsyncRequest*>
+  {
+  public:
+    Pool(ExceptionHandler* exception_handler,
+         void (*callback)(AsyncRequest*),
+         unsigned int num_threads);
+    virtual ~Pool();
+
+  private:
+    /// Called by HSS threads when they pull work off the queue.
+    virtual void process_work(AsyncRequest*&);
+  };
+
   virtual long get_json_object(const std::string& path,
                                rapidjson::Document*& object,
                                SAS::TrailId trail);
@@ -144,6 +241,14 @@ private:
                              std::shared_ptr<rapidxml::xml_document<>>& root,
                              SAS::TrailId trail);
 
+  /// Runs a request to Homestead, sharing the response with any identical
+  /// request made at the same time.
+  void run_shared(const std::string& key,
+                  const std::string& path,
+                  HomesteadResponse& response,
+                  const std::function<void(HomesteadResponse&)>& request,
+                  SAS::TrailId trail);
+
   HttpClient* _client;
   HttpConnection* _http;
   SNMP::EventAccumulatorTable* _latency_tbl;
@@ -152,6 +257,9 @@ private:
   SNMP::EventAccumulatorTable* _uar_latency_tbl;
   SNMP::EventAccumulatorTable* _lir_latency_tbl;
   SIFCService* _sifc_service;
+  Pool* _thread_pool;
+  std::atomic<uint64_t> _pending_requests;
+  Singleflight<HomesteadResponse> _inflight;
 };
 
 #endif
@@ -15,6 +15,7 @@
 #include "hssconnection.h"
 #include "scscfselector.h"
 #include "servercaps.h"
+#include "scscf_assignment_cache.h"
 #include "acr.h"
 
 #include "rapidjson/document.h"
@@ -28,7 +29,8 @@ public:
               SAS::TrailId trail,
               ACR* acr,
               int port,
-              std::set<std::string> blacklisted_scscfs = std::set<std::string>());
+              std::set<std::string> blacklisted_scscfs = std::set<std::string>(),
+              SCSCFAssignmentCache* cache = NULL);
   virtual ~ICSCFRouter();
 
   int get_scscf(pj_pool_t* pool,
@@ -36,11 +38,39 @@ public:
                 std::string& wildcard,
                 bool do_billing=false);
 
+  /// Starts the first HSS query that get_scscf will need without blocking
+  /// the calling thread.  on_complete is run once the result is available,
+  /// and get_scscf then uses it rather than querying the HSS again.
+  void prefetch(PJUtils::Callback* on_complete);
+
+  /// Removes any cached S-CSCF assignment for this request, e.g. because the
+  /// S-CSCF has failed.
+  void invalidate_cache();
+
 protected:
   /// Do the HSS query.  This must be implemented by the request-type specific
   /// routers.
   virtual int hss_query() = 0;
 
+  /// Start the HSS query that hss_query would make, asynchronously.  This
+  /// must be implemented by the request-type specific routers.
+  virtual void start_hss_query(HTTPCode& rc,
+                               rapidjson::Document*& rsp,
+                               PJUtils::Callback* on_complete) = 0;
+
+  /// Makes the HSS query, or collects the result of one started by prefetch.
+  void get_hss_result(HTTPCode& rc,
+                      rapidjson::Document*& rsp,
+                      const std::function<HTTPCode(rapidjson::Document*&)>& query);
+
+  /// Returns the key identifying the HSS query in the S-CSCF assignment
+  /// cache.  This must be implemented by the request-type specific routers.
+  virtual std::string cache_key() const = 0;
+
+  /// Fills in the HSS response from the S-CSCF assignment cache, if this is
+  /// the first query and its result is cached.
+  bool get_cached_response();
+
   /// Parses the HSS response.
   int parse_hss_response(rapidjson::Document*& rsp, bool queried_caps);
 
@@ -76,6 +106,16 @@ protected:
 
   /// The list of blacklisted S_CSCFs.
   std::set<std::string> _blacklisted_scscfs;
+
+  /// The result of the query started by prefetch, if it hasn't been used yet.
+  bool _prefetched;
+  HTTPCode _prefetch_rc;
+  rapidjson::Document* _prefetch_rsp;
+
+  /// Optional cache of the results of HSS queries, and whether the HSS
+  /// response has been filled in from it but not yet used.
+  SCSCFAssignmentCache* _cache;
+  bool _cached;
 };
 
 
@@ -93,13 +133,18 @@ public:
                 const std::string& visited_network,
                 const std::string& auth_type,
                 const bool& emergency,
-                std::set<std::string> blacklisted_scscfs = std::set<std::string>());
+                std::set<std::string> blacklisted_scscfs = std::set<std::string>(),
+                SCSCFAssignmentCache* cache = NULL);
   ~ICSCFUARouter();
 
 private:
 
   /// Perform the HSS UAR query.
   virtual int hss_query();
+  virtual void start_hss_query(HTTPCode& rc,
+                               rapidjson::Document*& rsp,
+                               PJUtils::Callback* on_complete);
+  virtual std::string cache_key() const;
 
   /// The private user identity to use on HSS queries.
   std::string _impi;
@@ -129,7 +174,8 @@ public:
                  int port,
                  const std::string& impu,
                  bool originating,
-                 std::set<std::string> blacklisted_scscfs = std::set<std::string>());
+                 std::set<std::string> blacklisted_scscfs = std::set<std::string>(),
+                 SCSCFAssignmentCache* cache = NULL);
   ~ICSCFLIRouter();
 
   /// Function to change the _impu we're looking up. This is used after
@@ -140,6 +186,10 @@ private:
 
   /// Perform the HSS LIR query.
   virtual int hss_query();
+  virtual void start_hss_query(HTTPCode& rc,
+                               rapidjson::Document*& rsp,
+                               PJUtils::Callback* on_complete);
+  virtual std::string cache_key() const;
 
   /// The public user identity to use on HSS queries.
   std::string _impu;
@@ -54,7 +54,8 @@ public:
                  SNMP::SuccessFailCountByRequestTypeTable* outgoing_sip_transactions_tbl,
                  bool override_npdi,
                  int network_function_port,
-                 std::set<std::string> blacklisted_scscfs = std::set<std::string>());
+                 std::set<std::string> blacklisted_scscfs = std::set<std::string>(),
+                 SCSCFAssignmentCache* assignment_cache = NULL);
 
   virtual ~ICSCFSproutlet();
 
@@ -133,6 +134,9 @@ private:
 
   /// The list of blacklisted S-CSCFs
   std::set<std::string> _blacklisted_scscfs;
+
+  /// Optional cache of the S-CSCFs assigned by the HSS.
+  SCSCFAssignmentCache* _assignment_cache;
 };
 
 
@@ -152,6 +156,13 @@ public:
   virtual void on_rx_cancel(int status_code, pjsip_msg* req) override;
 
 private:
+  /// Selects an S-CSCF for the request, once the router's first HSS query has
+  /// completed, and routes the request to it (or elsewhere).
+  ///
+  /// @param req                  The request to route.
+  /// @param impu                 The public ID the router is querying.
+  void route_request(pjsip_msg* req, std::string impu);
+
   /// Determine whether a status code indicates that the S-CSCF wasn't
   /// found.
   ///
@@ -191,6 +202,10 @@ private:
   /// as defined in TS 32.409.
   pjsip_method_e _req_type;
   bool _session_set_up;
+
+  /// Set if the transaction is cancelled or fails, e.g. while we're waiting
+  /// for the HSS.
+  bool _cancelled;
 };
 
 class ICSCFSproutletRegTsx : public CompositeSproutletTsx
@@ -204,11 +219,19 @@ public:
   virtual void on_tx_request(pjsip_msg* req, int fork_id) override;
   virtual void on_rx_response(pjsip_msg* rsp, int fork_id) override;
   virtual void on_tx_response(pjsip_msg* rsp) override;
+  virtual void on_rx_cancel(int status_code, pjsip_msg* req) override;
 
 private:
+  /// Selects an S-CSCF for the REGISTER, once the router's HSS query has
+  /// completed, and routes the request to it.
+  void route_request(pjsip_msg* req);
+
   ICSCFSproutlet* _icscf;
   ACR* _acr;
   ICSCFRouter* _router;
+
+  /// Set if the transaction fails, e.g. while we're waiting for the HSS.
+  bool _cancelled;
 };
 
 #endif
@@ -69,18 +69,21 @@ struct AsInvocation
 };
 
 /// A single Initial Filter Criterion (iFC).
+//
+// The iFC is compiled when it is constructed - the XML is walked once, any
+// regular expressions are compiled and the AS invocation is built - so that
+// evaluating it against each request doesn't need to touch the XML.  Copies of
+// an Ifc share the compiled form.
 class Ifc
 {
 public:
-  Ifc(rapidxml::xml_node<>* ifc) :
-    _ifc(ifc)
-  {
-  }
+  /// This constructor creates an Ifc from a node in an XML document, which
+  // must outlive the Ifc.
+  Ifc(rapidxml::xml_node<>* ifc);
 
-  /// This constructor creates an Ifc and makes sure that all of its
-  // associated memory is owned by the passed in XML document.
-  Ifc(std::string ifc_str,
-      rapidxml::xml_document<>* ifc_doc);
+  /// This constructor creates an Ifc from its XML string.  The Ifc owns all
+  // of its associated memory, so can be kept independently of any document.
+  Ifc(std::string ifc_str);
 
   bool filter_matches(const SessionCase& session_case,
                       const bool is_registered,
@@ -94,13 +97,28 @@ private:
 
 class ifc_error : public std::exception {};
 
+  // The compiled form of the iFC, and of each of its service point triggers.
+  // These are defined in ifc.cpp.
+  struct Error;
+  struct CompiledSpt;
+  struct CompiledIfc;
+
+  static std::shared_ptr<const CompiledIfc> compile(rapidxml::xml_node<>* ifc,
+                                                    std::shared_ptr<rapidxml::xml_document<> > doc);
+
+  static void compile_spt(rapidxml::xml_node<>* spt,
+                          CompiledSpt& compiled);
+
   static bool spt_matches(const SessionCase& session_case,
                           const bool is_registered,
                           const bool is_initial_registration,
                           pjsip_msg *msg,
-                          rapidxml::xml_node<>* spt,
-                          std::string ifc_str,
-                          std::string server_name,
+                          const CompiledSpt& spt,
+                          const std::string& server_name,
+                          SAS::TrailId trail);
+
+  static void raise_error(const Error& error,
+                          const std::string& server_name,
                           SAS::TrailId trail);
 
   static void handle_invalid_ifc(std::string error,
@@ -115,6 +133,6 @@ class ifc_error : public std::exception {};
                                  int instance_id,
                                  SAS::TrailId trail);
 
+  std::shared_ptr<const CompiledIfc> _program;
   rapidxml::xml_node<>* _ifc;
-  std::string _server_name;
 };
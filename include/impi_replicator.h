@@ -0,0 +1,134 @@
+/**
+ * @file impi_replicator.h  Concurrent access to remote IMPI stores.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef IMPI_REPLICATOR_H_
+#define IMPI_REPLICATOR_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "impistore.h"
+#include "sas.h"
+#include "snmp_event_accumulator_table.h"
+#include "snmp_counter_table.h"
+#include "threadpool.h"
+#include "exception_handler.h"
+
+/// Authentication challenges are replicated to the IMPI store in every remote
+/// site, and looked up in the remote sites if they aren't in the local store.
+/// Doing this one site at a time on the worker thread adds the latency of
+/// every remote site to each challenged request.
+///
+/// ImpiReplicator does these operations on its own thread pools instead.
+/// Writes are queued to every remote site without waiting for them to
+/// complete, and reads are sent to every remote site at once, returning as
+/// soon as one of them finds the IMPI.  Reads block the caller, so they have
+/// their own thread pool and never wait behind queued writes.  The latency of each remote site is
+/// recorded in its own statistics table.  Queuing work never blocks the
+/// caller - if the remote sites fall too far behind, further writes are
+/// dropped and counted instead.
+class ImpiReplicator
+{
+public:
+  /// The maximum number of writes to remote stores that can be waiting to
+  /// complete before further writes are dropped.
+  static const uint64_t MAX_PENDING_WRITES = 1000;
+
+  /// Constructor.
+  ///
+  /// @param remote_stores     - The IMPI stores in the remote sites.  The
+  ///                            caller retains ownership.
+  /// @param latency_tbls      - Optional statistics tables for the latency of
+  ///                            each remote store, in the same order as the
+  ///                            stores.  The caller retains ownership.
+  /// @param exception_handler - Exception handler for the thread pools.
+  /// @param num_threads       - The number of threads in each of the read and
+  ///                            write thread pools.
+  /// @param dropped_writes_tbl - Optional statistics table, incremented for
+  ///                            every write to a remote store that is
+  ///                            dropped.  The caller retains ownership.
+  ImpiReplicator(const std::vector<ImpiStore*>& remote_stores,
+                 const std::vector<SNMP::EventAccumulatorTable*>& latency_tbls,
+                 ExceptionHandler* exception_handler,
+                 unsigned int num_threads,
+                 SNMP::CounterTable* dropped_writes_tbl = NULL);
+  virtual ~ImpiReplicator();
+
+  /// Function that writes to a single remote store.
+  typedef std::function<void(ImpiStore*)> WriteFn;
+
+  /// Runs the write against every remote store on the write thread pool, and
+  /// returns without waiting for it to complete.  Anything the write uses
+  /// must be captured by value.  The write to a store is dropped if there are
+  /// already MAX_PENDING_WRITES writes waiting.
+  void write(const WriteFn& write_fn);
+
+  /// Reads the IMPI from every remote store in parallel, on the read thread
+  /// pool.
+  ///
+  /// @return - The first IMPI found that has authentication challenges, or
+  ///           NULL if no remote store has any.  The caller owns the returned
+  ///           object.
+  ImpiStore::Impi* read_impi(const std::string& impi, SAS::TrailId trail);
+
+  /// Number of remote store operations that have been queued but haven't yet
+  /// completed.
+  uint64_t pending() const { return _pending.load(); }
+
+  /// Number of writes to remote stores that have been dropped.
+  uint64_t dropped_writes() const { return _dropped_writes.load(); }
+
+private:
+  /// An operation on a single remote store.  abandon is called instead of
+  /// run if the operation can't complete.
+  struct Request
+  {
+    std::function<void()> run;
+    std::function<void()> abandon;
+  };
+
+  static void exception_callback(Request* work);
+
+  /// @class Pool
+  /// A thread pool used for remote store operations.
+  class Pool : public ThreadPool<Request*>
+  {
+  public:
+    Pool(ExceptionHandler* exception_handler,
+         void (*callback)(Request*),
+         unsigned int num_threads);
+    virtual ~Pool();
+
+  private:
+    /// Called by the replication threads when they pull work off the queue.
+    virtual void process_work(Request*&);
+  };
+
+  /// Queues an operation on the remote store at the given index to the given
+  /// thread pool, recording its latency.
+  void dispatch(Pool* pool,
+                size_t site,
+                const std::function<void(ImpiStore*)>& op,
+                const std::function<void()>& abandon);
+
+  std::vector<ImpiStore*> _remote_stores;
+  std::vector<SNMP::EventAccumulatorTable*> _latency_tbls;
+  Pool* _read_pool;
+  Pool* _write_pool;
+  std::atomic<uint64_t> _pending;
+  std::atomic<uint64_t> _pending_writes;
+  std::atomic<uint64_t> _dropped_writes;
+  SNMP::CounterTable* _dropped_writes_tbl;
+};
+
+#endif
@@ -26,6 +26,32 @@
 class ImpiStore
 {
 public:
+  /// @class ImpiStore::BinaryReader
+  ///
+  /// Reads fields from a record in the compact binary encoding, in which
+  /// integers are written as varints and strings are prefixed with their
+  /// length.
+  class BinaryReader
+  {
+  public:
+    BinaryReader(const std::string& data) :
+      _ptr(data.data()),
+      _end(data.data() + data.size()) {};
+
+    /// Each of these returns false if the record is too short.
+    bool read_byte(uint8_t& value);
+    bool read_varint(uint64_t& value);
+    bool read_string(std::string& value);
+
+  private:
+    const char* _ptr;
+    const char* _end;
+  };
+
+  /// Appends fields to a record in the compact binary encoding.
+  static void write_varint(std::string& data, uint64_t value);
+  static void write_string(std::string& data, const std::string& value);
+
   /// @class ImpiStore::AuthChallenge
   ///
   /// Represents an authentication challenge
@@ -70,6 +96,12 @@ public:
     /// Destructor must be virtual as we're going to extend this class.
     virtual ~AuthChallenge() {};
 
+    /// Returns a copy of this challenge, which the caller owns.
+    virtual AuthChallenge* clone() const
+    {
+      return new AuthChallenge(*this);
+    }
+
     /// Write to JSON writer (IMPI format).
     virtual void write_json(rapidjson::Writer<rapidjson::StringBuffer>* writer,
                             bool expiry_in_ms = false);
@@ -79,13 +111,20 @@ public:
                                                bool expiry_in_ms = false,
                                                bool include_expired = false);
 
+    /// Write to the compact binary encoding (IMPI format).
+    virtual void write_binary(std::string& data) const;
+
+    /// Deserialization from the compact binary encoding (IMPI format).
+    static ImpiStore::AuthChallenge* from_binary(const std::string& data,
+                                                 bool include_expired = false);
+
     /// Getters and setters
-    Type get_type()
+    Type get_type() const
     {
       return _type;
     }
 
-    std::string get_nonce()
+    std::string get_nonce() const
     {
       return _nonce;
     }
@@ -96,7 +135,7 @@ public:
       _nonce = nonce;
     }
 
-    uint32_t get_nonce_count()
+    uint32_t get_nonce_count() const
     {
       return _nonce_count;
     }
@@ -107,7 +146,7 @@ public:
       _nonce_count = nonce_count;
     }
 
-    int get_expires()
+    int get_expires() const
     {
       return _expires;
     }
@@ -118,7 +157,7 @@ public:
       _expires = expires;
     }
 
-    std::string get_correlator()
+    std::string get_correlator() const
     {
       return _correlator;
     }
@@ -129,7 +168,7 @@ public:
       _correlator = correlator;
     }
 
-    std::string get_scscf_uri()
+    std::string get_scscf_uri() const
     {
       return _scscf_uri;
     }
@@ -140,7 +179,7 @@ public:
       _scscf_uri = uri;
     }
 
-    std::string get_impu()
+    std::string get_impu() const
     {
       return _impu;
     }
@@ -152,7 +191,7 @@ public:
       _impu = impu;
     }
 
-    std::string get_timer_id()
+    std::string get_timer_id() const
     {
       return _timer_id;
     }
@@ -245,6 +284,11 @@ public:
     /// Destructor.
     virtual ~DigestAuthChallenge() {};
 
+    virtual AuthChallenge* clone() const override
+    {
+      return new DigestAuthChallenge(*this);
+    }
+
     /// Write to JSON writer (IMPI format).
     virtual void write_json(rapidjson::Writer<rapidjson::StringBuffer>* writer,
                             bool expiry_in_ms = false) override;
@@ -252,8 +296,14 @@ public:
     /// Deserialization from JSON (IMPI format).
     static ImpiStore::DigestAuthChallenge* from_json(rapidjson::Value* json);
 
+    /// Write to the compact binary encoding (IMPI format).
+    virtual void write_binary(std::string& data) const override;
+
+    /// Deserialization from the compact binary encoding (IMPI format).
+    static ImpiStore::DigestAuthChallenge* from_binary(BinaryReader& reader);
+
     /// Getters and Setters
-    std::string get_realm()
+    std::string get_realm() const
     {
       return _realm;
     }
@@ -264,7 +314,7 @@ public:
       _realm = realm;
     }
 
-    std::string get_qop()
+    std::string get_qop() const
     {
       return _qop;
     }
@@ -275,7 +325,7 @@ public:
       _qop = qop;
     }
 
-    std::string get_ha1()
+    std::string get_ha1() const
     {
       return _ha1;
     }
@@ -327,6 +377,11 @@ public:
     /// Destructor.
     virtual ~AKAAuthChallenge() {};
 
+    virtual AuthChallenge* clone() const override
+    {
+      return new AKAAuthChallenge(*this);
+    }
+
     /// Write to JSON writer (IMPI format).
     virtual void write_json(rapidjson::Writer<rapidjson::StringBuffer>* writer,
                             bool expiry_in_ms = false) override;
@@ -334,8 +389,14 @@ public:
     /// Deserialization from JSON (IMPI format).
     static ImpiStore::AKAAuthChallenge* from_json(rapidjson::Value* json);
 
+    /// Write to the compact binary encoding (IMPI format).
+    virtual void write_binary(std::string& data) const override;
+
+    /// Deserialization from the compact binary encoding (IMPI format).
+    static ImpiStore::AKAAuthChallenge* from_binary(BinaryReader& reader);
+
     /// Getters and Setters
-    std::string get_response()
+    std::string get_response() const
     {
       return _response;
     }
@@ -0,0 +1,133 @@
+/**
+ * @file irs_info_cache.h  Cache of subscriber data retrieved from the HSS.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef IRS_INFO_CACHE_H_
+#define IRS_INFO_CACHE_H_
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+
+#include "hssconnection.h"
+#include "sharded_lru_cache.h"
+#include "snmp_counter_table.h"
+
+/// Every call leg handled by the S-CSCF looks up the served user's service
+/// profiles, associated URIs and charging addresses from Homestead, and parses
+/// the XML response, even though this data changes rarely.
+///
+/// IrsInfoCache is a bounded, thread-safe cache of the parsed irs_info for
+/// each public ID, built on a ShardedLruCache.  Entries expire after a fixed
+/// time, and are invalidated when anything on this node changes the
+/// subscriber's data - an invalidation of an IMPU also invalidates every
+/// cached IMPU whose default IMPU it is.  The cache is per process, so changes
+/// made through other nodes aren't seen until the entry expires.  The expiry
+/// time must therefore be kept short.
+///
+/// To avoid caching data that was read from the HSS before an invalidation
+/// but returned after it, callers must call start_query before querying the
+/// HSS and pass the result to put.
+///
+/// The registration state is not cached, as it can be changed through any
+/// node without invalidating this node's cache.
+class IrsInfoCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param capacity          - The maximum number of public IDs to cache.
+  /// @param ttl_s             - The time (in seconds) to cache data for.
+  /// @param num_shards        - The number of independently locked shards.
+  /// @param hits_tbl          - Optional statistics tables, incremented on a
+  /// @param misses_tbl          cache hit and a cache miss.
+  IrsInfoCache(size_t capacity,
+               int ttl_s,
+               int num_shards = DEFAULT_NUM_SHARDS,
+               SNMP::CounterTable* hits_tbl = NULL,
+               SNMP::CounterTable* misses_tbl = NULL);
+  virtual ~IrsInfoCache();
+
+  static const int DEFAULT_NUM_SHARDS = 16;
+
+  /// Gets the cached data for a public ID.  Returns false if there is none.
+  bool get(const std::string& public_id, HSSConnection::irs_info& irs_info);
+
+  /// Returns a token identifying the start of an HSS query, to pass to put.
+  uint64_t start_query() const { return _sequence.load(); }
+
+  /// Caches the data for a public ID, unless it has been invalidated since
+  /// query_token was returned by start_query.  Data for public IDs that are
+  /// only matched by a wildcard is not cached, as it can't be invalidated
+  /// reliably.
+  void put(const std::string& public_id,
+           const HSSConnection::irs_info& irs_info,
+           uint64_t query_token);
+
+  /// Invalidates the cached data for a public ID and, if it is the default
+  /// public ID of an IRS, for every other public ID in the IRS.
+  void invalidate(const std::string& public_id);
+
+  uint64_t hits() const { return _cache.hits(); }
+  uint64_t misses() const { return _cache.misses(); }
+  size_t size() { return _cache.size(); }
+
+private:
+  struct Entry
+  {
+    std::shared_ptr<const HSSConnection::irs_info> irs_info;
+    std::string default_id;
+    uint64_t query_token;
+    unsigned long expiry_ms;
+  };
+
+  /// The recent invalidations of the public IDs that hash to it, so that data
+  /// read from the HSS before an invalidation is never returned.
+  struct InvalidationShard
+  {
+    InvalidationShard();
+    ~InvalidationShard();
+
+    pthread_mutex_t lock;
+
+    // The sequence number of the most recent invalidation of each public ID,
+    // and the order they were made in so that they can be discarded once any
+    // data they apply to has expired.
+    std::unordered_map<std::string, uint64_t> invalidations;
+    std::deque<std::pair<unsigned long, std::pair<std::string, uint64_t>>> invalidation_times;
+  };
+
+  InvalidationShard* get_invalidation_shard(const std::string& public_id) const;
+
+  // Returns the sequence number of the last invalidation of a public ID, or 0
+  // if it hasn't been invalidated recently.
+  uint64_t last_invalidation(const std::string& public_id);
+
+  // Records an invalidation of a public ID, and discards records of old
+  // invalidations.
+  void record_invalidation(const std::string& public_id,
+                           uint64_t sequence,
+                           unsigned long now);
+
+  static unsigned long now_ms();
+
+  unsigned long _ttl_ms;
+  ShardedLruCache<std::string, Entry> _cache;
+  std::vector<InvalidationShard*> _invalidation_shards;
+
+  std::atomic<uint64_t> _sequence;
+};
+
+#endif
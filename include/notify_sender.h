@@ -23,6 +23,7 @@ extern "C" {
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -72,6 +73,41 @@ public:
     UNREGISTERED
   };
 
+  /// The reginfo XML body (RFC 3680) of the NOTIFYs sent for an update to an
+  /// AoR.
+  ///
+  /// The body is the same for every subscription to the AoR except for the id
+  /// of each registration element, which is the subscription's dialog tag.
+  /// Rather than build an XML tree for every subscription, the body is
+  /// rendered to text once per update, and each subscription's id is patched
+  /// into the text.
+  class RegInfoBody
+  {
+  public:
+    /// Renders the body.
+    ///
+    /// @param associated_uris[in]     - The IMPUs in the implicit registration
+    ///                                  set, each of which gets a registration
+    ///                                  element.
+    /// @param classified_bindings[in] - The bindings to report as contacts in
+    ///                                  each registration element.
+    /// @param reg_state[in]           - The state of the registrations.
+    /// @param trail[in]               - The SAS trail ID.
+    RegInfoBody(const AssociatedURIs& associated_uris,
+                const ClassifiedBindings& classified_bindings,
+                RegistrationState reg_state,
+                SAS::TrailId trail);
+
+    /// Returns the body for the subscription with the given To tag.
+    std::string render(const std::string& to_tag) const;
+
+  private:
+    /// The rendered body, and the offsets into it at which the id of each
+    /// registration element belongs.
+    std::string _text;
+    std::vector<size_t> _id_offsets;
+  };
+
   /// This compares the original and updated AoRs and sends any NOTIFYs.
   ///
   /// @param aor_id[in]        - The AoR ID.
@@ -96,59 +132,23 @@ private:
   pj_status_t create_subscription_notify(
                                   pjsip_tx_data** tdata_notify,
                                   Subscription* s,
-                                  const std::string& aor,
-                                  const AssociatedURIs& associated_uris,
                                   int cseq,
-                                  const ClassifiedBindings& classified_bindings,
+                                  const RegInfoBody& reg_info,
                                   const RegistrationState& reg_state,
-                                  int now,
-                                  SAS::TrailId trail);
+                                  int now);
 
   pj_status_t create_notify(pjsip_tx_data** tdata_notify,
                             Subscription* subscription,
-                            const std::string& aor,
-                            const AssociatedURIs& associated_uris,
                             int cseq,
-                            const ClassifiedBindings& classified_bindings,
+                            const RegInfoBody& reg_info,
                             const RegistrationState& reg_state,
                             const SubscriptionState& subscription_state,
-                            int expiry,
-                            SAS::TrailId trail);
+                            int expiry);
 
   pj_status_t create_request_from_subscription(pjsip_tx_data** p_tdata,
                                                Subscription* subscription,
                                                int cseq,
                                                pj_str_t* body);
-
-  pj_status_t notify_create_body(pjsip_msg_body* body,
-                                  pj_pool_t *pool,
-                                  const std::string& aor,
-                                  const AssociatedURIs& associated_uris,
-                                  Subscription* subscription,
-                                  const ClassifiedBindings& classified_bindings,
-                                  const RegistrationState& reg_state,
-                                  SAS::TrailId trail);
-
-  pj_xml_node* notify_create_reg_state_xml(
-                                  pj_pool_t *pool,
-                                  const std::string& aor,
-                                  const AssociatedURIs& associated_uris,
-                                  Subscription* subscription,
-                                  const ClassifiedBindings& classified_bindings,
-                                  const RegistrationState& reg_state,
-                                  SAS::TrailId trail);
-
-  pj_xml_node* create_reg_node(pj_pool_t* pool,
-                               pj_str_t* aor,
-                               pj_str_t* id,
-                               pj_str_t* state);
-
-
-  pj_xml_node* create_contact_node(pj_pool_t* pool,
-                                   pj_str_t* id,
-                                   pj_str_t* state,
-                                   pj_str_t* event);
-
 };
 
 #endif
@@ -21,4 +21,12 @@ pj_status_t init_options();
 
 void destroy_options();
 
+/// Returns true if the message is an OPTIONS poll targeted at this node.
+bool is_options_poll_for_this_node(pjsip_rx_data* rdata);
+
+/// Responds statelessly to an OPTIONS poll targeted at this node.  This is
+/// used both by mod_options and by the thread dispatcher, so that a poll gets
+/// the same response whichever answers it.
+pj_status_t respond_to_options_poll(pjsip_rx_data* rdata);
+
 #endif
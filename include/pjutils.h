@@ -131,6 +131,19 @@ pjsip_tx_data* clone_msg(pjsip_endpoint* endpt,
 pjsip_tx_data* clone_msg(pjsip_endpoint* endpt,
                          pjsip_tx_data* tdata);
 
+/// Marks the body of a message so that clones of the message share the body
+/// by reference instead of copying it.  Only text bodies (such as SDP) are
+/// shared.  A message that shares a body must replace it, rather than modify
+/// it in place, and must not outlive the message that owns the body - call
+/// unshare_msg_body on it first if it might.
+void share_msg_body(pjsip_tx_data* tdata);
+
+/// Gives a message that shares its body its own copy of the body.
+void unshare_msg_body(pjsip_tx_data* tdata);
+
+/// Returns true if the body of the message is shared by reference.
+bool is_msg_body_shared(const pjsip_msg* msg);
+
 pj_status_t create_response(pjsip_endpoint *endpt,
                             const pjsip_rx_data *rdata,
                             int st_code,
@@ -0,0 +1,166 @@
+/**
+ * @file prefix_trie.h  Trie for matching numbers against routing prefixes.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef PREFIX_TRIE_H_
+#define PREFIX_TRIE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/// A trie of number prefixes, each with an associated value, used by the
+/// ENUM and BGCF services to route numbers.
+///
+/// A number matches a prefix if either of them is a prefix of the other.  If
+/// a number matches several prefixes, the lexicographically greatest one
+/// wins - so the longest prefix of the number is used, unless the number is
+/// itself a prefix of one or more configured prefixes.  This is the order in
+/// which the services previously scanned a std::map of prefixes, but a lookup
+/// now takes time proportional to the length of the number rather than the
+/// number of prefixes.
+///
+/// A trie is built once and not modified after it is shared, so lookups need
+/// no locking.
+template <class T>
+class PrefixTrie
+{
+public:
+  PrefixTrie() : _root(new Node()), _size(0) {}
+  ~PrefixTrie() { delete _root; }
+
+  /// Adds a prefix.  If the prefix is already present, the existing value is
+  /// kept (as with std::map::insert).
+  void insert(const std::string& prefix, const T& value)
+  {
+    Node* node = _root;
+    std::vector<Node*> path;
+    path.push_back(node);
+
+    for (char c : prefix)
+    {
+      node = node->get_or_add_child(c);
+      path.push_back(node);
+    }
+
+    if (node->entry != NULL)
+    {
+      return;
+    }
+
+    node->entry = new Entry(prefix, value);
+    ++_size;
+
+    // Every node on the path has the new prefix in its subtree.
+    for (Node* ancestor : path)
+    {
+      if ((ancestor->greatest == NULL) ||
+          (ancestor->greatest->prefix < prefix))
+      {
+        ancestor->greatest = node->entry;
+      }
+    }
+  }
+
+  /// Returns the value for the best matching prefix (see above), or NULL if
+  /// no prefix matches.  The number must already have been normalised.
+  const T* find(const std::string& number) const
+  {
+    const Node* node = _root;
+    const Entry* longest = node->entry;
+
+    for (char c : number)
+    {
+      node = node->child(c);
+
+      if (node == NULL)
+      {
+        // Only prefixes of the number match.
+        return (longest != NULL) ? &longest->value : NULL;
+      }
+
+      if (node->entry != NULL)
+      {
+        longest = node->entry;
+      }
+    }
+
+    // The whole number is on the trie, so the configured prefixes that extend
+    // it match too, and sort after any shorter prefix.
+    return (node->greatest != NULL) ? &node->greatest->value : NULL;
+  }
+
+  size_t size() const { return _size; }
+
+private:
+  // Not copyable.
+  PrefixTrie(const PrefixTrie&);
+  PrefixTrie& operator=(const PrefixTrie&);
+
+  struct Entry
+  {
+    Entry(const std::string& p, const T& v) : prefix(p), value(v) {}
+
+    std::string prefix;
+    T value;
+  };
+
+  struct Node
+  {
+    Node() : entry(NULL), greatest(NULL) {}
+
+    ~Node()
+    {
+      for (std::pair<char, Node*>& child : children)
+      {
+        delete child.second;
+      }
+      delete entry;
+    }
+
+    const Node* child(char c) const
+    {
+      for (const std::pair<char, Node*>& child : children)
+      {
+        if (child.first == c)
+        {
+          return child.second;
+        }
+      }
+      return NULL;
+    }
+
+    Node* get_or_add_child(char c)
+    {
+      Node* node = const_cast<Node*>(child(c));
+      if (node == NULL)
+      {
+        node = new Node();
+        children.push_back(std::make_pair(c, node));
+      }
+      return node;
+    }
+
+    // Numbers are mostly digits, so the fan out is small enough that a
+    // vector is quicker to search than a map.
+    std::vector<std::pair<char, Node*> > children;
+
+    // The prefix ending at this node, if there is one.
+    Entry* entry;
+
+    // The lexicographically greatest prefix in this node's subtree.
+    const Entry* greatest;
+  };
+
+  Node* _root;
+  size_t _size;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file regex_cache.h  Process-wide cache of compiled regular expressions.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef REGEX_CACHE_H_
+#define REGEX_CACHE_H_
+
+#include <string>
+#include <utility>
+#include <boost/regex.hpp>
+
+#include "sharded_lru_cache.h"
+#include "snmp_counter_table.h"
+
+/// The same regular expressions turn up over and over again - in the iFCs of
+/// thousands of subscriber profiles, and in ENUM rules - and compiling a
+/// boost::regex is far more expensive than matching one.
+///
+/// RegexCache is a bounded, thread-safe cache of compiled regexes keyed by
+/// pattern and flags.  It is a ShardedLruCache, so that worker threads
+/// compiling different patterns don't contend.
+///
+/// boost::regex shares its compiled state between copies, so the regexes
+/// handed out by the cache are cheap to copy and can be matched on any number
+/// of threads at once.
+class RegexCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param capacity          - The maximum number of regexes to cache.
+  /// @param num_shards        - The number of independently locked shards.
+  /// @param hits_tbl          - Optional statistics tables, incremented on a
+  /// @param misses_tbl          cache hit, a cache miss, and when a regex is
+  /// @param evictions_tbl       evicted to make space for another.
+  RegexCache(size_t capacity,
+             int num_shards = DEFAULT_NUM_SHARDS,
+             SNMP::CounterTable* hits_tbl = NULL,
+             SNMP::CounterTable* misses_tbl = NULL,
+             SNMP::CounterTable* evictions_tbl = NULL);
+  virtual ~RegexCache();
+
+  static const int DEFAULT_NUM_SHARDS = 16;
+
+  /// Returns the compiled form of the pattern.  The regex is compiled with
+  /// boost::regex_constants::no_except, so an invalid pattern returns a regex
+  /// with a non-zero status() rather than throwing.  Invalid patterns are
+  /// cached too.
+  boost::regex get(const std::string& pattern,
+                   boost::regex::flag_type flags = boost::regex::normal);
+
+  /// Sets the process-wide cache used by compile.  The caller retains
+  /// ownership.
+  static void set_instance(RegexCache* cache) { _instance = cache; }
+
+  /// Compiles a regex using the process-wide cache, or directly if there
+  /// isn't one.  Behaves as RegexCache::get.
+  static boost::regex compile(const std::string& pattern,
+                              boost::regex::flag_type flags = boost::regex::normal);
+
+  uint64_t hits() const { return _cache.hits(); }
+  uint64_t misses() const { return _cache.misses(); }
+  uint64_t evictions() const { return _cache.evictions(); }
+  size_t size() { return _cache.size(); }
+
+private:
+  typedef std::pair<std::string, boost::regex::flag_type> Key;
+
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const
+    {
+      return std::hash<std::string>()(key.first) ^ (size_t)key.second;
+    }
+  };
+
+  static RegexCache* _instance;
+
+  ShardedLruCache<Key, boost::regex, KeyHash> _cache;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file scscf_assignment_cache.h  Cache of S-CSCF assignments from the HSS.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SCSCF_ASSIGNMENT_CACHE_H_
+#define SCSCF_ASSIGNMENT_CACHE_H_
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <pthread.h>
+
+#include "servercaps.h"
+#include "snmp_counter_table.h"
+
+/// The I-CSCF queries the HSS (with a UAR or LIR) for every REGISTER and
+/// every initial request it routes, to find the S-CSCF assigned to the
+/// subscriber or the capabilities it needs, even though this rarely changes.
+///
+/// SCSCFAssignmentCache is a bounded, thread-safe cache of the parsed
+/// responses to these queries that name an assigned S-CSCF (responses that
+/// only return capabilities are never cached).  Entries expire after a short
+/// time, so that changes to the assignment on the HSS are picked up quickly,
+/// and the least recently used entry is evicted when the cache is full.  The
+/// I-CSCF invalidates an entry whenever it has to retry a request to an
+/// alternative S-CSCF.
+class SCSCFAssignmentCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param capacity          - The maximum number of queries to cache.
+  /// @param ttl_s             - The time (in seconds) to cache results for.
+  /// @param hits_tbl          - Optional statistics tables, incremented on a
+  /// @param misses_tbl          cache hit and a cache miss.
+  SCSCFAssignmentCache(size_t capacity,
+                       int ttl_s,
+                       SNMP::CounterTable* hits_tbl = NULL,
+                       SNMP::CounterTable* misses_tbl = NULL);
+  virtual ~SCSCFAssignmentCache();
+
+  /// Gets the cached result of a query.  Returns false if there is none.
+  ///
+  /// @param key               - Identifies the query.
+  /// @param caps              - Filled in with the S-CSCF and capabilities
+  ///                            returned by the HSS.
+  /// @param queried_caps      - Filled in with whether the HSS returned
+  ///                            capabilities.
+  bool get(const std::string& key, ServerCapabilities& caps, bool& queried_caps);
+
+  /// Caches the result of a query.
+  void put(const std::string& key, const ServerCapabilities& caps, bool queried_caps);
+
+  /// Removes the cached result of a query, if there is one.
+  void invalidate(const std::string& key);
+
+  uint64_t hits() const { return _hits.load(); }
+  uint64_t misses() const { return _misses.load(); }
+  size_t size();
+
+private:
+  struct Entry
+  {
+    ServerCapabilities caps;
+    bool queried_caps;
+    unsigned long expiry_ms;
+  };
+
+  typedef std::list<std::pair<std::string, Entry>> LruList;
+
+  static unsigned long now_ms();
+
+  size_t _capacity;
+  unsigned long _ttl_ms;
+
+  // Entries in order of use, most recently used first, protected by _lock.
+  pthread_mutex_t _lock;
+  LruList _lru;
+  std::unordered_map<std::string, LruList::iterator> _index;
+
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+
+  SNMP::CounterTable* _hits_tbl;
+  SNMP::CounterTable* _misses_tbl;
+};
+
+#endif
@@ -15,8 +15,10 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <functional>
-#include <boost/thread.hpp>
+#include <unordered_map>
+#include <boost/dynamic_bitset.hpp>
 #include "updater.h"
 #include "sas.h"
 
@@ -36,19 +38,44 @@ public:
                         const std::vector<std::string> &rejects,
                         SAS::TrailId trail);
 private:
+  // A set of capabilities, with one bit for each capability that any
+  // configured S-CSCF has.
+  typedef boost::dynamic_bitset<> Capabilities;
+
   typedef struct scscf
   {
     std::string server;
     int priority;
     int weight;
-    std::vector<int> capabilities;
+    Capabilities capabilities;
   } scscf_t;
 
+  // The configured S-CSCFs, and the bit used for each of their capabilities.
+  struct Config
+  {
+    std::vector<scscf_t> scscfs;
+    std::unordered_map<int, size_t> capability_bits;
+  };
+
+  // Converts a list of capabilities to a bitset.  Capabilities that no
+  // S-CSCF has are ignored, and the number of them is returned.
+  static size_t to_bitset(const Config& config,
+                          const std::vector<int>& caps,
+                          Capabilities& bitset);
+
+  // Builds the strings used to log capabilities and S-CSCFs to SAS.
+  static std::string caps_to_string(const std::vector<int>& caps);
+  static std::string rejects_to_string(const std::vector<std::string>& rejects);
+
   std::string _fallback_scscf_uri;
   std::string _configuration;
-  std::vector<scscf> _scscfs;
+
+  // The configuration.  Each time it is reloaded a new Config is built and
+  // swapped in atomically, so selections just take a reference to the
+  // current one rather than a lock.  This must only be accessed using
+  // std::atomic_load and std::atomic_store.
+  std::shared_ptr<const Config> _config;
   Updater<void, SCSCFSelector>* _updater;
-  boost::shared_mutex _scscfs_rw_lock;
 };
 
 #endif
@@ -307,10 +307,25 @@ private:
   /// @param req  - The request being handled.
   void retrieve_odi_and_sesscase(pjsip_msg* req);
 
+  /// Carries on processing an initial request once any HSS query for the
+  /// served user has completed.
+  ///
+  /// @param req          - The request being handled.
+  /// @param served_user  - The served user, if a new AS chain is needed.
+  void process_initial_request(pjsip_msg* req, std::string served_user);
+
   /// Determines the served user for the request.
   ///
+  /// @param req          - The request being handled.
+  /// @param served_user  - The served user, if a new AS chain is needed (as
+  ///                       returned by served_user_from_msg).
+  pjsip_status_code determine_served_user(pjsip_msg* req,
+                                          std::string served_user);
+
+  /// Sets the S-CSCF URI for a request that doesn't have an AS chain yet.
+  ///
   /// @param req  - The request being handled.
-  pjsip_status_code determine_served_user(pjsip_msg* req);
+  void set_scscf_uri(pjsip_msg* req);
 
   /// Gets the served user indicated in the message.
   std::string served_user_from_msg(pjsip_msg* msg);
@@ -439,6 +454,22 @@ private:
   HTTPCode read_hss_data(std::string public_id,
                          const HSSConnection::irs_query& irs_query);
 
+  /// Starts fetching the subscriber's data from the HSS without blocking the
+  /// calling thread, then calls on_complete.  The result is used by the next
+  /// call to get_data_from_hss.
+  ///
+  /// @param[in] public_id    - The public ID of the subscriber whose info is
+  ///                           being looked up.
+  /// @param[in] on_complete  - Called once the query has completed.
+  void prefetch_hss_data(const std::string& public_id,
+                         std::function<void()> on_complete);
+
+  /// Builds the IRS query used to fetch the subscriber's data.
+  HSSConnection::irs_query build_irs_query(const std::string& public_id);
+
+  /// Sets the class variables holding the subscriber's data from _irs_info.
+  void use_hss_data(const std::string& public_id);
+
   /// Add the S-CSCF sproutlet into a dialog.
   /// The third parameter passed may be attached to the Record-Route and can be
   /// used to recover the billing role that is in use on subsequent in-dialog
@@ -513,6 +544,12 @@ private:
   /// for this transaction.
   bool _hss_data_cached;
 
+  /// The result of an unsuccessful query started by prefetch_hss_data, if it
+  /// hasn't been used yet.
+  bool _hss_prefetched;
+  HTTPCode _prefetch_http_code;
+  std::string _prefetch_public_id;
+
   /// Data received from HSS for this service hop.
   bool _registered;
   bool _barred;
@@ -0,0 +1,255 @@
+/**
+ * @file sharded_lru_cache.h  Bounded, thread-safe, sharded LRU cache.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SHARDED_LRU_CACHE_H_
+#define SHARDED_LRU_CACHE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+
+#include "snmp_counter_table.h"
+
+/// ShardedLruCache is a bounded, thread-safe map from keys to values.  The
+/// cache is split into shards by the hash of the key, each with its own lock
+/// and least-recently-used eviction, so that threads using different keys
+/// don't contend.
+///
+/// Values are copied in and out of the cache under the shard's lock, so they
+/// should be cheap to copy (e.g. hold any large data through a shared_ptr).
+template <class K, class V, class Hash = std::hash<K>>
+class ShardedLruCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param capacity          - The maximum number of entries to cache.  This
+  ///                            is split evenly between the shards, rounding
+  ///                            up so that every shard can hold at least one.
+  /// @param num_shards        - The number of independently locked shards.
+  /// @param hits_tbl          - Optional statistics tables, incremented on a
+  /// @param misses_tbl          cache hit, a cache miss, and when an entry is
+  /// @param evictions_tbl       evicted to make space for another.
+  ShardedLruCache(size_t capacity,
+                  int num_shards,
+                  SNMP::CounterTable* hits_tbl = NULL,
+                  SNMP::CounterTable* misses_tbl = NULL,
+                  SNMP::CounterTable* evictions_tbl = NULL) :
+    _shard_capacity(0),
+    _shards(),
+    _hits(0),
+    _misses(0),
+    _evictions(0),
+    _hits_tbl(hits_tbl),
+    _misses_tbl(misses_tbl),
+    _evictions_tbl(evictions_tbl)
+  {
+    num_shards = std::max(num_shards, 1);
+    _shard_capacity = std::max((capacity + num_shards - 1) / num_shards, (size_t)1);
+
+    for (int ii = 0; ii < num_shards; ++ii)
+    {
+      _shards.push_back(new Shard());
+    }
+  }
+
+  virtual ~ShardedLruCache()
+  {
+    for (Shard* shard : _shards)
+    {
+      delete shard;
+    }
+    _shards.clear();
+  }
+
+  /// Gets the cached value for a key.  Returns false if there is none.
+  bool get(const K& key, V& value)
+  {
+    return get(key, value, [](const V&) { return true; });
+  }
+
+  /// Gets the cached value for a key, if valid returns true for it.  The
+  /// entry is removed if valid returns false, which counts as a miss.  valid
+  /// is called with the shard's lock held.
+  template <class Valid>
+  bool get(const K& key, V& value, Valid valid)
+  {
+    Shard* shard = get_shard(key);
+    bool found = false;
+
+    pthread_mutex_lock(&shard->lock);
+    auto it = shard->index.find(key);
+    if (it != shard->index.end())
+    {
+      if (valid(it->second->second))
+      {
+        // Move the entry to the front of the LRU list.
+        shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+        value = it->second->second;
+        found = true;
+      }
+      else
+      {
+        shard->lru.erase(it->second);
+        shard->index.erase(it);
+      }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (found)
+    {
+      ++_hits;
+      if (_hits_tbl)
+      {
+        _hits_tbl->increment();
+      }
+    }
+    else
+    {
+      ++_misses;
+      if (_misses_tbl)
+      {
+        _misses_tbl->increment();
+      }
+    }
+
+    return found;
+  }
+
+  /// Caches the value for a key, replacing any value already cached, and
+  /// evicts the least recently used entry in the shard if it is full.
+  void put(const K& key, const V& value)
+  {
+    Shard* shard = get_shard(key);
+    bool evicted = false;
+
+    pthread_mutex_lock(&shard->lock);
+    auto it = shard->index.find(key);
+    if (it != shard->index.end())
+    {
+      it->second->second = value;
+      shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+    }
+    else
+    {
+      shard->lru.push_front(std::make_pair(key, value));
+      shard->index[key] = shard->lru.begin();
+
+      if (shard->lru.size() > _shard_capacity)
+      {
+        shard->index.erase(shard->lru.back().first);
+        shard->lru.pop_back();
+        evicted = true;
+      }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (evicted)
+    {
+      ++_evictions;
+      if (_evictions_tbl)
+      {
+        _evictions_tbl->increment();
+      }
+    }
+  }
+
+  /// Removes the cached value for a key, returning it in value if there was
+  /// one.  Returns false if there was none.
+  bool erase(const K& key, V* value = NULL)
+  {
+    Shard* shard = get_shard(key);
+    bool found = false;
+
+    pthread_mutex_lock(&shard->lock);
+    auto it = shard->index.find(key);
+    if (it != shard->index.end())
+    {
+      if (value != NULL)
+      {
+        *value = it->second->second;
+      }
+
+      shard->lru.erase(it->second);
+      shard->index.erase(it);
+      found = true;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return found;
+  }
+
+  size_t size()
+  {
+    size_t size = 0;
+
+    for (Shard* shard : _shards)
+    {
+      pthread_mutex_lock(&shard->lock);
+      size += shard->lru.size();
+      pthread_mutex_unlock(&shard->lock);
+    }
+
+    return size;
+  }
+
+  size_t num_shards() const { return _shards.size(); }
+  size_t shard_capacity() const { return _shard_capacity; }
+
+  uint64_t hits() const { return _hits.load(); }
+  uint64_t misses() const { return _misses.load(); }
+  uint64_t evictions() const { return _evictions.load(); }
+
+private:
+  typedef std::list<std::pair<K, V>> LruList;
+
+  struct Shard
+  {
+    Shard()
+    {
+      pthread_mutex_init(&lock, NULL);
+    }
+
+    ~Shard()
+    {
+      pthread_mutex_destroy(&lock);
+    }
+
+    pthread_mutex_t lock;
+
+    // Entries in order of use, most recently used first.
+    LruList lru;
+    std::unordered_map<K, typename LruList::iterator, Hash> index;
+  };
+
+  Shard* get_shard(const K& key) const
+  {
+    return _shards[Hash()(key) % _shards.size()];
+  }
+
+  size_t _shard_capacity;
+  std::vector<Shard*> _shards;
+
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+  std::atomic<uint64_t> _evictions;
+
+  SNMP::CounterTable* _hits_tbl;
+  SNMP::CounterTable* _misses_tbl;
+  SNMP::CounterTable* _evictions_tbl;
+};
+
+#endif
@@ -40,16 +40,16 @@ public:
   /// Updates the shared iFC sets
   void update_sets();
 
-  /// Get the iFCs that belong to a set of IDs
+  /// Get the iFCs that belong to a set of IDs.  The iFCs are compiled when
+  /// the configuration is loaded, so this just copies them into ifc_map.
   virtual void get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
                                 const std::set<int32_t>& id,
-                                std::shared_ptr<xml_document<> > ifc_doc,
                                 SAS::TrailId trail) const;
 
 private:
   Alarm* _alarm;
   SNMP::CounterTable* _no_shared_ifcs_set_tbl;
-  std::map<int32_t, std::vector<std::pair<int32_t, std::string>>> _shared_ifc_sets;
+  std::map<int32_t, std::vector<std::pair<int32_t, Ifc>>> _shared_ifc_sets;
   std::string _configuration;
   Updater<void, SIFCService>* _updater;
 
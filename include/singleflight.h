@@ -0,0 +1,230 @@
+/**
+ * @file singleflight.h  Coalescing of concurrent identical requests.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SINGLEFLIGHT_H_
+#define SINGLEFLIGHT_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <pthread.h>
+
+#include "sas.h"
+#include "utils.h"
+#include "snmp_counter_table.h"
+
+/// Singleflight runs a request on behalf of every thread that asks for the
+/// same key at the same time.  The first thread to ask for a key runs the
+/// request; any other thread that asks for the key before it has completed
+/// waits for it and is given a copy of the same result, rather than running
+/// the request itself.
+///
+/// Results are not kept once the request has completed, so this is not a
+/// cache - a thread that asks for a key after the request has completed runs
+/// it again.  The result type must be cheap to copy (e.g. hold any large data
+/// through a shared_ptr), and must not be modified once the request has
+/// completed.
+template <class T>
+class Singleflight
+{
+public:
+  /// Constructor.
+  ///
+  /// @param issued_tbl     - Optional statistics tables, incremented for each
+  /// @param coalesced_tbl    request that is run and each request that waits
+  ///                         for another's result.
+  Singleflight(SNMP::CounterTable* issued_tbl = NULL,
+               SNMP::CounterTable* coalesced_tbl = NULL) :
+    _flights(),
+    _issued(0),
+    _coalesced(0),
+    _issued_tbl(issued_tbl),
+    _coalesced_tbl(coalesced_tbl)
+  {
+    pthread_mutex_init(&_lock, NULL);
+  }
+
+  virtual ~Singleflight()
+  {
+    pthread_mutex_destroy(&_lock);
+  }
+
+  /// Gets the result for a key, either by running request or by waiting for
+  /// another thread that is already running the request for the same key.
+  /// A thread that shares another's result has its SAS trail associated with
+  /// the trail of the thread that ran the request.  If the request throws,
+  /// the exception is passed to the thread that ran it, and any threads
+  /// waiting for it try again.
+  ///
+  /// @returns              - True if the result came from another thread.
+  /// @param key            - Identifies the request.  Requests with the same
+  ///                         key must be interchangeable.
+  /// @param trail          - The SAS trail of this thread.
+  /// @param result         - Filled in with the result.
+  /// @param request        - Fills in the result if this thread runs it.
+  bool run(const std::string& key,
+           SAS::TrailId trail,
+           T& result,
+           const std::function<void(T&)>& request)
+  {
+    bool counted = false;
+
+    pthread_mutex_lock(&_lock);
+
+    auto it = _flights.find(key);
+    while (it != _flights.end())
+    {
+      // Another thread is already running this request, so wait for it.
+      std::shared_ptr<Flight> flight = it->second;
+
+      if (!counted)
+      {
+        counted = true;
+        ++_coalesced;
+        if (_coalesced_tbl)
+        {
+          _coalesced_tbl->increment();
+        }
+      }
+
+      CW_IO_STARTS("Coalesced request")
+      {
+        while (!flight->complete)
+        {
+          pthread_cond_wait(&flight->cond, &_lock);
+        }
+      }
+      CW_IO_COMPLETES()
+
+      if (flight->succeeded)
+      {
+        result = flight->result;
+        SAS::TrailId request_trail = flight->trail;
+        pthread_mutex_unlock(&_lock);
+
+        if (request_trail != trail)
+        {
+          SAS::associate_trails(request_trail, trail);
+        }
+
+        return true;
+      }
+
+      // The request failed without a result.  Another waiting thread may
+      // already have started it again, otherwise run it ourselves.
+      it = _flights.find(key);
+    }
+
+    std::shared_ptr<Flight> flight = std::make_shared<Flight>(trail);
+    _flights[key] = flight;
+    pthread_mutex_unlock(&_lock);
+
+    ++_issued;
+    if (_issued_tbl)
+    {
+      _issued_tbl->increment();
+    }
+
+    {
+      // Complete the flight however the request finishes, so that waiting
+      // threads are never left waiting for a request that has thrown.
+      FlightGuard guard(this, key, flight);
+      request(flight->result);
+      guard.succeeded = true;
+    }
+
+    result = flight->result;
+    return false;
+  }
+
+  /// Number of requests that have been run.
+  uint64_t issued() const { return _issued.load(); }
+
+  /// Number of requests that waited for the result of another.
+  uint64_t coalesced() const { return _coalesced.load(); }
+
+private:
+  /// A request that is being run.  Each has its own condition, signalled when
+  /// it completes, so that waiting threads are only woken for their own key.
+  struct Flight
+  {
+    Flight(SAS::TrailId trail) :
+      complete(false),
+      succeeded(false),
+      trail(trail),
+      result()
+    {
+      pthread_cond_init(&cond, NULL);
+    }
+
+    ~Flight()
+    {
+      pthread_cond_destroy(&cond);
+    }
+
+    bool complete;
+    bool succeeded;
+    SAS::TrailId trail;
+    pthread_cond_t cond;
+    T result;
+  };
+
+  /// Marks a flight complete when it goes out of scope.
+  struct FlightGuard
+  {
+    FlightGuard(Singleflight* singleflight,
+                const std::string& key,
+                const std::shared_ptr<Flight>& flight) :
+      succeeded(false),
+      _singleflight(singleflight),
+      _key(key),
+      _flight(flight)
+    {}
+
+    ~FlightGuard()
+    {
+      _singleflight->complete(_key, _flight, succeeded);
+    }
+
+    bool succeeded;
+
+  private:
+    Singleflight* _singleflight;
+    const std::string& _key;
+    std::shared_ptr<Flight> _flight;
+  };
+
+  void complete(const std::string& key,
+                const std::shared_ptr<Flight>& flight,
+                bool succeeded)
+  {
+    pthread_mutex_lock(&_lock);
+    flight->complete = true;
+    flight->succeeded = succeeded;
+    _flights.erase(key);
+    pthread_cond_broadcast(&flight->cond);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  // The requests currently being run, protected by _lock.
+  pthread_mutex_t _lock;
+  std::unordered_map<std::string, std::shared_ptr<Flight>> _flights;
+
+  std::atomic<uint64_t> _issued;
+  std::atomic<uint64_t> _coalesced;
+
+  SNMP::CounterTable* _issued_tbl;
+  SNMP::CounterTable* _coalesced_tbl;
+};
+
+#endif
@@ -19,6 +19,7 @@ extern "C" {
 #include <stdint.h>
 }
 
+#include <functional>
 #include <list>
 #include "baseresolver.h"
 #include "snmp_success_fail_count_by_request_type_table.h"
@@ -32,6 +33,11 @@ class Sproutlet;
 class SproutletTsx;
 class SproutletProxy;
 
+namespace PJUtils
+{
+  class Callback;
+}
+
 
 /// Typedefs for Sproutlet-specific types
 typedef intptr_t TimerID;
@@ -365,6 +371,21 @@ public:
   ///
   virtual bool timer_running(TimerID id) = 0;
 
+  /// Creates a callback that continues processing of this transaction once
+  /// some asynchronous operation (such as an HSS query) has completed.  When
+  /// the callback is run on a worker thread, fn is called in the context of
+  /// the transaction and any actions it takes (sending requests or responses,
+  /// setting timers) are then processed, as if it were a timer expiring.
+  ///
+  /// The transaction is not destroyed while the callback is outstanding, so
+  /// the callback must always be run exactly once (typically by passing it to
+  /// add_callback_to_queue), and the caller relinquishes ownership of it.
+  ///
+  /// @returns             - The new callback.
+  /// @param  fn           - The function to call in the transaction context.
+  ///
+  virtual PJUtils::Callback* create_callback(std::function<void()> fn) = 0;
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
@@ -726,6 +747,16 @@ protected:
   bool timer_running(TimerID id)
     {return _helper->timer_running(id);}
 
+  /// Creates a callback that continues processing of this transaction once
+  /// some asynchronous operation has completed.  See
+  /// SproutletTsxHelper::create_callback.
+  ///
+  /// @returns             - The new callback.
+  /// @param  fn           - The function to call in the transaction context.
+  ///
+  PJUtils::Callback* create_callback(std::function<void()> fn)
+    {return _helper->create_callback(fn);}
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
@@ -12,15 +12,21 @@
 #ifndef SPROUTLETPROXY_H__
 #define SPROUTLETPROXY_H__
 
+#include <atomic>
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <list>
+#include <deque>
+#include <queue>
+#include <set>
 
+#include "arena.h"
 #include "basicproxy.h"
 #include "pjutils.h"
 #include "sproutlet.h"
 #include "snmp_counter_table.h"
+#include "snmp_event_accumulator_table.h"
 #include "snmp_sip_request_types.h"
 #include "sproutlet_options.h"
 
@@ -55,6 +61,18 @@ public:
   /// @param[in]  max_sproutlet_depth          The maximum number of Sproutlets
   ///                                          that can be invoked in a row
   ///                                          before we break the loop.
+  /// @param[in]  arena_bytes_tbl              SNMP table for tracking the
+  ///                                          memory each transaction
+  ///                                          allocates from its arena.
+  /// @param[in]  in_dialog_fast_path          Whether to forward in-dialog
+  ///                                          requests that no Sproutlet
+  ///                                          needs to see statelessly.
+  /// @param[in]  fast_path_tbl                SNMP table for counting the
+  ///                                          number of requests forwarded
+  ///                                          on the fast path.
+  /// @param[in]  requests_tbl                 SNMP table for counting every
+  ///                                          request received, whether or
+  ///                                          not it takes the fast path.
   SproutletProxy(pjsip_endpoint* endpt,
                  int priority,
                  const std::string& root_uri,
@@ -65,7 +83,11 @@ public:
                  const std::set<std::string>& stateless_proxies,
                  SNMP::CounterTable* route_to_remote_alias_tbl,
                  SNMP::CounterTable* accept_for_remote_alias_tbl,
-                 int max_sproutlet_depth=DEFAULT_MAX_SPROUTLET_DEPTH);
+                 int max_sproutlet_depth=DEFAULT_MAX_SPROUTLET_DEPTH,
+                 SNMP::EventAccumulatorTable* arena_bytes_tbl=NULL,
+                 bool in_dialog_fast_path=false,
+                 SNMP::CounterTable* fast_path_tbl=NULL,
+                 SNMP::CounterTable* requests_tbl=NULL);
 
   /// Destructor.
   virtual ~SproutletProxy();
@@ -79,9 +101,20 @@ public:
                               const pjsip_sip_uri* base_uri,
                               pj_pool_t* pool) const;
 
+  /// Handles requests that are received outside a transaction.  If the
+  /// in-dialog fast path is enabled, in-dialog requests that only need their
+  /// top Route header removing are forwarded statelessly, without creating a
+  /// UAS transaction or invoking any Sproutlets.
+  pj_bool_t on_rx_request(pjsip_rx_data *rdata) override;
+
   /// Handles responses that are received outside a transaction.
   pj_bool_t on_rx_response(pjsip_rx_data *rdata) override;
 
+  /// The number of requests forwarded on the in-dialog fast path, and the
+  /// number of requests passed to the Sproutlets.
+  uint64_t fast_path_requests() const { return _fast_path_requests.load(); }
+  uint64_t sproutlet_requests() const { return _sproutlet_requests.load(); }
+
   enum SPROUTLET_SELECTION_TYPES
   {
     SERVICE_NAME=0,
@@ -147,6 +180,27 @@ protected:
   /// Create Sproutlet UAS transaction objects.
   BasicProxy::UASTsx* create_uas_tsx();
 
+  /// @brief      Checks whether a request can be forwarded on the in-dialog
+  ///             fast path.  This is the case if the request is in-dialog,
+  ///             its top Route header is a loose route to this node that
+  ///             doesn't select a Sproutlet (so no Sproutlet added itself to
+  ///             the dialog), no Sproutlet owns the port it was received on,
+  ///             and its next hop is not local.
+  ///
+  /// @param[in]  rdata  The received request.
+  ///
+  /// @return     Whether the request can be forwarded on the fast path.
+  bool is_fast_path_request(pjsip_rx_data* rdata) const;
+
+  /// @brief      Removes the top Route header from a request and forwards it
+  ///             statelessly.  The Via header added to the request is marked
+  ///             so that responses can be forwarded statelessly too.
+  ///
+  /// @param[in]  rdata  The received request.
+  ///
+  /// @return     Whether the request was forwarded.
+  bool forward_fast_path(pjsip_rx_data* rdata);
+
   /// Registers a sproutlet.
   bool register_sproutlet(Sproutlet* sproutlet);
 
@@ -355,6 +409,11 @@ protected:
     bool cancel_timer(TimerID id);
     bool timer_running(TimerID id);
 
+    /// Creates a Callback which runs fn in the context of the Sproutlet, for
+    /// use when an asynchronous operation started by the Sproutlet completes.
+    PJUtils::Callback* create_callback(SproutletWrapper* tsx,
+                                       std::function<void()> fn);
+
     void tx_response(SproutletWrapper* sproutlet,
                      pjsip_tx_data* rsp);
 
@@ -428,6 +487,12 @@ protected:
                                     bool recieved_from_wire,
                                     std::string& alias);
 
+    /// Arena that the SproutletWrappers, timers and containers belonging to
+    /// this transaction are allocated from.  This must be declared before
+    /// any of the containers that use it, so that it is destroyed after
+    /// them.
+    Arena _arena;
+
     /// The root Sproutlet for this transaction.
     SproutletWrapper* _root;
 
@@ -436,8 +501,12 @@ protected:
     template<typename T>
     struct DMap
     {
-      typedef std::map<std::pair<SproutletWrapper*, int>, T> type;
-      typedef typename std::map<std::pair<SproutletWrapper*, int>, T>::iterator iterator;
+      typedef std::pair<SproutletWrapper*, int> key_type;
+      typedef std::map<key_type,
+                       T,
+                       std::less<key_type>,
+                       ArenaAllocator<std::pair<const key_type, T> > > type;
+      typedef typename type::iterator iterator;
     };
 
     /// Mapping from upstream Sproutlet/fork to downstream Sproutlet.
@@ -448,7 +517,11 @@ protected:
 
     /// Mapping from downstream Sproutlet or UAC transaction to upstream
     /// Sproutlet/fork.
-    typedef std::map<void*, std::pair<SproutletWrapper*, int> > UMap;
+    typedef std::map<void*,
+                     std::pair<SproutletWrapper*, int>,
+                     std::less<void*>,
+                     ArenaAllocator<std::pair<void* const,
+                                              std::pair<SproutletWrapper*, int> > > > UMap;
     UMap _umap;
 
     /// Queue of pending requests to be scheduled.
@@ -460,22 +533,36 @@ protected:
       int sproutlet_depth;
       std::string upstream_network_func;
     } PendingRequest;
-    std::queue<PendingRequest> _pending_req_q;
+    typedef std::queue<PendingRequest,
+                       std::deque<PendingRequest,
+                                  ArenaAllocator<PendingRequest> > > PendingRequestQueue;
+    PendingRequestQueue _pending_req_q;
 
     /// Parent proxy object
     SproutletProxy* _sproutlet_proxy;
 
-    /// This set holds all the timers created by sproutlet tsxs that are
-    /// children of this UASTsx. They are only freed when the UASTsx is freed
-    /// (they are not freed when a timer pops or is cancelled for example).
-    /// This prevents race conditions (such as a double free caused by one
-    /// thread popping a timer and another thread cancelling it).
-    std::set<pj_timer_entry*> _timers;
+    /// The timers created by sproutlet tsxs that are children of this UASTsx
+    /// are allocated from the arena, so are only freed when the UASTsx is
+    /// freed (they are not freed when a timer pops or is cancelled for
+    /// example). This prevents race conditions (such as a double free caused
+    /// by one thread popping a timer and another thread cancelling it).
+    typedef std::set<pj_timer_entry*,
+                     std::less<pj_timer_entry*>,
+                     ArenaAllocator<pj_timer_entry*> > TimerSet;
 
     /// This set holds all the timers created by sproutlet tsx that are
     /// children of this UASTsx that have not popped or been cancelled yet.
     /// The UASTsx will persist while there are pending timers.
-    std::set<pj_timer_entry*> _pending_timers;
+    TimerSet _pending_timers;
+
+    /// Records a message cloned for a Sproutlet in this transaction.
+    void record_clone(pjsip_tx_data* clone);
+
+    /// The number of messages cloned for Sproutlets in this transaction, and
+    /// the memory allocated for them.  Message bodies are shared between the
+    /// clones rather than copied (see PJUtils::share_msg_body).
+    int _clones;
+    size_t _clone_bytes;
 
     /// Count of the number of UASTsx objects currently active. Used for
     /// debugging purposes.
@@ -498,12 +585,20 @@ protected:
   std::list<Sproutlet*> _sproutlets;
 
   static const pj_str_t STR_SERVICE;
+  static const pj_str_t STR_FAST_PATH;
 
   SNMP::CounterTable* _route_to_remote_alias_tbl;
   SNMP::CounterTable* _accept_for_remote_alias_tbl;
+  SNMP::EventAccumulatorTable* _arena_bytes_tbl;
 
   const int _max_sproutlet_depth;
 
+  const bool _in_dialog_fast_path;
+  SNMP::CounterTable* _fast_path_tbl;
+  SNMP::CounterTable* _requests_tbl;
+  std::atomic<uint64_t> _fast_path_requests;
+  std::atomic<uint64_t> _sproutlet_requests;
+
   friend class UASTsx;
   friend class SproutletWrapper;
 };
@@ -529,6 +624,15 @@ public:
   /// Virtual destructor.
   virtual ~SproutletWrapper();
 
+  /// SproutletWrappers are allocated from the arena of their UASTsx, and
+  /// their memory is freed along with it.
+  static void* operator new(size_t size, Arena* arena)
+  {
+    return arena->allocate(size, alignof(SproutletWrapper));
+  }
+  static void operator delete(void* p) {}
+  static void operator delete(void* p, Arena* arena) {}
+
   const std::string& service_name() const;
 
   /// This implementation has concrete implementations for all of the virtual
@@ -557,6 +661,7 @@ public:
   bool schedule_timer(void* context, TimerID& id, int duration);
   void cancel_timer(TimerID id);
   bool timer_running(TimerID id);
+  PJUtils::Callback* create_callback(std::function<void()> fn);
   SAS::TrailId trail() const;
   bool is_uri_reflexive(const pjsip_uri*) const;
   pjsip_sip_uri* get_reflexive_uri(pj_pool_t*) const;
@@ -581,6 +686,7 @@ private:
   void rx_error(int status_code, const std::string& reason);
   void rx_fork_error(ForkErrorState fork_error, int fork_id);
   void on_timer_pop(TimerID id, void* context);
+  void on_async_complete(const std::function<void()>& fn);
   void register_tdata(pjsip_tx_data* tdata);
   void deregister_tdata(pjsip_tx_data* tdata);
 
@@ -632,13 +738,23 @@ private:
   // The depth of this wrapper in the transaction tree.  Used to detect loops.
   int _depth;
 
-  typedef std::unordered_map<const pjsip_msg*, pjsip_tx_data*> Packets;
+  // The containers below are allocated from the arena of the UASTsx.
+  typedef std::unordered_map<const pjsip_msg*,
+                             pjsip_tx_data*,
+                             std::hash<const pjsip_msg*>,
+                             std::equal_to<const pjsip_msg*>,
+                             ArenaAllocator<std::pair<const pjsip_msg* const,
+                                                      pjsip_tx_data*> > > Packets;
   Packets _packets;
 
-  typedef std::map<int, SproutletProxy::SendRequest> Requests;
+  typedef std::map<int,
+                   SproutletProxy::SendRequest,
+                   std::less<int>,
+                   ArenaAllocator<std::pair<const int,
+                                            SproutletProxy::SendRequest> > > Requests;
   Requests _send_requests;
 
-  typedef std::list<pjsip_tx_data*> Responses;
+  typedef std::list<pjsip_tx_data*, ArenaAllocator<pjsip_tx_data*> > Responses;
   Responses _send_responses;
 
   int _pending_sends;
@@ -667,12 +783,24 @@ private:
     bool pending_response;
     bool abandoned;
   } ForkStatus;
-  std::vector<ForkStatus> _forks;
+  typedef std::vector<ForkStatus, ArenaAllocator<ForkStatus> > Forks;
+  Forks _forks;
 
   /// Set keeping track of pending timers for this SproutletWrapper.  The
   /// SproutletWrapper (and the SproutletTsx it wraps) won't be deleted
   /// until all these timers have popped or been cancelled.
-  std::set<TimerID> _pending_timers;
+  typedef std::set<TimerID, std::less<TimerID>, ArenaAllocator<TimerID> > Timers;
+  Timers _pending_timers;
+
+  /// The number of callbacks created by create_callback that haven't yet
+  /// been run.  As with timers, the SproutletWrapper won't be deleted while
+  /// any are outstanding.
+  int _pending_async;
+
+  /// Set when the Sproutlet creates a callback or a callback is run, and
+  /// cleared once the Sproutlet call has returned and its actions are being
+  /// processed.  Used to detect callbacks that are run synchronously.
+  bool _in_sproutlet_call;
 
   // The allowed host state for outbound requests from the sproutlet wrapped by
   // this wrapper.  If there are no addresses of the appropriate state (e.g.
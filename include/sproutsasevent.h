@@ -34,6 +34,7 @@ namespace SASEvent
   const int IGNORED_NP_DATA_FROM_ENUM = SPROUT_BASE + 0x00000C;
   const int NON_SIP_URI_FROM_ENUM = SPROUT_BASE + 0x00000D;
   const int NO_ENUM_LOOKUP_LOCAL_DN = SPROUT_BASE + 0x0000E;
+  const int ENUM_CACHE_HIT = SPROUT_BASE + 0x00000F;
 
   const int BGCF_FOUND_ROUTE_DOMAIN = SPROUT_BASE + 0x000010;
   const int BGCF_DEFAULT_ROUTE_DOMAIN = SPROUT_BASE + 0x000011;
@@ -134,6 +135,7 @@ namespace SASEvent
   const int HTTP_HOMESTEAD_AUTH_STATUS = SPROUT_BASE + 0x0000A4;
   const int HTTP_HOMESTEAD_LOCATION = SPROUT_BASE + 0x0000A5;
   const int HTTP_HOMESTEAD_BAD_IDENTITY = SPROUT_BASE + 0x0000A6;
+  const int HTTP_HOMESTEAD_SHARED_RESPONSE = SPROUT_BASE + 0x0000A7;
 
   const int INVALID_IFC_IGNORED = SPROUT_BASE + 0x0000C0;
   const int INVALID_XML_IGNORED = SPROUT_BASE + 0x0000C1;
@@ -17,8 +17,10 @@ extern "C" {
 #include <pjsip.h>
 }
 
+#include <algorithm>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include "sas.h"
 #include "quiescing_manager.h"
@@ -37,6 +39,8 @@ struct stack_data_struct
   pj_pool_t           *pool;
   pjsip_endpoint      *endpt;
   pj_thread_t         *pjsip_transport_thread;
+  std::vector<pj_thread_t*> pjsip_transport_threads;
+  int                  num_transport_threads;
   int                  pcscf_untrusted_port;
   pjsip_tpfactory     *pcscf_untrusted_tcp_factory;
   int                  pcscf_trusted_port;
@@ -84,7 +88,10 @@ inline bool is_pjsip_transport_thread()
   // This check doesn't make sense in UT, where we use a different threading model
   return true;
 #else
-  return (pj_thread_this() == stack_data.pjsip_transport_thread);
+  pj_thread_t* this_thread = pj_thread_this();
+  return (std::find(stack_data.pjsip_transport_threads.begin(),
+                    stack_data.pjsip_transport_threads.end(),
+                    this_thread) != stack_data.pjsip_transport_threads.end());
 #endif
 }
 
@@ -153,7 +160,8 @@ extern pj_status_t init_stack(int pcscf_trusted_port,
                               QuiescingManager *quiescing_mgr,
                               const std::string& cdf_domain,
                               std::vector<std::string> sproutlet_uris,
-                              bool enable_orig_sip_to_tel_coerce);
+                              bool enable_orig_sip_to_tel_coerce,
+                              int num_transport_threads = 1);
 extern pj_status_t start_pjsip_thread();
 extern pj_status_t stop_pjsip_thread();
 extern void stop_stack();
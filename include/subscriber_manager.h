@@ -27,6 +27,7 @@ extern "C" {
 #include "analyticslogger.h"
 #include "associated_uris.h"
 #include "hssconnection.h"
+#include "irs_info_cache.h"
 #include "ifchandler.h"
 #include "aor.h"
 #include "s4.h"
@@ -52,11 +53,14 @@ public:
   /// @param registration_sender
   ///                           - RegistrationSender class that knows how to send
   ///                             3rd party REGISTERs.
+  /// @param irs_info_cache     - Optional cache of subscriber data from the HSS,
+  ///                             used by get_subscriber_state for calls.
   SubscriberManager(S4* s4,
                     HSSConnection* hss_connection,
                     AnalyticsLogger* analytics_logger,
                     NotifySender* notify_sender,
-                    RegistrationSender* registration_sender);
+                    RegistrationSender* registration_sender,
+                    IrsInfoCache* irs_info_cache = NULL);
 
   /// Destructor.
   virtual ~SubscriberManager();
@@ -206,6 +210,11 @@ public:
   /// get_cached_subscriber_state() because it can result in a call to the HSS
   /// if Homestead does not have the information cached.
   ///
+  /// If SM has an IrsInfoCache, call queries that allow cached data are
+  /// answered from it where possible, taking the registration state from the
+  /// bindings in the registration store.  Any other query may change the
+  /// subscriber's registration state, so invalidates the cached data.
+  ///
   /// @param[in]  public_id     The public ID to get state for
   /// @param[out] irs_info      The IRS information for this public ID
   /// @param[in]  trail         The SAS trail ID
@@ -213,6 +222,22 @@ public:
                                         HSSConnection::irs_info& irs_info,
                                         SAS::TrailId trail);
 
+  /// Asynchronous version of get_subscriber_state, for Sproutlets.  Data in
+  /// the IrsInfoCache is returned immediately; otherwise the query is made on
+  /// one of the HSSConnection's threads.  Either way, on_complete is run on a
+  /// worker thread once irs_info and http_code have been filled in.
+  ///
+  /// @param[in]  irs_query     The query to make
+  /// @param[out] irs_info      The IRS information for this public ID
+  /// @param[out] http_code     The result of the query
+  /// @param[in]  trail         The SAS trail ID
+  /// @param[in]  on_complete   Callback to run when the query has completed
+  virtual void get_subscriber_state_async(const HSSConnection::irs_query& irs_query,
+                                          HSSConnection::irs_info& irs_info,
+                                          HTTPCode& http_code,
+                                          SAS::TrailId trail,
+                                          PJUtils::Callback* on_complete);
+
   /// Update the associated URIs stored in an AoR.
   ///
   /// @param[in]  aor_id        The AoR ID to lookup in the store. It is the
@@ -265,6 +290,7 @@ private:
   AnalyticsLogger* _analytics;
   NotifySender* _notify_sender;
   RegistrationSender* _registration_sender;
+  IrsInfoCache* _irs_info_cache;
 
   /// Internal functions that methods on the interface call.
   HTTPCode register_subscriber_internal(const std::string& aor_id,
@@ -292,6 +318,22 @@ private:
   void handle_timer_pop_internal(const std::string& aor_id,
                                  SAS::TrailId trail);
 
+  /// Helper function to invalidate any cached HSS data for a public ID and the
+  /// rest of its IRS.
+  void invalidate_cached_subscriber_state(const std::string& public_id,
+                                          HSSConnection::irs_info& irs_info);
+
+  /// Helper function to get the cached HSS data for a public ID, with the
+  /// registration state filled in from the registration store.  Returns false
+  /// if there is no cached data or the registration store can't be read.
+  bool get_cached_irs_info(const std::string& public_id,
+                           HSSConnection::irs_info& irs_info,
+                           SAS::TrailId trail);
+
+  /// Whether the result of a query can be answered from, and stored in, the
+  /// IrsInfoCache.
+  static bool is_cacheable(const HSSConnection::irs_query& irs_query);
+
   /// Helper function to get the default public ID from the HSS.
   HTTPCode get_cached_default_id(const std::string& public_id,
                                  std::string& aor_id,
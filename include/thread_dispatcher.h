@@ -28,6 +28,25 @@ extern "C" {
 #include "sip_event_priority.h"
 #include "eventq.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+// If num_queue_shards_arg is 0 or 1, all worker threads service a single
+// global event queue.  Otherwise events are spread across that many
+// independently locked queues, each worker thread services the queue with
+// index (worker index % num_queue_shards_arg) and steals from the others when
+// its own queue is empty.
+//
+// If rx_clone_bytes_tbl_arg is set, the memory allocated to copy each received
+// message for the worker threads is reported to it.
+//
+// If options_on_transport_thread_arg is true, OPTIONS polls targeted at this
+// node are answered directly on the transport thread, with the same response
+// as the OPTIONS module sends, rather than being queued to a worker thread.
 pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
                                    SNMP::EventAccumulatorByScopeTable* latency_tbl_arg,
                                    SNMP::EventAccumulatorByScopeTable* queue_size_tbl_arg,
@@ -36,7 +55,10 @@ pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
                                    LoadMonitor* load_monitor_arg,
                                    RPHService* rph_service_arg,
                                    ExceptionHandler* exception_handler_arg,
-                                   unsigned long request_on_queue_timeout);
+                                   unsigned long request_on_queue_timeout,
+                                   int num_queue_shards_arg = 0,
+                                   SNMP::EventAccumulatorTable* rx_clone_bytes_tbl_arg = NULL,
+                                   bool options_on_transport_thread_arg = false);
 
 void unregister_thread_dispatcher(void);
 
@@ -69,7 +91,16 @@ struct SipEvent
   // The event data itself
   SipEventData event_data;
 
-  SipEvent() : type(MESSAGE), priority(SIPEventPriorityLevel::NORMAL_PRIORITY) {}
+  // Sequence number assigned by ShardedSipEventQueue when the event is
+  // pushed, so that events on different shards can be ordered without reading
+  // their stop watches.
+  uint64_t sequence;
+
+  SipEvent() :
+    type(MESSAGE),
+    priority(SIPEventPriorityLevel::NORMAL_PRIORITY),
+    sequence(0)
+  {}
 
   // Compares two SipEvents. Returns true if rhs is 'larger' than lhs, where
   // 'larger' SipEvents are those that should be processed earlier.
@@ -98,6 +129,21 @@ struct SipEvent
       return lhs_us < rhs_us;
     }
   }
+
+  // As compare, but orders SipEvents at the same priority level by sequence
+  // number, so doesn't need to read the clock.
+  static bool compare_sequence(const SipEvent& lhs, const SipEvent& rhs)
+  {
+    if (lhs.priority != rhs.priority)
+    {
+      return lhs.priority < rhs.priority;
+    }
+    else
+    {
+      // Lower sequence numbers were queued earlier, so are 'larger'
+      return lhs.sequence > rhs.sequence;
+    }
+  }
 };
 
 // Internal method exposed for testing purposes. Pops a single element off the
@@ -149,4 +195,142 @@ public:
                       std::function<bool(SipEvent, SipEvent)> > _queue;
 };
 
+// Implements eventq::Backend as an array of FIFO queues, one per priority
+// level.  Events at the same priority level are returned in the order they
+// were pushed, which avoids reading every event's stop watch on each push and
+// pop as PriorityEventQueueBackend does.
+class BucketedEventQueueBackend : public eventq<SipEvent>::Backend
+{
+public:
+  static const int NUM_PRIORITY_LEVELS =
+    SIPEventPriorityLevel::HIGH_PRIORITY_15 + 1;
+
+  BucketedEventQueueBackend() : _size(0), _non_empty(0) {}
+  virtual ~BucketedEventQueueBackend() {}
+
+  virtual const SipEvent& front()
+  {
+    return _buckets[top_level()].front();
+  }
+
+  virtual bool empty()
+  {
+    return (_size == 0);
+  }
+
+  virtual int size()
+  {
+    return _size;
+  }
+
+  virtual void push(const SipEvent& value)
+  {
+    int level = std::min(std::max((int)value.priority, 0),
+                         NUM_PRIORITY_LEVELS - 1);
+    _buckets[level].push_back(value);
+    _non_empty |= (1u << level);
+    ++_size;
+  }
+
+  virtual void pop()
+  {
+    int level = top_level();
+    _buckets[level].pop_front();
+    if (_buckets[level].empty())
+    {
+      _non_empty &= ~(1u << level);
+    }
+    --_size;
+  }
+
+private:
+  // Returns the highest priority level with events queued.  Must only be
+  // called if the queue is not empty.
+  int top_level() const
+  {
+    return (31 - __builtin_clz(_non_empty));
+  }
+
+  std::deque<SipEvent> _buckets[NUM_PRIORITY_LEVELS];
+  int _size;
+
+  // Bitmask of the priority levels that have events queued.
+  uint32_t _non_empty;
+};
+
+/// A queue of SipEvents split into a number of shards, each with its own lock
+/// and its own BucketedEventQueueBackend.
+///
+/// Each worker thread has a home shard.  When popping, a worker compares the
+/// head of its home shard with the head of one other shard (chosen in
+/// rotation) and takes whichever should be processed first, so priority and
+/// age ordering is strict within a shard and approximately maintained across
+/// shards.  If its home shard is empty a worker steals from the other shards
+/// in turn, and only blocks once every shard is empty.
+///
+/// Deadlock detection follows eventq - the queue is deemed deadlocked if it is
+/// non-empty and no shard has been serviced within the threshold.
+class ShardedSipEventQueue
+{
+public:
+  ShardedSipEventQueue(int num_shards);
+  virtual ~ShardedSipEventQueue();
+
+  int num_shards() const { return _shards.size(); }
+
+  void set_deadlock_threshold(unsigned long threshold_ms);
+  bool is_deadlocked();
+
+  // Total number of events across all shards.
+  int size();
+
+  // Pushes an event onto the specified shard, or onto a lightly loaded shard
+  // if preferred_shard is negative.
+  void push(const SipEvent& event, int preferred_shard = -1);
+
+  // Pops the next event for a worker whose home shard is home_shard, blocking
+  // until an event is available.  Returns false if the queue has been
+  // terminated.
+  bool pop(SipEvent& event, int home_shard);
+
+  // Terminates the queue, waking all blocked workers, and returns any events
+  // that were still queued.
+  void terminate(std::vector<SipEvent>& remaining);
+
+private:
+  struct Shard
+  {
+    Shard();
+    ~Shard();
+
+    pthread_mutex_t lock;
+    BucketedEventQueueBackend queue;
+
+    // Number of events on this shard, readable without taking the lock.
+    std::atomic<int> size;
+
+    // Time (from CLOCK_MONOTONIC) that this shard was last serviced, or that
+    // it last became non-empty.
+    std::atomic<unsigned long> service_time_ms;
+  };
+
+  bool pop_best_of(int home_shard, int other_shard, SipEvent& event);
+  bool pop_from(int shard_ix, SipEvent& event);
+  void pop_locked(Shard* shard, SipEvent& event);
+
+  static unsigned long now_ms();
+
+  std::vector<Shard*> _shards;
+  std::atomic<unsigned int> _next_push_shard;
+  std::atomic<uint64_t> _next_sequence;
+  std::atomic<int> _size;
+  unsigned long _deadlock_threshold_ms;
+
+  // Workers park on this condition when every shard is empty.
+  pthread_mutex_t _idle_lock;
+  pthread_cond_t _idle_cond;
+  std::atomic<int> _num_idle;
+  std::atomic<bool> _terminated;
+};
+
 #endif
@@ -679,7 +679,10 @@ std::string RalfACR::get_message(pj_time_val timestamp)
     pj_gettimeofday(&timestamp);
   }
 
-  rapidjson::StringBuffer sb;
+  // Encode into a buffer owned by this thread, which keeps its capacity
+  // between messages, rather than growing a fresh buffer for every ACR.
+  static thread_local rapidjson::StringBuffer sb;
+  sb.Clear();
   rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
   writer.StartObject();
 
@@ -1278,7 +1281,7 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   writer.EndObject(); // End whole object
 
   // Render the message to a string and return it.
-  return sb.GetString();
+  return std::string(sb.GetString(), sb.GetSize());
 }
 
 void RalfACR::set_default_ccf(const std::string& default_ccf)
@@ -23,25 +23,136 @@
 #include <list>
 #include <queue>
 #include <string>
+#include <algorithm>
+#include <unordered_map>
 
+#include "log.h"
 #include "analyticslogger.h"
 
-AnalyticsLogger::AnalyticsLogger()
+/// Source of unique logger identifiers.
+static std::atomic<uint64_t> next_logger_id(1);
+
+thread_local std::unordered_map<uint64_t, AnalyticsLogger::Ring*> AnalyticsLogger::_thread_rings;
+
+AnalyticsLogger::AnalyticsLogger() :
+  AnalyticsLogger(0)
 {
 }
 
+AnalyticsLogger::AnalyticsLogger(size_t queue_size,
+                                 SNMP::CounterTable* dropped_tbl,
+                                 const WriteFn& write_fn) :
+  _queue_size(queue_size),
+  _write_fn(write_fn ? write_fn : &AnalyticsLogger::write_to_syslog),
+  _id(next_logger_id++),
+  _rings(),
+  _terminated(false),
+  _dropped(0),
+  _dropped_tbl(dropped_tbl)
+{
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_cond, NULL);
+
+  if (_queue_size > 0)
+  {
+    int rc = pthread_create(&_writer, NULL, &writer_thread, this);
+
+    if (rc != 0)
+    {
+      // LCOV_EXCL_START
+      TRC_ERROR("Failed to start analytics writer thread, logging synchronously");
+      _queue_size = 0;
+      // LCOV_EXCL_STOP
+    }
+  }
+}
+
 AnalyticsLogger::~AnalyticsLogger()
 {
+  stop();
+
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
+}
+
+void AnalyticsLogger::stop()
+{
+  if (_queue_size > 0)
+  {
+    // Tell the writer thread to write any remaining records and exit.
+    pthread_mutex_lock(&_lock);
+    bool terminated = _terminated;
+    _terminated = true;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    if (!terminated)
+    {
+      pthread_join(_writer, NULL);
+    }
+  }
 }
 
 void AnalyticsLogger::log_with_tag_and_timestamp(char* log)
 {
-  // Add the current UTC time, in RFC3339 format.
   struct timespec timespec;
-  struct tm dt;
   clock_gettime(CLOCK_REALTIME, &timespec);
-  gmtime_r(&timespec.tv_sec, &dt);
-  char timestamp[100];
+
+  if (_queue_size == 0)
+  {
+    char timestamp[100];
+    format_timestamp(timespec, timestamp);
+    _write_fn(timestamp, log);
+    return;
+  }
+
+  // Queue the record for the writer thread.  Only this thread adds to the
+  // ring buffer, so the space can't be taken between the check and the
+  // update of the tail.
+  Ring* ring = get_ring();
+  size_t tail = ring->tail.load(std::memory_order_relaxed);
+
+  if (tail - ring->head.load(std::memory_order_acquire) >= _queue_size)
+  {
+    ++_dropped;
+    if (_dropped_tbl)
+    {
+      _dropped_tbl->increment();
+    }
+    return;
+  }
+
+  Record& record = ring->records[tail % _queue_size];
+  record.ts = timespec;
+  strncpy(record.log, log, sizeof(record.log) - 1);
+  record.log[sizeof(record.log) - 1] = '\0';
+
+  // Publish the record, then check whether the writer thread has emptied the
+  // ring buffer up to it.  If so the writer thread may be waiting, so wake it
+  // up.  The update of the tail here and of the head on the writer thread are
+  // both sequentially consistent, so either this sees the writer thread's
+  // update or the writer thread sees the record before it waits.
+  ring->tail.store(tail + 1);
+
+  if (ring->head.load() == tail)
+  {
+    pthread_mutex_lock(&_lock);
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+  }
+}
+
+void AnalyticsLogger::write_to_syslog(const char* timestamp, const char* log)
+{
+  syslog(LOG_INFO, "<analytics> %s %s", timestamp, log);
+}
+
+void AnalyticsLogger::format_timestamp(const struct timespec& ts,
+                                       char* timestamp)
+{
+  // Format the UTC time in RFC3339 format.
+  struct tm dt;
+  gmtime_r(&ts.tv_sec, &dt);
   sprintf(timestamp,
           "%4.4d-%2.2d-%2.2dT%2.2d:%2.2d:%2.2d.%3.3d+00:00",
           (dt.tm_year + 1900),
@@ -50,9 +161,125 @@ void AnalyticsLogger::log_with_tag_and_timestamp(char* log)
           dt.tm_hour,
           dt.tm_min,
           dt.tm_sec,
-          (int)(timespec.tv_nsec / 1000000));
+          (int)(ts.tv_nsec / 1000000));
+}
 
-  syslog(LOG_INFO, "<analytics> %s %s", timestamp, log);
+AnalyticsLogger::Ring* AnalyticsLogger::get_ring()
+{
+  Ring*& ring = _thread_rings[_id];
+
+  if (ring == NULL)
+  {
+    ring = new Ring(_queue_size);
+    pthread_mutex_lock(&_lock);
+    _rings.push_back(std::unique_ptr<Ring>(ring));
+    pthread_mutex_unlock(&_lock);
+  }
+
+  return ring;
+}
+
+void* AnalyticsLogger::writer_thread(void* p)
+{
+  ((AnalyticsLogger*)p)->writer();
+  return NULL;
+}
+
+void AnalyticsLogger::writer()
+{
+  std::vector<Record*> batch;
+  std::vector<std::pair<Ring*, size_t>> drained;
+  char timestamp[100];
+
+  while (true)
+  {
+    if (!drain(batch, drained))
+    {
+      // Wait until a record is queued or the logger is stopped.  The ring
+      // buffers are checked again under the lock, so a record queued since
+      // they were drained can't be missed.
+      pthread_mutex_lock(&_lock);
+      while ((!_terminated) && (rings_empty()))
+      {
+        pthread_cond_wait(&_cond, &_lock);
+      }
+      bool done = rings_empty();
+      pthread_mutex_unlock(&_lock);
+
+      if (done)
+      {
+        // The logger has been stopped and everything queued before then has
+        // been written.
+        break;
+      }
+
+      continue;
+    }
+
+    // Records from different threads are interleaved by the time they were
+    // made, so the output is in the same order as synchronous logging would
+    // give.
+    std::stable_sort(batch.begin(),
+                     batch.end(),
+                     [](const Record* a, const Record* b)
+                     {
+                       return (a->ts.tv_sec < b->ts.tv_sec) ||
+                              ((a->ts.tv_sec == b->ts.tv_sec) &&
+                               (a->ts.tv_nsec < b->ts.tv_nsec));
+                     });
+
+    for (Record* record : batch)
+    {
+      format_timestamp(record->ts, timestamp);
+      _write_fn(timestamp, record->log);
+    }
+
+    // Only now release the space in the ring buffers, since the batch points
+    // into them.
+    for (const std::pair<Ring*, size_t>& ring : drained)
+    {
+      ring.first->head.store(ring.second);
+    }
+  }
+}
+
+bool AnalyticsLogger::drain(std::vector<Record*>& batch,
+                            std::vector<std::pair<Ring*, size_t>>& drained)
+{
+  batch.clear();
+  drained.clear();
+
+  pthread_mutex_lock(&_lock);
+  for (const std::unique_ptr<Ring>& ring : _rings)
+  {
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t tail = ring->tail.load(std::memory_order_acquire);
+
+    if (tail != head)
+    {
+      for (size_t ii = head; ii != tail; ++ii)
+      {
+        batch.push_back(&ring->records[ii % _queue_size]);
+      }
+      drained.push_back(std::make_pair(ring.get(), tail));
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+
+  return !batch.empty();
+}
+
+bool AnalyticsLogger::rings_empty() const
+{
+  for (const std::unique_ptr<Ring>& ring : _rings)
+  {
+    if (ring->tail.load() != ring->head.load(std::memory_order_relaxed))
+    {
+      return false;
+    }
+  }
+
+  return true;
 }
 
 void AnalyticsLogger::registration(const std::string& aor,
@@ -0,0 +1,53 @@
+/**
+ * @file arena.cpp  Bump allocator for objects that share a lifetime.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <stdint.h>
+
+#include "log.h"
+#include "arena.h"
+
+Arena::Arena(pjsip_endpoint* endpt, const char* name, size_t block_size) :
+  _endpt(endpt),
+  _pool(NULL),
+  _bytes_allocated(0)
+{
+  _pool = pjsip_endpt_create_pool(_endpt, name, block_size, block_size);
+}
+
+Arena::~Arena()
+{
+  if (_pool != NULL)
+  {
+    pjsip_endpt_release_pool(_endpt, _pool);
+    _pool = NULL;
+  }
+}
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+  // PJSIP pools only guarantee PJ_POOL_ALIGNMENT, so allocate enough to align
+  // the memory ourselves.
+  char* p = (_pool != NULL) ?
+              (char*)pj_pool_alloc(_pool, size + alignment - 1) : NULL;
+
+  if (p == NULL)
+  {
+    // LCOV_EXCL_START
+    TRC_ERROR("Failed to allocate %lu bytes from arena", size);
+    throw std::bad_alloc();
+    // LCOV_EXCL_STOP
+  }
+
+  _bytes_allocated += size;
+
+  uintptr_t addr = (uintptr_t)p;
+  return (void*)((addr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
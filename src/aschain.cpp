@@ -49,7 +49,6 @@ AsChain::AsChain(AsChainTable* as_chain_table,
   _fallback_ifcs({}),
   _ifc_configuration(ifc_configuration),
   _using_standard_ifcs(true),
-  _root(NULL),
   _scscf_uri(scscf_uri)
 {
   TRC_DEBUG("Creating AsChain %p with %d iFCs and adding to map", this, ifcs.size());
@@ -67,8 +66,7 @@ AsChain::AsChain(AsChainTable* as_chain_table,
 
   if ((fifc_service) && (_ifc_configuration._apply_fallback_ifcs))
   {
-    _root = new rapidxml::xml_document<>;
-    _fallback_ifcs = fifc_service->get_fallback_ifcs(_root);
+    _fallback_ifcs = fifc_service->get_fallback_ifcs();
   }
 }
 
@@ -100,7 +98,6 @@ AsChain::~AsChain()
 
   _as_chain_table->unregister(_odi_tokens);
 
-  delete _root; _root = NULL;
 }
 
 
@@ -30,6 +30,13 @@ const std::string AstaireImpiStore::TABLE_IMPI = "impi";
 // JSON field names and values.
 static const char* const JSON_AUTH_CHALLENGES = "authChallenges";
 
+// The compact binary encoding starts with a byte that can't start a JSON
+// object, followed by the version of the encoding.  The rest of version 1 is
+// the number of AuthChallenges, followed by each AuthChallenge prefixed with
+// its length.
+static const char BINARY_MARKER = '\0';
+static const uint8_t BINARY_VERSION = 1;
+
 std::string AstaireImpiStore::Impi::to_json()
 {
   // Build a writer, serialize the IMPI to it and return the result.
@@ -68,6 +75,88 @@ void AstaireImpiStore::Impi::write_json(rapidjson::Writer<rapidjson::StringBuffe
   // The private ID itself is part of the key, so isn't stored in the JSON itself.
 }
 
+std::string AstaireImpiStore::Impi::to_binary()
+{
+  // Only write the AuthChallenges that haven't expired, as for JSON.
+  int now = time(NULL);
+  std::vector<std::string> records;
+  for (std::vector<ImpiStore::AuthChallenge*>::iterator it = auth_challenges.begin();
+       it != auth_challenges.end();
+       it++)
+  {
+    if ((*it)->get_expires() > now)
+    {
+      records.push_back(std::string());
+      (*it)->write_binary(records.back());
+    }
+  }
+
+  std::string data;
+  data.push_back(BINARY_MARKER);
+  data.push_back((char)BINARY_VERSION);
+  write_varint(data, records.size());
+  for (const std::string& record : records)
+  {
+    write_string(data, record);
+  }
+  return data;
+}
+
+bool AstaireImpiStore::is_binary(const std::string& data)
+{
+  return (!data.empty()) && (data[0] == BINARY_MARKER);
+}
+
+AstaireImpiStore::Impi* AstaireImpiStore::from_binary(const std::string& impi,
+                                                      const std::string& data)
+{
+  BinaryReader reader(data);
+  uint8_t marker;
+  uint8_t version;
+  uint64_t count;
+
+  if ((!reader.read_byte(marker)) ||
+      (!reader.read_byte(version)) ||
+      (marker != (uint8_t)BINARY_MARKER))
+  {
+    TRC_WARNING("Binary IMPI is truncated - dropping");
+    return NULL;
+  }
+
+  if (version != BINARY_VERSION)
+  {
+    TRC_WARNING("Unsupported binary IMPI version %u - dropping", version);
+    return NULL;
+  }
+
+  if (!reader.read_varint(count))
+  {
+    TRC_WARNING("Binary IMPI is truncated - dropping");
+    return NULL;
+  }
+
+  // Each AuthChallenge is prefixed with its length, so one we can't parse
+  // doesn't stop us reading the rest.
+  AstaireImpiStore::Impi* impi_obj = new AstaireImpiStore::Impi(impi);
+  for (uint64_t ii = 0; ii < count; ii++)
+  {
+    std::string record;
+    if (!reader.read_string(record))
+    {
+      TRC_WARNING("Binary IMPI is truncated - ignoring remaining challenges");
+      break;
+    }
+
+    ImpiStore::AuthChallenge* auth_challenge = ImpiStore::AuthChallenge::from_binary(record);
+    if (auth_challenge != NULL)
+    {
+      impi_obj->auth_challenges.push_back(auth_challenge);
+    }
+  }
+
+  return impi_obj;
+}
+
 AstaireImpiStore::Impi* AstaireImpiStore::from_json(const std::string& impi, const std::string& json)
 {
   // Simply parse the string to JSON, and then call through to the
@@ -114,8 +203,9 @@ AstaireImpiStore::Impi* AstaireImpiStore::from_json(const std::string& impi, rap
   return impi_obj;
 }
 
-AstaireImpiStore::AstaireImpiStore(Store* data_store) :
-  _data_store(data_store)
+AstaireImpiStore::AstaireImpiStore(Store* data_store, bool binary) :
+  _data_store(data_store),
+  _binary(binary)
 {
 }
 
@@ -130,15 +220,25 @@ Store::Status AstaireImpiStore::set_impi(ImpiStore::Impi* impi,
   int now = time(NULL);
 
   // First serialize the IMPI and set it in the store.
-  std::string data = astaire_impi->to_json();
-  TRC_DEBUG("Storing IMPI for %s\n%s", impi->impi.c_str(), data.c_str());
+  std::string data;
+  if (_binary)
+  {
+    data = astaire_impi->to_binary();
+    TRC_DEBUG("Storing binary IMPI for %s (%lu bytes)", impi->impi.c_str(), data.size());
+  }
+  else
+  {
+    data = astaire_impi->to_json();
+    TRC_DEBUG("Storing JSON IMPI for %s\n%s", impi->impi.c_str(), data.c_str());
+  }
+
   Store::Status status = _data_store->set_data(TABLE_IMPI,
                                                astaire_impi->impi,
                                                data,
                                                astaire_impi->_cas,
                                                astaire_impi->get_expires() - now,
                                                trail,
-                                               Store::Format::JSON);
+                                               store_format());
   if (status == Store::Status::OK)
   {
     SAS::Event event(trail, SASEvent::IMPISTORE_IMPI_SET_SUCCESS, 0);
@@ -168,7 +268,9 @@ ImpiStore::Impi* AstaireImpiStore::get_impi(const std::string& impi,
                                             SAS::TrailId trail,
                                             bool include_expired)
 {
-  // Get the IMPI data from the store and deserialize it.
+  // Get the IMPI data from the store and deserialize it.  The store has to be
+  // told the format before the data is read, so assume it is in the encoding
+  // we write.  It may not be while the binary encoding is being turned on.
   AstaireImpiStore::Impi* impi_obj = NULL;
   std::string data;
   uint64_t cas;
@@ -177,15 +279,24 @@ ImpiStore::Impi* AstaireImpiStore::get_impi(const std::string& impi,
                                                data,
                                                cas,
                                                trail,
-                                               Store::Format::JSON);
+                                               store_format());
   if (status == Store::Status::OK)
   {
-    TRC_DEBUG("Retrieved IMPI for %s\n%s", impi.c_str(), data.c_str());
     SAS::Event event(trail, SASEvent::IMPISTORE_IMPI_GET_SUCCESS, 0);
     event.add_var_param(impi);
     SAS::report_event(event);
 
-    impi_obj = AstaireImpiStore::from_json(impi, data);
+    if (is_binary(data))
+    {
+      TRC_DEBUG("Retrieved binary IMPI for %s (%lu bytes)", impi.c_str(), data.size());
+      impi_obj = AstaireImpiStore::from_binary(impi, data);
+    }
+    else
+    {
+      TRC_DEBUG("Retrieved JSON IMPI for %s\n%s", impi.c_str(), data.c_str());
+      impi_obj = AstaireImpiStore::from_json(impi, data);
+    }
+
     if (impi_obj == NULL)
     {
       // IMPI was corrupt. Create a new one.
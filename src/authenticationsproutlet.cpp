@@ -59,7 +59,8 @@ AuthenticationSproutlet::AuthenticationSproutlet(const std::string& name,
                                                  AnalyticsLogger* analytics_logger,
                                                  SNMP::AuthenticationStatsTables* auth_stats_tbls,
                                                  bool nonce_count_supported_arg,
-                                                 int cfg_max_expires) :
+                                                 int cfg_max_expires,
+                                                 ImpiReplicator* impi_replicator) :
   Sproutlet(name, port, uri, "", aliases, NULL, NULL, network_function),
   _aka_realm((realm_name != "") ?
     pj_strdup3(stack_data.pool, realm_name.c_str()) :
@@ -69,6 +70,7 @@ AuthenticationSproutlet::AuthenticationSproutlet(const std::string& name,
   _acr_factory(rfacr_factory),
   _impi_store(_impi_store),
   _remote_impi_stores(remote_impi_stores),
+  _impi_replicator(impi_replicator),
   _analytics(analytics_logger),
   _auth_stats_tables(auth_stats_tbls),
   _nonce_count_supported(nonce_count_supported_arg),
@@ -254,11 +256,16 @@ AuthenticationSproutletTsx::AuthenticationSproutletTsx(AuthenticationSproutlet*
   CompositeSproutletTsx(authentication, next_hop_service),
   _authentication(authentication),
   _authenticated_using_sip_digest(false),
-  _scscf_uri()
+  _scscf_uri(),
+  _hss_rc(HTTP_OK),
+  _hss_av_doc(NULL)
 {
 }
 
-AuthenticationSproutletTsx::~AuthenticationSproutletTsx() {}
+AuthenticationSproutletTsx::~AuthenticationSproutletTsx()
+{
+  delete _hss_av_doc; _hss_av_doc = NULL;
+}
 
 // Retrieve the digest credentials (from the Authorization header for REGISTERs, and the
 // Proxy-Authorization header otherwise).
@@ -528,7 +535,8 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
                                                   pj_bool_t stale,
                                                   std::string resync,
                                                   pjsip_msg* req,
-                                                  pjsip_msg* rsp)
+                                                  pjsip_msg* rsp,
+                                                  ACR* acr)
 {
   // Get the public and private identities from the request.
   std::string impi;
@@ -575,22 +583,40 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
     TRC_DEBUG("Get AV from HSS for impi=%s impu=%s",
               impi.c_str(), impu_for_hss.c_str());
 
-    rapidjson::Document* doc = NULL;
-    HTTPCode http_code = _authentication->_hss->get_auth_vector(impi,
-                                                                impu_for_hss,
-                                                                auth_type,
-                                                                resync,
-                                                                _scscf_uri,
-                                                                doc,
-                                                                trail());
-    av_source_unavailable = ((http_code == HTTP_SERVER_UNAVAILABLE) ||
-                             (http_code == HTTP_GATEWAY_TIMEOUT));
-
-    if (doc != NULL)
-    {
-      av = verify_auth_vector(doc, impi);
-    }
-    delete doc; doc = NULL;
+    // Don't block this thread waiting for the HSS - build the challenge once
+    // the AV has been retrieved.
+    _authentication->_hss->get_auth_vector_async(
+      impi,
+      impu_for_hss,
+      auth_type,
+      resync,
+      _scscf_uri,
+      _hss_rc,
+      _hss_av_doc,
+      trail(),
+      create_callback([this, stale, impi, impu_for_hss, req, rsp, acr]() -> void
+      {
+        bool av_source_unavailable = ((_hss_rc == HTTP_SERVER_UNAVAILABLE) ||
+                                      (_hss_rc == HTTP_GATEWAY_TIMEOUT));
+        AuthenticationVector* av = NULL;
+
+        if (_hss_av_doc != NULL)
+        {
+          av = verify_auth_vector(_hss_av_doc, impi);
+        }
+        delete _hss_av_doc; _hss_av_doc = NULL;
+
+        add_challenge(av,
+                      av_source_unavailable,
+                      stale,
+                      impi,
+                      impu_for_hss,
+                      NULL,
+                      req,
+                      rsp);
+        send_final_response(req, rsp, acr);
+      }));
+    return;
   }
   else
   {
@@ -625,6 +651,26 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
     }
   }
 
+  add_challenge(av,
+                av_source_unavailable,
+                stale,
+                impi,
+                impu_for_hss,
+                impi_obj,
+                req,
+                rsp);
+  send_final_response(req, rsp, acr);
+}
+
+void AuthenticationSproutletTsx::add_challenge(AuthenticationVector* av,
+                                               bool av_source_unavailable,
+                                               pj_bool_t stale,
+                                               const std::string& impi,
+                                               const std::string& impu_for_hss,
+                                               ImpiStore::Impi* impi_obj,
+                                               pjsip_msg* req,
+                                               pjsip_msg* rsp)
+{
   if (av != NULL)
   {
     // Retrieved a valid authentication vector, so generate the challenge.
@@ -1233,7 +1279,10 @@ void AuthenticationSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     }
 
     rsp = create_response(req, static_cast<pjsip_status_code>(sc));
-    create_challenge(credentials, stale, resync, req, rsp);
+
+    // This sends the response, possibly once the HSS has returned an AV.
+    create_challenge(credentials, stale, resync, req, rsp, acr);
+    return;
   }
   else
   {
@@ -1278,6 +1327,13 @@ void AuthenticationSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     rsp = create_response(req, static_cast<pjsip_status_code>(sc));
   }
 
+  send_final_response(req, rsp, acr);
+}
+
+void AuthenticationSproutletTsx::send_final_response(pjsip_msg* req,
+                                                     pjsip_msg* rsp,
+                                                     ACR* acr)
+{
   // Send the ACR.
   acr->tx_response(rsp);
   acr->send();
@@ -1332,7 +1388,22 @@ Store::Status AuthenticationSproutlet::write_challenge(const std::string& impi,
                                                   impi_obj,
                                                   trail);
 
-  if ((status == Store::OK) && !_remote_impi_stores.empty())
+  if ((status == Store::OK) && (_impi_replicator != NULL))
+  {
+    // Queue the writes to the backup stores on the replication threads, each
+    // writing a copy of the challenge, as the caller owns this one.  The IMPI
+    // object was read from the local store, so its CAS is no use for the
+    // backup stores.
+    TRC_DEBUG("Replicate challenge to backup stores asynchronously");
+    std::shared_ptr<const ImpiStore::AuthChallenge> challenge(auth_challenge->clone());
+
+    _impi_replicator->write([impi, challenge, trail](ImpiStore* store)
+    {
+      std::unique_ptr<ImpiStore::AuthChallenge> copy(challenge->clone());
+      write_challenge_to_store(store, impi, copy.get(), NULL, trail);
+    });
+  }
+  else if ((status == Store::OK) && !_remote_impi_stores.empty())
   {
     TRC_DEBUG("Replicate challenge to backup stores");
 
@@ -1441,6 +1512,22 @@ ImpiStore::Impi* AuthenticationSproutlet::read_impi(const std::string& impi,
     TRC_DEBUG("Got an empty IMPI object - try backup stores (%d in total)",
               _remote_impi_stores.size());
 
+    if (_impi_replicator != NULL)
+    {
+      // Read from all the backup stores at once, and use whichever finds
+      // challenges first.
+      ImpiStore::Impi* backup_impi_obj = _impi_replicator->read_impi(impi, trail);
+
+      if (backup_impi_obj != NULL)
+      {
+        TRC_DEBUG("Found IMPI in backup store");
+        impi_obj->auth_challenges = std::move(backup_impi_obj->auth_challenges);
+        delete backup_impi_obj; backup_impi_obj = NULL;
+      }
+
+      return impi_obj;
+    }
+
     for (ImpiStore* store: _remote_impi_stores)
     {
       TRC_DEBUG("Try to get IMPI from backup store");
@@ -24,6 +24,7 @@
 #include "sprout_pd_definitions.h"
 
 BgcfService::BgcfService(std::string configuration) :
+  _routes(new Routes()),
   _configuration(configuration),
   _updater(NULL)
 {
@@ -77,8 +78,7 @@ void BgcfService::update_routes()
 
   try
   {
-    std::map<std::string, std::vector<std::string>> new_domain_routes;
-    std::map<std::string, std::vector<std::string>> new_number_routes;
+    std::shared_ptr<Routes> new_routes = std::make_shared<Routes>();
 
     JSON_ASSERT_CONTAINS(doc, "routes");
     JSON_ASSERT_ARRAY(doc["routes"]);
@@ -116,14 +116,14 @@ void BgcfService::update_routes()
         if ((*routes_it).HasMember("domain"))
         {
           routing_value = (*routes_it)["domain"].GetString();
-          new_domain_routes.insert(std::make_pair(routing_value, route_vec));
+          new_routes->domain_routes.insert(std::make_pair(routing_value, route_vec));
         }
         else
         {
           routing_value = (*routes_it)["number"].GetString();
-          new_number_routes.insert(
-                    std::make_pair(Utils::remove_visual_separators(routing_value),
-                                   route_vec));
+          new_routes->number_routes.insert(
+                                Utils::remove_visual_separators(routing_value),
+                                route_vec);
         }
 
         route_vec.clear();
@@ -137,10 +137,9 @@ void BgcfService::update_routes()
       }
     }
 
-    // Take a write lock on the mutex in RAII style
-    boost::lock_guard<boost::shared_mutex> write_lock(_routes_rw_lock);
-    _domain_routes = new_domain_routes;
-    _number_routes = new_number_routes;
+    // Swap in the new routes.  Lookups in progress keep the old routes alive
+    // until they have finished with them.
+    std::atomic_store(&_routes, std::shared_ptr<const Routes>(new_routes));
   }
   catch (JsonFormatError err)
   {
@@ -162,13 +161,13 @@ std::vector<std::string> BgcfService::get_route_from_domain(
 {
   TRC_DEBUG("Getting route for URI domain %s via BGCF lookup", domain.c_str());
 
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_routes_rw_lock);
+  // Take a reference to the current routes.
+  std::shared_ptr<const Routes> routes = std::atomic_load(&_routes);
 
   // First try the specified domain.
   std::map<std::string, std::vector<std::string>>::const_iterator i =
-                                                    _domain_routes.find(domain);
-  if (i != _domain_routes.end())
+                                           routes->domain_routes.find(domain);
+  if (i != routes->domain_routes.end())
   {
     TRC_INFO("Found route to domain %s", domain.c_str());
 
@@ -188,8 +187,8 @@ std::vector<std::string> BgcfService::get_route_from_domain(
   }
 
   // Then try the default domain (*).
-  i = _domain_routes.find("*");
-  if (i != _domain_routes.end())
+  i = routes->domain_routes.find("*");
+  if (i != routes->domain_routes.end())
   {
     TRC_INFO("Found default route");
 
@@ -219,44 +218,34 @@ std::vector<std::string> BgcfService::get_route_from_number(
                                                 const std::string &number,
                                                 SAS::TrailId trail) const
 {
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_routes_rw_lock);
-
-  // The number routes map is ordered by length of key. Start from the end of
-  // the map to get the longest prefixes first.
-  for (std::map<std::string, std::vector<std::string>>::const_reverse_iterator it =
-        _number_routes.rbegin();
-       it != _number_routes.rend();
-       it++)
-  {
-    int len = std::min(number.size(), (*it).first.size());
-
-    if (Utils::remove_visual_separators(number).compare(0,
-                                                        len,
-                                                        (*it).first,
-                                                        0,
-                                                        len) == 0)
-    {
-      // Found a match, so return it
-      TRC_DEBUG("Match found. Number: %s, prefix: %s",
-                number.c_str(), (*it).first.c_str());
+  // Take a reference to the current routes.
+  std::shared_ptr<const Routes> routes = std::atomic_load(&_routes);
 
-      SAS::Event event(trail, SASEvent::BGCF_FOUND_ROUTE_NUMBER, 0);
-      event.add_var_param(number);
-      std::string route_string;
+  // Find the most specific matching prefix, normalising the number once.
+  std::string normalised_number = Utils::remove_visual_separators(number);
+  const std::vector<std::string>* route =
+                           routes->number_routes.find(normalised_number);
 
-      for (std::vector<std::string>::const_iterator ii = (*it).second.begin();
-                                                    ii != (*it).second.end();
-                                                    ++ii)
-      {
-        route_string = route_string + *ii + ";";
-      }
+  if (route != NULL)
+  {
+    // Found a match, so return it
+    TRC_DEBUG("Match found. Number: %s", number.c_str());
 
-      event.add_var_param(route_string);
-      SAS::report_event(event);
+    SAS::Event event(trail, SASEvent::BGCF_FOUND_ROUTE_NUMBER, 0);
+    event.add_var_param(number);
+    std::string route_string;
 
-      return (*it).second;
+    for (std::vector<std::string>::const_iterator ii = route->begin();
+                                                  ii != route->end();
+                                                  ++ii)
+    {
+      route_string = route_string + *ii + ";";
     }
+
+    event.add_var_param(route_string);
+    SAS::report_event(event);
+
+    return *route;
   }
 
   SAS::Event event(trail, SASEvent::BGCF_NO_ROUTE_NUMBER, 0);
@@ -0,0 +1,136 @@
+/**
+ * @file binding_target_cache.cpp  Process-wide cache of parsed bindings.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include "log.h"
+#include "constants.h"
+#include "pjutils.h"
+#include "binding_target_cache.h"
+
+void ParsedBinding::parse(const Binding& binding, pj_pool_t* pool)
+{
+  uri = PJUtils::uri_from_string(binding._uri, pool);
+  paths.clear();
+  bad_path.clear();
+
+  if (uri == NULL)
+  {
+    return;
+  }
+
+  for (std::string path : binding._path_headers)
+  {
+    pjsip_route_hdr* path_hdr = (pjsip_route_hdr*)pjsip_parse_hdr(pool,
+                                                                  &STR_ROUTE,
+                                                                  (char*)path.c_str(),
+                                                                  strlen(path.c_str()),
+                                                                  NULL);
+    if (path_hdr != NULL)
+    {
+      // We need to clone the header here, as it points into path, which is
+      // about to be freed.
+      paths.push_back((pjsip_route_hdr*)pjsip_hdr_clone(pool, path_hdr));
+    }
+    else
+    {
+      bad_path = path;
+      break;
+    }
+  }
+}
+
+void ParsedBinding::clone(pj_pool_t* pool, ParsedBinding& copy) const
+{
+  copy.uri = (uri != NULL) ? (pjsip_uri*)pjsip_uri_clone(pool, uri) : NULL;
+  copy.paths.clear();
+
+  for (pjsip_route_hdr* path_hdr : paths)
+  {
+    copy.paths.push_back((pjsip_route_hdr*)pjsip_hdr_clone(pool, path_hdr));
+  }
+
+  copy.bad_path = bad_path;
+}
+
+class BindingTargetCache::Entry : public ParsedBinding
+{
+public:
+  Entry(const Binding& binding, pj_pool_factory* pool_factory)
+  {
+    _pool = pj_pool_create(pool_factory, "binding", 512, 512, NULL);
+    parse(binding, _pool);
+  }
+
+  ~Entry()
+  {
+    pj_pool_release(_pool);
+  }
+
+private:
+  pj_pool_t* _pool;
+};
+
+BindingTargetCache* BindingTargetCache::_instance = NULL;
+
+BindingTargetCache::BindingTargetCache(pj_pool_factory* pool_factory,
+                                       size_t capacity,
+                                       int num_shards) :
+  _pool_factory(pool_factory),
+  _cache(capacity, num_shards)
+{
+  TRC_STATUS("Created binding target cache with %lu shards of %lu bindings",
+             _cache.num_shards(), _cache.shard_capacity());
+}
+
+BindingTargetCache::~BindingTargetCache()
+{
+}
+
+std::shared_ptr<const ParsedBinding> BindingTargetCache::get(const Binding& binding)
+{
+  std::string k = key(binding);
+  std::shared_ptr<const Entry> entry;
+
+  if (!_cache.get(k, entry))
+  {
+    // Parse the binding outside the cache's lock, as this is the expensive
+    // part.
+    entry = std::make_shared<Entry>(binding, _pool_factory);
+    TRC_DEBUG("Parsed binding %s", binding._uri.c_str());
+    _cache.put(k, entry);
+  }
+
+  return entry;
+}
+
+std::shared_ptr<const ParsedBinding> BindingTargetCache::lookup(const Binding& binding)
+{
+  if (_instance != NULL)
+  {
+    return _instance->get(binding);
+  }
+
+  return std::shared_ptr<const ParsedBinding>();
+}
+
+std::string BindingTargetCache::key(const Binding& binding)
+{
+  // Neither URIs nor header values can contain a raw line break, so use one
+  // to separate the contact URI and the Path headers.
+  std::string key = binding._uri;
+
+  for (const std::string& path : binding._path_headers)
+  {
+    key.append("\n");
+    key.append(path);
+  }
+
+  return key;
+}
@@ -14,6 +14,7 @@
 #include "pjutils.h"
 #include "sproutsasevent.h"
 #include "aor_utils.h"
+#include "binding_target_cache.h"
 
 #include <limits>
 #include <boost/algorithm/string.hpp>
@@ -70,6 +71,19 @@ void filter_bindings_to_targets(const std::string& aor,
                        accept_headers,
                        reject_headers);
 
+  // Convert the feature sets to strings once, rather than for every binding.
+  std::vector<FeaturePredicate> accept_predicates;
+  for (pjsip_accept_contact_hdr* accept : accept_headers)
+  {
+    accept_predicates.push_back(to_feature_predicate(accept));
+  }
+
+  std::vector<FeaturePredicate> reject_predicates;
+  for (pjsip_reject_contact_hdr* reject : reject_headers)
+  {
+    reject_predicates.push_back(to_feature_predicate(reject));
+  }
+
   // Iterate over the Bindings, checking if they're valid and creating a target
   // if so.
   int bindings_rejected_due_to_gruu = 0;
@@ -125,11 +139,11 @@ void filter_bindings_to_targets(const std::string& aor,
     }
 
     // Perform Reject-Contact filtering.
-    for (std::vector<pjsip_reject_contact_hdr*>::iterator reject = reject_headers.begin();
-         reject != reject_headers.end() && (!rejected);
+    for (std::vector<FeaturePredicate>::const_iterator reject = reject_predicates.begin();
+         reject != reject_predicates.end() && (!rejected);
          ++reject)
     {
-      if (match_feature_sets(binding->second->_params, *reject) == YES)
+      if (match_reject_predicate(binding->second->_params, *reject) == YES)
       {
         TRC_DEBUG("Rejecting Contact: header matching Reject-Contact header");
         // TODO SAS log.
@@ -141,14 +155,14 @@ void filter_bindings_to_targets(const std::string& aor,
     // headers, Accept-Contact headers have a "require" parameter,
     // which determines whetner to reject or just deprioritise
     // non-matching bindings.
-    for (std::vector<pjsip_accept_contact_hdr*>::iterator accept = accept_headers.begin();
-         accept != accept_headers.end() && (!rejected);
+    for (std::vector<FeaturePredicate>::const_iterator accept = accept_predicates.begin();
+         accept != accept_predicates.end() && (!rejected);
          ++accept)
     {
-      MatchResult accept_rc = match_feature_sets(binding->second->_params, *accept);
+      MatchResult accept_rc = match_accept_predicate(binding->second->_params, *accept);
       if (accept_rc == NO)
       {
-        if ((*accept)->required_match) {
+        if (accept->required_match) {
           TRC_DEBUG("Rejecting Contact: header matching Accept-Contact header");
           // TODO SAS log.
           rejected = true;
@@ -218,10 +232,24 @@ bool binding_to_target(const std::string& aor,
 {
   bool valid = true;
 
+  // Use the parsed form of the binding from the cache if there is one, so we
+  // only need to copy it into the pool.
+  ParsedBinding parsed;
+  std::shared_ptr<const ParsedBinding> cached = BindingTargetCache::lookup(binding);
+
+  if (cached)
+  {
+    cached->clone(pool, parsed);
+  }
+  else
+  {
+    parsed.parse(binding, pool);
+  }
+
   target.from_store = true;
   target.aor = aor;
   target.binding_id = binding_id;
-  target.uri = PJUtils::uri_from_string(binding._uri, pool);
+  target.uri = parsed.uri;
   target.deprioritized = deprioritized;
   target.contact_expiry = binding._expires;
   target.contact_q1000_value = binding._priority;
@@ -233,43 +261,24 @@ bool binding_to_target(const std::string& aor,
     // TODO SAS log
     valid = false;
   }
-  else
+  else if (!parsed.bad_path.empty())
+  {
+    TRC_WARNING("Ignoring contact %s for target %s because of badly formed path header %s",
+                binding._uri.c_str(), aor.c_str(), parsed.bad_path.c_str());
+    // TODO SAS log
+    valid = false;
+  }
+  else if (!parsed.paths.empty())
   {
     // Fill in the paths parameter for the target.
+    target.paths.assign(parsed.paths.begin(), parsed.paths.end());
+  }
+  else
+  {
     // If _path_headers is empty no paths parameter is set.
-    if (!binding._path_headers.empty())
-    {
-      for (std::string path : binding._path_headers)
-      {
-        pjsip_route_hdr* path_hdr = (pjsip_route_hdr*)pjsip_parse_hdr(pool,
-                                                                      &STR_ROUTE,
-                                                                      (char*)path.c_str(),
-                                                                      strlen(path.c_str()),
-                                                                      NULL);
-        if (path_hdr != NULL)
-        {
-          // We need to clone the message here so that we can delete path_str.
-          // If didn't clone the header we would free memory in the header when
-          // deleting path_str.
-          pjsip_route_hdr* path_hdr_clone = (pjsip_route_hdr*)pjsip_hdr_clone(pool, path_hdr);
-          target.paths.push_back(path_hdr_clone);
-        }
-        else
-        {
-          TRC_WARNING("Ignoring contact %s for target %s because of badly formed path header %s",
-                      binding._uri.c_str(), aor.c_str(), path.c_str());
-          // TODO SAS log
-          valid = false;
-          break;
-        }
-      }
-    }
-    else
-    {
-      TRC_DEBUG("Empty path headers field for contact %s, implying no path "
-                "headers were present on a register (which is valid)",
-                binding._uri.c_str());
-    }
+    TRC_DEBUG("Empty path headers field for contact %s, implying no path "
+              "headers were present on a register (which is valid)",
+              binding._uri.c_str());
   }
 
   return valid;
@@ -324,21 +333,25 @@ void add_implicit_filters(const pjsip_msg* msg,
 // Accept-Contact header).
 MatchResult match_feature_sets(const FeatureSet& contact_feature_set,
                                pjsip_accept_contact_hdr* accept)
+{
+  return match_accept_predicate(contact_feature_set,
+                                to_feature_predicate(accept));
+}
+
+MatchResult match_accept_predicate(const FeatureSet& contact_feature_set,
+                                   const FeaturePredicate& accept)
 {
   MatchResult rc = YES;
 
   // Iterate over the parameters on the Accept-Contact header, we can drop out
   // early if the main match value ever drops to NO since there's no way it will
   // change to YES afterwards.
-  for (pjsip_param* feature_param = accept->feature_set.next;
-       (feature_param != &accept->feature_set) && (rc != NO);
-       feature_param = feature_param->next)
+  for (std::vector<Feature>::const_iterator feature = accept.features.begin();
+       (feature != accept.features.end()) && (rc != NO);
+       ++feature)
   {
-    std::string feature_name = PJUtils::pj_str_to_string(&feature_param->name);
-    std::string feature_value = PJUtils::pj_str_to_string(&feature_param->value);
-    TRC_DEBUG("Trying to match Accept-Contact parameter '%s' (value '%s')", feature_name.c_str(), feature_value.c_str());
-
-    Feature feature(feature_name, feature_value);
+    const std::string& feature_name = feature->first;
+    TRC_DEBUG("Trying to match Accept-Contact parameter '%s' (value '%s')", feature_name.c_str(), feature->second.c_str());
 
     // Now find the Contact's version of this feature.
     FeatureSet::const_iterator contact_feature;
@@ -350,7 +363,7 @@ MatchResult match_feature_sets(const FeatureSet& contact_feature_set,
       // Contact header doesn't contain a feature in the
       // Accept-Contact header - should fail the match if "explicit"
       // was specified.
-      if (accept->explicit_match)
+      if (accept.explicit_match)
       {
         rc = NO;
         TRC_DEBUG("Parameter %s is not in the Contact parameters and is explicitly required", feature_name.c_str());
@@ -363,7 +376,7 @@ MatchResult match_feature_sets(const FeatureSet& contact_feature_set,
     }
     else
     {
-      rc = match_feature(feature,
+      rc = match_feature(*feature,
                          *contact_feature);
     }
   }
@@ -377,21 +390,25 @@ MatchResult match_feature_sets(const FeatureSet& contact_feature_set,
 // collection which could satisfy them both.
 MatchResult match_feature_sets(const FeatureSet& contact_feature_set,
                                pjsip_reject_contact_hdr* reject)
+{
+  return match_reject_predicate(contact_feature_set,
+                                to_feature_predicate(reject));
+}
+
+MatchResult match_reject_predicate(const FeatureSet& contact_feature_set,
+                                   const FeaturePredicate& reject)
 {
   MatchResult rc = YES;
 
   // Iterate over the parameters on the Reject-Contact header, since
   // the only way a Reject-Contact header can match is perfectly, we
   // can drop out early if rc is ever non-YES.
-  for (pjsip_param* feature_param = reject->feature_set.next;
-       (feature_param != &reject->feature_set) && (rc == YES);
-       feature_param = feature_param->next)
+  for (std::vector<Feature>::const_iterator feature = reject.features.begin();
+       (feature != reject.features.end()) && (rc == YES);
+       ++feature)
   {
-    std::string feature_name = PJUtils::pj_str_to_string(&feature_param->name);
-    std::string feature_value = PJUtils::pj_str_to_string(&feature_param->value);
-    TRC_DEBUG("Trying to match Reject-Contact parameter '%s' (value '%s')", feature_name.c_str(), feature_value.c_str());
-
-    Feature feature(feature_name, feature_value);
+    const std::string& feature_name = feature->first;
+    TRC_DEBUG("Trying to match Reject-Contact parameter '%s' (value '%s')", feature_name.c_str(), feature->second.c_str());
 
     // Now find the Contact's version of this feature.
     FeatureSet::const_iterator contact_feature;
@@ -407,7 +424,7 @@ MatchResult match_feature_sets(const FeatureSet& contact_feature_set,
     }
     else
     {
-      rc = match_feature(feature,
+      rc = match_feature(*feature,
                          *contact_feature);
     }
   }
@@ -415,6 +432,38 @@ MatchResult match_feature_sets(const FeatureSet& contact_feature_set,
   return rc;
 }
 
+// Converts the feature set in an Accept-Contact or Reject-Contact header to
+// strings.
+static void to_features(const pjsip_param* feature_set,
+                        std::vector<Feature>& features)
+{
+  for (const pjsip_param* feature_param = feature_set->next;
+       feature_param != feature_set;
+       feature_param = feature_param->next)
+  {
+    features.push_back(Feature(PJUtils::pj_str_to_string(&feature_param->name),
+                               PJUtils::pj_str_to_string(&feature_param->value)));
+  }
+}
+
+FeaturePredicate to_feature_predicate(pjsip_accept_contact_hdr* accept)
+{
+  FeaturePredicate predicate;
+  to_features(&accept->feature_set, predicate.features);
+  predicate.explicit_match = accept->explicit_match;
+  predicate.required_match = accept->required_match;
+  return predicate;
+}
+
+FeaturePredicate to_feature_predicate(pjsip_reject_contact_hdr* reject)
+{
+  FeaturePredicate predicate;
+  to_features(&reject->feature_set, predicate.features);
+  predicate.explicit_match = false;
+  predicate.required_match = false;
+  return predicate;
+}
+
 // Compares a single term of a feature predicate in the
 // Accept/Reject-Contact header (the matcher) and in the Contact
 // header (the matchee).
@@ -11,6 +11,7 @@
 
 ///
 
+#include <algorithm>
 #include <fstream>
 #include <stdlib.h>
 #include <sys/socket.h>
@@ -29,7 +30,8 @@ DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
                          _trail(0),
                          _domain(""),
                          _status(ARES_SUCCESS),
-                         _naptr_reply(NULL)
+                         _naptr_reply(NULL),
+                         _ttl(0)
 {
   // Set options to ensure we always get a response as quickly as possible -
   // we are on the call path!
@@ -114,7 +116,10 @@ void DNSResolver::destroy(DNSResolver* resolver)
 
 
 // LCOV_EXCL_START
-int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int DNSResolver::perform_naptr_query(const std::string& domain,
+                                     struct ares_naptr_reply*& naptr_reply,
+                                     int& ttl,
+                                     SAS::TrailId trail)
 {
   send_naptr_query(domain, trail);
   CW_IO_STARTS("DNS NAPTR query")
@@ -125,12 +130,14 @@ int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_napt
 
   // Save off the results...
   naptr_reply = _naptr_reply;
+  ttl = _ttl;
   int status = _status;
   // ...and then clear out our state.
   _trail = 0;
   _domain = "";
   _naptr_reply = NULL;
   _status = ARES_SUCCESS;
+  _ttl = 0;
 
   return status;
 }
@@ -255,6 +262,11 @@ void DNSResolver::ares_callback(int status,
     {
       TRC_WARNING("Unparseable DNS ENUM response from host %s: %s", _domain.c_str(), ares_strerror(status));
     }
+    else
+    {
+      // ares_parse_naptr_reply doesn't return the TTLs, so get them ourselves.
+      _ttl = parse_naptr_ttl(abuf, alen);
+    }
   }
   else
   {
@@ -269,6 +281,63 @@ void DNSResolver::ares_callback(int status,
 }
 
 
+int DNSResolver::parse_naptr_ttl(const unsigned char* abuf, int alen)
+{
+  // The response has already been parsed successfully by ares, so we only
+  // need to be careful not to run off the end of the buffer.
+  if (alen < NS_HFIXEDSZ)
+  {
+    return 0;
+  }
+
+  int qdcount = (abuf[4] << 8) | abuf[5];
+  int ancount = (abuf[6] << 8) | abuf[7];
+  const unsigned char* aptr = abuf + NS_HFIXEDSZ;
+  char* name;
+  long len;
+
+  // Skip the question section.
+  for (int ii = 0; ii < qdcount; ii++)
+  {
+    if (ares_expand_name(aptr, abuf, alen, &name, &len) != ARES_SUCCESS)
+    {
+      return 0;
+    }
+    ares_free_string(name);
+    aptr += len + NS_QFIXEDSZ;
+  }
+
+  int ttl = -1;
+
+  for (int ii = 0; ii < ancount; ii++)
+  {
+    if (ares_expand_name(aptr, abuf, alen, &name, &len) != ARES_SUCCESS)
+    {
+      break;
+    }
+    ares_free_string(name);
+    aptr += len;
+
+    if (aptr + NS_RRFIXEDSZ > abuf + alen)
+    {
+      break;
+    }
+
+    int rr_type = (aptr[0] << 8) | aptr[1];
+    int rr_ttl = (aptr[4] << 24) | (aptr[5] << 16) | (aptr[6] << 8) | aptr[7];
+    int rr_len = (aptr[8] << 8) | aptr[9];
+    aptr += NS_RRFIXEDSZ + rr_len;
+
+    if ((rr_type == ns_t_naptr) && ((ttl < 0) || (rr_ttl < ttl)))
+    {
+      ttl = rr_ttl;
+    }
+  }
+
+  return std::max(ttl, 0);
+}
+
+
 DNSResolver* DNSResolverFactory::new_resolver(const std::vector<struct IP46Address>& servers) const
 {
   return new DNSResolver(servers);
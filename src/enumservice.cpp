@@ -13,8 +13,10 @@
 #include "rapidjson/document.h"
 #include "rapidjson/error/en.h"
 #include "json_parse_utils.h"
+#include <algorithm>
 #include <fstream>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -23,6 +25,7 @@
 
 #include "pjutils.h"
 #include "enumservice.h"
+#include "regex_cache.h"
 #include "dnsresolver.h"
 #include "utils.h"
 #include "log.h"
@@ -73,16 +76,14 @@ bool EnumService::parse_regex_replace(const std::string& regex_replace, boost::r
   if (match_replace.size() == 2)
   {
     TRC_DEBUG("Split regex into match=%s, replace=%s", match_replace[0].c_str(), match_replace[1].c_str());
-    try
+    // The same rules turn up in many ENUM responses, so use the regex cache
+    // rather than compiling them each time.
+    regex = RegexCache::compile(match_replace[0], boost::regex::extended);
+    if (regex.status() == 0)
     {
-      regex.assign(match_replace[0], boost::regex::extended);
       replace = match_replace[1];
       success = true;
     }
-    catch (...)
-    {
-      success = false;
-    }
   }
   else
   {
@@ -94,6 +95,7 @@ bool EnumService::parse_regex_replace(const std::string& regex_replace, boost::r
 
 
 JSONEnumService::JSONEnumService(std::string configuration):
+  _number_prefixes(new NumberPrefixTrie()),
   _configuration(configuration),
   _updater(NULL)
 {
@@ -147,8 +149,8 @@ void JSONEnumService::update_enum()
 
   try
   {
-    std::vector<NumberPrefix> new_number_prefixes;
-    std::map<std::string, NumberPrefix> new_prefix_regex_map;
+    std::shared_ptr<NumberPrefixTrie> new_number_prefixes =
+                                          std::make_shared<NumberPrefixTrie>();
 
     JSON_ASSERT_CONTAINS(doc, "number_blocks");
     JSON_ASSERT_ARRAY(doc["number_blocks"]);
@@ -173,11 +175,9 @@ void JSONEnumService::update_enum()
 
         if (parse_regex_replace(regex, pfix.match, pfix.replace))
         {
-          // Create an array in order of entries in json file, and a map
-          // (automatically sorted in order of key length) so we can later
-          // match numbers to the most specific prefixes
-          new_number_prefixes.push_back(pfix);
-          new_prefix_regex_map.insert(std::make_pair(prefix, pfix));
+          // Add the prefix to the trie, so we can later match numbers to the
+          // most specific prefixes.
+          new_number_prefixes->insert(prefix, pfix);
           TRC_STATUS("  Adding number prefix %s, regex=%s",
                      pfix.prefix.c_str(), regex.c_str());
         }
@@ -196,10 +196,10 @@ void JSONEnumService::update_enum()
       }
     }
 
-    // Take a write lock on the mutex in RAII style
-    boost::lock_guard<boost::shared_mutex> write_lock(_number_prefixes_rw_lock);
-    _number_prefixes = new_number_prefixes;
-    _prefix_regex_map = new_prefix_regex_map;
+    // Swap in the new prefixes.  Lookups in progress keep the old trie alive
+    // until they have finished with it.
+    std::atomic_store(&_number_prefixes,
+                      std::shared_ptr<const NumberPrefixTrie>(new_number_prefixes));
   }
   catch (JsonFormatError err)
   {
@@ -230,10 +230,12 @@ std::string JSONEnumService::lookup_uri_from_user(const std::string &user, SAS::
 
   std::string aus = user_to_aus(user);
 
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_number_prefixes_rw_lock);
+  // Take a reference to the current prefixes, which keeps them valid until
+  // we've finished with them even if the configuration is reloaded.
+  std::shared_ptr<const NumberPrefixTrie> number_prefixes =
+                                          std::atomic_load(&_number_prefixes);
 
-  const struct NumberPrefix* pfix = prefix_match(aus);
+  const struct NumberPrefix* pfix = prefix_match(*number_prefixes, aus);
 
   if (pfix == NULL)
   {
@@ -270,43 +272,38 @@ std::string JSONEnumService::lookup_uri_from_user(const std::string &user, SAS::
 }
 
 
-// This function returns a pointer to a struct that may be destroyed by the
-// updater. Callers must therefore ensure that they have the read lock before
-// calling this function and only release the lock once they no longer need
-// the object.
-const JSONEnumService::NumberPrefix* JSONEnumService::prefix_match(const std::string& number) const
+// This function returns a pointer into the trie, so callers must hold a
+// reference to the trie for as long as they need the result.
+const JSONEnumService::NumberPrefix* JSONEnumService::prefix_match(
+                                       const NumberPrefixTrie& number_prefixes,
+                                       const std::string& number)
 {
-  // Iterate through map in reverse order (already sorted by key length during
-  // construction) to find the most specific matching prefix
-  for (std::map<std::string, NumberPrefix>::const_reverse_iterator it =
-                                                     _prefix_regex_map.rbegin();
-       it != _prefix_regex_map.rend();
-       it++)
-  {
-    int len = std::min(number.size(), (*it).first.size());
+  // Normalise the number once, then find the most specific matching prefix.
+  std::string normalised_number = Utils::remove_visual_separators(number);
+  const NumberPrefix* pfix = number_prefixes.find(normalised_number);
 
-    TRC_DEBUG("Comparing first %d numbers of %s against prefix %s",
-              len, number.c_str(), (*it).first.c_str());
-
-    if (Utils::remove_visual_separators(number).
-                                      compare(0, len, (*it).first, 0, len) == 0)
-    {
-      // Found a match, so return it.
-      TRC_DEBUG("Match found");
-      return &((*it).second);
-    }
+  if (pfix != NULL)
+  {
+    TRC_DEBUG("Number %s matches prefix %s",
+              normalised_number.c_str(), pfix->prefix.c_str());
   }
 
-  return NULL;
+  return pfix;
 }
 
 DNSEnumService::DNSEnumService(const std::vector<std::string>& dns_servers,
                                const std::string& dns_suffix,
                                const DNSResolverFactory* resolver_factory,
-                               CommunicationMonitor* comm_monitor) :
+                               CommunicationMonitor* comm_monitor,
+                               int max_cache_entries) :
                                _dns_suffix(dns_suffix),
                                _resolver_factory(resolver_factory),
-                               _comm_monitor(comm_monitor)
+                               _comm_monitor(comm_monitor),
+                               _max_cache_entries(std::max(max_cache_entries, 0)),
+                               _cache(_max_cache_entries,
+                                      std::min(std::max(max_cache_entries, 1),
+                                               (int)NUM_CACHE_SHARDS)),
+                               _inflight()
 {
   // Initialize the ares library.  This might have already been done by curl
   // but it's safe to do it twice.
@@ -390,8 +387,6 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
   // expressions.
   std::string aus = user_to_aus(user);
   std::string string = aus;
-  // Get the resolver to use.  This comes from thread-local data.
-  DNSResolver* resolver = get_resolver();
   // Spin round until we've finished (successfully or otherwise) or we've done
   // the maximum number of queries.
   bool complete = false;
@@ -402,19 +397,17 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
          (!failed) &&
          (dns_queries < MAX_DNS_QUERIES))
   {
-    // Translate the key into a domain and issue a query for it.
+    // Translate the key into a domain and get the sorted list of rules for
+    // it.
     std::string domain = key_to_domain(string);
-    struct ares_naptr_reply* naptr_reply = NULL;
-    int status = resolver->perform_naptr_query(domain, naptr_reply, trail);
+    std::shared_ptr<const std::vector<Rule>> rules;
+    int status = get_rules(domain, rules, trail);
     if (status == ARES_SUCCESS)
     {
-      // Parse the reply into a sorted list of rules.
-      std::vector<Rule> rules;
-      parse_naptr_reply(naptr_reply, rules);
       // Now spin through the rules, looking for the first match.
       std::vector<DNSEnumService::Rule>::const_iterator rule;
-      for (rule = rules.begin();
-           rule != rules.end();
+      for (rule = rules->begin();
+           rule != rules->end();
            ++rule)
       {
         if (rule->matches(string))
@@ -440,7 +433,7 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
       }
       // If we didn't find a match (and so hit the end of the list), consider
       // this a failure.
-      failed = failed || (rule == rules.end());
+      failed = failed || (rule == rules->end());
     }
     else if (status == ARES_ENOTFOUND)
     {
@@ -455,14 +448,6 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
       server_failed = true;
     }
 
-
-    // Free off the NAPTR reply if we have one.
-    if (naptr_reply != NULL)
-    {
-      resolver->free_naptr_reply(naptr_reply);
-      naptr_reply = NULL;
-    }
-
     dns_queries++;
   }
 
@@ -503,6 +488,120 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
 }
 
 
+int DNSEnumService::get_rules(const std::string& domain,
+                              std::shared_ptr<const std::vector<Rule>>& rules,
+                              SAS::TrailId trail) const
+{
+  if (_max_cache_entries == 0)
+  {
+    int ttl;
+    return query_rules(domain, rules, ttl, trail);
+  }
+
+  unsigned long now = now_ms();
+  CachedRules cached;
+  bool waited = false;
+  bool found = _cache.get(domain,
+                          cached,
+                          [now](const CachedRules& entry) -> bool
+                          {
+                            return (entry.expiry_ms > now);
+                          });
+
+  if (!found)
+  {
+    // Query the DNS server ourselves, unless another thread is already
+    // querying this domain, in which case wait for it to finish and use its
+    // result.
+    waited = _inflight.run(domain,
+                           trail,
+                           cached,
+                           [&](CachedRules& result) -> void
+                           {
+                             int ttl = 0;
+                             result.status = query_rules(domain,
+                                                         result.rules,
+                                                         ttl,
+                                                         trail);
+
+                             if ((result.status == ARES_SUCCESS) && (ttl > 0))
+                             {
+                               result.expiry_ms = now_ms() + (unsigned long)ttl * 1000;
+                             }
+                             else if (result.status == ARES_ENOTFOUND)
+                             {
+                               result.expiry_ms = now_ms() + NEGATIVE_CACHE_TTL * 1000;
+                             }
+
+                             // Don't cache server failures or records with a
+                             // zero TTL.  Any threads already waiting for this
+                             // query still see the result.
+                             if (result.expiry_ms != 0)
+                             {
+                               _cache.put(domain, result);
+                             }
+                           });
+
+    if (waited)
+    {
+      TRC_DEBUG("Waited for in-progress ENUM query for %s", domain.c_str());
+    }
+  }
+
+  if ((found) || (waited))
+  {
+    TRC_DEBUG("Using cached ENUM result for %s", domain.c_str());
+    SAS::Event event(trail, SASEvent::ENUM_CACHE_HIT, 0);
+    event.add_static_param(cached.status);
+    event.add_static_param(waited);
+    event.add_var_param(domain);
+    SAS::report_event(event);
+  }
+
+  rules = cached.rules;
+  return cached.status;
+}
+
+int DNSEnumService::query_rules(const std::string& domain,
+                                std::shared_ptr<const std::vector<Rule>>& rules,
+                                int& ttl,
+                                SAS::TrailId trail) const
+{
+  // Get the resolver to use.  This comes from thread-local data.
+  DNSResolver* resolver = get_resolver();
+  struct ares_naptr_reply* naptr_reply = NULL;
+  ttl = 0;
+  int status = resolver->perform_naptr_query(domain, naptr_reply, ttl, trail);
+
+  if (status == ARES_SUCCESS)
+  {
+    // Parse the reply into a sorted list of rules.
+    std::vector<Rule>* parsed_rules = new std::vector<Rule>();
+    parse_naptr_reply(naptr_reply, *parsed_rules);
+    rules.reset(parsed_rules);
+  }
+  else
+  {
+    rules.reset();
+  }
+
+  // Free off the NAPTR reply if we have one.
+  if (naptr_reply != NULL)
+  {
+    resolver->free_naptr_reply(naptr_reply);
+    naptr_reply = NULL;
+  }
+
+  return status;
+}
+
+unsigned long DNSEnumService::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
 std::string DNSEnumService::key_to_domain(const std::string& key) const
 {
   // First strip all non-numeric characters from the key.
@@ -106,7 +106,7 @@ void FIFCService::update_fifcs()
   _fallback_ifcs.clear();
 
   // Parse any iFCs that are present.
-  std::multimap<int32_t, std::string> ifc_map;
+  std::multimap<int32_t, Ifc> ifc_map;
   rapidxml::xml_node<>* fifc_set = root->first_node(FIFCService::FALLBACK_IFCS_SET);
   rapidxml::xml_node<>* ifc = NULL;
   for (ifc = fifc_set->first_node(RegDataXMLUtils::IFC);
@@ -133,14 +133,15 @@ void FIFCService::update_fifcs()
       }
     }
     // Creating the iFC always passes, and the iFC isn't validated any
-    // further at this stage.
+    // further at this stage.  The iFC is compiled now, rather than each time
+    // it's used, and owns a copy of its XML.
     std::string ifc_str;
     rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
-    ifc_map.insert(std::make_pair(priority, ifc_str));
+    ifc_map.insert(std::make_pair(priority, Ifc(ifc_str)));
   }
 
-  std::vector<std::string> ifcs_vec;
-  for (std::pair<int32_t, std::string> ifc_pair : ifc_map)
+  std::vector<Ifc> ifcs_vec;
+  for (const std::pair<int32_t, Ifc>& ifc_pair : ifc_map)
   {
     ifcs_vec.push_back(ifc_pair.second);
   }
@@ -161,18 +162,11 @@ void FIFCService::update_fifcs()
   return;
 }
 
-std::vector<Ifc> FIFCService::get_fallback_ifcs(rapidxml::xml_document<>* ifc_doc) const
+std::vector<Ifc> FIFCService::get_fallback_ifcs() const
 {
   // Take a read lock on the mutex in RAII style
   boost::shared_lock<boost::shared_mutex> read_lock(_sets_rw_lock);
-
-  std::vector<Ifc> ifc_vec;
-  for (std::string ifc : _fallback_ifcs)
-  {
-    ifc_vec.push_back(Ifc(ifc, ifc_doc));
-  }
-
-  return ifc_vec;
+  return _fallback_ifcs;
 }
 
 void FIFCService::set_alarm()
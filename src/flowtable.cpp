@@ -16,6 +16,7 @@ extern "C" {
 }
 
 // Common STL includes.
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <string>
@@ -26,29 +27,49 @@ extern "C" {
 #include "stack.h"
 #include "flowtable.h"
 
-FlowTable::FlowTable(QuiescingManager* qm, SNMP::U32Scalar* connection_count) :
-  _tp2flow_map(),
-  _tk2flow_map(),
+FlowTable::FlowTable(QuiescingManager* qm,
+                     SNMP::U32Scalar* connection_count,
+                     int num_shards) :
+  _address_shards(),
+  _token_shards(),
+  _flow_count(0),
   _conn_count(connection_count),
   _quiescing(false),
   _qm(qm)
 {
-  pthread_mutex_init(&_flow_map_lock, NULL);
+  num_shards = std::max(num_shards, 1);
+
+  for (int ii = 0; ii < num_shards; ++ii)
+  {
+    _address_shards.push_back(new AddressShard());
+    _token_shards.push_back(new TokenShard());
+  }
+
   report_flow_count();
 }
 
 
 FlowTable::~FlowTable()
 {
-  // Delete all the existing flows.
-  for (std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.begin();
-       i != _tp2flow_map.end();
-       ++i)
+  // Delete all the existing flows.  Every flow is in exactly one token shard
+  // until it is removed, so delete the flows from there.
+  for (TokenShard* shard : _token_shards)
   {
-    delete i->second;
+    for (std::unordered_map<std::string, Flow*>::iterator i = shard->flows.begin();
+         i != shard->flows.end();
+         ++i)
+    {
+      delete i->second;
+    }
+    delete shard;
   }
+  _token_shards.clear();
 
-  pthread_mutex_destroy(&_flow_map_lock);
+  for (AddressShard* shard : _address_shards)
+  {
+    delete shard;
+  }
+  _address_shards.clear();
 }
 
 
@@ -58,41 +79,49 @@ Flow* FlowTable::find_create_flow(pjsip_transport* transport, const pj_sockaddr*
 {
   Flow* flow = NULL;
   FlowKey key(transport->key.type, raddr);
+  AddressShard* shard = address_shard(key);
 
   char buf[100];
   TRC_DEBUG("Find or create flow for transport %s (%d), remote address %s",
             transport->obj_name, transport->key.type,
             pj_sockaddr_print(raddr, buf, sizeof(buf), 3));
 
-  pthread_mutex_lock(&_flow_map_lock);
+  pthread_mutex_lock(&shard->lock);
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
+  std::unordered_map<FlowKey, Flow*, FlowKey::Hash>::iterator i = shard->flows.find(key);
 
-  if (i == _tp2flow_map.end())
+  if ((i != shard->flows.end()) && (i->second->try_inc_ref()))
+  {
+    // Found a matching flow, so return this one.
+    flow = i->second;
+
+    TRC_DEBUG("Found flow record %p", flow);
+  }
+  else
   {
-    // No matching flow, so create a new one.
+    // No matching flow (or the matching flow is being removed), so create a
+    // new one.
     flow = new Flow(this, transport, raddr);
 
-    // Add the new flow to the maps.
-    _tp2flow_map.insert(std::make_pair(key, flow));
-    _tk2flow_map.insert(std::make_pair(flow->token(), flow));
+    // Add the new flow to the maps, replacing any flow being removed.
+    shard->flows[key] = flow;
+
+    TokenShard* tk_shard = token_shard(flow->token());
+    pthread_mutex_lock(&tk_shard->lock);
+    tk_shard->flows.insert(std::make_pair(flow->token(), flow));
+    pthread_mutex_unlock(&tk_shard->lock);
+
+    ++_flow_count;
 
     TRC_DEBUG("Added flow record %p", flow);
 
     report_flow_count();
-  }
-  else
-  {
-    // Found a matching flow, so return this one.
-    flow = i->second;
 
-    TRC_DEBUG("Found flow record %p", flow);
+    // Add a reference to the flow.
+    flow->try_inc_ref();
   }
 
-  // Add a reference to the flow.
-  flow->inc_ref();
-
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return flow;
 }
@@ -104,28 +133,28 @@ Flow* FlowTable::find_flow(pjsip_transport* transport, const pj_sockaddr* raddr)
 {
   Flow* flow = NULL;
   FlowKey key(transport->key.type, raddr);
+  AddressShard* shard = address_shard(key);
 
   char buf[100];
   TRC_DEBUG("Find flow for transport %s (%d), remote address %s",
             transport->obj_name, transport->key.type,
             pj_sockaddr_print(raddr, buf, sizeof(buf), 3));
 
-  pthread_mutex_lock(&_flow_map_lock);
+  pthread_mutex_lock(&shard->lock);
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
+  std::unordered_map<FlowKey, Flow*, FlowKey::Hash>::iterator i = shard->flows.find(key);
 
-  if (i != _tp2flow_map.end())
+  // Only return a matching flow if we can take a reference to it - otherwise
+  // it is being removed.
+  if ((i != shard->flows.end()) && (i->second->try_inc_ref()))
   {
     // Found a matching flow, so return this one.
     flow = i->second;
 
-    // Increment the reference count on the flow.
-    flow->inc_ref();
-
     TRC_DEBUG("Found flow record %p", flow);
   }
 
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return flow;
 }
@@ -135,31 +164,29 @@ Flow* FlowTable::find_flow(pjsip_transport* transport, const pj_sockaddr* raddr)
 Flow* FlowTable::find_flow(const std::string& token)
 {
   Flow* flow = NULL;
+  TokenShard* shard = token_shard(token);
 
   TRC_DEBUG("Find flow for flow token %s", token.c_str());
 
-  pthread_mutex_lock(&_flow_map_lock);
+  pthread_mutex_lock(&shard->lock);
 
-  std::map<std::string, Flow*>::iterator i = _tk2flow_map.find(token);
-  if (i != _tk2flow_map.end())
+  std::unordered_map<std::string, Flow*>::iterator i = shard->flows.find(token);
+  if ((i != shard->flows.end()) && (i->second->try_inc_ref()))
   {
     // Found a flow matching the token.
     flow = i->second;
 
-    // Add a reference to the flow.
-    flow->inc_ref();
-
     TRC_DEBUG("Found flow record %p", flow);
   }
 
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return flow;
 }
 
 void FlowTable::check_quiescing_state()
 {
-  if (_tp2flow_map.empty() && is_quiescing() && (_qm != NULL))
+  if ((_flow_count.load() == 0) && is_quiescing() && (_qm != NULL))
   {
     TRC_DEBUG("Flow map is empty and we are quiescing - start transaction-based quiescing");
     _qm->flows_gone();
@@ -167,7 +194,7 @@ void FlowTable::check_quiescing_state()
   else
   {
     TRC_DEBUG("Checked quiescing state: flow_map is %s, is_quiescing() result is %s, _qm (QuiescingManager reference) is %s",
-              _tp2flow_map.empty() ? "empty" : "not empty",
+              (_flow_count.load() == 0) ? "empty" : "not empty",
               is_quiescing()? "true" : "false",
               (_qm == NULL) ? "NULL" : "not NULL");
   }
@@ -175,50 +202,97 @@ void FlowTable::check_quiescing_state()
 
 void FlowTable::remove_flow(Flow* flow)
 {
-  pthread_mutex_lock(&_flow_map_lock);
-
   TRC_DEBUG("Remove flow %p", flow);
 
+  // Remove the flow from both its shards before deleting it.  Threads only
+  // use flows they find in a shard while holding the shard's lock, so once
+  // it has been removed from both no other thread can be using it.  The
+  // address may already map to a replacement flow, so check before erasing.
   FlowKey key(flow->transport()->key.type, flow->remote_addr());
+  AddressShard* shard = address_shard(key);
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
-  if (i != _tp2flow_map.end())
+  pthread_mutex_lock(&shard->lock);
+  std::unordered_map<FlowKey, Flow*, FlowKey::Hash>::iterator i = shard->flows.find(key);
+  if ((i != shard->flows.end()) && (i->second == flow))
   {
-    _tp2flow_map.erase(i);
+    shard->flows.erase(i);
   }
+  pthread_mutex_unlock(&shard->lock);
 
-  std::map<std::string, Flow*>::iterator j = _tk2flow_map.find(flow->token());
-  if (j != _tk2flow_map.end())
+  TokenShard* tk_shard = token_shard(flow->token());
+
+  pthread_mutex_lock(&tk_shard->lock);
+  std::unordered_map<std::string, Flow*>::iterator j = tk_shard->flows.find(flow->token());
+  if (j != tk_shard->flows.end())
   {
-    _tk2flow_map.erase(j);
+    tk_shard->flows.erase(j);
   }
+  pthread_mutex_unlock(&tk_shard->lock);
+
+  --_flow_count;
 
   report_flow_count();
 
   delete flow;
 
   check_quiescing_state();
-
-  pthread_mutex_unlock(&_flow_map_lock);
 }
 
 void FlowTable::report_flow_count()
 {
-  TRC_DEBUG("Reporting current flow count: %d", _tp2flow_map.size());
-  _conn_count->value = _tp2flow_map.size();
+  size_t flow_count = _flow_count.load();
+  TRC_DEBUG("Reporting current flow count: %lu", flow_count);
+  _conn_count->value = flow_count;
+}
+
+FlowTable::AddressShard* FlowTable::address_shard(const FlowKey& key) const
+{
+  return _address_shards[FlowKey::Hash()(key) % _address_shards.size()];
+}
+
+FlowTable::TokenShard* FlowTable::token_shard(const std::string& token) const
+{
+  return _token_shards[std::hash<std::string>()(token) % _token_shards.size()];
+}
+
+size_t FlowTable::FlowKey::Hash::operator() (const FlowKey& key) const
+{
+  // FNV-1a over the transport type, address family, address and port.
+  size_t hash = 14695981039346656037ULL;
+  int family = key._raddr.addr.sa_family;
+  pj_uint16_t port = 0;
+
+  auto add = [&hash](const void* data, size_t len)
+  {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t ii = 0; ii < len; ++ii)
+    {
+      hash = (hash ^ bytes[ii]) * 1099511628211ULL;
+    }
+  };
+
+  add(&key._type, sizeof(key._type));
+  add(&family, sizeof(family));
+
+  if ((family == PJ_AF_INET) || (family == PJ_AF_INET6))
+  {
+    add(pj_sockaddr_get_addr(&key._raddr), pj_sockaddr_get_addr_len(&key._raddr));
+    port = pj_sockaddr_get_port(&key._raddr);
+  }
+
+  add(&port, sizeof(port));
+
+  return hash;
 }
 
 void FlowTable::quiesce()
 {
   TRC_DEBUG("FlowTable was kicked to quiesce");
   _quiescing = true;
-  pthread_mutex_lock(&_flow_map_lock);
 
   // If we have no flows, quiesce now - otherwise we do this in
   // remove_flow when the last flow disappears
   check_quiescing_state();
-
-  pthread_mutex_unlock(&_flow_map_lock);
 }
 
 void FlowTable::unquiesce()
@@ -569,12 +643,26 @@ void Flow::restart_timer(int id, int timeout)
 }
 
 
-/// Increment the reference count on the flow.  This is always called when
-/// the flowtable lock is held, so no need to lock.
-void Flow::inc_ref()
+/// Increments the reference count on the flow, unless it has already fallen
+/// to zero (in which case the flow is being removed and this returns false).
+/// This is always called with the lock held on a FlowTable shard containing
+/// the flow, so the flow can't be deleted while it runs.
+bool Flow::try_inc_ref()
 {
-  ++_refs;
-  TRC_DEBUG("Dialog count now %d for flow %s", _refs, _default_id.c_str());
+  int refs = _refs.load();
+
+  do
+  {
+    if (refs == 0)
+    {
+      TRC_DEBUG("Flow %p is being removed", this);
+      return false;
+    }
+  }
+  while (!_refs.compare_exchange_weak(refs, refs + 1));
+
+  TRC_DEBUG("Reference count now %d for flow %s", refs + 1, _default_id.c_str());
+  return true;
 }
 
 
@@ -582,17 +670,15 @@ void Flow::inc_ref()
 /// to zero.
 void Flow::dec_ref()
 {
-  pthread_mutex_lock(&_flow_table->_flow_map_lock);
+  int refs = --_refs;
 
-  if ((--_refs) == 0)
+  if (refs == 0)
   {
-    pthread_mutex_unlock(&_flow_table->_flow_map_lock);
     _flow_table->remove_flow(this);
   }
   else
   {
-    TRC_DEBUG("Dialog count now %d for flow %s", _refs, _default_id.c_str());
-    pthread_mutex_unlock(&_flow_table->_flow_map_lock);
+    TRC_DEBUG("Reference count now %d for flow %s", refs, _default_id.c_str());
   }
 }
 
@@ -26,6 +26,7 @@
 #include "snmp_continuous_accumulator_table.h"
 #include "xml_utils.h"
 #include "sprout_xml_utils.h"
+#include "pjutils.h"
 
 const std::string HSSConnection::REG = "reg";
 const std::string HSSConnection::CALL = "call";
@@ -46,7 +47,11 @@ HSSConnection::HSSConnection(const std::string& server,
                              SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                              CommunicationMonitor* comm_monitor,
                              SIFCService* sifc_service,
-                             long homestead_timeout_ms) :
+                             long homestead_timeout_ms,
+                             int async_threads,
+                             ExceptionHandler* exception_handler,
+                             SNMP::CounterTable* issued_tbl,
+                             SNMP::CounterTable* coalesced_tbl) :
   _client(new HttpClient(false,
                          resolver,
                          homestead_count_tbl,
@@ -64,17 +69,166 @@ HSSConnection::HSSConnection(const std::string& server,
   _sar_latency_tbl(homestead_sar_latency_tbl),
   _uar_latency_tbl(homestead_uar_latency_tbl),
   _lir_latency_tbl(homestead_lir_latency_tbl),
-  _sifc_service(sifc_service)
+  _sifc_service(sifc_service),
+  _thread_pool(NULL),
+  _pending_requests(0),
+  _inflight(issued_tbl, coalesced_tbl)
 {
+  if (async_threads > 0)
+  {
+    TRC_STATUS("Starting %d threads for asynchronous HSS queries", async_threads);
+    _thread_pool = new Pool(exception_handler, &exception_callback, async_threads);
+    _thread_pool->start();
+  }
 }
 
 
 HSSConnection::~HSSConnection()
 {
+  if (_thread_pool != NULL)
+  {
+    _thread_pool->stop();
+    _thread_pool->join();
+    delete _thread_pool; _thread_pool = NULL;
+  }
+
   delete _http; _http = NULL;
   delete _client; _client = NULL;
 }
 
+void HSSConnection::run_async(std::function<void()> request,
+                              PJUtils::Callback* on_complete)
+{
+  if (_thread_pool == NULL)
+  {
+    request();
+    PJUtils::run_callback_on_worker_thread(on_complete);
+    return;
+  }
+
+  // Don't let a slow Homestead build up an unbounded backlog of queries.
+  // Fail the query instead - the caller set the result to a failure before
+  // calling us.
+  if (_pending_requests.load() >= MAX_PENDING_REQUESTS)
+  {
+    TRC_WARNING("Failing HSS query - too many queries pending");
+    PJUtils::run_callback_on_worker_thread(on_complete);
+    return;
+  }
+
+  ++_pending_requests;
+  AsyncRequest* work = new AsyncRequest();
+  work->request = request;
+  work->on_complete = on_complete;
+  work->pending = &_pending_requests;
+  _thread_pool->add_work(work);
+}
+
+void HSSConnection::exception_callback(AsyncRequest* work)
+{
+  // The query failed, but the caller is still waiting for it to complete, so
+  // run the callback anyway.  The result code was set to a failure before the
+  // query started.
+  --(*work->pending);
+  PJUtils::run_callback_on_worker_thread(work->on_complete, false);
+  delete work;
+}
+
+HSSConnection::Pool::Pool(ExceptionHandler* exception_handler,
+                          void (*callback)(AsyncRequest*),
+                          unsigned int num_threads) :
+  // The queue is unbounded, so that queuing a query never blocks a worker
+  // thread.  Its length is limited by MAX_PENDING_REQUESTS instead.
+  ThreadPool<AsyncRequest*>(num_threads, exception_handler, callback, 0)
+{}
+
+HSSConnection::Pool::~Pool()
+{}
+
+void HSSConnection::Pool::process_work(AsyncRequest*& work)
+{
+  work->request();
+  --(*work->pending);
+
+  // The HSS threads aren't PJSIP threads, so this always queues the callback
+  // for a worker thread.
+  PJUtils::run_callback_on_worker_thread(work->on_complete, false);
+  delete work; work = NULL;
+}
+
+void HSSConnection::get_auth_vector_async(const std::string& private_user_id,
+                                          const std::string& public_user_id,
+                                          const std::string& auth_type,
+                                          const std::string& resync_auth,
+                                          const std::string& server_name,
+                                          HTTPCode& rc,
+                                          rapidjson::Document*& object,
+                                          SAS::TrailId trail,
+                                          PJUtils::Callback* on_complete)
+{
+  rc = HTTP_SERVER_UNAVAILABLE;
+  object = NULL;
+  run_async([=, &rc, &object]() -> void
+            {
+              rc = get_auth_vector(private_user_id,
+                                   public_user_id,
+                                   auth_type,
+                                   resync_auth,
+                                   server_name,
+                                   object,
+                                   trail);
+            },
+            on_complete);
+}
+
+void HSSConnection::get_user_auth_status_async(const std::string& private_user_identity,
+                                               const std::string& public_user_identity,
+                                               const std::string& visited_network,
+                                               const std::string& auth_type,
+                                               const bool& emergency,
+                                               HTTPCode& rc,
+                                               rapidjson::Document*& object,
+                                               SAS::TrailId trail,
+                                               PJUtils::Callback* on_complete)
+{
+  rc = HTTP_SERVER_UNAVAILABLE;
+  object = NULL;
+  bool emergency_copy = emergency;
+  run_async([=, &rc, &object]() -> void
+            {
+              rc = get_user_auth_status(private_user_identity,
+                                        public_user_identity,
+                                        visited_network,
+                                        auth_type,
+                                        emergency_copy,
+                                        object,
+                                        trail);
+            },
+            on_complete);
+}
+
+void HSSConnection::get_location_data_async(const std::string& public_user_identity,
+                                            const bool& originating,
+                                            const std::string& auth_type,
+                                            HTTPCode& rc,
+                                            rapidjson::Document*& object,
+                                            SAS::TrailId trail,
+                                            PJUtils::Callback* on_complete)
+{
+  rc = HTTP_SERVER_UNAVAILABLE;
+  object = NULL;
+  bool originating_copy = originating;
+  run_async([=, &rc, &object]() -> void
+            {
+              rc = get_location_data(public_user_identity,
+                                     originating_copy,
+                                     auth_type,
+                                     object,
+                                     trail);
+            },
+            on_complete);
+}
+
 /// Get an Authentication Vector as JSON object. Caller is responsible for deleting.
 HTTPCode HSSConnection::get_auth_vector(const std::string& private_user_identity,
                                         const std::string& public_user_identity,
@@ -452,8 +606,6 @@ HTTPCode HSSConnection::put_homestead_xml(const irs_query& irs_query,
 
   TRC_DEBUG("Making Homestead request for %s", path.c_str());
 
-  rapidxml::xml_document<>* root_underlying_ptr = NULL;
-
   std::string json_wildcard = (irs_query._wildcard != "") ?
     ", \"wildcard_identity\": \"" +
     irs_query._wildcard +
@@ -469,26 +621,52 @@ HTTPCode HSSConnection::put_homestead_xml(const irs_query& irs_query,
                          json_wildcard +
                          "}";
 
-  Utils::StopWatch stopWatch;
-  stopWatch.start();
-  HTTPCode http_code = put_for_xml_object(path,
-                                          req_body,
-                                          irs_query._cache_allowed,
-                                          root_underlying_ptr,
-                                          trail);
-  unsigned long latency_us = 0;
+  std::function<void(HomesteadResponse&)> request =
+    [&](HomesteadResponse& response)
+  {
+    rapidxml::xml_document<>* root_underlying_ptr = NULL;
 
-  root.reset(root_underlying_ptr);
+    Utils::StopWatch stopWatch;
+    stopWatch.start();
+    response.rc = put_for_xml_object(path,
+                                     req_body,
+                                     irs_query._cache_allowed,
+                                     root_underlying_ptr,
+                                     trail);
+    unsigned long latency_us = 0;
 
-  // Only accumulate the latency if we haven't already applied a
-  // penalty
-  if ((http_code != HTTP_SERVER_UNAVAILABLE) &&
-      (http_code != HTTP_GATEWAY_TIMEOUT)    &&
-      (stopWatch.read(latency_us)))
+    response.xml.reset(root_underlying_ptr);
+
+    // Only accumulate the latency if we haven't already applied a
+    // penalty
+    if ((response.rc != HTTP_SERVER_UNAVAILABLE) &&
+        (response.rc != HTTP_GATEWAY_TIMEOUT)    &&
+        (stopWatch.read(latency_us)))
+    {
+      _latency_tbl->accumulate(latency_us);
+      _sar_latency_tbl->accumulate(latency_us);
+    }
+  };
+
+  HomesteadResponse response;
+
+  if (irs_query._req_type == CALL)
   {
-    _latency_tbl->accumulate(latency_us);
-    _sar_latency_tbl->accumulate(latency_us);
+    // Call requests don't change the registration state, so identical ones
+    // made at the same time can share a response.  Other request types are
+    // always sent.
+    std::string key = "PUT " + path + " " + req_body +
+                      (irs_query._cache_allowed ? "" : " no-cache");
+
+    run_shared(key, path, response, request, trail);
   }
+  else
+  {
+    request(response);
+  }
+
+  HTTPCode http_code = response.rc;
+  root = response.xml;
 
   if (http_code != HTTP_OK)
   {
@@ -499,6 +677,22 @@ HTTPCode HSSConnection::put_homestead_xml(const irs_query& irs_query,
   return http_code;
 }
 
+void HSSConnection::run_shared(const std::string& key,
+                               const std::string& path,
+                               HomesteadResponse& response,
+                               const std::function<void(HomesteadResponse&)>& request,
+                               SAS::TrailId trail)
+{
+  if (_inflight.run(key, trail, response, request))
+  {
+    TRC_DEBUG("Shared response to concurrent request for %s", path.c_str());
+    SAS::Event event(trail, SASEvent::HTTP_HOMESTEAD_SHARED_RESPONSE, 0);
+    event.add_static_param(response.rc);
+    event.add_var_param(path);
+    SAS::report_event(event);
+  }
+}
+
 HTTPCode HSSConnection::update_registration_state(const irs_query& irs_query,
                                                   irs_info& irs_info,
                                                   SAS::TrailId trail)
@@ -558,26 +752,37 @@ HTTPCode HSSConnection::get_homestead_xml(const std::string& public_id,
 
   TRC_DEBUG("Making Homestead request for %s", path.c_str());
 
-  rapidxml::xml_document<>* root_underlying_ptr = NULL;
+  std::function<void(HomesteadResponse&)> request =
+    [&](HomesteadResponse& response)
+  {
+    rapidxml::xml_document<>* root_underlying_ptr = NULL;
 
-  Utils::StopWatch stopWatch;
-  stopWatch.start();
-  HTTPCode http_code = get_xml_object(path, 
-                                      root_underlying_ptr, 
-                                      trail);
-  unsigned long latency_us = 0;
+    Utils::StopWatch stopWatch;
+    stopWatch.start();
+    response.rc = get_xml_object(path,
+                                 root_underlying_ptr,
+                                 trail);
+    unsigned long latency_us = 0;
 
-  root.reset(root_underlying_ptr);
+    response.xml.reset(root_underlying_ptr);
 
-  // Only accumulate the latency if we haven't already applied a
-  // penalty
-  if ((http_code != HTTP_SERVER_UNAVAILABLE) &&
-      (http_code != HTTP_GATEWAY_TIMEOUT)    &&
-      (stopWatch.read(latency_us)))
-  {
-    _latency_tbl->accumulate(latency_us);
-    _sar_latency_tbl->accumulate(latency_us);
-  }
+    // Only accumulate the latency if we haven't already applied a
+    // penalty
+    if ((response.rc != HTTP_SERVER_UNAVAILABLE) &&
+        (response.rc != HTTP_GATEWAY_TIMEOUT)    &&
+        (stopWatch.read(latency_us)))
+    {
+      _latency_tbl->accumulate(latency_us);
+      _sar_latency_tbl->accumulate(latency_us);
+    }
+  };
+
+  HomesteadResponse response;
+
+  run_shared("GET " + path, path, response, request, trail);
+
+  HTTPCode http_code = response.rc;
+  root = response.xml;
 
   if (http_code != HTTP_OK)
   {
@@ -670,18 +875,38 @@ HTTPCode HSSConnection::get_location_data(const std::string& public_user_identit
     path += prefix + "auth-type=" + Utils::url_escape(auth_type);
   }
 
-  HTTPCode rc = get_json_object(path, location_data, trail);
+  std::function<void(HomesteadResponse&)> request =
+    [&](HomesteadResponse& response)
+  {
+    rapidjson::Document* json_object = NULL;
+    response.rc = get_json_object(path, json_object, trail);
+    response.json.reset(json_object);
 
-  unsigned long latency_us = 0;
-  // Only accumulate the latency if we haven't already applied a
-  // penalty
-  if ((rc != HTTP_SERVER_UNAVAILABLE) &&
-      (rc != HTTP_GATEWAY_TIMEOUT)    &&
-      (stopWatch.read(latency_us)))
+    unsigned long latency_us = 0;
+    // Only accumulate the latency if we haven't already applied a
+    // penalty
+    if ((response.rc != HTTP_SERVER_UNAVAILABLE) &&
+        (response.rc != HTTP_GATEWAY_TIMEOUT)    &&
+        (stopWatch.read(latency_us)))
+    {
+      _latency_tbl->accumulate(latency_us);
+      _lir_latency_tbl->accumulate(latency_us);
+    }
+  };
+
+  HomesteadResponse response;
+
+  run_shared("GET " + path, path, response, request, trail);
+
+  // The caller owns (and may modify) the returned document, so give it its
+  // own copy of the shared one.
+  location_data = NULL;
+
+  if (response.json)
   {
-    _latency_tbl->accumulate(latency_us);
-    _lir_latency_tbl->accumulate(latency_us);
+    location_data = new rapidjson::Document;
+    location_data->CopyFrom(*response.json, location_data->GetAllocator());
   }
 
-  return rc;
+  return response.rc;
 }
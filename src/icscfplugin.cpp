@@ -13,9 +13,13 @@
 #include "sproutletplugin.h"
 #include "stack.h"
 #include "scscfselector.h"
+#include "scscf_assignment_cache.h"
 #include "icscfsproutlet.h"
 #include "log.h"
 
+/// The maximum number of S-CSCF assignments to cache, if caching is enabled.
+static const int ICSCF_CACHE_SIZE = 10000;
+
 class ICSCFPlugin : public SproutletPlugin
 {
 public:
@@ -29,8 +33,11 @@ private:
   ICSCFSproutlet* _icscf_sproutlet;
   ACRFactory* _acr_factory;
   SCSCFSelector* _scscf_selector;
+  SCSCFAssignmentCache* _assignment_cache;
   SNMP::SuccessFailCountByRequestTypeTable* _incoming_sip_transactions_tbl;
   SNMP::SuccessFailCountByRequestTypeTable* _outgoing_sip_transactions_tbl;
+  SNMP::CounterTable* _assignment_cache_hits_tbl;
+  SNMP::CounterTable* _assignment_cache_misses_tbl;
 };
 
 /// Export the plug-in using the magic symbol "sproutlet_plugin"
@@ -41,7 +48,8 @@ ICSCFPlugin sproutlet_plugin;
 ICSCFPlugin::ICSCFPlugin() :
   _icscf_sproutlet(NULL),
   _acr_factory(NULL),
-  _scscf_selector(NULL)
+  _scscf_selector(NULL),
+  _assignment_cache(NULL)
 {
 }
 
@@ -61,6 +69,10 @@ bool ICSCFPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
                                                                                     "1.2.826.0.1.1578918.9.3.18");
   _outgoing_sip_transactions_tbl = SNMP::SuccessFailCountByRequestTypeTable::create("icscf_outgoing_sip_transactions",
                                                                                     "1.2.826.0.1.1578918.9.3.19");
+  _assignment_cache_hits_tbl = SNMP::CounterTable::create("icscf_assignment_cache_hits",
+                                                          "1.2.826.0.1.1578918.9.3.57");
+  _assignment_cache_misses_tbl = SNMP::CounterTable::create("icscf_assignment_cache_misses",
+                                                            "1.2.826.0.1.1578918.9.3.58");
 
   if (opt.enabled_icscf)
   {
@@ -69,6 +81,15 @@ bool ICSCFPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
     // Create the S-CSCF selector.
     _scscf_selector = new SCSCFSelector(opt.uri_scscf);
 
+    // Create the cache of S-CSCF assignments, if enabled.
+    if (opt.icscf_cache_ttl > 0)
+    {
+      _assignment_cache = new SCSCFAssignmentCache(ICSCF_CACHE_SIZE,
+                                                   opt.icscf_cache_ttl,
+                                                   _assignment_cache_hits_tbl,
+                                                   _assignment_cache_misses_tbl);
+    }
+
     // Create the I-CSCF ACR factory.
     _acr_factory = (ralf_processor != NULL) ?
                         (ACRFactory*)new RalfACRFactory(ralf_processor, ACR::ICSCF) :
@@ -89,7 +110,8 @@ bool ICSCFPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
                                           _outgoing_sip_transactions_tbl,
                                           opt.override_npdi,
                                           opt.port_icscf,
-                                          opt.blacklisted_scscfs);
+                                          opt.blacklisted_scscfs,
+                                          _assignment_cache);
     _icscf_sproutlet->init();
 
     sproutlets.push_back(_icscf_sproutlet);
@@ -104,6 +126,9 @@ void ICSCFPlugin::unload()
   delete _icscf_sproutlet;
   delete _acr_factory;
   delete _scscf_selector;
+  delete _assignment_cache;
   delete _incoming_sip_transactions_tbl;
   delete _outgoing_sip_transactions_tbl;
+  delete _assignment_cache_hits_tbl;
+  delete _assignment_cache_misses_tbl;
 }
@@ -28,7 +28,8 @@ ICSCFRouter::ICSCFRouter(HSSConnection* hss,
                          SAS::TrailId trail,
                          ACR* acr,
                          int port,
-                         std::set<std::string> blacklisted_scscfs) :
+                         std::set<std::string> blacklisted_scscfs,
+                         SCSCFAssignmentCache* cache) :
   _hss(hss),
   _scscf_selector(scscf_selector),
   _trail(trail),
@@ -37,13 +38,97 @@ ICSCFRouter::ICSCFRouter(HSSConnection* hss,
   _queried_caps(false),
   _hss_rsp(),
   _attempted_scscfs(),
-  _blacklisted_scscfs(blacklisted_scscfs)
+  _blacklisted_scscfs(blacklisted_scscfs),
+  _prefetched(false),
+  _prefetch_rc(HTTP_OK),
+  _prefetch_rsp(NULL),
+  _cache(cache),
+  _cached(false)
 {
 }
 
 
 ICSCFRouter::~ICSCFRouter()
 {
+  delete _prefetch_rsp; _prefetch_rsp = NULL;
+}
+
+
+void ICSCFRouter::prefetch(PJUtils::Callback* on_complete)
+{
+  if (get_cached_response())
+  {
+    // There's no need to query the HSS, so we can continue straight away.
+    _cached = true;
+    PJUtils::run_callback_on_worker_thread(on_complete);
+    return;
+  }
+
+  _prefetched = true;
+  start_hss_query(_prefetch_rc, _prefetch_rsp, on_complete);
+}
+
+
+void ICSCFRouter::get_hss_result(HTTPCode& rc,
+                                 rapidjson::Document*& rsp,
+                                 const std::function<HTTPCode(rapidjson::Document*&)>& query)
+{
+  if (_prefetched)
+  {
+    // The prefetched result is only valid for the first query.
+    TRC_DEBUG("Using result of prefetched HSS query");
+    _prefetched = false;
+    rc = _prefetch_rc;
+    rsp = _prefetch_rsp;
+    _prefetch_rsp = NULL;
+  }
+  else
+  {
+    rc = query(rsp);
+  }
+}
+
+
+void ICSCFRouter::invalidate_cache()
+{
+  if (_cache != NULL)
+  {
+    _cache->invalidate(cache_key());
+  }
+}
+
+
+bool ICSCFRouter::get_cached_response()
+{
+  // Only the first query can be answered from the cache - any later query is
+  // looking for an alternative S-CSCF.
+  if ((_cache == NULL) ||
+      (_queried_caps) ||
+      (!_hss_rsp.scscf.empty()) ||
+      (!_attempted_scscfs.empty()))
+  {
+    return false;
+  }
+
+  ServerCapabilities caps;
+  bool queried_caps = false;
+
+  if (!_cache->get(cache_key(), caps, queried_caps))
+  {
+    return false;
+  }
+
+  TRC_DEBUG("Using cached HSS response");
+  _hss_rsp = caps;
+  _queried_caps = queried_caps;
+
+  if (_acr != NULL)
+  {
+    // Pass the server capabilities to the ACR for reporting.
+    _acr->server_capabilities(_hss_rsp);
+  }
+
+  return true;
 }
 
 
@@ -67,7 +152,13 @@ int ICSCFRouter::get_scscf(pj_pool_t* pool,
   std::string scscf;
   scscf_sip_uri = NULL;
 
-  if (!_queried_caps)
+  if (_cached)
+  {
+    // The HSS response was filled in from the cache by prefetch.
+    _cached = false;
+  }
+  else if ((!_queried_caps) &&
+           ((_prefetched) || (!get_cached_response())))
   {
     // Do the HSS query.
     status_code = hss_query();
@@ -204,6 +295,10 @@ int ICSCFRouter::parse_hss_response(rapidjson::Document*& rsp, bool queried_caps
 {
   int status_code = PJSIP_SC_OK;
 
+  // Only the response to a query that didn't force the HSS to return
+  // capabilities can be cached.
+  bool cacheable = !queried_caps;
+
   // Clear out any older response.
   _queried_caps = false;
   _hss_rsp.mandatory_caps.clear();
@@ -286,6 +381,18 @@ int ICSCFRouter::parse_hss_response(rapidjson::Document*& rsp, bool queried_caps
   // the HSS decided to return capabilities anyway.
   _queried_caps = (status_code == PJSIP_SC_OK) ? queried_caps : false;
 
+  // Only cache responses that name the S-CSCF assigned by the HSS.  A
+  // response that just returns capabilities means the subscriber has no
+  // assigned S-CSCF yet, and will have one as soon as it registers, so must
+  // not be reused.
+  if ((_cache != NULL) &&
+      (cacheable) &&
+      (status_code == PJSIP_SC_OK) &&
+      (!_hss_rsp.scscf.empty()))
+  {
+    _cache->put(cache_key(), _hss_rsp, _queried_caps);
+  }
+
   if (_acr != NULL)
   {
     // Pass the server capabilities to the ACR for reporting.
@@ -325,8 +432,9 @@ ICSCFUARouter::ICSCFUARouter(HSSConnection* hss,
                              const std::string& visited_network,
                              const std::string& auth_type,
                              const bool& emergency,
-                             std::set<std::string> blacklisted_scscfs) :
-  ICSCFRouter(hss, scscf_selector, trail, acr, port, blacklisted_scscfs),
+                             std::set<std::string> blacklisted_scscfs,
+                             SCSCFAssignmentCache* cache) :
+  ICSCFRouter(hss, scscf_selector, trail, acr, port, blacklisted_scscfs, cache),
   _impi(impi),
   _impu(impu),
   _visited_network(visited_network),
@@ -354,13 +462,17 @@ int ICSCFUARouter::hss_query()
             _visited_network.c_str(), auth_type.c_str());
 
   rapidjson::Document* rsp = NULL;
-  HTTPCode rc =_hss->get_user_auth_status(_impi,
-                                          _impu,
-                                          _visited_network,
-                                          auth_type,
-                                          _emergency,
-                                          rsp,
-                                          _trail);
+  HTTPCode rc;
+  get_hss_result(rc, rsp, [&](rapidjson::Document*& doc) -> HTTPCode
+  {
+    return _hss->get_user_auth_status(_impi,
+                                      _impu,
+                                      _visited_network,
+                                      auth_type,
+                                      _emergency,
+                                      doc,
+                                      _trail);
+  });
 
   if ((rc == HTTP_NOT_FOUND) ||
       (rc == HTTP_FORBIDDEN))
@@ -396,6 +508,34 @@ int ICSCFUARouter::hss_query()
 }
 
 
+/// Starts the first HSS UAR query.
+void ICSCFUARouter::start_hss_query(HTTPCode& rc,
+                                    rapidjson::Document*& rsp,
+                                    PJUtils::Callback* on_complete)
+{
+  TRC_DEBUG("Start UAR - impi %s, impu %s, vn %s, auth_type %s",
+            _impi.c_str(), _impu.c_str(),
+            _visited_network.c_str(), _auth_type.c_str());
+  _hss->get_user_auth_status_async(_impi,
+                                   _impu,
+                                   _visited_network,
+                                   _auth_type,
+                                   _emergency,
+                                   rc,
+                                   rsp,
+                                   _trail,
+                                   on_complete);
+}
+
+
+/// Identifies the first UAR query in the S-CSCF assignment cache.
+std::string ICSCFUARouter::cache_key() const
+{
+  return "UAR " + _impi + " " + _impu + " " + _visited_network + " " +
+         _auth_type + (_emergency ? " sos" : "");
+}
+
+
 ICSCFLIRouter::ICSCFLIRouter(HSSConnection* hss,
                              SCSCFSelector* scscf_selector,
                              SAS::TrailId trail,
@@ -403,8 +543,9 @@ ICSCFLIRouter::ICSCFLIRouter(HSSConnection* hss,
                              int port,
                              const std::string& impu,
                              bool originating,
-                             std::set<std::string> blacklisted_scscfs) :
-  ICSCFRouter(hss, scscf_selector, trail, acr, port, blacklisted_scscfs),
+                             std::set<std::string> blacklisted_scscfs,
+                             SCSCFAssignmentCache* cache) :
+  ICSCFRouter(hss, scscf_selector, trail, acr, port, blacklisted_scscfs, cache),
   _impu(impu),
   _originating(originating)
 {
@@ -430,11 +571,15 @@ int ICSCFLIRouter::hss_query()
             (_originating) ? "true" : "false",
             (auth_type != "") ? auth_type.c_str() : "None");
   rapidjson::Document* rsp = NULL;
-  HTTPCode rc =_hss->get_location_data(_impu,
-                                       _originating,
-                                       auth_type,
-                                       rsp,
-                                       _trail);
+  HTTPCode rc;
+  get_hss_result(rc, rsp, [&](rapidjson::Document*& doc) -> HTTPCode
+  {
+    return _hss->get_location_data(_impu,
+                                   _originating,
+                                   auth_type,
+                                   doc,
+                                   _trail);
+  });
 
   if (rc == HTTP_NOT_FOUND)
   {
@@ -462,3 +607,25 @@ int ICSCFLIRouter::hss_query()
 }
 
 
+/// Starts the first HSS LIR query.
+void ICSCFLIRouter::start_hss_query(HTTPCode& rc,
+                                    rapidjson::Document*& rsp,
+                                    PJUtils::Callback* on_complete)
+{
+  TRC_DEBUG("Start LIR - impu %s, originating %s",
+            _impu.c_str(), (_originating) ? "true" : "false");
+  _hss->get_location_data_async(_impu,
+                                _originating,
+                                "",
+                                rc,
+                                rsp,
+                                _trail,
+                                on_complete);
+}
+
+
+/// Identifies the first LIR query in the S-CSCF assignment cache.
+std::string ICSCFLIRouter::cache_key() const
+{
+  return "LIR " + _impu + (_originating ? " orig" : "");
+}
@@ -48,7 +48,8 @@ ICSCFSproutlet::ICSCFSproutlet(const std::string& icscf_name,
                                SNMP::SuccessFailCountByRequestTypeTable* outgoing_sip_transactions_tbl,
                                bool override_npdi,
                                int network_function_port,
-                               std::set<std::string> blacklisted_scscfs) :
+                               std::set<std::string> blacklisted_scscfs,
+                               SCSCFAssignmentCache* assignment_cache) :
   Sproutlet(icscf_name,
             port,
             uri,
@@ -66,7 +67,8 @@ ICSCFSproutlet::ICSCFSproutlet(const std::string& icscf_name,
   _override_npdi(override_npdi),
   _bgcf_uri_str(bgcf_uri),
   _network_function_port(network_function_port),
-  _blacklisted_scscfs(blacklisted_scscfs)
+  _blacklisted_scscfs(blacklisted_scscfs),
+  _assignment_cache(assignment_cache)
 {
   _session_establishment_tbl = SNMP::SuccessFailCountTable::create("icscf_session_establishment",
                                                                    "1.2.826.0.1.1578918.9.3.36");
@@ -154,7 +156,8 @@ ICSCFSproutletRegTsx::ICSCFSproutletRegTsx(ICSCFSproutlet* icscf,
   CompositeSproutletTsx(icscf, next_hop_service),
   _icscf(icscf),
   _acr(NULL),
-  _router(NULL)
+  _router(NULL),
+  _cancelled(false)
 {
 }
 
@@ -290,8 +293,31 @@ void ICSCFSproutletRegTsx::on_rx_initial_request(pjsip_msg* req)
                                             visited_network,
                                             auth_type,
                                             emergency,
-                                            _icscf->_blacklisted_scscfs);
+                                            _icscf->_blacklisted_scscfs,
+                                            _icscf->_assignment_cache);
+
+  // Start the HSS query without blocking this thread, and pick up routing
+  // the request once it has completed.
+  _router->prefetch(create_callback([this, req]() -> void
+  {
+    if (_cancelled)
+    {
+      // The transaction failed during the HSS query.  There were no forks to
+      // cancel, so reject the request here rather than routing it.
+      TRC_DEBUG("Request cancelled during HSS query");
+      pjsip_msg* rsp = create_response(req, PJSIP_SC_REQUEST_TERMINATED);
+      send_response(rsp);
+      free_msg(req);
+      return;
+    }
 
+    route_request(req);
+  }));
+}
+
+
+void ICSCFSproutletRegTsx::route_request(pjsip_msg* req)
+{
   // We have a router, query it for an S-CSCF to use.
   pjsip_sip_uri* scscf_sip_uri = NULL;
   std::string dummy_wildcard;
@@ -368,6 +394,10 @@ void ICSCFSproutletRegTsx::on_rx_response(pjsip_msg* rsp, int fork_id)
     event.add_var_param(st_code);
     SAS::report_event(event);
 
+    // The S-CSCF we used may have been assigned from the cache, and either
+    // way it has failed, so make sure later requests query the HSS.
+    _router->invalidate_cache();
+
     // Now we can simply reuse the UA router we made on the initial request.
     pjsip_sip_uri* scscf_sip_uri = NULL;
     pjsip_msg* req = original_request();
@@ -433,6 +463,12 @@ void ICSCFSproutletRegTsx::on_tx_response(pjsip_msg* rsp)
   }
 }
 
+
+void ICSCFSproutletRegTsx::on_rx_cancel(int status_code, pjsip_msg* cancel_req)
+{
+  _cancelled = true;
+}
+
 /*****************************************************************************/
 /* Non-REGISTER handling.                                                    */
 /*****************************************************************************/
@@ -448,7 +484,8 @@ ICSCFSproutletTsx::ICSCFSproutletTsx(ICSCFSproutlet* icscf,
   _originating(false),
   _routed_to_bgcf(false),
   _req_type(req_type),
-  _session_set_up(false)
+  _session_set_up(false),
+  _cancelled(false)
 {
 }
 
@@ -600,8 +637,34 @@ void ICSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
                                             _acr,
                                             _icscf->network_function_port(),
                                             impu,
-                                            _originating);
+                                            _originating,
+                                            std::set<std::string>(),
+                                            _icscf->_assignment_cache);
+
+  // Start the HSS query without blocking this thread, and pick up routing
+  // the request once it has completed.
+  _router->prefetch(create_callback([this, req, impu]() -> void
+  {
+    if (_cancelled)
+    {
+      // The request was cancelled (or the transaction failed) during the HSS
+      // query.  There were no forks for the CANCEL to reach, so reject the
+      // request here rather than routing it.
+      TRC_DEBUG("Request cancelled during HSS query");
+      pjsip_msg* rsp = create_response(req, PJSIP_SC_REQUEST_TERMINATED);
+      send_response(rsp);
+      free_msg(req);
+      return;
+    }
 
+    route_request(req, impu);
+  }));
+}
+
+
+void ICSCFSproutletTsx::route_request(pjsip_msg* req, std::string impu)
+{
+  pj_pool_t* pool = get_pool(req);
   pjsip_sip_uri* scscf_sip_uri = NULL;
 
   // Use the router we just created to query the HSS for an S-CSCF to use.
@@ -830,6 +893,10 @@ void ICSCFSproutletTsx::on_rx_response(pjsip_msg* rsp, int fork_id)
     event.add_var_param(st_code);
     SAS::report_event(event);
 
+    // The S-CSCF we used may have been assigned from the cache, and either
+    // way it has failed, so make sure later requests query the HSS.
+    _router->invalidate_cache();
+
     // Now we can simply reuse the UA router we made on the initial request.
     pjsip_sip_uri* scscf_sip_uri = NULL;
     pjsip_msg* req = original_request();
@@ -945,6 +1012,8 @@ void ICSCFSproutletTsx::on_tx_response(pjsip_msg* rsp)
 
 void ICSCFSproutletTsx::on_rx_cancel(int status_code, pjsip_msg* cancel_req)
 {
+  _cancelled = true;
+
   // If this is cancelling a terminating INVITE then check whether we need to
   // update our session establishment stats.
   if (!_originating &&
@@ -28,6 +28,7 @@ extern "C" {
 #include "sas.h"
 #include "sproutsasevent.h"
 #include "uri_classifier.h"
+#include "regex_cache.h"
 
 #include "rapidxml/rapidxml_print.hpp"
 using namespace rapidxml;
@@ -44,67 +45,274 @@ using namespace rapidxml;
 #define ORIGINATING_UNREGISTERED 3
 #define ORIGINATING_CDIV 4
 
-Ifc::Ifc(std::string ifc_str,
-         rapidxml::xml_document<>* ifc_doc) :
-  _ifc(NULL)
+/// An error found while compiling an iFC.  Errors aren't reported when the
+// iFC is compiled, but when evaluation reaches the point at which the XML
+// would have been found to be invalid, so that a bad trigger only causes the
+// iFC to be skipped for requests that actually depend on it.
+struct Ifc::Error
 {
-  rapidxml::xml_document<>* new_document = new rapidxml::xml_document<>();
+  enum Type { NONE, INVALID_IFC, INVALID_XML };
+
+  Type type;
+  std::string reason;
+
+  Error() : type(NONE) {}
 
-  // We must use a new XML document to parse the string (as it's destructive).
-  // We allocate the string from the passed in document, and then clone the
-  // node into that document, ensuring that the passed in document owns
-  // everything associated with the IFC.
-  char* xml_str = ifc_doc->allocate_string(ifc_str.c_str());
-  new_document->parse<0>(xml_str);
-  _ifc = ifc_doc->clone_node(new_document->first_node());
+  void set(Type error_type, const std::string& error_reason)
+  {
+    type = error_type;
+    reason = error_reason;
+  }
+};
 
-  delete new_document;
+/// A compiled service point trigger.
+struct Ifc::CompiledSpt
+{
+  enum Class
+  {
+    METHOD,
+    SIP_HEADER,
+    SESSION_CASE,
+    REQUEST_URI,
+    SESSION_DESCRIPTION,
+    UNKNOWN
+  };
+
+  CompiledSpt() :
+    negated(false),
+    spt_class(UNKNOWN),
+    match_reg_types(false),
+    session_case(0),
+    has_content(false),
+    unusual_req_uri(false)
+  {}
+
+  bool negated;
+  Error neg_error;
+
+  Class spt_class;
+  std::string class_name;
+  Error class_error;
+
+  // Method class.  If the method is REGISTER and the trigger has an Extension
+  // element, the registration types to match on, in order.
+  std::string method;
+  bool match_reg_types;
+  std::vector<std::pair<int, Error> > reg_types;
+
+  // SessionCase class.
+  int session_case;
+
+  // SIPHeader, RequestURI and SessionDescription classes.  The regex matches
+  // the header name, the Request URI or the SDP line type respectively.
+  boost::regex regex;
+
+  // SIPHeader and SessionDescription classes.  Errors in the content regex
+  // are only reported if the content needs to be matched.
+  bool has_content;
+  boost::regex content_regex;
+  Error content_error;
+
+  // RequestURI class.
+  bool unusual_req_uri;
+
+  // The groups this trigger belongs to.
+  std::vector<int32_t> groups;
+  Error group_error;
+};
+
+/// A compiled iFC.
+struct Ifc::CompiledIfc
+{
+  CompiledIfc() :
+    has_ppi(false),
+    ppi_reg(false),
+    has_trigger(false),
+    cnf(false),
+    bad_default_handling(false)
+  {}
+
+  // The document that owns the iFC XML, if the Ifc was created from a string.
+  std::shared_ptr<rapidxml::xml_document<> > doc;
+
+  // The iFC XML, for SAS logging.
+  std::string ifc_str;
+
+  std::string server_name;
+  Error as_error;
+
+  bool has_ppi;
+  bool ppi_reg;
+  Error ppi_error;
+
+  bool has_trigger;
+  bool cnf;
+  Error cnf_error;
+  std::vector<CompiledSpt> spts;
+
+  AsInvocation as_invocation;
+  bool bad_default_handling;
+  std::string default_handling;
+};
+
+Ifc::Ifc(rapidxml::xml_node<>* ifc) :
+  _program(compile(ifc, NULL)),
+  _ifc(ifc)
+{
 }
 
-void Ifc::handle_invalid_ifc(std::string error,
-                             std::string server_name,
-                             int sas_event_id,
-                             int instance_id,
-                             SAS::TrailId trail)
+Ifc::Ifc(std::string ifc_str) :
+  _program(),
+  _ifc(NULL)
 {
-  TRC_ERROR("Skip processing invalid iFC for %s: %s",
-            server_name.c_str(),
-            error.c_str());
-  SAS::Event event(trail, sas_event_id, instance_id);
-  event.add_var_param(server_name);
-  event.add_var_param(error);
-  SAS::report_event(event);
-  throw ifc_error();
+  // The document owns the parsed XML, and is kept alive by the compiled iFC.
+  std::shared_ptr<rapidxml::xml_document<> > doc =
+                             std::make_shared<rapidxml::xml_document<> >();
+  char* xml_str = doc->allocate_string(ifc_str.c_str());
+  doc->parse<0>(xml_str);
+  _ifc = doc->first_node();
+  _program = compile(_ifc, doc);
 }
 
-void Ifc::handle_unusual_ifc(std::string error,
-                             std::string server_name,
-                             int sas_event_id,
-                             int instance_id,
-                             SAS::TrailId trail)
+std::shared_ptr<const Ifc::CompiledIfc> Ifc::compile(xml_node<>* ifc,
+                                                     std::shared_ptr<xml_document<> > doc)
 {
-  TRC_INFO("Continue processing unusual iFC for %s: %s",
-           server_name.c_str(),
-           error.c_str());
-  SAS::Event event(trail, sas_event_id, instance_id);
-  event.add_var_param(server_name);
-  event.add_var_param(error);
-  SAS::report_event(event);
+  std::shared_ptr<CompiledIfc> compiled = std::make_shared<CompiledIfc>();
+  compiled->doc = doc;
+  rapidxml::print(std::back_inserter(compiled->ifc_str), *ifc, 0);
+
+  xml_node<>* as = ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
+  if (as == NULL)
+  {
+    compiled->as_error.set(Error::INVALID_IFC,
+                           "iFC missing ApplicationServer element");
+  }
+  else
+  {
+    compiled->server_name =
+         XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
+    if (compiled->server_name.empty())
+    {
+      compiled->as_error.set(Error::INVALID_IFC, "iFC has no ServerName");
+    }
+
+    // Build the AS invocation now, so that it can just be copied out if the
+    // iFC matches.
+    AsInvocation& as_invocation = compiled->as_invocation;
+    as_invocation.server_name = compiled->server_name;
+
+    compiled->default_handling =
+         XMLUtils::get_first_node_value(as, RegDataXMLUtils::DEFAULT_HANDLING);
+    if (compiled->default_handling == "0")
+    {
+      // DefaultHandling is present and set to 0, which is SESSION_CONTINUED.
+      as_invocation.default_handling = SESSION_CONTINUED;
+    }
+    else if (compiled->default_handling == "1")
+    {
+      // DefaultHandling is present and set to 1, which is SESSION_TERMINATED.
+      as_invocation.default_handling = SESSION_TERMINATED;
+    }
+    else
+    {
+      // If the DefaultHandling attribute isn't present, or is malformed,
+      // default to SESSION_CONTINUED.  This is logged when the AS is invoked.
+      compiled->bad_default_handling = true;
+      as_invocation.default_handling = SESSION_CONTINUED;
+    }
+    as_invocation.service_info =
+         XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVICE_INFO);
+
+    xml_node<>* as_ext = as->first_node(RegDataXMLUtils::EXTENSION);
+    if (as_ext)
+    {
+      as_invocation.include_register_request =
+                XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_REQ);
+      as_invocation.include_register_response =
+               XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_RSP);
+    }
+    else
+    {
+      as_invocation.include_register_request = false;
+      as_invocation.include_register_response = false;
+    }
+  }
+
+  xml_node<>* profile_part_indicator =
+                   ifc->first_node(RegDataXMLUtils::PROFILE_PART_INDICATOR);
+  if (profile_part_indicator)
+  {
+    compiled->has_ppi = true;
+    try
+    {
+      compiled->ppi_reg = XMLUtils::parse_integer(profile_part_indicator,
+                                                  "ProfilePartIndicator",
+                                                  0,
+                                                  1) == 0;
+    }
+    catch (xml_error err)
+    {
+      compiled->ppi_error.set(Error::INVALID_XML, err.what());
+    }
+  }
+
+  xml_node<>* trigger = ifc->first_node(RegDataXMLUtils::TRIGGER_POINT);
+  if (trigger)
+  {
+    compiled->has_trigger = true;
+    try
+    {
+      compiled->cnf = XMLUtils::parse_bool(trigger->first_node(RegDataXMLUtils::CONDITION_TYPE_CNF),
+                                           RegDataXMLUtils::CONDITION_TYPE_CNF);
+    }
+    catch (xml_error err)
+    {
+      compiled->cnf_error.set(Error::INVALID_XML, err.what());
+    }
+
+    for (xml_node<>* spt = trigger->first_node(RegDataXMLUtils::SPT);
+         spt;
+         spt = spt->next_sibling(RegDataXMLUtils::SPT))
+    {
+      compiled->spts.push_back(CompiledSpt());
+      compile_spt(spt, compiled->spts.back());
+    }
+  }
+
+  return compiled;
 }
 
-// Test if the SPT matches. Ignores grouping and negation, and just
-// evaluates the service point trigger in the node.
-// @return true if the SPT matches, false if not
-// @throw xml_error if there is a problem evaluating the trigger.
-bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
-                      const bool is_registered,               //< The registration state
-                      const bool is_initial_registration,
-                      pjsip_msg* msg,                   //< The message being matched
-                      xml_node<>* spt,                  //< The Service Point Trigger node
-                      std::string ifc_str,
-                      std::string server_name,
-                      SAS::TrailId trail)
+void Ifc::compile_spt(xml_node<>* spt, CompiledSpt& compiled)
 {
+  xml_node<>* neg_node = spt->first_node(RegDataXMLUtils::CONDITION_NEGATED);
+  try
+  {
+    compiled.negated = neg_node &&
+                XMLUtils::parse_bool(neg_node, RegDataXMLUtils::CONDITION_NEGATED);
+  }
+  catch (xml_error err)
+  {
+    compiled.neg_error.set(Error::INVALID_XML, err.what());
+  }
+
+  for (xml_node<>* group_node = spt->first_node(RegDataXMLUtils::GROUP);
+       group_node;
+       group_node = group_node->next_sibling(RegDataXMLUtils::GROUP))
+  {
+    try
+    {
+      compiled.groups.push_back(XMLUtils::parse_integer(group_node,
+                                                        "Group ID",
+                                                        0,
+                                                        std::numeric_limits<int32_t>::max()));
+    }
+    catch (xml_error err)
+    {
+      compiled.group_error.set(Error::INVALID_XML, err.what());
+      break;
+    }
+  }
+
   // Find the class node.
   xml_node<>* node = spt->first_node();
   const char* name = NULL;
@@ -118,132 +326,280 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
     {
       if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
       {
-        handle_invalid_ifc("Missing class for service point trigger", server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
-      }
-      else
-      {
-        break;
+        node = NULL;
       }
+      break;
     }
   }
 
   if (!node)
   {
-    handle_invalid_ifc("Missing class for service point trigger", server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
+    compiled.class_error.set(Error::INVALID_IFC,
+                             "Missing class for service point trigger");
+    return;
   }
 
-  // Now interpret the node depending on its class.
-  bool ret = false;
+  compiled.class_name = name;
 
   if (strcmp(RegDataXMLUtils::METHOD, name) == 0)
   {
+    compiled.spt_class = CompiledSpt::METHOD;
+    compiled.method = node->value();
+
     // If we have a REGISTER we may need to match on RegistrationType.
-    if ((strcmp("REGISTER", node->value()) == 0) &&
-        (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0))
+    xml_node<>* ext_node = node->next_sibling();
+    if ((compiled.method == "REGISTER") &&
+        (ext_node) &&
+        (strcmp(ext_node->name(), RegDataXMLUtils::EXTENSION) == 0))
     {
-      ret = true;
-      node = node->next_sibling();
-      if (node)
+      compiled.match_reg_types = true;
+
+      for (xml_node<>* reg_type_node = ext_node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
+           reg_type_node;
+           reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
       {
-        name = node->name();
-        if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
+        std::pair<int, Error> reg_type(0, Error());
+        try
         {
-          for (xml_node<>* reg_type_node = node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
-               reg_type_node;
-               reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
-          {
-            name = reg_type_node->name();
-            int reg_type = XMLUtils::parse_integer(reg_type_node,
+          reg_type.first = XMLUtils::parse_integer(reg_type_node,
                                                    "registration type",
                                                    0,
                                                    2);
+        }
+        catch (xml_error err)
+        {
+          reg_type.second.set(Error::INVALID_XML, err.what());
+        }
+        compiled.reg_types.push_back(reg_type);
+      }
+    }
+  }
+  else if (strcmp(RegDataXMLUtils::SIP_HEADER, name) == 0)
+  {
+    compiled.spt_class = CompiledSpt::SIP_HEADER;
+    xml_node<>* spt_header = node->first_node(RegDataXMLUtils::HEADER);
+    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
 
-            // Find expiry value from SIP message if it is present to determine
-            // whether we have a de-registration.  Set an arbitrary default value of
-            // an hour.
-            pj_bool_t dereg = PJUtils::is_deregistration(msg);
+    if (!spt_header)
+    {
+      compiled.class_error.set(Error::INVALID_IFC,
+                               "Missing Header element for SIPHeader service point trigger");
+      return;
+    }
 
-            switch (reg_type)
-            {
-            case INITIAL_REGISTRATION:
-              ret = (is_initial_registration && !dereg);
-              break;
-            case REREGISTRATION:
-              ret = (!is_initial_registration && !dereg);
-              break;
-            case DEREGISTRATION:
-              ret = dereg;
-              break;
-            default:
-              // LCOV_EXCL_START Unreachable
-              TRC_WARNING("Impossible case %d", reg_type);
-              ret = false;
-              break;
-              // LCOV_EXCL_STOP
-            }
+    compiled.regex = RegexCache::compile(XMLUtils::get_text_or_cdata(spt_header),
+                                         boost::regex_constants::icase);
+    if (compiled.regex.status())
+    {
+      compiled.class_error.set(Error::INVALID_IFC,
+                               "Invalid regular expression in Header element for SIPHeader service point trigger");
+      return;
+    }
 
-            // If we've found a match, break out of the for loop.
-            if (ret)
-            {
-              break;
-            }
-          }
-        }
+    if (spt_content)
+    {
+      compiled.has_content = true;
+      compiled.content_regex = RegexCache::compile(XMLUtils::get_text_or_cdata(spt_content));
+      if (compiled.content_regex.status())
+      {
+        compiled.content_error.set(Error::INVALID_IFC,
+                                   "Invalid regular expression in Content element for SIPHeader service point trigger");
       }
     }
-    else
+  }
+  else if (strcmp(RegDataXMLUtils::SESSION_CASE, name) == 0)
+  {
+    compiled.spt_class = CompiledSpt::SESSION_CASE;
+    try
+    {
+      compiled.session_case = XMLUtils::parse_integer(node, "session case", 0, 4);
+    }
+    catch (xml_error err)
     {
-      ret = (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0);
+      compiled.class_error.set(Error::INVALID_XML, err.what());
     }
   }
-  else if (strcmp(RegDataXMLUtils::SIP_HEADER, name) == 0)
+  else if (strcmp(RegDataXMLUtils::REQUEST_URI, name) == 0)
   {
-    xml_node<>* spt_header = node->first_node(RegDataXMLUtils::HEADER);
+    compiled.spt_class = CompiledSpt::REQUEST_URI;
+    std::string req_uri = XMLUtils::get_text_or_cdata(node);
+    compiled.unusual_req_uri = ((req_uri.compare(0, 4, "sip:") == 0) ||
+                                (req_uri.compare(0, 4, "tel:") == 0));
+
+    compiled.regex = RegexCache::compile(req_uri);
+    if (compiled.regex.status())
+    {
+      compiled.class_error.set(Error::INVALID_IFC,
+                               "Invalid regular expression in Request URI service point trigger");
+    }
+  }
+  else if (strcmp(RegDataXMLUtils::SESSION_DESCRIPTION, name) == 0)
+  {
+    compiled.spt_class = CompiledSpt::SESSION_DESCRIPTION;
+    xml_node<>* spt_line = node->first_node(RegDataXMLUtils::LINE);
     xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
-    boost::regex header_regex;
-    boost::regex content_regex;
-    pjsip_hdr* header = NULL;
 
-    if (!spt_header)
+    if (!spt_line)
+    {
+      compiled.class_error.set(Error::INVALID_IFC,
+                               "Missing Line element for SessionDescription service point trigger");
+      return;
+    }
+
+    compiled.regex = RegexCache::compile(XMLUtils::get_text_or_cdata(spt_line));
+    if (compiled.regex.status())
+    {
+      compiled.class_error.set(Error::INVALID_IFC,
+                               "Invalid regular expression in Line element for Session Description service point trigger");
+      return;
+    }
+
+    if (spt_content)
     {
-      handle_invalid_ifc("Missing Header element for SIPHeader service point trigger",
-                         server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
+      compiled.has_content = true;
+      compiled.content_regex = RegexCache::compile(XMLUtils::get_text_or_cdata(spt_content));
+      if (compiled.content_regex.status())
+      {
+        compiled.content_error.set(Error::INVALID_IFC,
+                                   "Invalid regular expression in Content element for Session Description service point trigger");
+      }
     }
+  }
+}
+
+void Ifc::raise_error(const Error& error,
+                      const std::string& server_name,
+                      SAS::TrailId trail)
+{
+  if (error.type == Error::INVALID_IFC)
+  {
+    handle_invalid_ifc(error.reason, server_name,
+                       SASEvent::INVALID_IFC_IGNORED, 0, trail);
+  }
+  else if (error.type == Error::INVALID_XML)
+  {
+    // Generic SAS event to log skipping iFC due to syntactic error in parsing
+    // XML, most likely thrown by utility libraries.
+    std::string err_str = "iFC XML is syntactically invalid: " + error.reason;
+    TRC_ERROR(err_str.c_str());
+    SAS::Event event(trail, SASEvent::INVALID_XML_IGNORED, 0);
+    event.add_var_param(error.reason);
+    SAS::report_event(event);
+    throw ifc_error();
+  }
+}
+
+void Ifc::handle_invalid_ifc(std::string error,
+                             std::string server_name,
+                             int sas_event_id,
+                             int instance_id,
+                             SAS::TrailId trail)
+{
+  TRC_ERROR("Skip processing invalid iFC for %s: %s",
+            server_name.c_str(),
+            error.c_str());
+  SAS::Event event(trail, sas_event_id, instance_id);
+  event.add_var_param(server_name);
+  event.add_var_param(error);
+  SAS::report_event(event);
+  throw ifc_error();
+}
 
-    header_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_header),
-                                boost::regex_constants::icase |
-                                boost::regex_constants::no_except);
-    if (header_regex.status())
+void Ifc::handle_unusual_ifc(std::string error,
+                             std::string server_name,
+                             int sas_event_id,
+                             int instance_id,
+                             SAS::TrailId trail)
+{
+  TRC_INFO("Continue processing unusual iFC for %s: %s",
+           server_name.c_str(),
+           error.c_str());
+  SAS::Event event(trail, sas_event_id, instance_id);
+  event.add_var_param(server_name);
+  event.add_var_param(error);
+  SAS::report_event(event);
+}
+
+// Test if the SPT matches. Ignores grouping and negation, and just
+// evaluates the service point trigger.
+// @return true if the SPT matches, false if not
+// @throw ifc_error if there is a problem evaluating the trigger.
+bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
+                      const bool is_registered,               //< The registration state
+                      const bool is_initial_registration,
+                      pjsip_msg* msg,                   //< The message being matched
+                      const CompiledSpt& spt,           //< The compiled Service Point Trigger
+                      const std::string& server_name,
+                      SAS::TrailId trail)
+{
+  bool ret = false;
+
+  switch (spt.spt_class)
+  {
+  case CompiledSpt::METHOD:
+    // If we have a REGISTER we may need to match on RegistrationType.
+    ret = (pj_strcmp2(&msg->line.req.method.name, spt.method.c_str()) == 0);
+    if ((ret) && (spt.match_reg_types))
     {
-      handle_invalid_ifc("Invalid regular expression in Header element for SIPHeader service point trigger",
-                         server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
+      // Find expiry value from SIP message if it is present to determine
+      // whether we have a de-registration.
+      pj_bool_t dereg = PJUtils::is_deregistration(msg);
+
+      for (const std::pair<int, Error>& reg_type : spt.reg_types)
+      {
+        raise_error(reg_type.second, server_name, trail);
+
+        switch (reg_type.first)
+        {
+        case INITIAL_REGISTRATION:
+          ret = (is_initial_registration && !dereg);
+          break;
+        case REREGISTRATION:
+          ret = (!is_initial_registration && !dereg);
+          break;
+        case DEREGISTRATION:
+          ret = dereg;
+          break;
+        default:
+          // LCOV_EXCL_START Unreachable
+          TRC_WARNING("Impossible case %d", reg_type.first);
+          ret = false;
+          break;
+          // LCOV_EXCL_STOP
+        }
+
+        // If we've found a match, break out of the for loop.
+        if (ret)
+        {
+          break;
+        }
+      }
     }
+    break;
 
-    for (header = msg->hdr.next; header != &msg->hdr; header = header->next)
+  case CompiledSpt::SIP_HEADER:
+    raise_error(spt.class_error, server_name, trail);
+
+    for (pjsip_hdr* header = msg->hdr.next;
+         header != &msg->hdr;
+         header = header->next)
     {
-      if (boost::regex_search(PJUtils::pj_str_to_string(&(header->name)), header_regex))
+      // Match the header name in place, rather than copying it to a string.
+      if (boost::regex_search(header->name.ptr,
+                              header->name.ptr + header->name.slen,
+                              spt.regex))
       {
-        if (!spt_content)
+        if (!spt.has_content)
         {
           // We've found a matching header, and don't have to match on content
           ret = true;
         }
         else
         {
+          raise_error(spt.content_error, server_name, trail);
           std::string header_value = PJUtils::get_header_value(header);
-          // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once
-          if (content_regex.status())
-          {
-            content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                         boost::regex_constants::no_except);
-            if (content_regex.status())
-            {
-              handle_invalid_ifc("Invalid regular expression in Content element for SIPHeader service point trigger",
-                                 server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
-            }
-          }
 
-          if (boost::regex_search(header_value, content_regex))
+          if (boost::regex_search(header_value, spt.content_regex))
           {
             // We've found a matching header, and have matching content in one field
             ret = true;
@@ -256,11 +612,12 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
         break;
       }
     }
-  }
-  else if (strcmp(RegDataXMLUtils::SESSION_CASE, name) == 0)
-  {
-    int direction = XMLUtils::parse_integer(node, "session case", 0, 4);
-    switch (direction)
+    break;
+
+  case CompiledSpt::SESSION_CASE:
+    raise_error(spt.class_error, server_name, trail);
+
+    switch (spt.session_case)
     {
     case ORIGINATING_REGISTERED:
       ret = (session_case == SessionCase::Originating) && is_registered;
@@ -279,153 +636,121 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
       break;
     default:
       // LCOV_EXCL_START Unreachable
-      TRC_WARNING("Impossible case %d", direction);
+      TRC_WARNING("Impossible case %d", spt.session_case);
       ret = false;
       break;
     // LCOV_EXCL_STOP
     }
-  }
-  else if (strcmp(RegDataXMLUtils::REQUEST_URI, name) == 0)
-  {
-    boost::regex req_uri_regex;
-    std::string test_string;
-
-    if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
-    {
-      pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
-
-      // Match against the telephone-subscriber part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      test_string = PJUtils::pj_str_to_string(&req_uri->number);
-    }
-    else if (PJSIP_URI_SCHEME_IS_URN(msg->line.req.uri))
-    {
-      pjsip_other_uri* req_uri = (pjsip_other_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+    break;
 
-      // There is nothing in TS 29.228 about what to match against in the case
-      // of a urn URI. So just pull out the entire content (which is everything
-      // after "urn:").
-      test_string = PJUtils::pj_str_to_string(&req_uri->content);
-    }
-    else
+  case CompiledSpt::REQUEST_URI:
     {
-      pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+      std::string test_string;
 
-      // Compare against the hostport part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
+      if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
+      {
+        pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
 
-      if (req_uri->port != 0)
+        // Match against the telephone-subscriber part of the Req URI, as per Table F.1
+        // of 3GPP TS 29.228.
+        test_string = PJUtils::pj_str_to_string(&req_uri->number);
+      }
+      else if (PJSIP_URI_SCHEME_IS_URN(msg->line.req.uri))
       {
-        hostport += ":" + std::to_string(req_uri->port);
+        pjsip_other_uri* req_uri = (pjsip_other_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+
+        // There is nothing in TS 29.228 about what to match against in the case
+        // of a urn URI. So just pull out the entire content (which is everything
+        // after "urn:").
+        test_string = PJUtils::pj_str_to_string(&req_uri->content);
       }
+      else
+      {
+        pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
 
-      test_string = hostport;
-    }
+        // Compare against the hostport part of the Req URI, as per Table F.1
+        // of 3GPP TS 29.228.
+        std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
 
-    std::string req_uri = XMLUtils::get_text_or_cdata(node);
-    if ((req_uri.compare(0, 4, "sip:") == 0) ||
-        (req_uri.compare(0, 4, "tel:") == 0))
-    {
-      handle_unusual_ifc("Request URI should be a regex that matches either on "
-                         "the hostport of a SIP URI or a telephone number.",
-                         server_name, SASEvent::IFC_UNUSUAL, 0, trail);
-    }
+        if (req_uri->port != 0)
+        {
+          hostport += ":" + std::to_string(req_uri->port);
+        }
 
-    req_uri_regex = boost::regex(req_uri,
-                                 boost::regex_constants::no_except);
-    if (req_uri_regex.status())
-    {
-      handle_invalid_ifc("Invalid regular expression in Request URI service point trigger",
-                         server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
-    }
-      ret = boost::regex_search(test_string, req_uri_regex);
-  }
-  else if (strcmp(RegDataXMLUtils::SESSION_DESCRIPTION, name) == 0)
-  {
-    xml_node<>* spt_line = node->first_node(RegDataXMLUtils::LINE);
-    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
-    boost::regex line_regex;
-    boost::regex content_regex;
-    char newline = '\n';
+        test_string = hostport;
+      }
 
-    if (!spt_line)
-    {
-      handle_invalid_ifc("Missing Line element for SessionDescription service point trigger",
-                         server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
-    }
+      if (spt.unusual_req_uri)
+      {
+        handle_unusual_ifc("Request URI should be a regex that matches either on "
+                           "the hostport of a SIP URI or a telephone number.",
+                           server_name, SASEvent::IFC_UNUSUAL, 0, trail);
+      }
 
-    line_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_line),
-                              boost::regex_constants::no_except);
-    if (line_regex.status())
-    {
-      handle_invalid_ifc("Invalid regular expression in Line element for Session Description service point trigger",
-                         server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
+      raise_error(spt.class_error, server_name, trail);
+      ret = boost::regex_search(test_string, spt.regex);
     }
+    break;
+
+  case CompiledSpt::SESSION_DESCRIPTION:
+    raise_error(spt.class_error, server_name, trail);
 
     // Check if the message body is SDP.
     if (msg->body &&
         (!pj_stricmp2(&msg->body->content_type.type, "application")) &&
-        (!pj_stricmp2(&msg->body->content_type.subtype, "sdp")))
+        (!pj_stricmp2(&msg->body->content_type.subtype, "sdp")) &&
+        (msg->body->data != NULL))
     {
-      if (msg->body->data != NULL)
+      // Split the message body into each SDP line.
+      std::stringstream sdp((char *)msg->body->data);
+      std::string sdp_line;
+      while ((std::getline(sdp, sdp_line, '\n')) && (ret == false))
       {
-        // Split the message body into each SDP line.
-        std::stringstream sdp((char *)msg->body->data);
-        std::string sdp_line;
-        while((std::getline(sdp, sdp_line, newline)) && (ret == false))
+        // Match the line regex on the first character of the SDP line.
+        std::string sdp_identifier(1, sdp_line[0]);
+        if (boost::regex_search(sdp_identifier, spt.regex))
         {
-          // Match the line regex on the first character of the SDP line.
-          std::string sdp_identifier(1, sdp_line[0]);
-          if (boost::regex_search(sdp_identifier, line_regex))
+          if (!spt.has_content)
+          {
+            // We've found a matching line type, and don't have to match on content.
+            ret = true;
+          }
+          else
           {
-            if (!spt_content)
+            raise_error(spt.content_error, server_name, trail);
+
+            // Check the second character of the line is an equals sign, and then
+            // consider the content of the SDP line.
+            if (sdp_line.find_first_of("=") == 1)
             {
-              // We've found a matching line type, and don't have to match on content.
-              ret = true;
+              sdp_line.erase(0,2);
+              if (boost::regex_search(sdp_line, spt.content_regex))
+              {
+                // We've found a matching line.
+                ret = true;
+              }
             }
             else
             {
-              // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once.
-              if (content_regex.status())
-              {
-                content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                             boost::regex_constants::no_except);
-                if (content_regex.status())
-                {
-                  handle_invalid_ifc("Invalid regular expression in Content element for Session Description service point trigger",
-                                     server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
-                }
-              }
-
-              // Check the second character of the line is an equals sign, and then
-              // consider the content of the SDP line.
-              if (sdp_line.find_first_of("=") == 1)
-              {
-                sdp_line.erase(0,2);
-                if (boost::regex_search(sdp_line, content_regex))
-                {
-                  // We've found a matching line.
-                  ret = true;
-                }
-              }
-              else
-              {
-                TRC_WARNING("Found badly formatted SDP line: %s", sdp_line.c_str());
-              }
+              TRC_WARNING("Found badly formatted SDP line: %s", sdp_line.c_str());
             }
           }
         }
       }
     }
-  }
-  else
-  {
-    TRC_WARNING("Unimplemented iFC service point trigger class: %s", name);
+    break;
+
+  default:
+    // Either the trigger has no class (which is an error), or the class isn't
+    // one we support.
+    raise_error(spt.class_error, server_name, trail);
+    TRC_WARNING("Unimplemented iFC service point trigger class: %s",
+                spt.class_name.c_str());
     ret = false;
+    break;
   }
 
-  TRC_DEBUG("SPT class %s: result %s", name, ret ? "true" : "false");
+  TRC_DEBUG("SPT class %s: result %s", spt.class_name.c_str(), ret ? "true" : "false");
   return ret;
 }
 
@@ -440,40 +765,25 @@ bool Ifc::filter_matches(const SessionCase& session_case,
                          pjsip_msg* msg,
                          SAS::TrailId trail) const
 {
-  std::string ifc_str;
-  rapidxml::print(std::back_inserter(ifc_str), *_ifc, 0);
+  const CompiledIfc& ifc = *_program;
 
   SAS::Event event(trail, SASEvent::IFC_TESTING, 0);
-  event.add_var_param(ifc_str);
+  event.add_var_param(ifc.ifc_str);
   SAS::report_event(event);
-  std::string server_name;
+
+  const std::string& server_name = ifc.server_name;
 
   try
   {
-    xml_node<>* as = _ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
-    if (as == NULL)
-    {
-      handle_invalid_ifc("iFC missing ApplicationServer element", server_name,
-                         SASEvent::INVALID_IFC_IGNORED, 0, trail);
-    }
+    raise_error(ifc.as_error, server_name, trail);
 
-    server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
-    if (server_name.empty())
+    if (ifc.has_ppi)
     {
-      handle_invalid_ifc("iFC has no ServerName", server_name,
-                         SASEvent::INVALID_IFC_IGNORED, 0, trail);
-    }
+      raise_error(ifc.ppi_error, server_name, trail);
 
-    xml_node<>* profile_part_indicator = _ifc->first_node(RegDataXMLUtils::PROFILE_PART_INDICATOR);
-    if (profile_part_indicator)
-    {
-      bool reg = XMLUtils::parse_integer(profile_part_indicator,
-                                         "ProfilePartIndicator",
-                                         0,
-                                         1) == 0;
-      if (reg != is_registered)
+      if (ifc.ppi_reg != is_registered)
       {
-        std::string reg_state = reg ? "reg" : "unreg";
+        std::string reg_state = ifc.ppi_reg ? "reg" : "unreg";
         std::string reason = "iFC ProfilePartIndicator " + reg_state + " doesn't match";
         TRC_DEBUG(reason.c_str());
 
@@ -492,8 +802,7 @@ bool Ifc::filter_matches(const SessionCase& session_case,
     // That means each AsInvocation would have to belong to a pool,
     // though, and that's not easy in the current architecture.
 
-    xml_node<>* trigger = _ifc->first_node(RegDataXMLUtils::TRIGGER_POINT);
-    if (!trigger)
+    if (!ifc.has_trigger)
     {
       TRC_DEBUG("iFC has no trigger point - unconditional match");  // 3GPP TS 29.228 sB.2.2
 
@@ -504,8 +813,8 @@ bool Ifc::filter_matches(const SessionCase& session_case,
       return true;
     }
 
-    bool cnf = XMLUtils::parse_bool(trigger->first_node(RegDataXMLUtils::CONDITION_TYPE_CNF),
-                                    RegDataXMLUtils::CONDITION_TYPE_CNF);
+    raise_error(ifc.cnf_error, server_name, trail);
+    bool cnf = ifc.cnf;
 
     // In CNF (conjunct-of-disjuncts, i.e., big-AND of ORs), as we
     // work through each SPT we OR it into its group(s). At the end,
@@ -518,29 +827,20 @@ bool Ifc::filter_matches(const SessionCase& session_case,
     ifc_match.append(spt_relation).append(" each SPT match result to determine group result.\n");
     ifc_match.append(group_relation).append(" each group result to determine overall iFC match.\n\n");
 
-    for (xml_node<>* spt = trigger->first_node(RegDataXMLUtils::SPT);
-         spt;
-         spt = spt->next_sibling(RegDataXMLUtils::SPT))
+    for (const CompiledSpt& spt : ifc.spts)
     {
-      xml_node<>* neg_node = spt->first_node(RegDataXMLUtils::CONDITION_NEGATED);
-      bool neg = neg_node && XMLUtils::parse_bool(neg_node, RegDataXMLUtils::CONDITION_NEGATED);
+      raise_error(spt.neg_error, server_name, trail);
       bool spt_matched = spt_matches(session_case,
                                      is_registered,
                                      is_initial_registration,
                                      msg,
                                      spt,
-                                     ifc_str,
                                      server_name,
-                                     trail) != neg;
+                                     trail) != spt.negated;
+      raise_error(spt.group_error, server_name, trail);
 
-      for (xml_node<>* group_node = spt->first_node(RegDataXMLUtils::GROUP);
-           group_node;
-           group_node = group_node->next_sibling(RegDataXMLUtils::GROUP))
+      for (int32_t group_id : spt.groups)
       {
-        int32_t group_id = XMLUtils::parse_integer(group_node,
-                                                   "Group ID",
-                                                   0,
-                                                   std::numeric_limits<int32_t>::max());
         if (groups.find(group_id) == groups.end())
         {
           groups[group_id] = spt_matched;
@@ -589,22 +889,10 @@ bool Ifc::filter_matches(const SessionCase& session_case,
     TRC_DEBUG("%s", ifc_match.c_str());
     return ret;
   }
-  catch (xml_error err)
-  {
-    // Generic SAS event to log skipping iFC due to syntactic error in parsing
-    // XML, most likely thrown by utility libraries.
-    std::string err_str = "iFC XML is syntactically invalid: "
-      + std::string(err.what());
-    TRC_ERROR(err_str.c_str());
-    SAS::Event event(trail, SASEvent::INVALID_XML_IGNORED, 0);
-    event.add_var_param(std::string(err.what()));
-    SAS::report_event(event);
-    return false;
-  }
   catch (ifc_error err)
   {
-    // Skip processing iFC due to semantic error. Specific SAS event and
-    // TRC_ERROR is logged by handle_invalid_ifc.
+    // Skip processing iFC due to a semantic or syntactic error. Specific SAS
+    // event and TRC_ERROR is logged by raise_error.
     return false;
   }
 }
@@ -615,54 +903,12 @@ bool Ifc::filter_matches(const SessionCase& session_case,
 // the iFC).
 AsInvocation Ifc::as_invocation() const
 {
-  xml_node<>* as = _ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
-
-  AsInvocation as_invocation;
-  as_invocation.server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
-
-  // @@@ KSW Parse the URI and ensure it is parsable and a SIP URI
-  // here. If it's invalid, ignore it (seems the only sensible
-  // option).
-  //
-  // That means each AsInvocation would have to belong to a pool,
-  // though, and that's not easy in the current architecture.
-
-  std::string default_handling =
-                          XMLUtils::get_first_node_value(as, RegDataXMLUtils::DEFAULT_HANDLING);
-  if (default_handling == "0")
-  {
-    // DefaultHandling is present and set to 0, which is SESSION_CONTINUED.
-    as_invocation.default_handling = SESSION_CONTINUED;
-  }
-  else if (default_handling == "1")
+  if (_program->bad_default_handling)
   {
-    // DefaultHandling is present and set to 1, which is SESSION_TERMINATED.
-    as_invocation.default_handling = SESSION_TERMINATED;
-  }
-  else
-  {
-    // If the DefaultHandling attribute isn't present, or is malformed, default
-    // to SESSION_CONTINUED.
     TRC_WARNING("Badly formed DefaultHandling element in iFC (%s), defaulting to SESSION_CONTINUED",
-                default_handling.c_str());
-    as_invocation.default_handling = SESSION_CONTINUED;
-  }
-  as_invocation.service_info = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVICE_INFO);
-
-  xml_node<>* as_ext = as->first_node(RegDataXMLUtils::EXTENSION);
-  if (as_ext)
-  {
-    as_invocation.include_register_request =
-              XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_REQ);
-    as_invocation.include_register_response =
-             XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_RSP);
+                _program->default_handling.c_str());
   }
-  else
-  {
-    as_invocation.include_register_request = false;
-    as_invocation.include_register_response = false;
-  };
 
-  TRC_INFO("Found (triggered) server %s", as_invocation.server_name.c_str());
-  return as_invocation;
+  TRC_INFO("Found (triggered) server %s", _program->as_invocation.server_name.c_str());
+  return _program->as_invocation;
 }
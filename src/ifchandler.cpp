@@ -92,7 +92,7 @@ Ifcs::Ifcs(std::shared_ptr<xml_document<> > ifc_doc,
 
       if ((sifc_service) && (!ids.empty()))
       {
-        sifc_service->get_ifcs_from_id(ifc_map, ids, ifc_doc, trail);
+        sifc_service->get_ifcs_from_id(ifc_map, ids, trail);
       }
     }
 
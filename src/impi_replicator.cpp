@@ -0,0 +1,240 @@
+/**
+ * @file impi_replicator.cpp  Concurrent access to remote IMPI stores.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <memory>
+#include <pthread.h>
+
+#include "log.h"
+#include "utils.h"
+#include "impi_replicator.h"
+
+/// The progress of a read that has been sent to every remote store.  This is
+/// shared between the reading thread and the replication threads, as the
+/// reading thread stops waiting as soon as one store finds the IMPI.
+struct ReadState
+{
+  ReadState(size_t num_stores) : result(NULL), outstanding(num_stores)
+  {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~ReadState()
+  {
+    delete result; result = NULL;
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+  }
+
+  /// Records the result from one store, keeping it if it's the first one with
+  /// challenges.
+  void complete(ImpiStore::Impi* impi_obj)
+  {
+    pthread_mutex_lock(&lock);
+    if ((result == NULL) &&
+        (impi_obj != NULL) &&
+        !impi_obj->auth_challenges.empty())
+    {
+      result = impi_obj;
+      impi_obj = NULL;
+    }
+    --outstanding;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&lock);
+
+    delete impi_obj;
+  }
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  ImpiStore::Impi* result;
+  size_t outstanding;
+};
+
+ImpiReplicator::ImpiReplicator(const std::vector<ImpiStore*>& remote_stores,
+                               const std::vector<SNMP::EventAccumulatorTable*>& latency_tbls,
+                               ExceptionHandler* exception_handler,
+                               unsigned int num_threads,
+                               SNMP::CounterTable* dropped_writes_tbl) :
+  _remote_stores(remote_stores),
+  _latency_tbls(latency_tbls),
+  _read_pool(NULL),
+  _write_pool(NULL),
+  _pending(0),
+  _pending_writes(0),
+  _dropped_writes(0),
+  _dropped_writes_tbl(dropped_writes_tbl)
+{
+  // Pad the statistics tables so there's an entry for every store.
+  _latency_tbls.resize(_remote_stores.size(), NULL);
+
+  TRC_STATUS("Starting %d read and %d write threads for %d remote IMPI stores",
+             num_threads, num_threads, _remote_stores.size());
+  _read_pool = new Pool(exception_handler, &exception_callback, num_threads);
+  _read_pool->start();
+  _write_pool = new Pool(exception_handler, &exception_callback, num_threads);
+  _write_pool->start();
+}
+
+ImpiReplicator::~ImpiReplicator()
+{
+  _read_pool->stop();
+  _write_pool->stop();
+  _read_pool->join();
+  _write_pool->join();
+  delete _read_pool; _read_pool = NULL;
+  delete _write_pool; _write_pool = NULL;
+}
+
+void ImpiReplicator::write(const WriteFn& write_fn)
+{
+  std::atomic<uint64_t>* pending_writes = &_pending_writes;
+
+  for (size_t site = 0; site < _remote_stores.size(); ++site)
+  {
+    // Don't let slow remote sites build up an unbounded backlog of writes.
+    // The remote stores are only backups, so drop the write instead.
+    if (_pending_writes.load() >= MAX_PENDING_WRITES)
+    {
+      TRC_WARNING("Dropping write to remote IMPI store %d - too many writes pending",
+                  site + 1);
+      ++_dropped_writes;
+
+      if (_dropped_writes_tbl != NULL)
+      {
+        _dropped_writes_tbl->increment();
+      }
+
+      continue;
+    }
+
+    ++_pending_writes;
+    dispatch(_write_pool,
+             site,
+             [write_fn, pending_writes](ImpiStore* store)
+             {
+               write_fn(store);
+               --(*pending_writes);
+             },
+             [pending_writes]()
+             {
+               --(*pending_writes);
+             });
+  }
+}
+
+ImpiStore::Impi* ImpiReplicator::read_impi(const std::string& impi,
+                                           SAS::TrailId trail)
+{
+  if (_remote_stores.empty())
+  {
+    return NULL;
+  }
+
+  TRC_DEBUG("Read IMPI %s from %d remote stores", impi.c_str(), _remote_stores.size());
+  std::shared_ptr<ReadState> state =
+                             std::make_shared<ReadState>(_remote_stores.size());
+
+  for (size_t site = 0; site < _remote_stores.size(); ++site)
+  {
+    dispatch(_read_pool,
+             site,
+             [state, impi, trail](ImpiStore* store)
+             {
+               state->complete(store->get_impi(impi, trail));
+             },
+             [state]()
+             {
+               state->complete(NULL);
+             });
+  }
+
+  // Wait until a store finds the IMPI, or they've all failed to.  Any stores
+  // that are still outstanding finish in the background.
+  ImpiStore::Impi* impi_obj;
+
+  CW_IO_STARTS("Remote IMPI store read")
+  {
+    pthread_mutex_lock(&state->lock);
+    while ((state->result == NULL) && (state->outstanding > 0))
+    {
+      pthread_cond_wait(&state->cond, &state->lock);
+    }
+    impi_obj = state->result;
+    state->result = NULL;
+    pthread_mutex_unlock(&state->lock);
+  }
+  CW_IO_COMPLETES()
+
+  TRC_DEBUG("%s IMPI in remote stores", (impi_obj != NULL) ? "Found" : "Didn't find");
+  return impi_obj;
+}
+
+void ImpiReplicator::dispatch(Pool* pool,
+                              size_t site,
+                              const std::function<void(ImpiStore*)>& op,
+                              const std::function<void()>& abandon)
+{
+  ImpiStore* store = _remote_stores[site];
+  SNMP::EventAccumulatorTable* latency_tbl = _latency_tbls[site];
+  std::atomic<uint64_t>* pending = &_pending;
+
+  Request* work = new Request();
+  work->run = [store, latency_tbl, pending, op]()
+  {
+    Utils::StopWatch stopWatch;
+    stopWatch.start();
+
+    op(store);
+
+    unsigned long latency_us = 0;
+    if ((latency_tbl != NULL) && (stopWatch.read(latency_us)))
+    {
+      latency_tbl->accumulate(latency_us);
+    }
+
+    --(*pending);
+  };
+  work->abandon = [pending, abandon]()
+  {
+    abandon();
+    --(*pending);
+  };
+
+  ++_pending;
+  pool->add_work(work);
+}
+
+void ImpiReplicator::exception_callback(Request* work)
+{
+  // The operation failed, but a reader may still be waiting for it, so
+  // report it as complete.
+  work->abandon();
+  delete work;
+}
+
+ImpiReplicator::Pool::Pool(ExceptionHandler* exception_handler,
+                           void (*callback)(Request*),
+                           unsigned int num_threads) :
+  // The queue is unbounded, so that queuing work never blocks a worker
+  // thread.  Reads are bounded by the number of worker threads, and writes by
+  // MAX_PENDING_WRITES.
+  ThreadPool<Request*>(num_threads, exception_handler, callback, 0)
+{}
+
+ImpiReplicator::Pool::~Pool()
+{}
+
+void ImpiReplicator::Pool::process_work(Request*& work)
+{
+  work->run();
+  delete work; work = NULL;
+}
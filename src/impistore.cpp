@@ -262,6 +262,211 @@ ImpiStore::AKAAuthChallenge* ImpiStore::AKAAuthChallenge::from_json(rapidjson::V
   return auth_challenge;
 }
 
+void ImpiStore::write_varint(std::string& data, uint64_t value)
+{
+  // Write seven bits at a time, least significant first, setting the top bit
+  // of every byte except the last.
+  while (value >= 0x80)
+  {
+    data.push_back((char)((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  data.push_back((char)value);
+}
+
+void ImpiStore::write_string(std::string& data, const std::string& value)
+{
+  write_varint(data, value.size());
+  data.append(value);
+}
+
+bool ImpiStore::BinaryReader::read_byte(uint8_t& value)
+{
+  if (_ptr >= _end)
+  {
+    return false;
+  }
+
+  value = (uint8_t)*_ptr++;
+  return true;
+}
+
+bool ImpiStore::BinaryReader::read_varint(uint64_t& value)
+{
+  value = 0;
+
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    uint8_t byte;
+    if (!read_byte(byte))
+    {
+      return false;
+    }
+
+    value |= (uint64_t)(byte & 0x7f) << shift;
+
+    if ((byte & 0x80) == 0)
+    {
+      return true;
+    }
+  }
+
+  // The varint is too long to be valid.
+  return false;
+}
+
+bool ImpiStore::BinaryReader::read_string(std::string& value)
+{
+  uint64_t length;
+  if ((!read_varint(length)) || (length > (uint64_t)(_end - _ptr)))
+  {
+    return false;
+  }
+
+  value.assign(_ptr, length);
+  _ptr += length;
+  return true;
+}
+
+void ImpiStore::AuthChallenge::write_binary(std::string& data) const
+{
+  // Write all the base AuthChallenge fields, in a fixed order.  Subclasses
+  // append their own fields after these.
+  data.push_back((char)_type);
+  write_string(data, _nonce);
+  write_varint(data, _nonce_count);
+  write_varint(data, (uint64_t)std::max(_expires, 0));
+  write_string(data, _correlator);
+  write_string(data, _scscf_uri);
+  write_string(data, _timer_id);
+}
+
+ImpiStore::AuthChallenge* ImpiStore::AuthChallenge::from_binary(const std::string& data,
+                                                                bool include_expired)
+{
+  // Read the base AuthChallenge fields, and then call through to the class
+  // for the type of AuthChallenge to read its fields.  Unlike JSON, the fields
+  // are in a fixed order, so we deserialize "top-to-bottom".
+  BinaryReader reader(data);
+  uint8_t type;
+  std::string nonce;
+  uint64_t nonce_count;
+  uint64_t expires;
+  std::string correlator;
+  std::string scscf_uri;
+  std::string timer_id;
+
+  if ((!reader.read_byte(type)) ||
+      (!reader.read_string(nonce)) ||
+      (!reader.read_varint(nonce_count)) ||
+      (!reader.read_varint(expires)) ||
+      (!reader.read_string(correlator)) ||
+      (!reader.read_string(scscf_uri)) ||
+      (!reader.read_string(timer_id)))
+  {
+    TRC_WARNING("Truncated binary authentication challenge - dropping");
+    return NULL;
+  }
+
+  ImpiStore::AuthChallenge* auth_challenge = NULL;
+  if (type == Type::DIGEST)
+  {
+    auth_challenge = ImpiStore::DigestAuthChallenge::from_binary(reader);
+  }
+  else if (type == Type::AKA)
+  {
+    auth_challenge = ImpiStore::AKAAuthChallenge::from_binary(reader);
+  }
+  else
+  {
+    TRC_WARNING("Unknown binary authentication challenge type: %u", type);
+  }
+
+  if (auth_challenge != NULL)
+  {
+    auth_challenge->_nonce = nonce;
+    auth_challenge->_nonce_count = (uint32_t)nonce_count;
+    auth_challenge->_expires = (int)expires;
+    auth_challenge->_correlator = correlator;
+    auth_challenge->_scscf_uri = scscf_uri;
+    auth_challenge->_timer_id = timer_id;
+
+    // Apply the same defaults and checks as for JSON.
+    if (auth_challenge->_nonce_count == 0)
+    {
+      auth_challenge->_nonce_count = INITIAL_NONCE_COUNT;
+    }
+
+    if (auth_challenge->_expires == 0)
+    {
+      auth_challenge->_expires = time(NULL) + DEFAULT_EXPIRES;
+    }
+
+    if (auth_challenge->_nonce == "")
+    {
+      TRC_WARNING("No nonce in binary authentication challenge - dropping");
+      delete auth_challenge; auth_challenge = NULL;
+    }
+    else if ((auth_challenge->_expires < time(NULL)) && (!include_expired))
+    {
+      TRC_DEBUG("Expires in past - dropping");
+      delete auth_challenge; auth_challenge = NULL;
+    }
+  }
+
+  return auth_challenge;
+}
+
+void ImpiStore::DigestAuthChallenge::write_binary(std::string& data) const
+{
+  ImpiStore::AuthChallenge::write_binary(data);
+  write_string(data, _realm);
+  write_string(data, _qop);
+  write_string(data, _ha1);
+}
+
+ImpiStore::DigestAuthChallenge* ImpiStore::DigestAuthChallenge::from_binary(BinaryReader& reader)
+{
+  // Construct a DigestAuthChallenge and fill it in.  Check we have the realm,
+  // qop and ha1 - otherwise drop the record.
+  ImpiStore::DigestAuthChallenge* auth_challenge = new DigestAuthChallenge();
+
+  if ((!reader.read_string(auth_challenge->_realm)) ||
+      (!reader.read_string(auth_challenge->_qop)) ||
+      (!reader.read_string(auth_challenge->_ha1)) ||
+      (auth_challenge->_realm == "") ||
+      (auth_challenge->_qop == "") ||
+      (auth_challenge->_ha1 == ""))
+  {
+    TRC_WARNING("Incomplete binary digest authentication challenge - dropping");
+    delete auth_challenge; auth_challenge = NULL;
+  }
+
+  return auth_challenge;
+}
+
+void ImpiStore::AKAAuthChallenge::write_binary(std::string& data) const
+{
+  ImpiStore::AuthChallenge::write_binary(data);
+  write_string(data, _response);
+}
+
+ImpiStore::AKAAuthChallenge* ImpiStore::AKAAuthChallenge::from_binary(BinaryReader& reader)
+{
+  // Construct an AKAAuthChallenge and fill it in.  Check we have the response
+  // field - otherwise drop the record.
+  ImpiStore::AKAAuthChallenge* auth_challenge = new AKAAuthChallenge();
+
+  if ((!reader.read_string(auth_challenge->_response)) ||
+      (auth_challenge->_response == ""))
+  {
+    TRC_WARNING("Incomplete binary AKA authentication challenge - dropping");
+    delete auth_challenge; auth_challenge = NULL;
+  }
+
+  return auth_challenge;
+}
+
 ImpiStore::Impi::~Impi()
 {
   // Spin through the AuthChallenges, destroying them.
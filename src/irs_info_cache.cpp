@@ -0,0 +1,202 @@
+/**
+ * @file irs_info_cache.cpp  Cache of subscriber data retrieved from the HSS.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <algorithm>
+#include <time.h>
+
+#include "log.h"
+#include "irs_info_cache.h"
+
+IrsInfoCache::InvalidationShard::InvalidationShard()
+{
+  pthread_mutex_init(&lock, NULL);
+}
+
+IrsInfoCache::InvalidationShard::~InvalidationShard()
+{
+  pthread_mutex_destroy(&lock);
+}
+
+IrsInfoCache::IrsInfoCache(size_t capacity,
+                           int ttl_s,
+                           int num_shards,
+                           SNMP::CounterTable* hits_tbl,
+                           SNMP::CounterTable* misses_tbl) :
+  _ttl_ms((unsigned long)std::max(ttl_s, 0) * 1000),
+  _cache(capacity, num_shards, hits_tbl, misses_tbl),
+  _invalidation_shards(),
+  _sequence(0)
+{
+  for (size_t ii = 0; ii < _cache.num_shards(); ++ii)
+  {
+    _invalidation_shards.push_back(new InvalidationShard());
+  }
+
+  TRC_STATUS("Created HSS data cache with %lu shards of %lu entries",
+             _cache.num_shards(), _cache.shard_capacity());
+}
+
+IrsInfoCache::~IrsInfoCache()
+{
+  for (InvalidationShard* shard : _invalidation_shards)
+  {
+    delete shard;
+  }
+  _invalidation_shards.clear();
+}
+
+bool IrsInfoCache::get(const std::string& public_id,
+                       HSSConnection::irs_info& irs_info)
+{
+  unsigned long now = now_ms();
+  Entry entry;
+
+  // Expired entries, and entries read from the HSS before their IRS was last
+  // invalidated (through this public ID or its default public ID), are
+  // removed and count as misses.
+  bool found = _cache.get(public_id,
+                          entry,
+                          [&](const Entry& cached) -> bool
+                          {
+                            if (cached.expiry_ms <= now)
+                            {
+                              TRC_DEBUG("Cached HSS data for %s has expired",
+                                        public_id.c_str());
+                              return false;
+                            }
+
+                            return ((last_invalidation(public_id) <= cached.query_token) &&
+                                    ((cached.default_id == public_id) ||
+                                     (last_invalidation(cached.default_id) <= cached.query_token)));
+                          });
+
+  if (found)
+  {
+    TRC_DEBUG("Found cached HSS data for %s", public_id.c_str());
+    irs_info = *entry.irs_info;
+  }
+
+  return found;
+}
+
+void IrsInfoCache::put(const std::string& public_id,
+                       const HSSConnection::irs_info& irs_info,
+                       uint64_t query_token)
+{
+  AssociatedURIs associated_uris = irs_info._associated_uris;
+  std::vector<std::string> uris = associated_uris.get_all_uris();
+  std::string default_id;
+
+  if ((std::find(uris.begin(), uris.end(), public_id) == uris.end()) ||
+      (!associated_uris.get_default_impu(default_id, false)))
+  {
+    TRC_DEBUG("Not caching HSS data for %s as it isn't explicitly in its IRS",
+              public_id.c_str());
+    return;
+  }
+
+  // An invalidation after this check is caught when the entry is read, as
+  // get checks the invalidations again.
+  if (last_invalidation(public_id) > query_token)
+  {
+    TRC_DEBUG("Not caching HSS data for %s as it was invalidated during the query",
+              public_id.c_str());
+    return;
+  }
+
+  std::shared_ptr<HSSConnection::irs_info> cached_irs_info =
+                                std::make_shared<HSSConnection::irs_info>(irs_info);
+  cached_irs_info->_regstate.clear();
+  cached_irs_info->_prev_regstate.clear();
+
+  Entry entry;
+  entry.irs_info = cached_irs_info;
+  entry.default_id = default_id;
+  entry.query_token = query_token;
+  entry.expiry_ms = now_ms() + _ttl_ms;
+  _cache.put(public_id, entry);
+}
+
+void IrsInfoCache::invalidate(const std::string& public_id)
+{
+  TRC_DEBUG("Invalidating cached HSS data for %s", public_id.c_str());
+
+  uint64_t sequence = ++_sequence;
+  unsigned long now = now_ms();
+
+  record_invalidation(public_id, sequence, now);
+
+  Entry entry;
+  if ((_cache.erase(public_id, &entry)) && (entry.default_id != public_id))
+  {
+    // Invalidate the rest of the IRS too.
+    record_invalidation(entry.default_id, sequence, now);
+  }
+}
+
+IrsInfoCache::InvalidationShard* IrsInfoCache::get_invalidation_shard(const std::string& public_id) const
+{
+  return _invalidation_shards[std::hash<std::string>()(public_id) %
+                              _invalidation_shards.size()];
+}
+
+uint64_t IrsInfoCache::last_invalidation(const std::string& public_id)
+{
+  InvalidationShard* shard = get_invalidation_shard(public_id);
+  uint64_t sequence = 0;
+
+  pthread_mutex_lock(&shard->lock);
+  auto it = shard->invalidations.find(public_id);
+  if (it != shard->invalidations.end())
+  {
+    sequence = it->second;
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  return sequence;
+}
+
+void IrsInfoCache::record_invalidation(const std::string& public_id,
+                                       uint64_t sequence,
+                                       unsigned long now)
+{
+  InvalidationShard* shard = get_invalidation_shard(public_id);
+
+  pthread_mutex_lock(&shard->lock);
+  shard->invalidations[public_id] = sequence;
+  shard->invalidation_times.push_back(
+                 std::make_pair(now, std::make_pair(public_id, sequence)));
+
+  // An invalidation only matters while data read before it could still be in
+  // the cache.  Entries expire _ttl_ms after they are added, and HSS queries
+  // take far less than that, so invalidations can be forgotten after twice
+  // the TTL.
+  while ((!shard->invalidation_times.empty()) &&
+         (shard->invalidation_times.front().first + 2 * _ttl_ms <= now))
+  {
+    const std::pair<std::string, uint64_t>& old =
+                                       shard->invalidation_times.front().second;
+    auto it = shard->invalidations.find(old.first);
+    if ((it != shard->invalidations.end()) && (it->second == old.second))
+    {
+      shard->invalidations.erase(it);
+    }
+    shard->invalidation_times.pop_front();
+  }
+  pthread_mutex_unlock(&shard->lock);
+}
+
+unsigned long IrsInfoCache::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
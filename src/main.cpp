@@ -90,6 +90,9 @@ extern "C" {
 #include "astaire_impistore.h"
 #include "updater.h"
 #include "sasservice.h"
+#include "regex_cache.h"
+#include "binding_target_cache.h"
+#include "irs_info_cache.h"
 
 enum OptionTypes
 {
@@ -146,6 +149,17 @@ enum OptionTypes
   OPT_REMOTE_ALIASES,
   OPT_ALWAYS_SERVE_REMOTE_ALIASES,
   OPT_RAM_RECORD_EVERYTHING,
+  OPT_EVENT_QUEUE_SHARDS,
+  OPT_ENUM_CACHE_SIZE,
+  OPT_HSS_CACHE_SIZE,
+  OPT_HSS_CACHE_TTL,
+  OPT_IN_DIALOG_FAST_PATH,
+  OPT_OPTIONS_ON_TRANSPORT_THREAD,
+  OPT_HSS_THREADS,
+  OPT_ICSCF_CACHE_TTL,
+  OPT_ANALYTICS_QUEUE_SIZE,
+  OPT_REMOTE_IMPI_THREADS,
+  OPT_IMPI_BINARY_ENCODING,
 };
 
 
@@ -237,6 +251,17 @@ const static struct pj_getopt_option long_opt[] =
   { "blacklisted-scscfs",           required_argument, 0, OPT_BLACKLISTED_SCSCFS},
   { "enable-orig-sip-to-tel-coerce",no_argument,       0, OPT_ORIG_SIP_TO_TEL_COERCE},
   { "ram-record-everything",        no_argument,       0, OPT_RAM_RECORD_EVERYTHING},
+  { "event-queue-shards",           required_argument, 0, OPT_EVENT_QUEUE_SHARDS},
+  { "enum-cache-size",              required_argument, 0, OPT_ENUM_CACHE_SIZE},
+  { "hss-cache-size",               required_argument, 0, OPT_HSS_CACHE_SIZE},
+  { "hss-cache-ttl",                required_argument, 0, OPT_HSS_CACHE_TTL},
+  { "in-dialog-fast-path",          no_argument,       0, OPT_IN_DIALOG_FAST_PATH},
+  { "options-on-transport-thread",  no_argument,       0, OPT_OPTIONS_ON_TRANSPORT_THREAD},
+  { "hss-threads",                  required_argument, 0, OPT_HSS_THREADS},
+  { "icscf-cache-ttl",              required_argument, 0, OPT_ICSCF_CACHE_TTL},
+  { "analytics-queue-size",         required_argument, 0, OPT_ANALYTICS_QUEUE_SIZE},
+  { "remote-impi-threads",          required_argument, 0, OPT_REMOTE_IMPI_THREADS},
+  { "impi-binary-encoding",         no_argument,       0, OPT_IMPI_BINARY_ENCODING},
   { NULL,                           0,                 0, 0}
 };
 
@@ -255,6 +280,14 @@ const static int MIN_SESSION_EXPIRES = 90;
 static const std::string SPROUT_HTTP_MGMT_SOCKET_PATH = "/tmp/sprout-http-mgmt-socket";
 static const int NUM_HTTP_MGMT_THREADS = 5;
 
+// The number of compiled regexes to cache.  This comfortably covers the
+// distinct iFC triggers and ENUM rules in a typical deployment.
+static const size_t REGEX_CACHE_SIZE = 10000;
+
+// The number of parsed bindings to cache for routing requests to registered
+// subscribers.
+static const size_t BINDING_TARGET_CACHE_SIZE = 20000;
+
 static void usage(void)
 {
   puts("Options:\n"
@@ -322,6 +355,9 @@ static void usage(void)
        "                            IP addresses of ENUM server (can't be enabled at same\n"
        "                            time as -f)\n"
        " -x, --enum-suffix <suffix> Suffix appended to ENUM domains (default: .e164.arpa)\n"
+       "     --enum-cache-size N    Maximum number of ENUM domains to cache the results of DNS\n"
+       "                            queries for, when using an ENUM server. 0 means results are\n"
+       "                            not cached (default: 0)\n"
        " -f, --enum-file <file>     JSON ENUM config file (can't be enabled at same time as\n"
        "                            -E)\n"
        "     --default-tel-uri-translation\n"
@@ -356,11 +392,25 @@ static void usage(void)
        "                            Specify the HTTP bind address\n"
        " -o  --http-port <port>     Specify the HTTP bind port\n"
        " -q  --http-threads N       Number of HTTP threads (default: 1)\n"
-       " -P, --pjsip-threads N      Number of PJSIP threads (default: 1)\n"
+       " -P, --pjsip-threads N      Number of PJSIP transport threads. The threads share the\n"
+       "                            SIP sockets, but each UDP socket and TCP connection is read\n"
+       "                            by one thread at a time, so extra threads help most with\n"
+       "                            many TCP connections (default: 1)\n"
        " -B, --billing-cdf <server> Billing CDF server\n"
        " -W, --worker-threads N     Number of worker threads (default: 1)\n"
+       "     --event-queue-shards N Number of queues to spread SIP events across. Each worker\n"
+       "                            thread services one queue and steals from the others when\n"
+       "                            its own is empty. 0 or 1 means a single shared queue\n"
+       "                            (default: 0)\n"
+       "     --options-on-transport-thread\n"
+       "                            Answer OPTIONS polls to this node on the transport thread,\n"
+       "                            rather than queuing them to a worker thread\n"
        " -a, --analytics <directory>\n"
        "                            Generate analytics logs in specified directory\n"
+       "     --analytics-queue-size N\n"
+       "                            Number of analytics logs each thread can queue for writing on a\n"
+       "                            separate thread. Logs are dropped if the queue is full. 0 means\n"
+       "                            logs are written on the thread that makes them (default: 0)\n"
        " -A, --authentication       Enable authentication\n"
        "     --allow-emergency-registration\n"
        "                            Allow the P-CSCF to acccept emergency registrations.\n"
@@ -408,6 +458,8 @@ static void usage(void)
        "                            identified in SIP (for example if a cluster of nodes is identified by\n"
        "                            the name 'cluster.example.com', this value should be used instead of\n"
        "                            the hostnames or IP addresses of individual servers\n"
+       "     --in-dialog-fast-path  Forward in-dialog requests statelessly if no Sproutlet added\n"
+       "                            itself to the dialog, rather than creating a transaction\n"
        "     --non-registering-pbxes <comma-separated-list>\n"
        "                            A comma separated list of IP addresses that are treated as\n"
        "                            non-registering PBXes (i.e. INVITEs should be allowed by the \n"
@@ -423,6 +475,15 @@ static void usage(void)
        "                              requests that already have a Proxy-Authorization header.\n"
        "                            - 'initial_req_from_reg_digest_endpoint' means sprout will challenge\n"
        "                              requests from an endpoint that reigsters with SIP digest authentication.\n"
+       "     --remote-impi-threads N\n"
+       "                            Number of threads for writing authentication challenges to the\n"
+       "                            IMPI stores in remote sites concurrently, and the same number\n"
+       "                            again for reading them. 0 means the remote stores are accessed\n"
+       "                            one at a time on the worker threads (default: 0)\n"
+       "     --impi-binary-encoding\n"
+       "                            Write IMPIs to the IMPI store in a compact binary encoding rather\n"
+       "                            than as JSON. Both encodings are always read, so this should only\n"
+       "                            be enabled once every node in the deployment has been upgraded\n"
        "     --force-3pr-body       Always include the original REGISTER and 200 OK in the body of\n"
        "                            third-party REGISTER messages to application servers, even if the\n"
        "                            User-Data doesn't specify it\n"
@@ -456,6 +517,21 @@ static void usage(void)
        "     --http-acr-logging     Whether to include the bodies of ACR HTTP requests when they are logged \n"
        "                            to SAS\n"
        "     --homestead-timeout    The timeout in ms to use on HTTP requests to Homestead\n"
+       "     --hss-cache-size N     Maximum number of public IDs to cache subscriber data from\n"
+       "                            Homestead for, for use on calls. 0 means data is not cached\n"
+       "                            (default: 0)\n"
+       "     --hss-cache-ttl N      Time in seconds to cache subscriber data from Homestead for.\n"
+       "                            The cache is per node, so changes made through this node\n"
+       "                            invalidate its cached data but changes made through other\n"
+       "                            nodes don't, and the data can be stale for up to this long\n"
+       "                            (default: 30)\n"
+       "     --hss-threads N        Number of threads to make HSS queries for the S-CSCF, I-CSCF\n"
+       "                            and authentication Sproutlets on, so that worker threads\n"
+       "                            don't wait for Homestead. 0 means queries are made on the\n"
+       "                            worker threads (default: 0)\n"
+       "     --icscf-cache-ttl N    Time in seconds for the I-CSCF to cache the S-CSCF assigned to\n"
+       "                            each subscriber by the HSS. 0 means every request is routed\n"
+       "                            using a fresh HSS query (default: 0)\n"
        "     --blacklisted-scscfs   List of URIs of blacklisted S-CSCFs\n"
        " -N, --plugin-option <plugin>,<name>,<value>\n"
        "                            Provide an option value to a plugin.\n"
@@ -940,6 +1016,14 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case 'P':
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->pjsip_threads,
+                                    pjsip_threads,
+                                    Number of PJSIP threads);
+      }
+      break;
+
     case 'B':
       options->billing_cdf = std::string(pj_optarg);
       TRC_INFO("Use %s as billing cdf server", options->billing_cdf.c_str());
@@ -1089,6 +1173,11 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_IN_DIALOG_FAST_PATH:
+      options->in_dialog_fast_path = true;
+      TRC_INFO("In-dialog fast path enabled");
+      break;
+
     case OPT_NON_REGISTERING_PBXES:
       {
         options->pbxes = std::string(pj_optarg);
@@ -1274,6 +1363,80 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_EVENT_QUEUE_SHARDS:
+      {
+        VALIDATE_INT_PARAM(options->event_queue_shards,
+                           event_queue_shards,
+                           Number of event queue shards);
+      }
+      break;
+
+    case OPT_OPTIONS_ON_TRANSPORT_THREAD:
+      options->options_on_transport_thread = true;
+      TRC_INFO("OPTIONS polls will be answered on the transport thread");
+      break;
+
+    case OPT_ENUM_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->enum_cache_size,
+                           enum_cache_size,
+                           Maximum number of cached ENUM domains);
+      }
+      break;
+
+    case OPT_HSS_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->hss_cache_size,
+                           hss_cache_size,
+                           Maximum number of public IDs with cached HSS data);
+      }
+      break;
+
+    case OPT_HSS_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM(options->hss_cache_ttl,
+                           hss_cache_ttl,
+                           Time to cache HSS data);
+      }
+      break;
+
+    case OPT_HSS_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->hss_threads,
+                           hss_threads,
+                           Number of threads for asynchronous HSS queries);
+      }
+      break;
+
+    case OPT_ICSCF_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM(options->icscf_cache_ttl,
+                           icscf_cache_ttl,
+                           Time to cache S-CSCF assignments at the I-CSCF);
+      }
+      break;
+
+    case OPT_ANALYTICS_QUEUE_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->analytics_queue_size,
+                           analytics_queue_size,
+                           Number of analytics logs to queue per thread);
+      }
+      break;
+
+    case OPT_REMOTE_IMPI_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->remote_impi_threads,
+                           remote_impi_threads,
+                           Number of threads for accessing remote IMPI stores);
+      }
+      break;
+
+    case OPT_IMPI_BINARY_ENCODING:
+      options->impi_binary_encoding = true;
+      TRC_INFO("IMPIs will be stored in the compact binary encoding");
+      break;
+
     SPROUTLET_MACRO(SPROUTLET_OPTIONS)
 
     case 'h':
@@ -1531,7 +1694,8 @@ int create_astaire_stores(struct options opt,
                                                                       astaire_resolver,
                                                                       false,
                                                                       astaire_comm_monitor);
-    local_impi_store = new AstaireImpiStore(local_impi_data_store);
+    local_impi_store = new AstaireImpiStore(local_impi_data_store,
+                                            opt.impi_binary_encoding);
 
     // Only set up remote IMPI stores if some have been configured, and we need
     // the IMPI store to be GR.
@@ -1550,7 +1714,8 @@ int create_astaire_stores(struct options opt,
                                                                              true,
                                                                              remote_astaire_comm_monitor);
         remote_impi_data_stores.push_back(remote_data_store);
-        remote_impi_stores.push_back(new AstaireImpiStore(remote_data_store));
+        remote_impi_stores.push_back(new AstaireImpiStore(remote_data_store,
+                                                          opt.impi_binary_encoding));
       }
     }
   }
@@ -1559,7 +1724,8 @@ int create_astaire_stores(struct options opt,
     // Use local store.
     TRC_STATUS("Using local store");
     local_impi_data_store = (Store*)new LocalStore();
-    local_impi_store = new AstaireImpiStore(local_data_store);
+    local_impi_store = new AstaireImpiStore(local_data_store,
+                                            opt.impi_binary_encoding);
   }
   return 0;
 }
@@ -1668,6 +1834,14 @@ int main(int argc, char* argv[])
   opt.external_icscf_uri = "";
   opt.auth_enabled = PJ_FALSE;
   opt.enum_suffix = ".e164.arpa";
+  opt.enum_cache_size = 0;
+  opt.hss_cache_size = 0;
+  opt.hss_cache_ttl = 30;
+  opt.hss_threads = 0;
+  opt.icscf_cache_ttl = 0;
+  opt.analytics_queue_size = 0;
+  opt.remote_impi_threads = 0;
+  opt.impi_binary_encoding = false;
   opt.default_tel_uri_translation = false;
 
   // If changing this default for reg_max_expires, note that
@@ -1684,6 +1858,7 @@ int main(int argc, char* argv[])
   opt.http_address = "127.0.0.1";
   opt.http_port = 9888;
   opt.http_threads = 1;
+  opt.pjsip_threads = 1;
   opt.dns_servers.push_back("127.0.0.1");
   opt.billing_cdf = "";
   opt.emerg_reg_accepted = PJ_FALSE;
@@ -1708,6 +1883,7 @@ int main(int argc, char* argv[])
   opt.session_terminated_timeout_ms = SCSCFSproutlet::DEFAULT_SESSION_TERMINATED_TIMEOUT;
   opt.stateless_proxies.clear();
   opt.max_sproutlet_depth = SproutletProxy::DEFAULT_MAX_SPROUTLET_DEPTH;
+  opt.in_dialog_fast_path = false;
   opt.ralf_threads = 25;
   opt.non_register_auth_mode = NonRegisterAuthentication::NEVER;
   opt.force_third_party_register_body = false;
@@ -1724,6 +1900,8 @@ int main(int argc, char* argv[])
   opt.homestead_timeout = 750;
   opt.enable_orig_sip_to_tel_coerce = false;
   opt.request_on_queue_timeout = 4000;
+  opt.event_queue_shards = 0;
+  opt.options_on_transport_thread = false;
   opt.ram_record_everything = false;
   opt.always_serve_remote_aliases = false;
 
@@ -1805,11 +1983,6 @@ int main(int argc, char* argv[])
 
   start_signal_handlers();
 
-  if (opt.analytics_enabled)
-  {
-    analytics_logger = new AnalyticsLogger();
-  }
-
   std::vector<std::string> sproutlet_uris;
   SPROUTLET_MACRO(SPROUTLET_VERIFY_OPTIONS)
 
@@ -1926,6 +2099,24 @@ int main(int argc, char* argv[])
   SNMP::CounterTable* route_to_remote_alias_tbl = NULL;
   SNMP::CounterTable* accept_for_remote_alias_tbl = NULL;
 
+  SNMP::EventAccumulatorTable* rx_clone_bytes_tbl = NULL;
+
+  SNMP::CounterTable* regex_cache_hits_tbl = NULL;
+  SNMP::CounterTable* regex_cache_misses_tbl = NULL;
+  SNMP::CounterTable* regex_cache_evictions_tbl = NULL;
+
+  SNMP::CounterTable* hss_cache_hits_tbl = NULL;
+  SNMP::CounterTable* hss_cache_misses_tbl = NULL;
+
+  SNMP::EventAccumulatorTable* sproutlet_tsx_arena_bytes_tbl = NULL;
+  SNMP::CounterTable* sproutlet_fast_path_tbl = NULL;
+  SNMP::CounterTable* sproutlet_proxy_requests_tbl = NULL;
+
+  SNMP::CounterTable* homestead_requests_issued_tbl = NULL;
+  SNMP::CounterTable* homestead_requests_coalesced_tbl = NULL;
+
+  SNMP::CounterTable* analytics_records_dropped_tbl = NULL;
+
   if (opt.pcscf_enabled)
   {
     latency_table = SNMP::EventAccumulatorByScopeTable::create("bono_latency",
@@ -1992,8 +2183,61 @@ int main(int argc, char* argv[])
                                                            "1.2.826.0.1.1578918.9.3.44");
     accept_for_remote_alias_tbl = SNMP::CounterTable::create("accept_for_remote_alias",
                                                            "1.2.826.0.1.1578918.9.3.45");
+
+    rx_clone_bytes_tbl = SNMP::EventAccumulatorTable::create("sprout_rx_clone_bytes",
+                                                             "1.2.826.0.1.1578918.9.3.51");
+
+    regex_cache_hits_tbl = SNMP::CounterTable::create("regex_cache_hits",
+                                                      "1.2.826.0.1.1578918.9.3.46");
+    regex_cache_misses_tbl = SNMP::CounterTable::create("regex_cache_misses",
+                                                        "1.2.826.0.1.1578918.9.3.47");
+    regex_cache_evictions_tbl = SNMP::CounterTable::create("regex_cache_evictions",
+                                                           "1.2.826.0.1.1578918.9.3.48");
+
+    hss_cache_hits_tbl = SNMP::CounterTable::create("hss_cache_hits",
+                                                    "1.2.826.0.1.1578918.9.3.49");
+    hss_cache_misses_tbl = SNMP::CounterTable::create("hss_cache_misses",
+                                                      "1.2.826.0.1.1578918.9.3.50");
+
+    sproutlet_tsx_arena_bytes_tbl = SNMP::EventAccumulatorTable::create("sproutlet_tsx_arena_bytes",
+                                                                        "1.2.826.0.1.1578918.9.3.53");
+    sproutlet_fast_path_tbl = SNMP::CounterTable::create("sproutlet_fast_path_requests",
+                                                         "1.2.826.0.1.1578918.9.3.54");
+    sproutlet_proxy_requests_tbl = SNMP::CounterTable::create("sproutlet_proxy_requests",
+                                                              "1.2.826.0.1.1578918.9.3.62");
+
+    homestead_requests_issued_tbl = SNMP::CounterTable::create("homestead_requests_issued",
+                                                               "1.2.826.0.1.1578918.9.3.55");
+    homestead_requests_coalesced_tbl = SNMP::CounterTable::create("homestead_requests_coalesced",
+                                                                  "1.2.826.0.1.1578918.9.3.56");
   }
 
+  if (opt.analytics_enabled)
+  {
+    analytics_records_dropped_tbl = SNMP::CounterTable::create("analytics_records_dropped",
+                                                               "1.2.826.0.1.1578918.9.3.59");
+    size_t analytics_queue_size = (opt.analytics_queue_size > 0) ?
+                                    opt.analytics_queue_size : 0;
+    analytics_logger = new AnalyticsLogger(analytics_queue_size,
+                                           analytics_records_dropped_tbl);
+  }
+
+  // Create the process-wide cache of compiled regexes, used for iFCs and ENUM
+  // rules.
+  RegexCache* regex_cache = new RegexCache(REGEX_CACHE_SIZE,
+                                           RegexCache::DEFAULT_NUM_SHARDS,
+                                           regex_cache_hits_tbl,
+                                           regex_cache_misses_tbl,
+                                           regex_cache_evictions_tbl);
+  RegexCache::set_instance(regex_cache);
+
+  // Create the process-wide cache of parsed bindings, used to route requests
+  // to registered subscribers.
+  BindingTargetCache* binding_target_cache =
+                          new BindingTargetCache(&stack_data.cp.factory,
+                                                 BINDING_TARGET_CACHE_SIZE);
+  BindingTargetCache::set_instance(binding_target_cache);
+
   // Create Sprout's alarm objects.
   alarm_manager = new AlarmManager();
 
@@ -2091,7 +2335,8 @@ int main(int argc, char* argv[])
                       quiescing_mgr,
                       opt.billing_cdf,
                       sproutlet_uris,
-                      opt.enable_orig_sip_to_tel_coerce);
+                      opt.enable_orig_sip_to_tel_coerce,
+                      opt.pjsip_threads);
 
   if (status != PJ_SUCCESS)
   {
@@ -2165,7 +2410,11 @@ int main(int argc, char* argv[])
                                        homestead_lir_latency_table,
                                        hss_comm_monitor,
                                        sifc_service,
-                                       opt.homestead_timeout);
+                                       opt.homestead_timeout,
+                                       opt.hss_threads,
+                                       exception_handler,
+                                       homestead_requests_issued_tbl,
+                                       homestead_requests_coalesced_tbl);
   }
 
   // Create FIFC service
@@ -2188,7 +2437,8 @@ int main(int argc, char* argv[])
     enum_service = new DNSEnumService(opt.enum_servers,
                                       opt.enum_suffix,
                                       new DNSResolverFactory(),
-                                      enum_comm_monitor);
+                                      enum_comm_monitor,
+                                      opt.enum_cache_size);
   }
   else if (!opt.enum_file.empty())
   {
@@ -2290,11 +2540,23 @@ int main(int argc, char* argv[])
                            fifc_service,
                            &third_party_reg_stats_tbls,
                            opt.force_third_party_register_body);
+  // Create the cache of subscriber data from the HSS, if enabled.
+  IrsInfoCache* irs_info_cache = NULL;
+  if ((opt.hss_cache_size > 0) && (opt.hss_cache_ttl > 0))
+  {
+    irs_info_cache = new IrsInfoCache(opt.hss_cache_size,
+                                      opt.hss_cache_ttl,
+                                      IrsInfoCache::DEFAULT_NUM_SHARDS,
+                                      hss_cache_hits_tbl,
+                                      hss_cache_misses_tbl);
+  }
+
   subscriber_manager = new SubscriberManager(s4,
                                              hss_connection,
                                              analytics_logger,
                                              notify_sender,
-                                             registration_sender);
+                                             registration_sender,
+                                             irs_info_cache);
 
   // Start the HTTP stack early as plugins might need to register handlers
   // with it.
@@ -2377,7 +2639,11 @@ int main(int argc, char* argv[])
                                          opt.stateless_proxies,
                                          route_to_remote_alias_tbl,
                                          accept_for_remote_alias_tbl,
-                                         opt.max_sproutlet_depth);
+                                         opt.max_sproutlet_depth,
+                                         sproutlet_tsx_arena_bytes_tbl,
+                                         opt.in_dialog_fast_path,
+                                         sproutlet_fast_path_tbl,
+                                         sproutlet_proxy_requests_tbl);
     if (sproutlet_proxy == NULL)
     {
       TRC_ERROR("Failed to create SproutletProxy. Aborting startup");
@@ -2396,7 +2662,10 @@ int main(int argc, char* argv[])
                          load_monitor,
                          rph_service,
                          exception_handler,
-                         opt.request_on_queue_timeout);
+                         opt.request_on_queue_timeout,
+                         opt.event_queue_shards,
+                         rx_clone_bytes_tbl,
+                         opt.options_on_transport_thread);
 
   // Create worker threads first as they take work from the PJSIP threads so
   // need to be ready.
@@ -2564,6 +2833,12 @@ int main(int argc, char* argv[])
   }
 
   destroy_options();
+
+  // The cached bindings are allocated from the stack's pools, so must be freed
+  // before the stack is destroyed.
+  BindingTargetCache::set_instance(NULL);
+  delete binding_target_cache; binding_target_cache = NULL;
+
   destroy_stack();
 
   delete http_stack_sig; http_stack_sig = NULL;
@@ -2578,6 +2853,7 @@ int main(int argc, char* argv[])
   delete exception_handler;
   delete load_monitor;
   delete subscriber_manager;
+  delete irs_info_cache; irs_info_cache = NULL;
   delete notify_sender;
   delete s4;
   delete local_aor_store;
@@ -2668,6 +2944,21 @@ int main(int argc, char* argv[])
 
   delete route_to_remote_alias_tbl;
   delete accept_for_remote_alias_tbl;
+  delete rx_clone_bytes_tbl;
+
+  RegexCache::set_instance(NULL);
+  delete regex_cache; regex_cache = NULL;
+  delete regex_cache_hits_tbl;
+  delete regex_cache_misses_tbl;
+  delete regex_cache_evictions_tbl;
+  delete hss_cache_hits_tbl;
+  delete hss_cache_misses_tbl;
+  delete sproutlet_tsx_arena_bytes_tbl;
+  delete sproutlet_fast_path_tbl;
+  delete sproutlet_proxy_requests_tbl;
+  delete homestead_requests_issued_tbl;
+  delete homestead_requests_coalesced_tbl;
+  delete analytics_records_dropped_tbl;
 
   hc->stop_thread();
   delete hc;
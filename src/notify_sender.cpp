@@ -14,6 +14,7 @@
 
 
 #include <string>
+#include <memory>
 #include "stack.h"
 #include "log.h"
 #include "constants.h"
@@ -21,16 +22,152 @@
 #include "sproutsasevent.h"
 #include "aor_utils.h"
 
-// Print XML message body.
-static int xml_print_body(struct pjsip_msg_body *msg_body,
-                          char *buf,
-                          pj_size_t size)
+/// Streaming XML writer, used to render reginfo bodies straight to text.  The
+/// layout matches pj_xml_print - each element on its own line, indented by a
+/// space per level.
+class XmlWriter
 {
-  return pj_xml_print((const pj_xml_node*)msg_body->data,
-                      buf,
-                      size,
-                      PJ_TRUE);
-}
+public:
+  /// Constructor.
+  ///
+  /// @param out               - The string to write to.
+  /// @param indent            - The level of the first element written, if
+  ///                            rendering a fragment of a document.
+  XmlWriter(std::string& out, size_t indent = 0) :
+    _out(out),
+    _indent(indent),
+    _open(false)
+  {
+  }
+
+  void start_element(const pj_str_t& name)
+  {
+    if (!_elements.empty())
+    {
+      start_child();
+    }
+
+    _out.append("<");
+    _out.append(name.ptr, name.slen);
+    _elements.push_back(std::make_pair(std::string(name.ptr, name.slen), false));
+    _open = true;
+  }
+
+  /// Writes an attribute of the current element.  The value must already be
+  /// escaped.
+  void attribute(const pj_str_t& name, const std::string& value)
+  {
+    attribute_start(name);
+    _out.append(value);
+    _out.append("\"");
+  }
+
+  void attribute(const pj_str_t& name, const pj_str_t& value)
+  {
+    attribute(name, std::string(value.ptr, value.slen));
+  }
+
+  /// Writes an attribute of the current element with an empty value, and
+  /// returns the offset in the output at which the value belongs, so that it
+  /// can be filled in later.
+  size_t attribute_placeholder(const pj_str_t& name)
+  {
+    attribute_start(name);
+    size_t offset = _out.size();
+    _out.append("\"");
+    return offset;
+  }
+
+  /// Writes the content of the current element.  The content must already be
+  /// escaped.
+  void content(const std::string& content)
+  {
+    if (!content.empty())
+    {
+      close_start_tag();
+      _out.append(content);
+    }
+  }
+
+  /// Writes child elements of the current element that have already been
+  /// rendered, at the level below it.
+  void children(const std::string& children)
+  {
+    if (!children.empty())
+    {
+      close_start_tag();
+      _elements.back().second = true;
+      _out.append(children);
+    }
+  }
+
+  void end_element()
+  {
+    const std::pair<std::string, bool>& element = _elements.back();
+
+    if (_open)
+    {
+      // Empty element.
+      _out.append(" />");
+      _open = false;
+    }
+    else
+    {
+      if (element.second)
+      {
+        new_line(_out, _indent + _elements.size() - 1);
+      }
+
+      _out.append("</");
+      _out.append(element.first);
+      _out.append(">");
+    }
+
+    _elements.pop_back();
+  }
+
+  /// Writes the line break and indent for an element at the given level of
+  /// the document.
+  static void new_line(std::string& out, size_t level)
+  {
+    out.append("\n");
+    out.append(level, ' ');
+  }
+
+private:
+  void attribute_start(const pj_str_t& name)
+  {
+    _out.append(" ");
+    _out.append(name.ptr, name.slen);
+    _out.append("=\"");
+  }
+
+  void start_child()
+  {
+    close_start_tag();
+    _elements.back().second = true;
+    new_line(_out, _indent + _elements.size());
+  }
+
+  void close_start_tag()
+  {
+    if (_open)
+    {
+      _out.append(">");
+      _open = false;
+    }
+  }
+
+  std::string& _out;
+  size_t _indent;
+
+  /// The elements that haven't been ended yet, and whether each one has
+  /// child elements.
+  std::vector<std::pair<std::string, bool>> _elements;
+
+  /// Whether the start tag of the current element is still open.
+  bool _open;
+};
 
 NotifySender::NotifySender()
 {
@@ -117,11 +254,23 @@ void NotifySender::send_notifys(const std::string& aor_id,
     }
   }
 
+  // The body of the NOTIFYs is only rendered if a NOTIFY is needed, and then
+  // only once.
+  std::unique_ptr<RegInfoBody> reg_info;
+
   for (SubscriberDataUtils::ClassifiedSubscription* classified_subscription :
                                                        classified_subscriptions)
   {
     if (classified_subscription->_notify_required)
     {
+      if (!reg_info)
+      {
+        reg_info.reset(new RegInfoBody(associated_uris,
+                                       classified_bindings,
+                                       reg_state,
+                                       trail));
+      }
+
       TRC_DEBUG("Sending NOTIFY for subscription %s: %s",
                 classified_subscription->_id.c_str(),
                 classified_subscription->_reasons.c_str());
@@ -137,13 +286,10 @@ void NotifySender::send_notifys(const std::string& aor_id,
       pj_status_t status = create_subscription_notify(
                                          &tdata_notify,
                                          classified_subscription->_subscription,
-                                         aor_id,
-                                         associated_uris,
                                          cseq,
-                                         classified_bindings,
+                                         *reg_info,
                                          reg_state,
-                                         now,
-                                         trail);
+                                         now);
 
       if (status == PJ_SUCCESS)
       {
@@ -194,13 +340,10 @@ void NotifySender::send_notifys(const std::string& aor_id,
 pj_status_t NotifySender::create_subscription_notify(
                                   pjsip_tx_data** tdata_notify,
                                   Subscription* s,
-                                  const std::string& aor,
-                                  const AssociatedURIs& associated_uris,
                                   int cseq,
-                                  const ClassifiedBindings& classified_bindings,
+                                  const RegInfoBody& reg_info,
                                   const RegistrationState& reg_state,
-                                  int now,
-                                  SAS::TrailId trail)
+                                  int now)
 {
   // Set the correct subscription state header
   SubscriptionState state = SubscriptionState::ACTIVE;
@@ -214,14 +357,11 @@ pj_status_t NotifySender::create_subscription_notify(
 
   pj_status_t status = create_notify(tdata_notify,
                                      s,
-                                     aor,
-                                     associated_uris,
                                      cseq,
-                                     classified_bindings,
+                                     reg_info,
                                      reg_state,
                                      state,
-                                     expiry,
-                                     trail);
+                                     expiry);
   return status;
 }
 
@@ -230,14 +370,11 @@ pj_status_t NotifySender::create_subscription_notify(
 pj_status_t NotifySender::create_notify(
                                     pjsip_tx_data** tdata_notify,
                                     Subscription* subscription,
-                                    const std::string& aor,
-                                    const AssociatedURIs& associated_uris,
                                     int cseq,
-                                    const ClassifiedBindings& classified_bindings,
+                                    const RegInfoBody& reg_info,
                                     const RegistrationState& reg_state,
                                     const SubscriptionState& subscription_state,
-                                    int expiry,
-                                    SAS::TrailId trail)
+                                    int expiry)
 {
   pj_status_t status = create_request_from_subscription(tdata_notify,
                                                         subscription,
@@ -309,18 +446,15 @@ pj_status_t NotifySender::create_notify(
 
     pj_list_push_back( &(*tdata_notify)->msg->hdr, sub_state_hdr);
 
-    // Complete body
-    pjsip_msg_body *body2;
-    body2 = PJ_POOL_ZALLOC_T((*tdata_notify)->pool, pjsip_msg_body);
-    status = notify_create_body(body2,
-                               (*tdata_notify)->pool,
-                                aor,
-                                associated_uris,
-                                subscription,
-                                classified_bindings,
-                                reg_state,
-                                trail);
-    (*tdata_notify)->msg->body = body2;
+    // Complete body, patching this subscription into the shared rendering.
+    TRC_DEBUG("Create body of a SIP NOTIFY");
+    std::string body = reg_info.render(subscription->_to_tag);
+    pj_str_t body_str;
+    pj_cstr(&body_str, body.c_str());
+    (*tdata_notify)->msg->body = pjsip_msg_body_create((*tdata_notify)->pool,
+                                                       &STR_MIME_TYPE,
+                                                       &STR_MIME_SUBTYPE,
+                                                       &body_str);
   }
   else
   {
@@ -362,79 +496,142 @@ pj_status_t NotifySender::create_request_from_subscription(
   return status;
 }
 
-// Create the body of a SIP NOTIFY
-pj_status_t NotifySender::notify_create_body(
-                                  pjsip_msg_body* body,
-                                  pj_pool_t *pool,
-                                  const std::string& aor,
+// Render the complete XML body for the NOTIFYs, leaving out the id of each
+// registration element.
+NotifySender::RegInfoBody::RegInfoBody(
                                   const AssociatedURIs& associated_uris,
-                                  Subscription* subscription,
                                   const ClassifiedBindings& classified_bindings,
-                                  const RegistrationState& reg_state,
+                                  RegistrationState reg_state,
                                   SAS::TrailId trail)
 {
-  TRC_DEBUG("Create body of a SIP NOTIFY");
+  TRC_DEBUG("Create the XML body for a SIP NOTIFY");
 
-  pj_xml_node* doc = notify_create_reg_state_xml(pool,
-                                                 aor,
-                                                 associated_uris,
-                                                 subscription,
-                                                 classified_bindings,
-                                                 reg_state,
-                                                 trail);
+  // Building the pub-GRUUs needs a pool.
+  pj_pool_t* pool = pj_pool_create(&stack_data.cp.factory,
+                                   "reginfo",
+                                   1024,
+                                   512,
+                                   NULL);
 
-  if (doc == NULL)
-  {
-    // LCOV_EXCL_START
-    TRC_DEBUG("Failed to create body");
-    return PJ_FALSE;
-    // LCOV_EXCL_STOP
-  }
+  _text.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  XmlWriter writer(_text);
 
-  body->content_type.type = STR_MIME_TYPE;
-  body->content_type.subtype = STR_MIME_SUBTYPE;
+  // Create the root document
+  writer.start_element(STR_REGINFO);
+  writer.attribute(STR_XMLNS_NAME, STR_XMLNS_VAL);
+  writer.attribute(STR_XMLNS_GRUU_NAME, STR_XMLNS_GRUU_VAL);
+  writer.attribute(STR_XMLNS_XSI_NAME, STR_XMLNS_XSI_VAL);
+  writer.attribute(STR_XMLNS_ERE_NAME, STR_XMLNS_ERE_VAL);
+  writer.attribute(STR_VERSION, STR_VERSION_VAL);
 
-  body->data = doc;
-  body->len = 0;
+  // Add the state - this will always be FULL (the subscription RFC says it
+  // should be partial except on an initial subscriptions, but the TS specs
+  // say it should always be full).
+  writer.attribute(STR_STATE, STR_FULL);
 
-  body->print_body = &xml_print_body;
+  // The contact elements are the same in every registration element, so
+  // render them once.  They are two levels down, inside a registration
+  // element.
+  std::vector<std::string> contacts;
 
-  return PJ_SUCCESS;
-}
+  for (SubscriberDataUtils::ClassifiedBinding* classified_binding :
+                                                            classified_bindings)
+  {
+    pj_str_t c_state;
+    pj_str_t c_event;
+    switch (classified_binding->_contact_event)
+    {
+      case SubscriberDataUtils::ContactEvent::REGISTERED:
+        c_event = STR_REGISTERED;
+        c_state = STR_ACTIVE;
+        break;
+      case SubscriberDataUtils::ContactEvent::CREATED:
+        c_event = STR_CREATED;
+        c_state = STR_ACTIVE;
+        break;
+      case SubscriberDataUtils::ContactEvent::REFRESHED:
+        c_event = STR_REFRESHED;
+        c_state = STR_ACTIVE;
+        break;
+      case SubscriberDataUtils::ContactEvent::SHORTENED:
+        c_event = STR_SHORTENED;
+        c_state = STR_ACTIVE;
+        break;
+      case SubscriberDataUtils::ContactEvent::EXPIRED:
+        c_event = STR_EXPIRED;
+        c_state = STR_TERMINATED;
+        break;
+      case SubscriberDataUtils::ContactEvent::UNREGISTERED:
+        c_event = STR_UNREGISTERED;
+        c_state = STR_TERMINATED;
+        break;
+      case SubscriberDataUtils::ContactEvent::DEACTIVATED:
+        c_event = STR_DEACTIVATED;
+        c_state = STR_TERMINATED;
+        break;
+    }
 
-// Create complete XML body for a NOTIFY
-pj_xml_node* NotifySender::notify_create_reg_state_xml(
-                                  pj_pool_t* pool,
-                                  const std::string& aor,
-                                  const AssociatedURIs& associated_uris,
-                                  Subscription* subscription,
-                                  const ClassifiedBindings& classified_bindings,
-                                  const RegistrationState& reg_state,
-                                  SAS::TrailId trail)
-{
-  TRC_DEBUG("Create the XML body for a SIP NOTIFY");
+    std::string contact;
+    XmlWriter::new_line(contact, 2);
+    XmlWriter contact_writer(contact, 2);
+
+    // Contact node requires an id, state and event
+    contact_writer.start_element(STR_CONTACT);
+    contact_writer.attribute(STR_ID, Utils::xml_escape(classified_binding->_id));
+    contact_writer.attribute(STR_STATE, c_state);
+    contact_writer.attribute(STR_EVENT_LOWER, c_event);
+
+    // Create and add the URI element.
+    contact_writer.start_element(STR_URI);
+    contact_writer.content(Utils::xml_escape(classified_binding->_binding->_uri));
+    contact_writer.end_element();
+
+    // Add all 'unknown parameters' from the contact header into the contact
+    // element as <unknown-param> elements. For example, a contact header that
+    // looks like this:
+    //
+    //     Contact: <sip:alice@example.com;p1=v1>;expires=3600;p2;p3=v3
+    //
+    // Would result in the following unknown param elements being added.
+    //
+    //     <unknown-param name="p2" />
+    //     <unknown-param name="p3">v3<unknown-param>
+    //
+    // Note that p1 is not included (as it's a URI parameter) and expires is
+    // not included (as it is defined in RFC 3261 so is a 'known' parameter).
+    for (const std::pair<std::string, std::string>& param :
+                                          classified_binding->_binding->_params)
+    {
+      // RFC 3680 defines unknown parameters as any parameter not defined in
+      // RFC 3261. RFC 3261 defines 'q' and 'expires' so don't add these.
+      if ((param.first != "q") && (param.first != "expires"))
+      {
+        // Add the parameter value as the element content, and the parameter
+        // name as the 'name' attribute.
+        contact_writer.start_element(STR_UNKNOWN_PARAM);
+        contact_writer.attribute(STR_NAME, param.first);
+        contact_writer.content(Utils::xml_check_escape(param.second));
+        contact_writer.end_element();
+      }
+    }
 
-  // Create the root document
-  pj_xml_node* doc = pj_xml_node_new(pool, &STR_REGINFO);
-
-  // Add attributes to the doc
-  pj_xml_attr* attr = pj_xml_attr_new(pool, &STR_XMLNS_NAME, &STR_XMLNS_VAL);
-  pj_xml_add_attr(doc, attr);
-  attr = pj_xml_attr_new(pool, &STR_XMLNS_GRUU_NAME, &STR_XMLNS_GRUU_VAL);
-  pj_xml_add_attr(doc, attr);
-  attr = pj_xml_attr_new(pool, &STR_XMLNS_XSI_NAME, &STR_XMLNS_XSI_VAL);
-  pj_xml_add_attr(doc, attr);
-  attr = pj_xml_attr_new(pool, &STR_XMLNS_ERE_NAME, &STR_XMLNS_ERE_VAL);
-  pj_xml_add_attr(doc, attr);
-  attr = pj_xml_attr_new(pool, &STR_VERSION, &STR_VERSION_VAL);
-  pj_xml_add_attr(doc, attr);
+    std::string gruu =
+      Utils::xml_escape(AoRUtils::pub_gruu_str(classified_binding->_binding,
+                                               pool));
 
-  // Add the state - this will always be FULL (the subscription RFC says it
-  // should be partial except on an initial subscriptions, but the TS specs
-  // say it should always be full).
-  const pj_str_t* state_str = &STR_FULL;
-  attr = pj_xml_attr_new(pool, &STR_STATE, state_str);
-  pj_xml_add_attr(doc, attr);
+    if (!gruu.empty())
+    {
+      TRC_DEBUG("Create pub-gruu node");
+      contact_writer.start_element(STR_XML_PUB_GRUU);
+      contact_writer.attribute(STR_URI, gruu);
+      contact_writer.end_element();
+    }
+
+    contact_writer.end_element();
+    contacts.push_back(contact);
+  }
+
+  pj_pool_release(pool);
 
   // Create the registration nodes.  We need one per IMPU in the Implicit
   // Registration Set, with the same binding/contact information in each.
@@ -466,6 +663,9 @@ pj_xml_node* NotifySender::notify_create_reg_state_xml(
     SAS::report_event(event);
   }
 
+  pj_str_t reg_state_str = (reg_state == RegistrationState::ACTIVE) ?
+                                                 STR_ACTIVE : STR_TERMINATED;
+
   // Iterate over the unbarred IMPUs in the IRS, inserting a registration
   // element for each one
   std::vector<std::string> irs_impus = associated_uris.get_unbarred_uris();
@@ -498,193 +698,55 @@ pj_xml_node* NotifySender::notify_create_reg_state_xml(
       unescaped_aor = "sip:wildcardimpu@wildcard";
     }
 
-    pj_str_t reg_aor;
-    pj_strdup2(pool, &reg_aor, Utils::xml_escape(unescaped_aor).c_str());
-    std::string unescaped_reg_id = subscription->_to_tag;
-    pj_str_t reg_id;
-    pj_strdup2(pool, &reg_id, Utils::xml_escape(unescaped_reg_id).c_str());
-    pj_str_t reg_state_str;
-    reg_state_str = (reg_state == RegistrationState::ACTIVE) ? STR_ACTIVE :
-                                                               STR_TERMINATED;
-    pj_xml_node* reg_node = create_reg_node(pool,
-                                            &reg_aor,
-                                            &reg_id,
-                                            &reg_state_str);
-
-    // Create the contact nodes
-    // For each binding, add a contact node to the registration node
-    for (SubscriberDataUtils::ClassifiedBinding* classified_binding :
-                                                            classified_bindings)
-    {
-      std::string unescaped_c_id = classified_binding->_id;
-      pj_str_t c_id;
-      pj_strdup2(pool, &c_id, Utils::xml_escape(unescaped_c_id).c_str());
-
-      pj_str_t c_state;
-      pj_str_t c_event;
-      switch (classified_binding->_contact_event)
-      {
-        case SubscriberDataUtils::ContactEvent::REGISTERED:
-          c_event = STR_REGISTERED;
-          c_state = STR_ACTIVE;
-          break;
-        case SubscriberDataUtils::ContactEvent::CREATED:
-          c_event = STR_CREATED;
-          c_state = STR_ACTIVE;
-          break;
-        case SubscriberDataUtils::ContactEvent::REFRESHED:
-          c_event = STR_REFRESHED;
-          c_state = STR_ACTIVE;
-          break;
-        case SubscriberDataUtils::ContactEvent::SHORTENED:
-          c_event = STR_SHORTENED;
-          c_state = STR_ACTIVE;
-          break;
-        case SubscriberDataUtils::ContactEvent::EXPIRED:
-          c_event = STR_EXPIRED;
-          c_state = STR_TERMINATED;
-          break;
-        case SubscriberDataUtils::ContactEvent::UNREGISTERED:
-          c_event = STR_UNREGISTERED;
-          c_state = STR_TERMINATED;
-          break;
-        case SubscriberDataUtils::ContactEvent::DEACTIVATED:
-          c_event = STR_DEACTIVATED;
-          c_state = STR_TERMINATED;
-          break;
-      }
-
-      pj_xml_node* contact_node = create_contact_node(pool,
-                                                      &c_id,
-                                                      &c_state,
-                                                      &c_event);
-
-      // Create and add the URI element.
-      pj_str_t c_uri;
+    // Registration node requires a aor, id and state.  The id is the
+    // subscription's, so is left to be patched in for each NOTIFY.
+    writer.start_element(STR_REGISTRATION);
+    writer.attribute(STR_AOR, Utils::xml_escape(unescaped_aor));
+    _id_offsets.push_back(writer.attribute_placeholder(STR_ID));
+    writer.attribute(STR_STATE, reg_state_str);
 
-      if (classified_binding->_binding->_uri.size() > 0)
-      {
-        std::string unescaped_c_uri = classified_binding->_binding->_uri;
-        pj_strdup2(pool, &c_uri, Utils::xml_escape(unescaped_c_uri).c_str());
-      }
-
-      pj_xml_node* uri_node = pj_xml_node_new(pool, &STR_URI);
-      pj_strdup(pool, &uri_node->content, &c_uri);
-      pj_xml_add_node(contact_node, uri_node);
-
-      // Add all 'unknown parameters' from the contact header into the contact
-      // element as <unknown-param> elements. For example, a contact header that
-      // looks like this:
-      //
-      //     Contact: <sip:alice@example.com;p1=v1>;expires=3600;p2;p3=v3
-      //
-      // Would result in the following unknown param elements being added.
-      //
-      //     <unknown-param name="p2" />
-      //     <unknown-param name="p3">v3<unknown-param>
-      //
-      // Note that p1 is not included (as it's a URI parameter) and expires is
-      // not included (as it is defined in RFC 3261 so is a 'known' parameter).
-      for (const std::pair<std::string, std::string>& param :
-                                          classified_binding->_binding->_params)
-      {
-        // RFC 3680 defines unknown parameters as any parameter not defined in
-        // RFC 3261. RFC 3261 defines 'q' and 'expires' so don't add these.
-        if ((param.first != "q") && (param.first != "expires"))
-        {
-          // Add the parameter value as the element content, and the parameter
-          // name as the 'name' attribute.
-          pj_xml_node* unknown_param_node =
-                                      pj_xml_node_new(pool, &STR_UNKNOWN_PARAM);
-          std::string escaped_value = Utils::xml_check_escape(param.second);
-          pj_strdup2(pool, &unknown_param_node->content, escaped_value.c_str());
-
-          pj_str_t param_name;
-          pj_strdup2(pool, &param_name, param.first.c_str());
-          pj_xml_attr* name_attr =
-                                  pj_xml_attr_new(pool, &STR_NAME, &param_name);
-          pj_xml_add_attr(unknown_param_node, name_attr);
-
-          pj_xml_add_node(contact_node, unknown_param_node);
-        }
-      }
-
-      pj_str_t gruu;
-      pj_strdup2(pool,
-                 &gruu,
-                 Utils::xml_escape(AoRUtils::pub_gruu_str(classified_binding->_binding,
-                                                          pool))
-                                  .c_str());
-
-      if (gruu.slen != 0)
-      {
-        TRC_DEBUG("Create pub-gruu node");
-        pj_xml_node* gruu_node = pj_xml_node_new(pool, &STR_XML_PUB_GRUU);
-        attr = pj_xml_attr_new(pool, &STR_URI, &gruu);
-        pj_xml_add_attr(gruu_node, attr);
-        pj_xml_add_node(contact_node, gruu_node);
-      }
+    // For each binding, add a contact node to the registration node
+    std::string children;
 
+    for (const std::string& contact : contacts)
+    {
       if (is_wildcard_impu)
       {
         // Add the wildcard node to the registration node
         TRC_DEBUG("Add wildcard registration node");
-        pj_str_t c_wildcard;
-        pj_strdup2(pool, &c_wildcard, Utils::xml_escape(*impu).c_str());
-        pj_xml_node* wildcard_node = pj_xml_node_new(pool, &STR_WILDCARD);
-        pj_strdup(pool, &wildcard_node->content, &c_wildcard);
-        pj_xml_add_node(reg_node, wildcard_node);
+        XmlWriter::new_line(children, 2);
+        XmlWriter wildcard_writer(children, 2);
+        wildcard_writer.start_element(STR_WILDCARD);
+        wildcard_writer.content(Utils::xml_escape(*impu));
+        wildcard_writer.end_element();
       }
 
-      // Add the contact node to the registration node
-      pj_xml_add_node(reg_node, contact_node);
+      children.append(contact);
     }
 
-    pj_xml_add_node(doc, reg_node);
-
+    writer.children(children);
+    writer.end_element();
   }
 
-  return doc;
-}
-
-// Return a XML registration node with the attributes populated
-pj_xml_node* NotifySender::create_reg_node(pj_pool_t* pool,
-                                           pj_str_t* aor,
-                                           pj_str_t* id,
-                                           pj_str_t* state)
-{
-  TRC_DEBUG("Create registration node");
-
-  pj_xml_node* reg_node = pj_xml_node_new(pool, &STR_REGISTRATION);
-
-  // Registration node requires a aor, id and state
-  pj_xml_attr* aor_attr = pj_xml_attr_new(pool, &STR_AOR, aor);
-  pj_xml_add_attr(reg_node, aor_attr);
-  pj_xml_attr* id_attr = pj_xml_attr_new(pool, &STR_ID, id);
-  pj_xml_add_attr(reg_node, id_attr);
-  pj_xml_attr* state_attr = pj_xml_attr_new(pool, &STR_STATE, state);
-  pj_xml_add_attr(reg_node, state_attr);
-
-  return reg_node;
+  writer.end_element();
+  _text.append("\n");
 }
 
-// Return a XML contact node with the attributes populated
-pj_xml_node* NotifySender::create_contact_node(pj_pool_t* pool,
-                                               pj_str_t* id,
-                                               pj_str_t* state,
-                                               pj_str_t* event)
+// Patch the subscription's id into the rendered body.
+std::string NotifySender::RegInfoBody::render(const std::string& to_tag) const
 {
-  TRC_DEBUG("Create contact node");
-
-  pj_xml_node* contact_node = pj_xml_node_new(pool, &STR_CONTACT);
+  std::string reg_id = Utils::xml_escape(to_tag);
+  std::string body;
+  body.reserve(_text.size() + _id_offsets.size() * reg_id.size());
 
-  // Contact node requires an id, state and event
-  pj_xml_attr* id_attr = pj_xml_attr_new(pool, &STR_ID, id);
-  pj_xml_add_attr(contact_node, id_attr);
-  pj_xml_attr* state_attr = pj_xml_attr_new(pool, &STR_STATE, state);
-  pj_xml_add_attr(contact_node, state_attr);
-  pj_xml_attr* event_attr = pj_xml_attr_new(pool, &STR_EVENT_LOWER, event);
-  pj_xml_add_attr(contact_node, event_attr);
+  size_t offset = 0;
+  for (size_t id_offset : _id_offsets)
+  {
+    body.append(_text, offset, id_offset - offset);
+    body.append(reg_id);
+    offset = id_offset;
+  }
+  body.append(_text, offset, std::string::npos);
 
-  return contact_node;
+  return body;
 }
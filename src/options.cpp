@@ -50,23 +50,35 @@ pj_bool_t on_rx_request(pjsip_rx_data* rdata)
   SAS::Event event(get_trail(rdata), SASEvent::BEGIN_OPTIONS_MODULE, 0);
   SAS::report_event(event);
 
-  URIClass uri_class = URIClassifier::classify_uri(rdata->msg_info.msg->line.req.uri);
-  if (rdata->msg_info.msg->line.req.method.id == PJSIP_OPTIONS_METHOD)
+  if (is_options_poll_for_this_node(rdata))
   {
-    if ((uri_class == NODE_LOCAL_SIP_URI) &&
-        PJUtils::check_route_headers(rdata))
-    {
-      // OPTIONS targetted at this node/home domain, and there's either no route
-      // header or a single local route header. espond statelessly.
-      PJUtils::respond_stateless(stack_data.endpt, rdata, 200, NULL, NULL, NULL);
-      return PJ_TRUE;
-    }
+    respond_to_options_poll(rdata);
+    return PJ_TRUE;
   }
 
   return PJ_FALSE;
 }
 
 
+bool is_options_poll_for_this_node(pjsip_rx_data* rdata)
+{
+  // OPTIONS targetted at this node/home domain, with either no route header or
+  // a single local route header.
+  return ((rdata->msg_info.msg->type == PJSIP_REQUEST_MSG) &&
+          (rdata->msg_info.msg->line.req.method.id == PJSIP_OPTIONS_METHOD) &&
+          (URIClassifier::classify_uri(rdata->msg_info.msg->line.req.uri) ==
+                                                           NODE_LOCAL_SIP_URI) &&
+          (PJUtils::check_route_headers(rdata)));
+}
+
+
+pj_status_t respond_to_options_poll(pjsip_rx_data* rdata)
+{
+  // Respond statelessly.
+  return PJUtils::respond_stateless(stack_data.endpt, rdata, 200, NULL, NULL, NULL);
+}
+
+
 pj_status_t init_options()
 {
   pj_status_t status;
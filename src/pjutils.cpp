@@ -747,6 +747,47 @@ pjsip_tx_data* PJUtils::clone_msg(pjsip_endpoint* endpt,
 }
 
 
+/// Body clone function for shared text bodies - the clone refers to the same
+/// data as the original.
+static void* share_text_data(pj_pool_t* pool, const void* data, unsigned len)
+{
+  return (void*)data;
+}
+
+
+void PJUtils::share_msg_body(pjsip_tx_data* tdata)
+{
+  pjsip_msg_body* body = tdata->msg->body;
+
+  if ((body != NULL) &&
+      (body->clone_data == &pjsip_clone_text_data))
+  {
+    body->clone_data = &share_text_data;
+  }
+}
+
+
+void PJUtils::unshare_msg_body(pjsip_tx_data* tdata)
+{
+  pjsip_msg_body* body = tdata->msg->body;
+
+  if ((body != NULL) &&
+      (body->clone_data == &share_text_data))
+  {
+    TRC_DEBUG("Copy shared body (%u bytes) into %s", body->len, tdata->obj_name);
+    body->data = pjsip_clone_text_data(tdata->pool, body->data, body->len);
+    body->clone_data = &pjsip_clone_text_data;
+  }
+}
+
+
+bool PJUtils::is_msg_body_shared(const pjsip_msg* msg)
+{
+  return ((msg->body != NULL) &&
+          (msg->body->clone_data == &share_text_data));
+}
+
+
 pj_status_t PJUtils::create_response(pjsip_endpoint* endpt,
                                      const pjsip_rx_data* rdata,
                                      int st_code,
@@ -0,0 +1,60 @@
+/**
+ * @file regex_cache.cpp  Process-wide cache of compiled regular expressions.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include "log.h"
+#include "regex_cache.h"
+
+RegexCache* RegexCache::_instance = NULL;
+
+RegexCache::RegexCache(size_t capacity,
+                       int num_shards,
+                       SNMP::CounterTable* hits_tbl,
+                       SNMP::CounterTable* misses_tbl,
+                       SNMP::CounterTable* evictions_tbl) :
+  _cache(capacity, num_shards, hits_tbl, misses_tbl, evictions_tbl)
+{
+  TRC_STATUS("Created regex cache with %lu shards of %lu regexes",
+             _cache.num_shards(), _cache.shard_capacity());
+}
+
+RegexCache::~RegexCache()
+{
+}
+
+boost::regex RegexCache::get(const std::string& pattern,
+                             boost::regex::flag_type flags)
+{
+  Key key(pattern, flags);
+  boost::regex regex;
+
+  if (!_cache.get(key, regex))
+  {
+    // Compile the regex outside the cache's lock, as this is the expensive
+    // part.  If another thread compiles the same regex at the same time, the
+    // last one to finish replaces the other's copy in the cache.
+    regex = boost::regex(pattern, flags | boost::regex_constants::no_except);
+    TRC_DEBUG("Compiled regex %s (status %d)", pattern.c_str(), regex.status());
+    _cache.put(key, regex);
+  }
+
+  return regex;
+}
+
+boost::regex RegexCache::compile(const std::string& pattern,
+                                 boost::regex::flag_type flags)
+{
+  if (_instance != NULL)
+  {
+    return _instance->get(pattern, flags);
+  }
+
+  return boost::regex(pattern, flags | boost::regex_constants::no_except);
+}
@@ -42,6 +42,7 @@ extern "C" {
 #include "scscf_utils.h"
 #include "aor_utils.h"
 #include "subscriber_data_utils.h"
+#include "binding_target_cache.h"
 
 // RegistrarSproutlet constructor.
 RegistrarSproutlet::RegistrarSproutlet(const std::string& name,
@@ -833,6 +834,10 @@ void RegistrarSproutletTsx::get_bindings_from_req(
 
         binding->_expires = new_expiry;
 
+        // Parse the contact URI and Path headers into the binding target
+        // cache now, so that routing requests to the binding doesn't have to.
+        BindingTargetCache::lookup(*binding);
+
         updated_bindings.insert(std::make_pair(binding_id, binding));
       }
     }
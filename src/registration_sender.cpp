@@ -53,12 +53,10 @@ void RegistrationSender::register_with_application_servers(pjsip_msg* received_r
   deregister_subscriber = false;
 
   std::vector<Ifc> fallback_ifcs;
-  rapidxml::xml_document<>* root = NULL;
 
   if ((_fifc_service) && (_ifc_configuration._apply_fallback_ifcs))
   {
-    root = new rapidxml::xml_document<>;
-    fallback_ifcs = _fifc_service->get_fallback_ifcs(root);
+    fallback_ifcs = _fifc_service->get_fallback_ifcs();
   }
 
   std::vector<AsInvocation> as_list;
@@ -127,7 +125,6 @@ void RegistrationSender::register_with_application_servers(pjsip_msg* received_r
     }
   }
 
-  delete root; root = NULL;
 }
 
 void RegistrationSender::deregister_with_application_servers(const std::string& served_user,
@@ -0,0 +1,150 @@
+/**
+ * @file scscf_assignment_cache.cpp  Cache of S-CSCF assignments from the HSS.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <algorithm>
+#include <time.h>
+
+#include "log.h"
+#include "scscf_assignment_cache.h"
+
+SCSCFAssignmentCache::SCSCFAssignmentCache(size_t capacity,
+                                           int ttl_s,
+                                           SNMP::CounterTable* hits_tbl,
+                                           SNMP::CounterTable* misses_tbl) :
+  _capacity(std::max(capacity, (size_t)1)),
+  _ttl_ms((unsigned long)std::max(ttl_s, 0) * 1000),
+  _lru(),
+  _index(),
+  _hits(0),
+  _misses(0),
+  _hits_tbl(hits_tbl),
+  _misses_tbl(misses_tbl)
+{
+  pthread_mutex_init(&_lock, NULL);
+
+  TRC_STATUS("Created S-CSCF assignment cache of %lu entries for %lus",
+             _capacity, _ttl_ms / 1000);
+}
+
+SCSCFAssignmentCache::~SCSCFAssignmentCache()
+{
+  pthread_mutex_destroy(&_lock);
+}
+
+bool SCSCFAssignmentCache::get(const std::string& key,
+                               ServerCapabilities& caps,
+                               bool& queried_caps)
+{
+  unsigned long now = now_ms();
+  bool found = false;
+
+  pthread_mutex_lock(&_lock);
+  auto it = _index.find(key);
+  if (it != _index.end())
+  {
+    const Entry& entry = it->second->second;
+
+    if (entry.expiry_ms <= now)
+    {
+      TRC_DEBUG("Cached S-CSCF assignment for %s has expired", key.c_str());
+      _lru.erase(it->second);
+      _index.erase(it);
+    }
+    else
+    {
+      // Move the entry to the front of the LRU list.
+      _lru.splice(_lru.begin(), _lru, it->second);
+      caps = entry.caps;
+      queried_caps = entry.queried_caps;
+      found = true;
+    }
+  }
+  pthread_mutex_unlock(&_lock);
+
+  if (found)
+  {
+    TRC_DEBUG("Found cached S-CSCF assignment for %s", key.c_str());
+    ++_hits;
+    if (_hits_tbl)
+    {
+      _hits_tbl->increment();
+    }
+  }
+  else
+  {
+    ++_misses;
+    if (_misses_tbl)
+    {
+      _misses_tbl->increment();
+    }
+  }
+
+  return found;
+}
+
+void SCSCFAssignmentCache::put(const std::string& key,
+                               const ServerCapabilities& caps,
+                               bool queried_caps)
+{
+  Entry entry;
+  entry.caps = caps;
+  entry.queried_caps = queried_caps;
+  entry.expiry_ms = now_ms() + _ttl_ms;
+
+  pthread_mutex_lock(&_lock);
+
+  auto it = _index.find(key);
+  if (it != _index.end())
+  {
+    _lru.erase(it->second);
+    _index.erase(it);
+  }
+
+  _lru.push_front(std::make_pair(key, entry));
+  _index[key] = _lru.begin();
+
+  if (_lru.size() > _capacity)
+  {
+    _index.erase(_lru.back().first);
+    _lru.pop_back();
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+void SCSCFAssignmentCache::invalidate(const std::string& key)
+{
+  TRC_DEBUG("Invalidating cached S-CSCF assignment for %s", key.c_str());
+
+  pthread_mutex_lock(&_lock);
+  auto it = _index.find(key);
+  if (it != _index.end())
+  {
+    _lru.erase(it->second);
+    _index.erase(it);
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+size_t SCSCFAssignmentCache::size()
+{
+  pthread_mutex_lock(&_lock);
+  size_t size = _lru.size();
+  pthread_mutex_unlock(&_lock);
+  return size;
+}
+
+unsigned long SCSCFAssignmentCache::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
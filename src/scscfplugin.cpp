@@ -41,6 +41,9 @@ private:
   SubscriptionSproutlet* _subscription_sproutlet;
   RegistrarSproutlet* _registrar_sproutlet;
   AuthenticationSproutlet* _auth_sproutlet;
+  ImpiReplicator* _impi_replicator;
+  std::vector<SNMP::EventAccumulatorTable*> _remote_impi_latency_tbls;
+  SNMP::CounterTable* _remote_impi_dropped_writes_tbl;
   Alarm* _sess_cont_as_alarm;
   Alarm* _sess_term_as_alarm;
 
@@ -60,6 +63,10 @@ SCSCFPlugin::SCSCFPlugin() :
   _scscf_sproutlet(NULL),
   _subscription_sproutlet(NULL),
   _registrar_sproutlet(NULL),
+  _auth_sproutlet(NULL),
+  _impi_replicator(NULL),
+  _remote_impi_latency_tbls(),
+  _remote_impi_dropped_writes_tbl(NULL),
   _incoming_sip_transactions_tbl(NULL),
   _outgoing_sip_transactions_tbl(NULL)
 {
@@ -206,6 +213,29 @@ bool SCSCFPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
         SNMP::SuccessFailCountTable::create("non_register_auth_success_fail_count",
                                             ".1.2.826.0.1.1578918.9.3.17");
 
+      if ((opt.remote_impi_threads > 0) && !remote_impi_stores.empty())
+      {
+        // Access the remote IMPI stores concurrently, tracking the latency of
+        // each remote site separately.
+        for (size_t ii = 0; ii < remote_impi_stores.size(); ++ii)
+        {
+          std::string site = std::to_string(ii + 1);
+          _remote_impi_latency_tbls.push_back(
+            SNMP::EventAccumulatorTable::create("remote_impi_store_" + site + "_latency",
+                                                ".1.2.826.0.1.1578918.9.3.60." + site));
+        }
+
+        _remote_impi_dropped_writes_tbl =
+          SNMP::CounterTable::create("remote_impi_store_dropped_writes",
+                                     ".1.2.826.0.1.1578918.9.3.61");
+
+        _impi_replicator = new ImpiReplicator(remote_impi_stores,
+                                              _remote_impi_latency_tbls,
+                                              exception_handler,
+                                              opt.remote_impi_threads,
+                                              _remote_impi_dropped_writes_tbl);
+      }
+
       _auth_sproutlet =
         new AuthenticationSproutlet(AUTHENTICATION_SERVICE_NAME,
                                     opt.port_scscf,
@@ -223,7 +253,8 @@ bool SCSCFPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
                                     analytics_logger,
                                     &auth_stats_tbls,
                                     opt.nonce_count_supported,
-                                    opt.sub_max_expires);
+                                    opt.sub_max_expires,
+                                    _impi_replicator);
       ok = ok && _auth_sproutlet->init();
       sproutlets.push_front(_auth_sproutlet);
     }
@@ -240,6 +271,10 @@ void SCSCFPlugin::unload()
   delete _subscription_sproutlet;
   delete _registrar_sproutlet;
   delete _auth_sproutlet; _auth_sproutlet = NULL;
+  delete _impi_replicator; _impi_replicator = NULL;
+  for (SNMP::EventAccumulatorTable* tbl : _remote_impi_latency_tbls) { delete tbl; }
+  _remote_impi_latency_tbls.clear();
+  delete _remote_impi_dropped_writes_tbl; _remote_impi_dropped_writes_tbl = NULL;
   delete _sess_term_as_alarm; _sess_term_as_alarm = NULL;
   delete _sess_cont_as_alarm; _sess_cont_as_alarm = NULL;
   delete reg_stats_tbls.init_reg_tbl;
@@ -27,6 +27,7 @@ SCSCFSelector::SCSCFSelector(const std::string& fallback_scscf_uri,
                              std::string configuration) :
   _fallback_scscf_uri(fallback_scscf_uri),
   _configuration(configuration),
+  _config(),
   _updater(NULL)
 {
   // create an updater
@@ -35,7 +36,8 @@ SCSCFSelector::SCSCFSelector(const std::string& fallback_scscf_uri,
 
 void SCSCFSelector::update_scscf()
 {
-  std::vector<scscf_t> new_scscfs;
+  // The S-CSCFs read from the file, with their capabilities.
+  std::vector<std::pair<scscf_t, std::vector<int>>> new_scscfs;
 
   struct stat s;
   if ((stat(_configuration.c_str(), &s) != 0) &&
@@ -108,14 +110,7 @@ void SCSCFSelector::update_scscf()
                 capabilities_vec.push_back((*cap_it).GetInt());
               }
 
-              // Sort the capabilities and remove duplicates
-              std::sort(capabilities_vec.begin(), capabilities_vec.end());
-              capabilities_vec.erase(unique(capabilities_vec.begin(),
-                                            capabilities_vec.end()),
-                                     capabilities_vec.end() );
-              new_scscf.capabilities = capabilities_vec;
-              new_scscfs.push_back(new_scscf);
-              capabilities_vec.clear();
+              new_scscfs.push_back(std::make_pair(new_scscf, capabilities_vec));
             }
             catch (JsonFormatError err)
             {
@@ -143,12 +138,38 @@ void SCSCFSelector::update_scscf()
     new_scscf.server = _fallback_scscf_uri;
     new_scscf.priority = 0;
     new_scscf.weight = 100;
-    new_scscfs.push_back(new_scscf);
+    new_scscfs.push_back(std::make_pair(new_scscf, std::vector<int>()));
   }
 
-  // Take a write lock on the mutex in RAII style
-  boost::lock_guard<boost::shared_mutex> write_lock(_scscfs_rw_lock);
-  _scscfs = new_scscfs;
+  // Give each distinct capability a bit, and convert each S-CSCF's
+  // capabilities to a bitset, so that selecting an S-CSCF just compares
+  // bitsets.
+  Config* new_config = new Config();
+
+  for (const std::pair<scscf_t, std::vector<int>>& new_scscf : new_scscfs)
+  {
+    for (int cap : new_scscf.second)
+    {
+      new_config->capability_bits.insert(
+                 std::make_pair(cap, new_config->capability_bits.size()));
+    }
+  }
+
+  for (std::pair<scscf_t, std::vector<int>>& new_scscf : new_scscfs)
+  {
+    new_scscf.first.capabilities.resize(new_config->capability_bits.size());
+
+    for (int cap : new_scscf.second)
+    {
+      new_scscf.first.capabilities.set(new_config->capability_bits[cap]);
+    }
+
+    new_config->scscfs.push_back(new_scscf.first);
+  }
+
+  // Swap in the new configuration.  Selections in progress keep the old
+  // configuration alive until they have finished with it.
+  std::atomic_store(&_config, std::shared_ptr<const Config>(new_config));
 }
 
 SCSCFSelector::~SCSCFSelector()
@@ -163,78 +184,55 @@ std::string SCSCFSelector::get_scscf(const std::vector<int> &mandatory,
                                      const std::vector<std::string> &rejects,
                                      SAS::TrailId trail)
 {
-  // Take a read lock on the mutex in RAII style. See
-  // http://www.boost.org/doc/libs/1_41_0/doc/html/thread/synchronization.html
-  // for documentation.
-  boost::shared_lock<boost::shared_mutex> read_lock(_scscfs_rw_lock);
+  // Take a reference to the current configuration.
+  std::shared_ptr<const Config> config = std::atomic_load(&_config);
 
-  // There's at least one S-CSCF, so check if any match the capabilities requested
-  std::string reject_str;
-  for (std::vector<std::string>::const_iterator ii = rejects.begin(); ii != rejects.end(); ++ii)
-  {
-    reject_str = reject_str + *ii + ";";
-  }
-
-  // Sort the mandatory capabilities, and remove duplicates.
-  std::vector<int> mandatory_cap = mandatory;
-  std::sort(mandatory_cap.begin(), mandatory_cap.end());
-  mandatory_cap.erase(unique(mandatory_cap.begin(), mandatory_cap.end()), mandatory_cap.end());
-  std::string mandatory_str;
-  for (std::vector<int>::const_iterator ii = mandatory_cap.begin(); ii != mandatory_cap.end(); ++ii)
-  {
-    mandatory_str = mandatory_str + std::to_string(*ii) + ";";
-  }
-
-  // Sort the optional capabilities, and remove duplicates.
-  std::vector<int> optional_cap = optional;
-  std::sort(optional_cap.begin(), optional_cap.end());
-  optional_cap.erase(unique(optional_cap.begin(), optional_cap.end()), optional_cap.end());
-  std::string optional_str;
-  for (std::vector<int>::const_iterator ii = optional_cap.begin(); ii != optional_cap.end(); ++ii)
-  {
-    optional_str = optional_str + std::to_string(*ii) + ";";
-  }
+  // Convert the requested capabilities to bitsets.  If any of the mandatory
+  // capabilities aren't known then no S-CSCF has them all.
+  Capabilities mandatory_cap;
+  Capabilities optional_cap;
+  bool mandatory_known = (to_bitset(*config, mandatory, mandatory_cap) == 0);
+  to_bitset(*config, optional, optional_cap);
 
   // Find all S-CSCFs that have all the mandatory capabilities, the highest possible number
   // of optional capabilities, and the highest priority (closest to 0).
   // Also sum up the weights of the valid S-CSCFs as part of the iteration
-  std::vector<scscf> matches;
-  u_int max_size = 0;
+  std::vector<const scscf_t*> matches;
+  size_t max_size = 0;
   int priority = 0;
   int sum = 0;
 
-  for (std::vector<scscf>::iterator it=_scscfs.begin(); it!=_scscfs.end(); ++it)
+  for (std::vector<scscf_t>::const_iterator it = config->scscfs.begin();
+       (mandatory_known) && (it != config->scscfs.end());
+       ++it)
   {
     // Only include the S-CSCF if its name isn't in the list of S-CSCFs to reject and it has all of
     // the mandatory capabilities
     if ((std::find(rejects.begin(), rejects.end(), it->server) == rejects.end()) &&
-        (std::includes(it->capabilities.begin(), it->capabilities.end(), mandatory_cap.begin(), mandatory_cap.end())))
+        (mandatory_cap.is_subset_of(it->capabilities)))
     {
-      std::vector<int> intersection;
-      std::set_intersection(it->capabilities.begin(), it->capabilities.end(),
-                            optional_cap.begin(), optional_cap.end(),
-                            std::back_inserter(intersection));
+      size_t intersection_size = (it->capabilities & optional_cap).count();
 
-      if (intersection.size() > max_size ||
+      if (intersection_size > max_size ||
           matches.size() == 0)
       {
         matches.clear();
-        matches.push_back(*it);
-        max_size = intersection.size();
+        matches.push_back(&(*it));
+        max_size = intersection_size;
         priority = it->priority;
         sum = it->weight;
       }
-      else if (intersection.size() == max_size)
+      else if (intersection_size == max_size)
       {
         if (it->priority == priority)
         {
-          matches.push_back(*it);
+          matches.push_back(&(*it));
           sum += it->weight;
         }
         else if (it->priority < priority)
         {
           matches.clear();
-          matches.push_back(*it);
+          matches.push_back(&(*it));
           priority = it->priority;
           sum = it->weight;
         }
@@ -244,64 +242,110 @@ std::string SCSCFSelector::get_scscf(const std::vector<int> &mandatory,
 
   // If there are no matches, return an empty string (there will only be no matches
   // if no S-CSCFs had all the requested mandatory capabilities).
-  // If there's only one match, then return its name.
   if (matches.empty())
   {
+    std::string mandatory_str = caps_to_string(mandatory);
     TRC_WARNING("There are no configured S-CSCFs that have the requested mandatory capabilities (%s)",
                 mandatory_str.c_str());
 
-    SAS::Event event(trail, SASEvent::SCSCF_NONE_VALID, 0);
-    event.add_var_param(mandatory_str);
-    event.add_var_param(optional_str);
-    event.add_var_param(reject_str);
-    SAS::report_event(event);
+    if (trail != 0)
+    {
+      SAS::Event event(trail, SASEvent::SCSCF_NONE_VALID, 0);
+      event.add_var_param(mandatory_str);
+      event.add_var_param(caps_to_string(optional));
+      event.add_var_param(rejects_to_string(rejects));
+      SAS::report_event(event);
+    }
 
     return std::string();
   }
-  else if (matches.size() == 1)
+
+  // If there's only one match, then return its name.  Otherwise there are
+  // multiple S-CSCFs that match on all mandatory capabilities, the highest
+  // number of optional capabilities, and the highest priority, so select one
+  // using a weighted random choice.
+  size_t index = 0;
+
+  if (matches.size() > 1)
   {
-    TRC_DEBUG("Selected S-CSCF is %s",  matches[0].server.c_str());
+    srand(time(NULL));
+    int random = (sum != 0) ? rand() % sum : 0;
+    int accumulator = matches[index]->weight;
 
+    while (accumulator <= random)
+    {
+      index++;
+      accumulator += matches[index]->weight;
+    }
+  }
+
+  const scscf_t* selected = matches[index];
+  TRC_DEBUG("Selected S-CSCF is %s", selected->server.c_str());
+
+  if (trail != 0)
+  {
     SAS::Event event(trail, SASEvent::SCSCF_SELECTED, 0);
-    event.add_var_param(matches[0].server);
-    event.add_var_param(mandatory_str);
-    event.add_var_param(optional_str);
-    std::string priority_str = std::to_string(matches[0].priority);
-    std::string weight_str = std::to_string(matches[0].weight);
+    event.add_var_param(selected->server);
+    event.add_var_param(caps_to_string(mandatory));
+    event.add_var_param(caps_to_string(optional));
+    std::string priority_str = std::to_string(selected->priority);
+    std::string weight_str = std::to_string(selected->weight);
     event.add_var_param(priority_str);
     event.add_var_param(weight_str);
-    event.add_var_param(reject_str);
+    event.add_var_param(rejects_to_string(rejects));
     SAS::report_event(event);
+  }
+
+  return selected->server;
+}
 
-    return matches[0].server.c_str();
+size_t SCSCFSelector::to_bitset(const Config& config,
+                                const std::vector<int>& caps,
+                                Capabilities& bitset)
+{
+  size_t unknown = 0;
+  bitset.resize(config.capability_bits.size());
+
+  for (int cap : caps)
+  {
+    std::unordered_map<int, size_t>::const_iterator bit =
+                                            config.capability_bits.find(cap);
+    if (bit != config.capability_bits.end())
+    {
+      bitset.set(bit->second);
+    }
+    else
+    {
+      unknown++;
+    }
   }
 
-  // There are multiple S-CSCFs that match on all mandatory capabilities, the highest number of optional
-  // capabilities, and the highest priority. Select one using a weighted random choice.
-  srand(time(NULL));
-  int random = (sum != 0) ? rand() % sum : 0;
+  return unknown;
+}
 
-  int index = 0;
-  int accumulator = matches[index].weight;
+std::string SCSCFSelector::caps_to_string(const std::vector<int>& caps)
+{
+  // Sort the capabilities, and remove duplicates.
+  std::vector<int> sorted_caps = caps;
+  std::sort(sorted_caps.begin(), sorted_caps.end());
+  sorted_caps.erase(unique(sorted_caps.begin(), sorted_caps.end()), sorted_caps.end());
 
-  while (accumulator <= random)
+  std::string caps_str;
+  for (int cap : sorted_caps)
   {
-    index++;
-    accumulator +=  matches[index].weight;
+    caps_str += std::to_string(cap) + ";";
   }
 
-  TRC_DEBUG("Selected S-CSCF is %s",  matches[index].server.c_str());
+  return caps_str;
+}
 
-  SAS::Event event(trail, SASEvent::SCSCF_SELECTED, 0);
-  event.add_var_param(matches[index].server);
-  event.add_var_param(mandatory_str);
-  event.add_var_param(optional_str);
-  std::string priority_str = std::to_string(matches[index].priority);
-  std::string weight_str = std::to_string(matches[index].weight);
-  event.add_var_param(priority_str);
-  event.add_var_param(weight_str);
-  event.add_var_param(reject_str);
-  SAS::report_event(event);
+std::string SCSCFSelector::rejects_to_string(const std::vector<std::string>& rejects)
+{
+  std::string reject_str;
+  for (const std::string& reject : rejects)
+  {
+    reject_str += reject + ";";
+  }
 
-  return matches[index].server;
+  return reject_str;
 }
@@ -370,6 +370,9 @@ SCSCFSproutletTsx::SCSCFSproutletTsx(SCSCFSproutlet* scscf,
   _session_case(NULL),
   _as_chain_link(),
   _hss_data_cached(false),
+  _hss_prefetched(false),
+  _prefetch_http_code(HTTP_OK),
+  _prefetch_public_id(),
   _registered(false),
   _barred(false),
   _default_uri(""),
@@ -441,7 +444,12 @@ void SCSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
 {
   TRC_INFO("S-CSCF received initial request");
 
-  pjsip_status_code status_code = PJSIP_SC_OK;
+  // Store off the time we received this request, in case we need to track the
+  // session setup time for our stats.  We do this now as the request may wait
+  // for an HSS query before we know.
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  _tsx_start_time_usec = ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
 
   // Work out if we should be auto-registering the user based on this
   // request and if we are, also work out the IMPI to register them with.
@@ -488,11 +496,54 @@ void SCSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     }
   }
 
-  // Determine the session case and the served user.  This will link to
-  // an AsChain object (creating it if necessary), if we need to provide
-  // services.
+  // Determine the session case and any existing AS chain.
+  retrieve_odi_and_sesscase(req);
+
+  std::string served_user;
+
+  if (!_as_chain_link.is_set())
+  {
+    served_user = served_user_from_msg(req);
+
+    if (!served_user.empty())
+    {
+      // We will need to look up the served user's iFCs to create a new AS
+      // chain.  Start the HSS query now without blocking this thread, and
+      // carry on processing the request once it has completed.
+      set_scscf_uri(req);
+      prefetch_hss_data(served_user, [this, req, served_user]() -> void
+      {
+        if (_cancelled)
+        {
+          // The request was cancelled (or the transaction failed) during the
+          // HSS query.  There were no forks for the CANCEL to reach, so
+          // reject the request here rather than routing it.
+          TRC_DEBUG("Request cancelled during HSS query");
+          pjsip_msg* rsp = create_response(req, PJSIP_SC_REQUEST_TERMINATED);
+          send_response(rsp);
+          free_msg(req);
+          return;
+        }
+
+        process_initial_request(req, served_user);
+      });
+      return;
+    }
+  }
+
+  process_initial_request(req, served_user);
+}
+
+
+void SCSCFSproutletTsx::process_initial_request(pjsip_msg* req,
+                                                std::string served_user)
+{
+  pjsip_status_code status_code = PJSIP_SC_OK;
+
+  // Determine the served user.  This will link to an AsChain object
+  // (creating it if necessary), if we need to provide services.
   // It will also set the S-CSCF URI
-  status_code = determine_served_user(req);
+  status_code = determine_served_user(req, served_user);
 
   // Pass the received request to the ACR.
   // @TODO - request timestamp???
@@ -1049,19 +1100,18 @@ bool SCSCFSproutletTsx::is_retarget(std::string new_served_user)
   }
 }
 
-pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req)
+pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req,
+                                                           std::string served_user)
 {
   pjsip_status_code status_code = PJSIP_SC_OK;
 
-  retrieve_odi_and_sesscase(req);
-
   if (_as_chain_link.is_set())
   {
     // Set the S-CSCF URI to the one we stored in the AsChain
     _scscf_uri = _as_chain_link.scscf_uri();
 
     bool retargeted = false;
-    std::string served_user = served_user_from_msg(req);
+    served_user = served_user_from_msg(req);
 
     if ((_session_case->is_terminating()) &&
         is_retarget(served_user))
@@ -1175,8 +1225,8 @@ pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req)
   }
   else
   {
-    // No existing AS chain - create new.
-    std::string served_user = served_user_from_msg(req);
+    // No existing AS chain - create new.  The served user and the S-CSCF URI
+    // were determined before looking up the served user's data.
 
     // Create a new ACR for this request.
     ACR* acr = _scscf->get_acr(trail(),
@@ -1216,11 +1266,6 @@ pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req)
         {
           _record_session_setup_time = true;
 
-          // Store off the time we received this request.
-          struct timespec ts;
-          clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
-          _tsx_start_time_usec = ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
-
           // Check whether this is a video call.
           std::set<pjmedia_type> media_types = PJUtils::get_media_types(req);
           if (media_types.find(PJMEDIA_TYPE_VIDEO) != media_types.end())
@@ -1230,25 +1275,6 @@ pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req)
         }
       }
 
-      // Before looking up the iFCs, calculate the S-CSCF URI to use for this
-      // transaction, using the configured S-CSCF URI as a starting point.
-      pjsip_sip_uri* scscf_uri = (pjsip_sip_uri*)pjsip_uri_clone(get_pool(req),
-                                                                 _scscf->_scscf_cluster_uri);
-      pjsip_sip_uri* routing_uri = get_routing_uri(req);
-
-      // If the URI that routed to this Sproutlet isn't reflexive, just ignore it
-      // and use the configured scscf uri
-      if ((routing_uri != nullptr) && is_uri_reflexive((pjsip_uri*)routing_uri))
-      {
-        SCSCFUtils::get_scscf_uri(get_pool(req),
-                                  get_local_hostname(routing_uri),
-                                  get_local_hostname(scscf_uri),
-                                  scscf_uri);
-      }
-
-      _scscf_uri = PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR,
-                                          (pjsip_uri*)scscf_uri);
-
       TRC_DEBUG("Looking up iFCs for %s for new AS chain", served_user.c_str());
       Ifcs ifcs;
       long http_code = lookup_ifcs(served_user, ifcs);
@@ -1289,6 +1315,29 @@ pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req)
 }
 
 
+void SCSCFSproutletTsx::set_scscf_uri(pjsip_msg* req)
+{
+  // Calculate the S-CSCF URI to use for this transaction, using the
+  // configured S-CSCF URI as a starting point.
+  pjsip_sip_uri* scscf_uri = (pjsip_sip_uri*)pjsip_uri_clone(get_pool(req),
+                                                             _scscf->_scscf_cluster_uri);
+  pjsip_sip_uri* routing_uri = get_routing_uri(req);
+
+  // If the URI that routed to this Sproutlet isn't reflexive, just ignore it
+  // and use the configured scscf uri
+  if ((routing_uri != nullptr) && is_uri_reflexive((pjsip_uri*)routing_uri))
+  {
+    SCSCFUtils::get_scscf_uri(get_pool(req),
+                              get_local_hostname(routing_uri),
+                              get_local_hostname(scscf_uri),
+                              scscf_uri);
+  }
+
+  _scscf_uri = PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR,
+                                      (pjsip_uri*)scscf_uri);
+}
+
+
 std::string SCSCFSproutletTsx::served_user_from_msg(pjsip_msg* msg)
 {
   // For originating:
@@ -1984,15 +2033,19 @@ HTTPCode SCSCFSproutletTsx::get_data_from_hss(std::string public_id)
   // Read IRS information from HSS if not previously cached.
   if (!_hss_data_cached)
   {
-    HSSConnection::irs_query irs_query;
-    irs_query._public_id = public_id;
-    irs_query._private_id =_impi;
-    irs_query._req_type = _auto_reg ? HSSConnection::REG : HSSConnection::CALL;
-    irs_query._server_name = _scscf_uri;
-    irs_query._wildcard = _wildcard;
-    irs_query._cache_allowed = !_auto_reg;
-
-    http_code = read_hss_data(public_id, irs_query);
+    if (_hss_prefetched)
+    {
+      // The prefetch failed.  Report that failure rather than querying again
+      // straight away.
+      TRC_DEBUG("Using result of prefetched HSS query for %s",
+                _prefetch_public_id.c_str());
+      _hss_prefetched = false;
+      http_code = _prefetch_http_code;
+    }
+    else
+    {
+      http_code = read_hss_data(public_id, build_irs_query(public_id));
+    }
 
     if (http_code == HTTP_OK)
     {
@@ -2004,6 +2057,44 @@ HTTPCode SCSCFSproutletTsx::get_data_from_hss(std::string public_id)
 }
 
 
+HSSConnection::irs_query SCSCFSproutletTsx::build_irs_query(const std::string& public_id)
+{
+  HSSConnection::irs_query irs_query;
+  irs_query._public_id = public_id;
+  irs_query._private_id =_impi;
+  irs_query._req_type = _auto_reg ? HSSConnection::REG : HSSConnection::CALL;
+  irs_query._server_name = _scscf_uri;
+  irs_query._wildcard = _wildcard;
+  irs_query._cache_allowed = !_auto_reg;
+  return irs_query;
+}
+
+
+void SCSCFSproutletTsx::prefetch_hss_data(const std::string& public_id,
+                                          std::function<void()> on_complete)
+{
+  _prefetch_public_id = public_id;
+  _scscf->_sm->get_subscriber_state_async(build_irs_query(public_id),
+                                          _irs_info,
+                                          _prefetch_http_code,
+                                          trail(),
+                                          create_callback([this, on_complete]() -> void
+  {
+    if (_prefetch_http_code == HTTP_OK)
+    {
+      use_hss_data(_prefetch_public_id);
+      _hss_data_cached = true;
+    }
+    else
+    {
+      _hss_prefetched = true;
+    }
+
+    on_complete();
+  }));
+}
+
+
 HTTPCode SCSCFSproutletTsx::read_hss_data(std::string public_id,
                                           const HSSConnection::irs_query& irs_query)
 {
@@ -2013,21 +2104,27 @@ HTTPCode SCSCFSproutletTsx::read_hss_data(std::string public_id,
 
   if (http_code == HTTP_OK)
   {
-    _ifcs = _irs_info._service_profiles[irs_query._public_id];
-
-    // Get the default URI. This should always succeed.
-    _irs_info._associated_uris.get_default_impu(_default_uri, true);
-
-    // We may want to route to bindings that are barred (in case of an
-    // emergency), so get all the URIs.
-    _registered = (_irs_info._regstate == RegDataXMLUtils::STATE_REGISTERED);
-    _barred = _irs_info._associated_uris.is_impu_barred(irs_query._public_id);
+    use_hss_data(irs_query._public_id);
   }
 
   return http_code;
 }
 
 
+void SCSCFSproutletTsx::use_hss_data(const std::string& public_id)
+{
+  _ifcs = _irs_info._service_profiles[public_id];
+
+  // Get the default URI. This should always succeed.
+  _irs_info._associated_uris.get_default_impu(_default_uri, true);
+
+  // We may want to route to bindings that are barred (in case of an
+  // emergency), so get all the URIs.
+  _registered = (_irs_info._regstate == RegDataXMLUtils::STATE_REGISTERED);
+  _barred = _irs_info._associated_uris.is_impu_barred(public_id);
+}
+
+
 void SCSCFSproutletTsx::add_to_dialog(pjsip_msg* msg,
                                       bool bill_this_hop,
                                       ACR::NodeRole acr_billing_role)
@@ -137,7 +137,7 @@ void SIFCService::update_sets()
       continue;
     }
 
-    std::vector<std::pair<int32_t, std::string>> ifc_set;
+    std::vector<std::pair<int32_t, Ifc>> ifc_set;
 
     for (rapidxml::xml_node<>* ifc = set->first_node(RegDataXMLUtils::IFC);
          ifc != NULL;
@@ -164,10 +164,11 @@ void SIFCService::update_sets()
 
       // Creating the iFC always passes; we don't validate the iFC any further
       // at this stage. We've validated this against a schema before allowing
-      // any upload though.
+      // any upload though.  The iFC is compiled now, rather than each time
+      // it's used, and owns a copy of its XML.
       std::string ifc_str;
       rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
-      ifc_set.push_back(std::make_pair(priority, ifc_str));
+      ifc_set.push_back(std::make_pair(priority, Ifc(ifc_str)));
     }
 
     TRC_STATUS("Adding %lu iFCs for ID %d", ifc_set.size(), set_id);
@@ -195,7 +196,6 @@ SIFCService::~SIFCService()
 
 void SIFCService::get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
                                    const std::set<int32_t>& ids,
-                                   std::shared_ptr<xml_document<> > ifc_doc,
                                    SAS::TrailId trail) const
 {
   // Take a read lock on the mutex in RAII style
@@ -204,16 +204,16 @@ void SIFCService::get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
   for (int id : ids)
   {
     TRC_DEBUG("Getting the shared iFCs for ID %d", id);
-    std::map<int, std::vector<std::pair<int32_t, std::string>>>::const_iterator i =
+    std::map<int, std::vector<std::pair<int32_t, Ifc>>>::const_iterator i =
                                                       _shared_ifc_sets.find(id);
 
     if (i != _shared_ifc_sets.end())
     {
       TRC_DEBUG("Found iFC set for ID %d", id);
 
-      for (std::pair<int32_t, std::string> ifc : i->second)
+      for (const std::pair<int32_t, Ifc>& ifc : i->second)
       {
-        ifc_map.insert(std::make_pair(ifc.first, Ifc(ifc.second, ifc_doc.get())));
+        ifc_map.insert(ifc);
       }
     }
     else
@@ -26,6 +26,7 @@ extern "C" {
 #include "snmp_sip_request_types.h"
 
 const pj_str_t SproutletProxy::STR_SERVICE = {"service", 7};
+const pj_str_t SproutletProxy::STR_FAST_PATH = {"fast-path", 9};
 
 const ForkState NULL_FORK_STATE = {PJSIP_TSX_STATE_NULL, NONE};
 
@@ -40,7 +41,11 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
                                const std::set<std::string>& stateless_proxies,
                                SNMP::CounterTable* route_to_remote_alias_tbl,
                                SNMP::CounterTable* accept_for_remote_alias_tbl,
-                               int max_sproutlet_depth) :
+                               int max_sproutlet_depth,
+                               SNMP::EventAccumulatorTable* arena_bytes_tbl,
+                               bool in_dialog_fast_path,
+                               SNMP::CounterTable* fast_path_tbl,
+                               SNMP::CounterTable* requests_tbl) :
   BasicProxy(endpt,
              "mod-sproutlet-controller",
              priority,
@@ -53,7 +58,13 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
   _sproutlets(sproutlets),
   _route_to_remote_alias_tbl(route_to_remote_alias_tbl),
   _accept_for_remote_alias_tbl(accept_for_remote_alias_tbl),
-  _max_sproutlet_depth(max_sproutlet_depth)
+  _arena_bytes_tbl(arena_bytes_tbl),
+  _max_sproutlet_depth(max_sproutlet_depth),
+  _in_dialog_fast_path(in_dialog_fast_path),
+  _fast_path_tbl(fast_path_tbl),
+  _requests_tbl(requests_tbl),
+  _fast_path_requests(0),
+  _sproutlet_requests(0)
 {
   /// Store the URI of this SproutletProxy - this is used for Record-Routing.
   TRC_DEBUG("Root Record-Route URI = %s", root_uri.c_str());
@@ -85,6 +96,11 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
   {
     TRC_DEBUG("SproutletProxy not set to always serve remote aliases");
   }
+
+  if (in_dialog_fast_path)
+  {
+    TRC_STATUS("SproutletProxy forwarding in-dialog requests on the fast path");
+  }
 }
 
 
@@ -435,12 +451,170 @@ pjsip_sip_uri* SproutletProxy::next_hop_uri(const std::string& service,
 }
 
 
+pj_bool_t SproutletProxy::on_rx_request(pjsip_rx_data *rdata)
+{
+  if (_requests_tbl != NULL)
+  {
+    _requests_tbl->increment();
+  }
+
+  if ((_in_dialog_fast_path) &&
+      (is_fast_path_request(rdata)) &&
+      (forward_fast_path(rdata)))
+  {
+    ++_fast_path_requests;
+
+    if (_fast_path_tbl != NULL)
+    {
+      _fast_path_tbl->increment();
+    }
+
+    return PJ_TRUE;
+  }
+
+  ++_sproutlet_requests;
+
+  return BasicProxy::on_rx_request(rdata);
+}
+
+
+bool SproutletProxy::is_fast_path_request(pjsip_rx_data* rdata) const
+{
+  pjsip_msg* req = rdata->msg_info.msg;
+
+  // Only in-dialog requests are eligible.  This includes a CANCEL of a
+  // re-INVITE, which has the same Route headers as the re-INVITE so takes the
+  // same path.
+  if ((rdata->msg_info.to == NULL) ||
+      (rdata->msg_info.to->tag.slen == 0))
+  {
+    return false;
+  }
+
+  // Leave requests that have run out of hops to the full proxy, which rejects
+  // them.
+  if ((rdata->msg_info.max_fwd != NULL) &&
+      (rdata->msg_info.max_fwd->ivalue <= 1))
+  {
+    return false;
+  }
+
+  // The top Route header must be a loose route to this node.
+  pjsip_route_hdr* route = (pjsip_route_hdr*)
+                                  pjsip_msg_find_hdr(req, PJSIP_H_ROUTE, NULL);
+
+  if ((route == NULL) ||
+      (!PJSIP_URI_SCHEME_IS_SIP(route->name_addr.uri)))
+  {
+    return false;
+  }
+
+  pjsip_sip_uri* route_uri = (pjsip_sip_uri*)route->name_addr.uri;
+
+  if ((!route_uri->lr_param) ||
+      (get_host_locality(&route_uri->host) != AliasMatchLocality::LOCAL))
+  {
+    return false;
+  }
+
+  // The Route header must not select a Sproutlet, either by name or by the
+  // port the request was received on.  A Sproutlet that wants to see
+  // in-dialog requests adds itself to the dialog by Record-Routing with its
+  // own URI.
+  std::string alias;
+  std::string local_hostname;
+  SPROUTLET_SELECTION_TYPES selection_type = NONE_SELECTED;
+
+  if (match_sproutlet_from_uri((pjsip_uri*)route_uri,
+                               alias,
+                               local_hostname,
+                               selection_type).sproutlet != NULL)
+  {
+    return false;
+  }
+
+  if ((rdata->tp_info.transport != NULL) &&
+      (_ports.find(rdata->tp_info.transport->local_name.port) != _ports.end()))
+  {
+    return false;
+  }
+
+  // Finally, the next hop must not be this node, as the request might then
+  // select a Sproutlet.
+  pjsip_route_hdr* next_route = (pjsip_route_hdr*)
+                           pjsip_msg_find_hdr(req, PJSIP_H_ROUTE, route->next);
+  pjsip_uri* next_hop = (next_route != NULL) ?
+                                next_route->name_addr.uri : req->line.req.uri;
+
+  return ((PJSIP_URI_SCHEME_IS_SIP(next_hop)) &&
+          (get_uri_locality(next_hop) == AliasMatchLocality::NO_MATCH));
+}
+
+
+bool SproutletProxy::forward_fast_path(pjsip_rx_data* rdata)
+{
+  // Clone the request and add a Via header for this hop.  The branch is
+  // calculated from the received branch, so retransmissions are forwarded
+  // with the same branch.  This also decrements Max-Forwards.
+  pjsip_tx_data* tdata;
+  pj_status_t status = pjsip_endpt_create_request_fwd(stack_data.endpt,
+                                                      rdata,
+                                                      NULL,
+                                                      NULL,
+                                                      0,
+                                                      &tdata);
+
+  if (status != PJ_SUCCESS)
+  {
+    // LCOV_EXCL_START
+    TRC_ERROR("Failed to create fast path request, %s",
+              PJUtils::pj_status_to_string(status).c_str());
+    return false;
+    // LCOV_EXCL_STOP
+  }
+
+  set_trail(tdata, get_trail(rdata));
+
+  // Remove the Route header that refers to this node.
+  pjsip_route_hdr* route = (pjsip_route_hdr*)
+                           pjsip_msg_find_hdr(tdata->msg, PJSIP_H_ROUTE, NULL);
+  pj_list_erase(route);
+
+  // Mark our Via header so that responses, which aren't matched to any
+  // transaction, are forwarded statelessly.
+  pjsip_via_hdr* via = (pjsip_via_hdr*)
+                             pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, NULL);
+  pjsip_param* param = PJ_POOL_ZALLOC_T(tdata->pool, pjsip_param);
+  param->name = STR_FAST_PATH;
+  pj_list_insert_before(&via->other_param, param);
+
+  TRC_DEBUG("Forwarding %.*s request on the in-dialog fast path",
+            rdata->msg_info.msg->line.req.method.name.slen,
+            rdata->msg_info.msg->line.req.method.name.ptr);
+
+  // If this fails the request has been freed, and the caller passes the
+  // received request to the Sproutlets instead, which reject it as
+  // appropriate.
+  status = PJUtils::send_request_stateless(tdata);
+
+  return (status == PJ_SUCCESS);
+}
+
+
 pj_bool_t SproutletProxy::on_rx_response(pjsip_rx_data *rdata)
 {
   TRC_DEBUG("Received response (%p) after transaction completed.", rdata);
 
-  // Only forward responses to INVITES (see RFC 3261 - 18.2.1)
-  if (rdata->msg_info.cseq->method.id == PJSIP_INVITE_METHOD)
+  // Check whether this is a response to a request forwarded on the in-dialog
+  // fast path.
+  bool fast_path = ((rdata->msg_info.via != NULL) &&
+                    (pjsip_param_find(&rdata->msg_info.via->other_param,
+                                      &STR_FAST_PATH) != NULL));
+
+  // Only forward responses to INVITES (see RFC 3261 - 18.2.1), and responses
+  // to requests forwarded on the fast path.
+  if ((fast_path) ||
+      (rdata->msg_info.cseq->method.id == PJSIP_INVITE_METHOD))
   {
     // Create response to be forwarded upstream (Via will be stripped here)
     pjsip_tx_data *tdata;
@@ -456,9 +630,10 @@ pj_bool_t SproutletProxy::on_rx_response(pjsip_rx_data *rdata)
 
     // This transaction is complete and so there's nothing more we can do
     // locally. Remove any local Via headers, then pass on to BasicProxy to
-    // send on.
+    // send on.  Requests forwarded on the fast path don't pass through any
+    // Sproutlets, so have no local Via headers.
     for (pjsip_via_hdr *hvia = (pjsip_via_hdr*)pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, NULL);
-         hvia != NULL;
+         (hvia != NULL) && (!fast_path);
          hvia = (pjsip_via_hdr*)pjsip_msg_find_hdr(tdata->msg, PJSIP_H_VIA, NULL))
     {
       std::string local_hostname_unused;
@@ -771,14 +946,16 @@ void SproutletProxy::UASTsx::Callback::run()
 
 SproutletProxy::UASTsx::UASTsx(SproutletProxy* proxy) :
   BasicProxy::UASTsx(proxy),
+  _arena(stack_data.endpt, "sproutlet-tsx%p"),
   _root(NULL),
-  _dmap_sproutlet(),
-  _dmap_uac(),
-  _umap(),
-  _pending_req_q(),
+  _dmap_sproutlet(DMap<SproutletWrapper*>::type::key_compare(), &_arena),
+  _dmap_uac(DMap<UACTsx*>::type::key_compare(), &_arena),
+  _umap(UMap::key_compare(), &_arena),
+  _pending_req_q(PendingRequestQueue::container_type(&_arena)),
   _sproutlet_proxy(proxy),
-  _timers(),
-  _pending_timers()
+  _pending_timers(TimerSet::key_compare(), &_arena),
+  _clones(0),
+  _clone_bytes(0)
 {
   int instances = ++_num_instances;
   TRC_DEBUG("Sproutlet Proxy transaction (%p) created. There are now %d instances",
@@ -788,16 +965,6 @@ SproutletProxy::UASTsx::UASTsx(SproutletProxy* proxy) :
 
 SproutletProxy::UASTsx::~UASTsx()
 {
-  for (std::set<pj_timer_entry*>::const_iterator timer = _timers.begin();
-       timer != _timers.end();
-       ++timer)
-  {
-    TimerCallbackData* tdata = (TimerCallbackData*)(*timer)->user_data;
-    delete tdata;
-    delete *timer;
-  }
-  _timers.clear();
-
   if (_trail != 0)
   {
     // Flush the trail so it appears promptly in SAS. Note that we also log an
@@ -813,6 +980,16 @@ SproutletProxy::UASTsx::~UASTsx()
     SAS::report_marker(flush);
   }
 
+  TRC_DEBUG("Sproutlet Proxy transaction (%p) cloned %d messages using %lu bytes",
+            this, _clones, _clone_bytes);
+  TRC_DEBUG("Sproutlet Proxy transaction (%p) allocated %lu bytes from its arena",
+            this, _arena.bytes_allocated());
+
+  if (_sproutlet_proxy->_arena_bytes_tbl != NULL)
+  {
+    _sproutlet_proxy->_arena_bytes_tbl->accumulate(_arena.bytes_allocated());
+  }
+
   int instances = --_num_instances;
   TRC_DEBUG("Sproutlet Proxy transaction (%p) destroyed. There are now %d instances",
             this, instances);
@@ -829,6 +1006,12 @@ pj_status_t SproutletProxy::UASTsx::init(pjsip_rx_data* rdata)
 
   if (status == PJ_SUCCESS)
   {
+    // The original request lasts as long as this transaction, so let the
+    // copies of the request passed between Sproutlets share its body rather
+    // than copying it at every hop.  The body is copied if a request or
+    // response leaves the transaction.
+    PJUtils::share_msg_body(_req);
+
     // Locate the target Sproutlet for the request, and create the helper and
     // the Sproutlet transaction.
     std::string alias;
@@ -868,7 +1051,7 @@ pj_status_t SproutletProxy::UASTsx::init(pjsip_rx_data* rdata)
 
     if (status == PJ_SUCCESS)
     {
-      _root = new SproutletWrapper(_sproutlet_proxy,
+      _root = new (&_arena) SproutletWrapper(_sproutlet_proxy,
                                    this,
                                    sproutlet,
                                    sproutlet_tsx,
@@ -1145,7 +1328,7 @@ void SproutletProxy::UASTsx::schedule_requests()
         // create a SproutletWrapper. Since the Tsx is non-NULL, there is
         // guaranteed to be a sproutlet to handle the request.
         SproutletWrapper* downstream =
-          new SproutletWrapper(_sproutlet_proxy,
+          new (&_arena) SproutletWrapper(_sproutlet_proxy,
                                this,
                                sproutlet_tsx->_sproutlet,
                                sproutlet_tsx,
@@ -1189,6 +1372,10 @@ void SproutletProxy::UASTsx::schedule_requests()
         TRC_DEBUG("No local sproutlet matches request");
         size_t index;
 
+        // The request may outlive this transaction, so it must have its own
+        // copy of any shared body.
+        PJUtils::unshare_msg_body(req.req);
+
         pj_status_t status = allocate_uac(req.req, index, req.allowed_host_state);
 
         if (status == PJ_SUCCESS)
@@ -1216,21 +1403,30 @@ void SproutletProxy::UASTsx::schedule_requests()
   check_destroy();
 }
 
+void SproutletProxy::UASTsx::record_clone(pjsip_tx_data* clone)
+{
+  ++_clones;
+  _clone_bytes += pj_pool_get_used_size(clone->pool);
+}
+
 bool SproutletProxy::UASTsx::schedule_timer(SproutletWrapper* tsx,
                                             void* context,
                                             TimerID& id,
                                             int duration)
 {
-  TimerCallbackData* tdata = new TimerCallbackData;
+  // The timer and its data are freed along with the arena.
+  TimerCallbackData* tdata = new (_arena.allocate(sizeof(TimerCallbackData),
+                                                  alignof(TimerCallbackData)))
+                                 TimerCallbackData;
   tdata->uas_tsx = this;
   tdata->sproutlet_wrapper = tsx;
   tdata->context = context;
 
-  pj_timer_entry* tentry = new pj_timer_entry();
+  pj_timer_entry* tentry = new (_arena.allocate(sizeof(pj_timer_entry),
+                                                alignof(pj_timer_entry)))
+                                pj_timer_entry();
   pj_timer_entry_init(tentry, 0, tdata, &SproutletProxy::UASTsx::on_timer_pop);
 
-  _timers.insert(tentry);
-
   id = (TimerID)tentry;
 
   bool scheduled = _sproutlet_proxy->schedule_timer(tentry, duration);
@@ -1293,6 +1489,22 @@ bool SproutletProxy::UASTsx::timer_running(TimerID id)
 }
 
 
+PJUtils::Callback* SproutletProxy::UASTsx::create_callback(SproutletWrapper* tsx,
+                                                           std::function<void()> fn)
+{
+  // The Callback holds a pending callback count on this UASTsx until it is
+  // run, so neither the UASTsx nor the SproutletWrapper can be destroyed in
+  // the meantime.
+  return new Callback(this, [this, tsx, fn]() -> void
+  {
+    tsx->on_async_complete(fn);
+
+    // Schedule any requests generated by the Sproutlet.
+    this->schedule_requests();
+  });
+}
+
+
 void SproutletProxy::UASTsx::on_timer_pop(pj_timer_heap_t* th,
                                           pj_timer_entry* tentry)
 {
@@ -1340,6 +1552,7 @@ void SproutletProxy::UASTsx::tx_response(SproutletWrapper* downstream,
     {
       int st_code = rsp->msg->line.status.code;
       set_trail(rsp, trail());
+      PJUtils::unshare_msg_body(rsp);
       on_tx_response(rsp);
       pj_status_t status = pjsip_tsx_send_msg(_tsx, rsp);
 
@@ -1653,15 +1866,20 @@ SproutletWrapper::SproutletWrapper(SproutletProxy* proxy,
   _this_network_func(""),
   _upstream_network_func(upstream_network_func),
   _depth(depth),
-  _packets(),
-  _send_requests(),
-  _send_responses(),
+  _packets(0,
+           Packets::hasher(),
+           Packets::key_equal(),
+           Packets::allocator_type(&proxy_tsx->_arena)),
+  _send_requests(Requests::key_compare(), &proxy_tsx->_arena),
+  _send_responses(Responses::allocator_type(&proxy_tsx->_arena)),
   _pending_sends(0),
   _best_rsp(NULL),
   _complete(false),
   _process_actions_entered(0),
-  _forks(),
-  _pending_timers(),
+  _forks(Forks::allocator_type(&proxy_tsx->_arena)),
+  _pending_timers(Timers::key_compare(), &proxy_tsx->_arena),
+  _pending_async(0),
+  _in_sproutlet_call(false),
   _allowed_host_state(BaseResolver::ALL_LISTS),
   _trail_id(trail_id)
 {
@@ -1784,6 +2002,7 @@ pjsip_msg* SproutletWrapper::original_request()
     pj_list_erase(hr);
   }
 
+  _proxy_tsx->record_clone(clone);
   register_tdata(clone);
 
   return clone->msg;
@@ -1910,6 +2129,7 @@ pjsip_msg* SproutletWrapper::clone_msg(pjsip_msg* msg)
     //LCOV_EXCL_STOP
   }
 
+  _proxy_tsx->record_clone(new_tdata);
   register_tdata(new_tdata);
 
   return new_tdata->msg;
@@ -2162,6 +2382,15 @@ bool SproutletWrapper::timer_running(TimerID id)
   return _proxy_tsx->timer_running(id);
 }
 
+PJUtils::Callback* SproutletWrapper::create_callback(std::function<void()> fn)
+{
+  // This is called by the Sproutlet, so we're in a Sproutlet call until the
+  // actions it took are processed.
+  _in_sproutlet_call = true;
+  ++_pending_async;
+  return _proxy_tsx->create_callback(this, fn);
+}
+
 SAS::TrailId SproutletWrapper::trail() const
 {
   return _trail_id;
@@ -2380,7 +2609,10 @@ void SproutletWrapper::rx_error(int status_code, const std::string& reason)
   cancel_pending_forks(status_code, reason);
 
   // Consider the transaction to be complete as no final response should be
-  // sent upstream.
+  // sent upstream.  If the Sproutlet is waiting for an asynchronous operation
+  // it has been told about the error by on_rx_cancel, so won't forward the
+  // request when the operation completes, and any response it sends then is
+  // discarded.  This wrapper isn't destroyed until the operation completes.
   _complete = true;
   process_actions(false);
 }
@@ -2447,6 +2679,26 @@ void SproutletWrapper::on_timer_pop(TimerID id, void* context)
   process_actions(false);
 }
 
+void SproutletWrapper::on_async_complete(const std::function<void()>& fn)
+{
+  TRC_DEBUG("Processing completion of asynchronous operation");
+
+  // If the operation completed synchronously, the callback has been run from
+  // within the Sproutlet call that started it.  The actions will be processed
+  // (and this wrapper possibly destroyed) when that call returns, so don't do
+  // it here.
+  bool nested = _in_sproutlet_call;
+
+  --_pending_async;
+  _in_sproutlet_call = true;
+  fn();
+
+  if (!nested)
+  {
+    process_actions(false);
+  }
+}
+
 void SproutletWrapper::register_tdata(pjsip_tx_data* tdata)
 {
   TRC_DEBUG("Adding message %p => txdata %p mapping",
@@ -2464,8 +2716,10 @@ void SproutletWrapper::deregister_tdata(pjsip_tx_data* tdata)
 /// Process actions required by a Sproutlet
 void SproutletWrapper::process_actions(bool complete_after_actions)
 {
-  TRC_DEBUG("Processing actions from sproutlet - %d responses, %d requests, %d timers",
-            _send_responses.size(), _send_requests.size(), _pending_timers.size());
+  TRC_DEBUG("Processing actions from sproutlet - %d responses, %d requests, %d timers, %d async operations",
+            _send_responses.size(), _send_requests.size(), _pending_timers.size(), _pending_async);
+
+  _in_sproutlet_call = false;
 
   // We've entered process_actions again.  We track this counter because
   // process_actions can be re-entered, and we must never delete the
@@ -2500,7 +2754,7 @@ void SproutletWrapper::process_actions(bool complete_after_actions)
   // forwarded/generated by the Sproutlet.
   while (!_send_requests.empty())
   {
-    std::map<int, SproutletProxy::SendRequest>::iterator i = _send_requests.begin();
+    Requests::iterator i = _send_requests.begin();
     int fork_id = i->first;
     SproutletProxy::SendRequest req = i->second;
     _send_requests.erase(i);
@@ -2539,6 +2793,7 @@ void SproutletWrapper::process_actions(bool complete_after_actions)
   if ((_complete) &&
       (count_pending_responses() == 0) &&
       (_pending_timers.empty()) &&
+      (_pending_async == 0) &&
       (_process_actions_entered == 0))
   {
     // Sproutlet has sent a final response, has no downstream forks waiting
@@ -22,6 +22,7 @@ extern "C" {
 #include <sched.h>
 
 // Common STL includes.
+#include <algorithm>
 #include <cassert>
 #include <vector>
 #include <map>
@@ -152,18 +153,21 @@ static void on_io_started(const std::string& msg)
 }
 
 /// PJSIP threads are donated to PJSIP to handle receiving at transport level
-/// and timers.
+/// and timers.  There may be several of them, all polling the endpoint's
+/// ioqueue and timer heap, with the events on each socket handled by one
+/// thread at a time.  The first one (index 0) also acts on changes to the
+/// quiescing state.
 static int pjsip_thread_func(void *p)
 {
   pj_time_val delay = {0, 10};
-
-  PJ_UNUSED_ARG(p);
+  long index = (long)p;
 
   // Get the Kernel's ID for this thread so we can log it out.
   pid_t tid;
   tid = syscall(SYS_gettid);
 
-  TRC_STATUS("PJSIP transport thread started with kernel thread ID %d", tid);
+  TRC_STATUS("PJSIP transport thread %ld started with kernel thread ID %d",
+             index, tid);
 
   // Increase the priority of the transport thread (by giving it a real-time
   // scheduling policy and a non-zero priority). This means that the transport
@@ -183,8 +187,9 @@ static int pjsip_thread_func(void *p)
 
   pj_bool_t curr_quiescing = PJ_FALSE;
 
-  // Log whenever we do any I/O on this thread. There is only one transport
-  // thread so blocking on it is a really bad idea!
+  // Log whenever we do any I/O on this thread. There are only a handful of
+  // transport threads reading from every connection, so blocking on one is a
+  // really bad idea!
   Utils::IOHook io_hook(&on_io_started,
                         Utils::IOHook::NOOP_ON_COMPLETE);
 
@@ -192,6 +197,11 @@ static int pjsip_thread_func(void *p)
   {
     pjsip_endpt_handle_events(stack_data.endpt, &delay);
 
+    if (index != 0)
+    {
+      continue;
+    }
+
     // Check if our quiescing state has changed, and act appropriately
     pj_bool_t new_quiescing = quiescing;
     if (curr_quiescing != new_quiescing)
@@ -211,7 +221,7 @@ static int pjsip_thread_func(void *p)
 
   }
 
-  TRC_STATUS("PJSIP thread ended");
+  TRC_STATUS("PJSIP thread %ld ended", index);
 
   return 0;
 }
@@ -571,6 +581,17 @@ pj_status_t init_pjsip()
                                    pjsip_endpt_get_timer_heap(stack_data.endpt),
                                    4096);
 
+  if (stack_data.num_transport_threads > 1)
+  {
+    // Several transport threads poll the endpoint's ioqueue.  Stop them
+    // handling events on the same socket at the same time, so that the
+    // messages on each UDP socket and TCP connection are still read and
+    // processed in order, as they are with a single thread.  This must be set
+    // before any transports are created.
+    pj_ioqueue_set_default_concurrency(pjsip_endpt_get_ioqueue(stack_data.endpt),
+                                       PJ_FALSE);
+  }
+
   // Init transaction layer.
   status = pjsip_tsx_layer_init_module(stack_data.endpt);
   PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
@@ -592,13 +613,30 @@ pj_status_t start_pjsip_thread()
 {
   pj_status_t status = PJ_SUCCESS;
 
-  status = pj_thread_create(stack_data.pool, "pjsip", &pjsip_thread_func,
-                            NULL, 0, 0, &stack_data.pjsip_transport_thread);
-  if (status != PJ_SUCCESS)
+  // Create the threads suspended, so that the list of transport threads is
+  // complete before any of them starts handling events.
+  for (long ii = 0; ii < stack_data.num_transport_threads; ++ii)
   {
-    TRC_ERROR("Error creating PJSIP thread, %s",
-              PJUtils::pj_status_to_string(status).c_str());
-    return 1;
+    std::string name = (ii == 0) ? "pjsip" : "pjsip-" + std::to_string(ii);
+    pj_thread_t* thread;
+
+    status = pj_thread_create(stack_data.pool, name.c_str(), &pjsip_thread_func,
+                              (void*)ii, 0, PJ_THREAD_SUSPENDED, &thread);
+    if (status != PJ_SUCCESS)
+    {
+      TRC_ERROR("Error creating PJSIP thread, %s",
+                PJUtils::pj_status_to_string(status).c_str());
+      return 1;
+    }
+
+    stack_data.pjsip_transport_threads.push_back(thread);
+  }
+
+  stack_data.pjsip_transport_thread = stack_data.pjsip_transport_threads[0];
+
+  for (pj_thread_t* thread : stack_data.pjsip_transport_threads)
+  {
+    pj_thread_resume(thread);
   }
 
   return PJ_SUCCESS;
@@ -625,7 +663,8 @@ pj_status_t init_stack(int pcscf_trusted_port,
                        QuiescingManager *quiescing_mgr_arg,
                        const std::string& cdf_domain,
                        std::vector<std::string> sproutlet_uris,
-                       bool enable_orig_sip_to_tel_coerce)
+                       bool enable_orig_sip_to_tel_coerce,
+                       int num_transport_threads)
 {
   pj_status_t status;
   pj_sockaddr pri_addr;
@@ -655,6 +694,7 @@ pj_status_t init_stack(int pcscf_trusted_port,
   stack_data.sip_tcp_connect_timeout = sip_tcp_connect_timeout;
   stack_data.sip_tcp_send_timeout = sip_tcp_send_timeout;
   stack_data.enable_orig_sip_to_tel_coerce = enable_orig_sip_to_tel_coerce;
+  stack_data.num_transport_threads = std::max(num_transport_threads, 1);
 
   // Work out local and public hostnames and cluster domain names.
   stack_data.local_host = (local_host != "") ? pj_str(local_host_cstr) : *pj_gethostname();
@@ -948,8 +988,12 @@ pj_status_t stop_pjsip_thread()
   // for them to exit.
   quit_flag = PJ_TRUE;
 
-  pj_thread_join(stack_data.pjsip_transport_thread);
+  for (pj_thread_t* thread : stack_data.pjsip_transport_threads)
+  {
+    pj_thread_join(thread);
+  }
 
+  stack_data.pjsip_transport_threads.clear();
   stack_data.pjsip_transport_thread = NULL;
 
   return PJ_SUCCESS;
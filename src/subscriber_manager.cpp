@@ -13,17 +13,20 @@
 #include "sproutsasevent.h"
 #include "aor_utils.h"
 #include "pjutils.h"
+#include "xml_utils.h"
 
 SubscriberManager::SubscriberManager(S4* s4,
                                      HSSConnection* hss_connection,
                                      AnalyticsLogger* analytics_logger,
                                      NotifySender* notify_sender,
-                                     RegistrationSender* registration_sender) :
+                                     RegistrationSender* registration_sender,
+                                     IrsInfoCache* irs_info_cache) :
   _s4(s4),
   _hss_connection(hss_connection),
   _analytics(analytics_logger),
   _notify_sender(notify_sender),
-  _registration_sender(registration_sender)
+  _registration_sender(registration_sender),
+  _irs_info_cache(irs_info_cache)
 {
   if (_s4 != NULL)
   {
@@ -599,6 +602,9 @@ HTTPCode SubscriberManager::deregister_subscriber(const std::string& public_id,
     return rc;
   }
 
+  // The subscriber is being removed, so drop any data we have cached for it.
+  invalidate_cached_subscriber_state(public_id, irs_info);
+
   // DELETEs to S4 are CAS'd so we loop for as long as we get back
   // HTTP_PRECONDITION_FAILED.
   AoR* orig_aor = NULL;
@@ -762,21 +768,151 @@ HTTPCode SubscriberManager::get_subscriber_state(const HSSConnection::irs_query&
                                                  HSSConnection::irs_info& irs_info,
                                                  SAS::TrailId trail)
 {
+  bool cacheable = is_cacheable(irs_query);
+
+  if ((cacheable) && (get_cached_irs_info(irs_query._public_id, irs_info, trail)))
+  {
+    return HTTP_OK;
+  }
+
+  uint64_t query_token = (_irs_info_cache != NULL) ?
+                                           _irs_info_cache->start_query() : 0;
+
   // This call results in a PUT to homestead which first does a cache lookup and
   // if that fails, results in a SAR to the HSS in order to get subscriber
   // information.
   HTTPCode http_code = _hss_connection->update_registration_state(irs_query,
                                                                   irs_info,
                                                                   trail);
+
+  if (_irs_info_cache != NULL)
+  {
+    if (!cacheable)
+    {
+      // This query may have changed the registration state of the IRS, so
+      // invalidate anything we have cached for it.
+      invalidate_cached_subscriber_state(irs_query._public_id, irs_info);
+    }
+    else if (http_code == HTTP_OK)
+    {
+      _irs_info_cache->put(irs_query._public_id, irs_info, query_token);
+    }
+  }
+
   return http_code;
 }
 
+void SubscriberManager::get_subscriber_state_async(const HSSConnection::irs_query& irs_query,
+                                                   HSSConnection::irs_info& irs_info,
+                                                   HTTPCode& http_code,
+                                                   SAS::TrailId trail,
+                                                   PJUtils::Callback* on_complete)
+{
+  if (_hss_connection == NULL)
+  {
+    // There's nowhere to make the query.
+    TRC_ERROR("No HSS connection to query for %s", irs_query._public_id.c_str());
+    http_code = HTTP_SERVER_UNAVAILABLE;
+    PJUtils::run_callback_on_worker_thread(on_complete);
+    return;
+  }
+
+  if ((is_cacheable(irs_query)) &&
+      (get_cached_irs_info(irs_query._public_id, irs_info, trail)))
+  {
+    // We already have the data, so don't hand off to another thread.
+    http_code = HTTP_OK;
+    PJUtils::run_callback_on_worker_thread(on_complete);
+    return;
+  }
+
+  http_code = HTTP_SERVER_UNAVAILABLE;
+  _hss_connection->run_async([this, irs_query, &irs_info, &http_code, trail]() -> void
+                             {
+                               http_code = get_subscriber_state(irs_query,
+                                                                irs_info,
+                                                                trail);
+                             },
+                             on_complete);
+}
+
+bool SubscriberManager::is_cacheable(const HSSConnection::irs_query& irs_query)
+{
+  // Only call queries which allow cached data can be answered from our cache.
+  // Wildcard queries aren't cached, as the cache is keyed on the public ID.
+  return ((irs_query._req_type == HSSConnection::CALL) &&
+          (irs_query._cache_allowed) &&
+          (irs_query._wildcard.empty()));
+}
+
+bool SubscriberManager::get_cached_irs_info(const std::string& public_id,
+                                            HSSConnection::irs_info& irs_info,
+                                            SAS::TrailId trail)
+{
+  if ((_irs_info_cache == NULL) ||
+      (!_irs_info_cache->get(public_id, irs_info)))
+  {
+    return false;
+  }
+
+  // The registration state isn't cached, as another node can change it.  Work
+  // it out from the bindings in the registration store instead, which every
+  // node shares.  The cache only holds IRSs with a default public ID.
+  std::string default_id;
+  irs_info._associated_uris.get_default_impu(default_id, false);
+
+  Bindings bindings;
+  HTTPCode rc = get_bindings(default_id, bindings, trail);
+
+  if ((rc != HTTP_OK) && (rc != HTTP_NOT_FOUND))
+  {
+    TRC_DEBUG("Failed to get the registration state of %s from the store (%d), "
+              "so not using cached HSS data",
+              public_id.c_str(),
+              rc);
+    return false;
+  }
+
+  // A call query registers an IRS as unregistered if it has no bindings.
+  irs_info._regstate = bindings.empty() ? RegDataXMLUtils::STATE_UNREGISTERED :
+                                          RegDataXMLUtils::STATE_REGISTERED;
+  irs_info._prev_regstate = irs_info._regstate;
+  SubscriberDataUtils::delete_bindings(bindings);
+
+  return true;
+}
+
+void SubscriberManager::invalidate_cached_subscriber_state(const std::string& public_id,
+                                                           HSSConnection::irs_info& irs_info)
+{
+  if (_irs_info_cache == NULL)
+  {
+    return;
+  }
+
+  _irs_info_cache->invalidate(public_id);
+
+  std::string default_id;
+  if ((irs_info._associated_uris.get_default_impu(default_id, false)) &&
+      (default_id != public_id))
+  {
+    _irs_info_cache->invalidate(default_id);
+  }
+}
+
 HTTPCode SubscriberManager::update_associated_uris(const std::string& aor_id,
                                                    const AssociatedURIs& associated_uris,
                                                    SAS::TrailId trail)
 {
   TRC_DEBUG("Updating associted URIs for AoR %s", aor_id.c_str());
 
+  // The HSS has pushed a new profile for this IRS, so any subscriber data we
+  // have cached for it is out of date.
+  if (_irs_info_cache != NULL)
+  {
+    _irs_info_cache->invalidate(aor_id);
+  }
+
   // Get the original AoR from S4.
   AoR* orig_aor = NULL;
   uint64_t unused_version;
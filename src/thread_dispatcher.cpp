@@ -18,12 +18,14 @@ extern "C" {
 #include <arpa/inet.h>
 
 #include <cassert>
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <set>
 #include <list>
 #include <queue>
 #include <string>
+#include <time.h>
 
 #include <boost/regex.hpp>
 
@@ -48,18 +50,26 @@ extern "C" {
 #include "snmp_event_accumulator_table.h"
 #include "snmp_event_accumulator_by_scope_table.h"
 #include "thread_dispatcher.h"
+#include "options.h"
 
 static const boost::regex EMERGENCY_SERVICES_URI = boost::regex("service.*:sos.*", boost::regex::icase);
 
 static std::vector<pj_thread_t*> worker_threads;
 
 // Queue for incoming events.
-static PriorityEventQueueBackend* sip_event_queue_backend =
-  new PriorityEventQueueBackend(); // LCOV_EXCL_LINE
+static BucketedEventQueueBackend* sip_event_queue_backend =
+  new BucketedEventQueueBackend(); // LCOV_EXCL_LINE
 static eventq<struct SipEvent> sip_event_queue(0,
                                                true,
                                                sip_event_queue_backend);
 
+// Sharded queue for incoming events.  If this is set it is used in place of
+// sip_event_queue.
+static ShardedSipEventQueue* sharded_sip_event_queue = NULL;
+
+// The home shard of the current thread, or -1 if this is not a worker thread.
+static thread_local int worker_home_shard = -1;
+
 // Deadlock detection threshold for the message queue (in milliseconds).  This
 // is set to roughly twice the expected maximum service time for each message
 // (currently four seconds, allowing for four Homestead/Homer interactions
@@ -72,6 +82,9 @@ static SNMP::EventAccumulatorByScopeTable* latency_table = NULL;
 static SNMP::EventAccumulatorByScopeTable* queue_size_table = NULL;
 static SNMP::SuccessFailCountByPriorityAndScopeTable* queue_success_fail_table = NULL;
 
+// The memory allocated to copy each received message for the worker threads.
+static SNMP::EventAccumulatorTable* rx_clone_bytes_table = NULL;
+
 static LoadMonitor* load_monitor = NULL;
 
 static RPHService* rph_service = NULL;
@@ -81,6 +94,10 @@ static SNMP::CounterByScopeTable* overload_counter = NULL;
 static ExceptionHandler* exception_handler = NULL;
 static unsigned long request_on_queue_timeout_us = 1;
 
+// Whether OPTIONS polls targeted at this node are answered on the transport
+// thread.
+static bool options_on_transport_thread = false;
+
 static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata);
 
 static pjsip_process_rdata_param pjsip_entry_point;
@@ -88,6 +105,46 @@ static pjsip_process_rdata_param pjsip_entry_point;
 static pj_status_t reject_with_retry_header(pjsip_rx_data* rdata,
                                             pjsip_status_code code);
 
+// Wrappers that operate on whichever event queue is in use.
+static int event_queue_size()
+{
+  return (sharded_sip_event_queue != NULL) ?
+           sharded_sip_event_queue->size() : sip_event_queue.size();
+}
+
+static bool event_queue_is_deadlocked()
+{
+  return (sharded_sip_event_queue != NULL) ?
+           sharded_sip_event_queue->is_deadlocked() :
+           sip_event_queue.is_deadlocked();
+}
+
+static void event_queue_push(const SipEvent& qe)
+{
+  if (sharded_sip_event_queue != NULL)
+  {
+    // Worker threads queue callbacks to their own shard, other threads
+    // spread their events across the shards.
+    sharded_sip_event_queue->push(qe, worker_home_shard);
+  }
+  else
+  {
+    sip_event_queue.push(qe);
+  }
+}
+
+static bool event_queue_pop(SipEvent& qe)
+{
+  if (sharded_sip_event_queue != NULL)
+  {
+    return sharded_sip_event_queue->pop(qe, std::max(worker_home_shard, 0));
+  }
+  else
+  {
+    return sip_event_queue.pop(qe);
+  }
+}
+
 // Module to clone SIP requests and dispatch them to worker threads.
 
 // Priority of PJSIP_MOD_PRIORITY_TRANSPORT_LAYER-1 causes this to run
@@ -164,7 +221,7 @@ bool process_queue_element()
 
   unsigned long target_latency_us = load_monitor->get_target_latency_us();
 
-  rc = sip_event_queue.pop(qe);
+  rc = event_queue_pop(qe);
 
   if (rc)
   {
@@ -356,6 +413,14 @@ int worker_thread(void* p)
 {
   TRC_DEBUG("Worker thread started");
 
+  // The thread argument is the index of this worker thread, which determines
+  // its home shard if the event queue is sharded.
+  if (sharded_sip_event_queue != NULL)
+  {
+    worker_home_shard =
+      (int)((intptr_t)p % sharded_sip_event_queue->num_shards());
+  }
+
   // This thread is not allowed to do IO without using the CW_IO_START and
   // CW_IO_COMPLETES macros. Doing so means that sprout's overload algorithms
   // will not work properly.
@@ -563,6 +628,28 @@ static void reject_rx_msg_overload(pjsip_rx_data* rdata, SAS::TrailId trail)
   }
 }
 
+// Answers an OPTIONS poll targeted at this node without queuing it to the
+// worker threads, so that health checks get a prompt response even when the
+// queue is deep.  The response is the same as the OPTIONS module sends.  The
+// poll has already passed through the common processing module, so it still
+// counts as traffic for the health checker.
+static void answer_options_poll(pjsip_rx_data* rdata, SAS::TrailId trail)
+{
+  TRC_DEBUG("Answering OPTIONS poll %p on transport thread", rdata);
+
+  SAS::Event event(trail, SASEvent::BEGIN_OPTIONS_MODULE, 0);
+  SAS::report_event(event);
+
+  pj_status_t status = respond_to_options_poll(rdata);
+  if (status != PJ_SUCCESS)
+  {
+    // LCOV_EXCL_START
+    TRC_ERROR("Failed to send OPTIONS response: %s",
+              PJUtils::pj_status_to_string(status).c_str());
+    // LCOV_EXCL_STOP
+  }
+}
+
 static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
 {
   TRC_DEBUG("Received message %p", rdata);
@@ -572,6 +659,18 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   SAS::Event event(trail, SASEvent::BEGIN_THREAD_DISPATCHER, 0);
   SAS::report_event(event);
 
+  // Answer OPTIONS polls to this node straight away if configured to, and
+  // the worker threads are still healthy.  If they are deadlocked the poll
+  // drops through to the check below, so that health checks don't report a
+  // stuck process as up.
+  if ((options_on_transport_thread) &&
+      (is_options_poll_for_this_node(rdata)) &&
+      (!event_queue_is_deadlocked()))
+  {
+    answer_options_poll(rdata, trail);
+    return PJ_TRUE;
+  }
+
   SIPEventPriorityLevel priority = get_rx_msg_priority(rdata, trail);
 
   // Check whether the request should be rejected due to overload
@@ -585,7 +684,7 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   TRC_DEBUG("Admitted request %p", rdata);
 
   // Check that the worker threads are not all deadlocked.
-  if (sip_event_queue.is_deadlocked())
+  if (event_queue_is_deadlocked())
   {
     // LCOV_EXCL_START
     // The queue has not been serviced for sufficiently long to imply that
@@ -617,7 +716,18 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   }
   else
   {
-    TRC_DEBUG("Incoming message %p cloned to %p", rdata, clone_rdata);
+    // The transport parses the message into its own receive buffer, and
+    // reuses that buffer as soon as this callback returns, so the message
+    // can't be handed to a worker thread without this copy.  Report how much
+    // memory it took.
+    pj_size_t clone_bytes = pj_pool_get_used_size(clone_rdata->tp_info.pool);
+    TRC_DEBUG("Incoming message %p cloned to %p using %lu bytes",
+              rdata, clone_rdata, clone_bytes);
+
+    if (rx_clone_bytes_table != NULL)
+    {
+      rx_clone_bytes_table->accumulate(clone_bytes);
+    }
   }
 
   // Make sure the trail identifier is passed across.
@@ -644,14 +754,14 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   // Track the current queue size
   if (queue_size_table)
   {
-    queue_size_table->accumulate(sip_event_queue.size()); // LCOV_EXCL_LINE
+    queue_size_table->accumulate(event_queue_size()); // LCOV_EXCL_LINE
   }
   // Increment the number of items put on the queue for a worker thread.
   if (queue_success_fail_table)
   {
     queue_success_fail_table->increment_attempts(qe.priority); // LCOV_EXCL_LINE
   }
-  sip_event_queue.push(qe);
+  event_queue_push(qe);
 
   // return TRUE to flag that we have absorbed the incoming message.
   return PJ_TRUE;
@@ -665,7 +775,10 @@ pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
                                    LoadMonitor* load_monitor_arg,
                                    RPHService* rph_service_arg,
                                    ExceptionHandler* exception_handler_arg,
-                                   unsigned long request_on_queue_timeout_ms_arg)
+                                   unsigned long request_on_queue_timeout_ms_arg,
+                                   int num_queue_shards_arg,
+                                   SNMP::EventAccumulatorTable* rx_clone_bytes_tbl_arg,
+                                   bool options_on_transport_thread_arg)
 {
   // Set up the vectors of threads.  The threads don't get created until
   // start_worker_threads is called.
@@ -674,10 +787,31 @@ pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
   // Enable deadlock detection on the message queue.
   sip_event_queue.set_deadlock_threshold(MSG_Q_DEADLOCK_TIME);
 
+  // Set up the sharded queue if requested.  There's no point having more
+  // shards than worker threads, as a shard with no home worker is only ever
+  // serviced by stealing.
+  delete sharded_sip_event_queue; sharded_sip_event_queue = NULL;
+  int num_queue_shards = std::min(num_queue_shards_arg, num_worker_threads_arg);
+  if (num_queue_shards > 1)
+  {
+    TRC_STATUS("Using %d event queue shards for %d worker threads",
+               num_queue_shards,
+               num_worker_threads_arg);
+    sharded_sip_event_queue = new ShardedSipEventQueue(num_queue_shards);
+    sharded_sip_event_queue->set_deadlock_threshold(MSG_Q_DEADLOCK_TIME);
+  }
+
+  options_on_transport_thread = options_on_transport_thread_arg;
+  if (options_on_transport_thread)
+  {
+    TRC_STATUS("Answering OPTIONS polls on the transport thread");
+  }
+
   num_worker_threads = num_worker_threads_arg;
   latency_table = latency_table_arg;
   queue_size_table = queue_size_table_arg;
   queue_success_fail_table = queue_success_fail_table_arg;
+  rx_clone_bytes_table = rx_clone_bytes_tbl_arg;
   load_monitor = load_monitor_arg;
   rph_service = rph_service_arg;
   overload_counter = overload_counter_arg;
@@ -709,7 +843,7 @@ pj_status_t start_worker_threads()
   {
     pj_thread_t* thread;
     status = pj_thread_create(stack_data.pool, "worker", &worker_thread,
-                              NULL, 0, 0, &thread);
+                              (void*)(intptr_t)ii, 0, 0, &thread);
     if (status != PJ_SUCCESS)
     {
       TRC_ERROR("Error creating worker thread, %s",
@@ -733,7 +867,14 @@ void stop_worker_threads()
 
   // Terminate the queue and delete all elements remaining on it
   std::vector<SipEvent> remaining_elts;
-  sip_event_queue.terminate(remaining_elts);
+  if (sharded_sip_event_queue != NULL)
+  {
+    sharded_sip_event_queue->terminate(remaining_elts);
+  }
+  else
+  {
+    sip_event_queue.terminate(remaining_elts);
+  }
   for (std::vector<SipEvent>::iterator qe = remaining_elts.begin();
        qe != remaining_elts.end();
        ++qe)
@@ -770,6 +911,11 @@ void stop_worker_threads()
 void unregister_thread_dispatcher(void)
 {
   pjsip_endpt_unregister_module(stack_data.endpt, &mod_thread_dispatcher);
+
+  delete sharded_sip_event_queue; sharded_sip_event_queue = NULL;
+  rx_clone_bytes_table = NULL;
+
+  options_on_transport_thread = false;
 }
 
 void add_callback_to_queue(PJUtils::Callback* cb)
@@ -798,5 +944,281 @@ void add_callback_to_queue(PJUtils::Callback* cb)
   TRC_DEBUG("Queuing callback %p for worker threads with priority %d",
             cb,
             qe.priority);
-  sip_event_queue.push(qe);
+  event_queue_push(qe);
+}
+
+ShardedSipEventQueue::Shard::Shard() :
+  queue(),
+  size(0),
+  service_time_ms(0)
+{
+  pthread_mutex_init(&lock, NULL);
+}
+
+ShardedSipEventQueue::Shard::~Shard()
+{
+  pthread_mutex_destroy(&lock);
+}
+
+ShardedSipEventQueue::ShardedSipEventQueue(int num_shards) :
+  _shards(),
+  _next_push_shard(0),
+  _next_sequence(0),
+  _size(0),
+  _deadlock_threshold_ms(0),
+  _num_idle(0),
+  _terminated(false)
+{
+  for (int ii = 0; ii < std::max(num_shards, 1); ++ii)
+  {
+    _shards.push_back(new Shard());
+  }
+
+  pthread_mutex_init(&_idle_lock, NULL);
+  pthread_cond_init(&_idle_cond, NULL);
+}
+
+ShardedSipEventQueue::~ShardedSipEventQueue()
+{
+  for (Shard* shard : _shards)
+  {
+    delete shard;
+  }
+  _shards.clear();
+
+  pthread_cond_destroy(&_idle_cond);
+  pthread_mutex_destroy(&_idle_lock);
+}
+
+unsigned long ShardedSipEventQueue::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+void ShardedSipEventQueue::set_deadlock_threshold(unsigned long threshold_ms)
+{
+  _deadlock_threshold_ms = threshold_ms;
+}
+
+bool ShardedSipEventQueue::is_deadlocked()
+{
+  if (_deadlock_threshold_ms == 0)
+  {
+    return false;
+  }
+
+  // The queue is deadlocked if it has events on it but none of the shards
+  // have been serviced recently.  This check reads the shards' atomics
+  // without taking any locks, so it's cheap enough to do on every message.
+  bool empty = true;
+  unsigned long last_service_ms = 0;
+
+  for (Shard* shard : _shards)
+  {
+    if (shard->size.load() > 0)
+    {
+      empty = false;
+    }
+    last_service_ms = std::max(last_service_ms, shard->service_time_ms.load());
+  }
+
+  return ((!empty) &&
+          (now_ms() > last_service_ms + _deadlock_threshold_ms));
+}
+
+int ShardedSipEventQueue::size()
+{
+  return std::max(_size.load(), 0);
+}
+
+void ShardedSipEventQueue::push(const SipEvent& event, int preferred_shard)
+{
+  int num_shards = _shards.size();
+  int shard_ix = preferred_shard;
+
+  if ((shard_ix < 0) || (shard_ix >= num_shards))
+  {
+    // Pick the less loaded of the next shard in rotation and its neighbour.
+    // This keeps the shards balanced without having to scan them all.
+    unsigned int next = _next_push_shard.fetch_add(1, std::memory_order_relaxed);
+    int first_ix = next % num_shards;
+    int second_ix = (first_ix + 1) % num_shards;
+    shard_ix = (_shards[second_ix]->size.load(std::memory_order_relaxed) <
+                _shards[first_ix]->size.load(std::memory_order_relaxed)) ?
+                  second_ix : first_ix;
+  }
+
+  // Stamp the event with a sequence number, so that workers can compare the
+  // heads of different shards cheaply.
+  SipEvent stamped_event = event;
+  stamped_event.sequence = _next_sequence.fetch_add(1, std::memory_order_relaxed);
+
+  Shard* shard = _shards[shard_ix];
+  pthread_mutex_lock(&shard->lock);
+
+  if (shard->queue.empty())
+  {
+    // Start the deadlock timer for this shard.
+    shard->service_time_ms = now_ms();
+  }
+  shard->queue.push(stamped_event);
+  ++shard->size;
+
+  pthread_mutex_unlock(&shard->lock);
+
+  // The total size must be incremented before checking for idle workers, and
+  // idle workers increment _num_idle before checking the total size, so one of
+  // us is guaranteed to see the other.
+  ++_size;
+
+  if (_num_idle.load() > 0)
+  {
+    pthread_mutex_lock(&_idle_lock);
+    pthread_cond_signal(&_idle_cond);
+    pthread_mutex_unlock(&_idle_lock);
+  }
+}
+
+bool ShardedSipEventQueue::pop(SipEvent& event, int home_shard)
+{
+  int num_shards = _shards.size();
+  home_shard = home_shard % num_shards;
+
+  // Rotate through the other shards when choosing which one to compare our
+  // home shard against, so that no shard is left unserviced for long even if
+  // its home workers are busy.
+  static thread_local unsigned int compare_ix = 0;
+
+  while (!_terminated.load())
+  {
+    int other_shard = home_shard;
+    if (num_shards > 1)
+    {
+      other_shard = (home_shard + 1 + (compare_ix++ % (num_shards - 1))) %
+                    num_shards;
+    }
+
+    if (pop_best_of(home_shard, other_shard, event))
+    {
+      return true;
+    }
+
+    // Our home shard is empty, so try to steal from the other shards.
+    for (int ii = 1; ii < num_shards; ++ii)
+    {
+      if (pop_from((home_shard + ii) % num_shards, event))
+      {
+        return true;
+      }
+    }
+
+    // All the shards are empty, so wait for an event to be pushed.
+    pthread_mutex_lock(&_idle_lock);
+    ++_num_idle;
+    while ((!_terminated.load()) && (_size.load() <= 0))
+    {
+      pthread_cond_wait(&_idle_cond, &_idle_lock);
+    }
+    --_num_idle;
+    pthread_mutex_unlock(&_idle_lock);
+  }
+
+  return false;
+}
+
+bool ShardedSipEventQueue::pop_best_of(int home_shard,
+                                       int other_shard,
+                                       SipEvent& event)
+{
+  Shard* home = _shards[home_shard];
+  Shard* other = _shards[other_shard];
+
+  if (home->size.load(std::memory_order_relaxed) == 0)
+  {
+    return false;
+  }
+
+  pthread_mutex_lock(&home->lock);
+
+  if (home->queue.empty())
+  {
+    pthread_mutex_unlock(&home->lock);
+    return false;
+  }
+
+  // Only try to lock the other shard - we never block while holding our own
+  // shard's lock, so there's no risk of deadlock between workers.
+  if ((other != home) &&
+      (other->size.load(std::memory_order_relaxed) > 0) &&
+      (pthread_mutex_trylock(&other->lock) == 0))
+  {
+    if ((!other->queue.empty()) &&
+        (SipEvent::compare_sequence(home->queue.front(), other->queue.front())))
+    {
+      // The other shard's head should be processed first.
+      pthread_mutex_unlock(&home->lock);
+      pop_locked(other, event);
+      pthread_mutex_unlock(&other->lock);
+      return true;
+    }
+
+    pthread_mutex_unlock(&other->lock);
+  }
+
+  pop_locked(home, event);
+  pthread_mutex_unlock(&home->lock);
+  return true;
+}
+
+bool ShardedSipEventQueue::pop_from(int shard_ix, SipEvent& event)
+{
+  Shard* shard = _shards[shard_ix];
+
+  if (shard->size.load(std::memory_order_relaxed) == 0)
+  {
+    return false;
+  }
+
+  bool rc = false;
+  pthread_mutex_lock(&shard->lock);
+
+  if (!shard->queue.empty())
+  {
+    pop_locked(shard, event);
+    rc = true;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+  return rc;
+}
+
+void ShardedSipEventQueue::pop_locked(Shard* shard, SipEvent& event)
+{
+  event = shard->queue.front();
+  shard->queue.pop();
+  --shard->size;
+  --_size;
+  shard->service_time_ms = now_ms();
+}
+
+void ShardedSipEventQueue::terminate(std::vector<SipEvent>& remaining)
+{
+  pthread_mutex_lock(&_idle_lock);
+  _terminated = true;
+  pthread_cond_broadcast(&_idle_cond);
+  pthread_mutex_unlock(&_idle_lock);
+
+  for (Shard* shard : _shards)
+  {
+    pthread_mutex_lock(&shard->lock);
+    while (!shard->queue.empty())
+    {
+      SipEvent event;
+      pop_locked(shard, event);
+      remaining.push_back(event);
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
 }
@@ -0,0 +1,202 @@
+/**
+ * @file analyticslogger_test.cpp UT for the asynchronous AnalyticsLogger.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "analyticslogger.h"
+#include "fakesnmp.hpp"
+
+using namespace std;
+
+/// Captures the logs written by an AnalyticsLogger, rather than writing them
+/// to syslog.  Writes can be held up, to fill the ring buffers.
+class LogCapture
+{
+public:
+  LogCapture() :
+    _hold(false),
+    _writing(false)
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+  }
+
+  ~LogCapture()
+  {
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  AnalyticsLogger::WriteFn write_fn()
+  {
+    return [this](const char* timestamp, const char* log)
+           {
+             write(timestamp, log);
+           };
+  }
+
+  void hold()
+  {
+    pthread_mutex_lock(&_lock);
+    _hold = true;
+    pthread_mutex_unlock(&_lock);
+  }
+
+  void release()
+  {
+    pthread_mutex_lock(&_lock);
+    _hold = false;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  // Waits until the writer thread is held up writing a log.
+  void wait_for_write()
+  {
+    pthread_mutex_lock(&_lock);
+    while (!_writing)
+    {
+      pthread_cond_wait(&_cond, &_lock);
+    }
+    pthread_mutex_unlock(&_lock);
+  }
+
+  // Waits up to a second for the writer thread to have written count logs.
+  bool wait_for_logs(size_t count)
+  {
+    for (int ii = 0; ii < 1000; ++ii)
+    {
+      pthread_mutex_lock(&_lock);
+      bool written = (_logs.size() >= count);
+      pthread_mutex_unlock(&_lock);
+
+      if (written)
+      {
+        return true;
+      }
+
+      usleep(1000);
+    }
+
+    return false;
+  }
+
+  vector<string> _logs;
+
+private:
+  void write(const char* timestamp, const char* log)
+  {
+    pthread_mutex_lock(&_lock);
+    _logs.push_back(log);
+    _writing = true;
+    pthread_cond_broadcast(&_cond);
+    while (_hold)
+    {
+      pthread_cond_wait(&_cond, &_lock);
+    }
+    pthread_mutex_unlock(&_lock);
+  }
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  bool _hold;
+  bool _writing;
+};
+
+static void* log_from_thread(void* p)
+{
+  AnalyticsLogger* logger = (AnalyticsLogger*)p;
+  logger->call_disconnected("other-thread", 0);
+  return NULL;
+}
+
+// Test that logs made on several threads are all written, in order, by the
+// time the logger is stopped.
+TEST(AnalyticsLoggerTest, AsyncWritesAllLogs)
+{
+  SNMP::FakeCounterTable dropped_tbl;
+  LogCapture capture;
+  AnalyticsLogger logger(10, &dropped_tbl, capture.write_fn());
+
+  logger.call_disconnected("call-1", 0);
+  pthread_t thread;
+  pthread_create(&thread, NULL, &log_from_thread, &logger);
+  pthread_join(thread, NULL);
+  logger.call_disconnected("call-2", 0);
+  logger.stop();
+
+  ASSERT_EQ(3u, capture._logs.size());
+  EXPECT_EQ("Call-Disconnected: CALL_ID=call-1 REASON=0", capture._logs[0]);
+  EXPECT_EQ("Call-Disconnected: CALL_ID=other-thread REASON=0", capture._logs[1]);
+  EXPECT_EQ("Call-Disconnected: CALL_ID=call-2 REASON=0", capture._logs[2]);
+  EXPECT_EQ(0u, logger.dropped());
+  EXPECT_EQ(0, dropped_tbl._count);
+}
+
+// Test that the writer thread is woken up to write logs made while it is idle,
+// without waiting for the logger to be stopped.
+TEST(AnalyticsLoggerTest, AsyncWakesIdleWriter)
+{
+  LogCapture capture;
+  AnalyticsLogger logger(10, NULL, capture.write_fn());
+
+  logger.call_disconnected("call-1", 0);
+  ASSERT_TRUE(capture.wait_for_logs(1));
+
+  logger.call_disconnected("call-2", 0);
+  ASSERT_TRUE(capture.wait_for_logs(2));
+
+  logger.stop();
+  EXPECT_EQ("Call-Disconnected: CALL_ID=call-2 REASON=0", capture._logs[1]);
+}
+
+// Test that logs are dropped and counted, rather than blocking, when the
+// writer thread falls behind.
+TEST(AnalyticsLoggerTest, AsyncDropsOnOverflow)
+{
+  SNMP::FakeCounterTable dropped_tbl;
+  LogCapture capture;
+  AnalyticsLogger logger(2, &dropped_tbl, capture.write_fn());
+
+  // Hold up the writer thread on the first log, which keeps its space in the
+  // ring buffer until it has been written.
+  capture.hold();
+  logger.call_disconnected("call-1", 0);
+  capture.wait_for_write();
+
+  logger.call_disconnected("call-2", 0);
+  logger.call_disconnected("call-3", 0);
+  logger.call_disconnected("call-4", 0);
+
+  capture.release();
+  logger.stop();
+
+  ASSERT_EQ(2u, capture._logs.size());
+  EXPECT_EQ("Call-Disconnected: CALL_ID=call-1 REASON=0", capture._logs[0]);
+  EXPECT_EQ("Call-Disconnected: CALL_ID=call-2 REASON=0", capture._logs[1]);
+  EXPECT_EQ(2u, logger.dropped());
+  EXPECT_EQ(2, dropped_tbl._count);
+}
+
+// Test that a queue size of 0 writes logs on the calling thread.
+TEST(AnalyticsLoggerTest, Sync)
+{
+  LogCapture capture;
+  AnalyticsLogger logger(0, NULL, capture.write_fn());
+
+  logger.call_disconnected("call-1", 0);
+  ASSERT_EQ(1u, capture._logs.size());
+  EXPECT_EQ("Call-Disconnected: CALL_ID=call-1 REASON=0", capture._logs[0]);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file arena_test.cpp UT for the Arena class.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "gtest/gtest.h"
+
+#include "siptest.hpp"
+#include "stack.h"
+#include "arena.h"
+
+using namespace std;
+
+/// Fixture for Arena tests.
+class ArenaTest : public SipTest
+{
+public:
+  static void SetUpTestCase()
+  {
+    SipTest::SetUpTestCase();
+  }
+
+  static void TearDownTestCase()
+  {
+    SipTest::TearDownTestCase();
+  }
+
+  ArenaTest() : _arena(stack_data.endpt, "test-arena%p", 256)
+  {
+  }
+
+  Arena _arena;
+};
+
+// Test that allocations are aligned as requested and are counted.
+TEST_F(ArenaTest, Alignment)
+{
+  void* p1 = _arena.allocate(1, 1);
+  void* p2 = _arena.allocate(3, 16);
+  void* p3 = _arena.allocate(sizeof(double), alignof(double));
+
+  EXPECT_TRUE(p1 != NULL);
+  EXPECT_EQ(0u, (uintptr_t)p2 % 16);
+  EXPECT_EQ(0u, (uintptr_t)p3 % alignof(double));
+  EXPECT_EQ(4u + sizeof(double), _arena.bytes_allocated());
+}
+
+// Test that allocations larger than the block size succeed.
+TEST_F(ArenaTest, LargeAllocation)
+{
+  char* p = (char*)_arena.allocate(1000);
+  ASSERT_TRUE(p != NULL);
+  memset(p, 'x', 1000);
+  EXPECT_EQ(1000u, _arena.bytes_allocated());
+}
+
+// Test that standard library containers can use an ArenaAllocator.
+TEST_F(ArenaTest, Containers)
+{
+  typedef map<int,
+              string,
+              less<int>,
+              ArenaAllocator<pair<const int, string> > > ArenaMap;
+  ArenaMap m(ArenaMap::key_compare(), &_arena);
+  vector<int, ArenaAllocator<int> > v((ArenaAllocator<int>(&_arena)));
+
+  for (int ii = 0; ii < 100; ++ii)
+  {
+    m[ii] = to_string(ii);
+    v.push_back(ii);
+  }
+
+  m.erase(50);
+  EXPECT_EQ(99u, m.size());
+  EXPECT_EQ("99", m[99]);
+  EXPECT_EQ(100u, v.size());
+  EXPECT_EQ(42, v[42]);
+  EXPECT_GT(_arena.bytes_allocated(), 100 * sizeof(int));
+}
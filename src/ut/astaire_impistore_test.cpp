@@ -260,3 +260,213 @@ TEST_F(AstaireImpiStoreTest, ChallengeAKAMissingResponse)
   EXPECT_EQ(0, impi->auth_challenges.size());
   delete impi;
 }
+
+/// Fixture for tests of the compact binary encoding.
+class AstaireImpiStoreBinaryTest : public AstaireImpiStoreTest
+{
+public:
+  ImpiStore* binary_impi_store;
+  AstaireImpiStoreBinaryTest()
+  {
+    binary_impi_store = new AstaireImpiStore(local_store, true);
+  }
+  virtual ~AstaireImpiStoreBinaryTest()
+  {
+    delete binary_impi_store;
+  };
+
+  /// Writes the IMPI with the binary store, checks it was stored in the binary
+  /// encoding, and that both stores read it back.
+  void expect_binary_round_trip(ImpiStore::Impi* impi1)
+  {
+    Store::Status status = binary_impi_store->set_impi(impi1, 0L);
+    ASSERT_EQ(Store::Status::OK, status);
+
+    std::string data;
+    uint64_t cas;
+    local_store->get_data("impi", IMPI, data, cas, 0L);
+    EXPECT_TRUE(AstaireImpiStore::is_binary(data));
+
+    ImpiStore::Impi* impi2 = binary_impi_store->get_impi(IMPI, 0L);
+    expect_impis_equal(impi1, impi2);
+    delete impi2;
+
+    impi2 = impi_store->get_impi(IMPI, 0L);
+    expect_impis_equal(impi1, impi2);
+    delete impi2;
+  }
+};
+
+TEST_F(AstaireImpiStoreBinaryTest, SetGetDigest)
+{
+  ImpiStore::Impi* impi = example_impi_digest();
+  expect_binary_round_trip(impi);
+  delete impi;
+}
+
+TEST_F(AstaireImpiStoreBinaryTest, SetGetAKA)
+{
+  ImpiStore::Impi* impi = example_impi_aka();
+  expect_binary_round_trip(impi);
+  delete impi;
+}
+
+TEST_F(AstaireImpiStoreBinaryTest, SetGetDigestAKA)
+{
+  ImpiStore::Impi* impi = example_impi_digest_aka();
+  impi->auth_challenges[0]->_nonce_count = 300;
+  impi->auth_challenges[1]->_scscf_uri = "sip:scscf.example.com";
+  impi->auth_challenges[1]->_timer_id = "timer";
+  expect_binary_round_trip(impi);
+  delete impi;
+}
+
+// Test that a store writing the binary encoding can read IMPIs written as
+// JSON, e.g. by a node that hasn't been upgraded.
+TEST_F(AstaireImpiStoreBinaryTest, ReadJSON)
+{
+  ImpiStore::Impi* impi1 = example_impi_digest_aka();
+  Store::Status status = impi_store->set_impi(impi1, 0L);
+  ASSERT_EQ(Store::Status::OK, status);
+
+  ImpiStore::Impi* impi2 = binary_impi_store->get_impi(IMPI, 0L);
+  expect_impis_equal(impi1, impi2);
+
+  // Writing it back uses the binary encoding.
+  status = binary_impi_store->set_impi(impi2, 0L);
+  ASSERT_EQ(Store::Status::OK, status);
+  std::string data;
+  uint64_t cas;
+  local_store->get_data("impi", IMPI, data, cas, 0L);
+  EXPECT_TRUE(AstaireImpiStore::is_binary(data));
+
+  delete impi2;
+  delete impi1;
+}
+
+TEST_F(AstaireImpiStoreBinaryTest, ExpiredChallengesDropped)
+{
+  ImpiStore::Impi* impi1 = example_impi_digest_aka();
+  impi1->auth_challenges[1]->_expires = time(NULL) - 1;
+  Store::Status status = binary_impi_store->set_impi(impi1, 0L);
+  ASSERT_EQ(Store::Status::OK, status);
+
+  ImpiStore::Impi* impi2 = binary_impi_store->get_impi(IMPI, 0L);
+  ASSERT_TRUE(impi2 != NULL);
+  ASSERT_EQ(1, impi2->auth_challenges.size());
+  EXPECT_EQ(NONCE1, impi2->auth_challenges[0]->_nonce);
+  delete impi2;
+  delete impi1;
+}
+
+TEST_F(AstaireImpiStoreBinaryTest, IMPIUnknownVersion)
+{
+  local_store->set_data("impi", IMPI, std::string("\0\x02\x00", 3), 0, 30, 0L);
+  ImpiStore::Impi* impi = binary_impi_store->get_impi(IMPI, 0L);
+  ASSERT_TRUE(impi != NULL);
+  EXPECT_TRUE(impi->auth_challenges.empty());
+  delete impi;
+}
+
+TEST_F(AstaireImpiStoreBinaryTest, IMPITruncated)
+{
+  local_store->set_data("impi", IMPI, std::string("\0", 1), 0, 30, 0L);
+  ImpiStore::Impi* impi = binary_impi_store->get_impi(IMPI, 0L);
+  ASSERT_TRUE(impi != NULL);
+  EXPECT_TRUE(impi->auth_challenges.empty());
+  delete impi;
+}
+
+// Test that a truncated challenge is dropped, but earlier challenges are kept.
+TEST_F(AstaireImpiStoreBinaryTest, ChallengeTruncated)
+{
+  AstaireImpiStore::Impi* impi1 = (AstaireImpiStore::Impi*)example_impi_digest_aka();
+  std::string data = impi1->to_binary();
+  local_store->set_data("impi", IMPI, data.substr(0, data.size() - 1), 0, 30, 0L);
+
+  ImpiStore::Impi* impi2 = binary_impi_store->get_impi(IMPI, 0L);
+  ASSERT_TRUE(impi2 != NULL);
+  ASSERT_EQ(1, impi2->auth_challenges.size());
+  EXPECT_EQ(NONCE1, impi2->auth_challenges[0]->_nonce);
+  delete impi2;
+  delete impi1;
+}
+
+TEST_F(AstaireImpiStoreBinaryTest, ChallengeUnknownType)
+{
+  std::string challenge;
+  challenge.push_back('\x7f');
+  ImpiStore::write_string(challenge, NONCE1);
+  ImpiStore::write_varint(challenge, 1);
+  ImpiStore::write_varint(challenge, time(NULL) + 30);
+  ImpiStore::write_string(challenge, "");
+  ImpiStore::write_string(challenge, "");
+  ImpiStore::write_string(challenge, "");
+  std::string data("\0\x01\x01", 3);
+  ImpiStore::write_string(data, challenge);
+  local_store->set_data("impi", IMPI, data, 0, 30, 0L);
+
+  ImpiStore::Impi* impi = binary_impi_store->get_impi(IMPI, 0L);
+  ASSERT_TRUE(impi != NULL);
+  EXPECT_EQ(0, impi->auth_challenges.size());
+  delete impi;
+}
+
+// Compares the time to encode and decode IMPIs, and the number of bytes
+// stored, for the JSON and binary encodings.
+TEST_F(AstaireImpiStoreBinaryTest, DISABLED_SerializationBenchmark)
+{
+  const int NUM_ITERATIONS = 100000;
+
+  std::vector<std::pair<std::string, ImpiStore::Impi*>> impis =
+    {{"digest", example_impi_digest()},
+     {"AKA", example_impi_aka()}};
+
+  for (std::pair<std::string, ImpiStore::Impi*>& impi : impis)
+  {
+    AstaireImpiStore::Impi* impi_obj = (AstaireImpiStore::Impi*)impi.second;
+    std::string json = impi_obj->to_json();
+    std::string binary = impi_obj->to_binary();
+
+    Utils::StopWatch sw;
+    unsigned long json_encode_us = 0;
+    unsigned long json_decode_us = 0;
+    unsigned long binary_encode_us = 0;
+    unsigned long binary_decode_us = 0;
+
+    sw.start();
+    for (int ii = 0; ii < NUM_ITERATIONS; ++ii)
+    {
+      json = impi_obj->to_json();
+    }
+    sw.read(json_encode_us);
+
+    sw.start();
+    for (int ii = 0; ii < NUM_ITERATIONS; ++ii)
+    {
+      delete AstaireImpiStore::from_json(IMPI, json);
+    }
+    sw.read(json_decode_us);
+
+    sw.start();
+    for (int ii = 0; ii < NUM_ITERATIONS; ++ii)
+    {
+      binary = impi_obj->to_binary();
+    }
+    sw.read(binary_encode_us);
+
+    sw.start();
+    for (int ii = 0; ii < NUM_ITERATIONS; ++ii)
+    {
+      delete AstaireImpiStore::from_binary(IMPI, binary);
+    }
+    sw.read(binary_decode_us);
+
+    printf("%s: JSON %lu bytes, %d encodes took %luus, decodes took %luus\n",
+           impi.first.c_str(), json.size(), NUM_ITERATIONS, json_encode_us, json_decode_us);
+    printf("%s: binary %lu bytes, %d encodes took %luus, decodes took %luus\n",
+           impi.first.c_str(), binary.size(), NUM_ITERATIONS, binary_encode_us, binary_decode_us);
+
+    delete impi_obj;
+  }
+}
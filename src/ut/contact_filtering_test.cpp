@@ -9,6 +9,7 @@
 
 #include "gtest/gtest.h"
 #include "contact_filtering.h"
+#include "binding_target_cache.h"
 #include "pjsip.h"
 #include "pjutils.h"
 
@@ -691,6 +692,62 @@ TEST_F(ContactFilteringBindingToTargetTest, EmptyPath)
                                 target));
 }
 
+TEST_F(ContactFilteringBindingToTargetTest, CachedConversion)
+{
+  BindingTargetCache cache(&caching_pool.factory, 10, 1);
+  BindingTargetCache::set_instance(&cache);
+
+  std::string aor = "sip:user@domain.com";
+  Binding binding(aor);
+  create_binding(binding);
+  std::string binding_id = "<sip:user@10.1.2.3>";
+
+  // The first conversion parses the binding into the cache, and the second
+  // copies it from there.
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    Target target;
+    EXPECT_TRUE(binding_to_target(aor,
+                                  binding_id,
+                                  binding,
+                                  false,
+                                  pool,
+                                  target));
+    EXPECT_EQ(PJUtils::uri_to_string(PJSIP_URI_IN_CONTACT_HDR,
+                                     PJUtils::uri_from_string(binding._uri, pool)),
+              PJUtils::uri_to_string(PJSIP_URI_IN_CONTACT_HDR, target.uri));
+    ASSERT_EQ((unsigned)2, target.paths.size());
+
+    std::list<std::string>::const_iterator j = binding._path_headers.begin();
+    for (std::list<pjsip_route_hdr*>::const_iterator i = target.paths.begin();
+         i != target.paths.end();
+         ++i)
+    {
+      std::string path = PJUtils::get_header_value((pjsip_hdr*)*i);
+      EXPECT_EQ(path, *j);
+      ++j;
+    }
+  }
+
+  EXPECT_EQ(1u, cache.misses());
+  EXPECT_EQ(1u, cache.hits());
+
+  // Changing the stored Path headers means the binding is parsed again, and
+  // a badly formed Path header is still rejected.
+  binding._path_headers.push_back("banana");
+  Target target;
+  EXPECT_FALSE(binding_to_target(aor,
+                                 binding_id,
+                                 binding,
+                                 false,
+                                 pool,
+                                 target));
+  EXPECT_EQ(2u, cache.misses());
+  EXPECT_EQ(2u, cache.size());
+
+  BindingTargetCache::set_instance(NULL);
+}
+
 class ContactFilteringFullStackTest :
   public ContactFilteringCreateBindingFixture {};
 
@@ -16,6 +16,8 @@
 #include "test_interposer.hpp"
 #include "utils.h"
 #include "sas.h"
+#include "mock_sas.h"
+#include "sproutsasevent.h"
 #include "enumservice.h"
 #include "fakednsresolver.hpp"
 #include "fakelogger.h"
@@ -440,3 +442,87 @@ TEST_F(DNSEnumServiceTest, PosixRegexTest)
   ET("1234", "").test(enum_);
 }
 
+TEST_F(DNSEnumServiceTest, CacheHitTest)
+{
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 100);
+  mock_sas_collect_messages(true);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ((MockSASMessage*)NULL, mock_sas_find_event(SASEvent::ENUM_CACHE_HIT));
+
+  // The cache hit is logged to SAS.
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_NE((MockSASMessage*)NULL, mock_sas_find_event(SASEvent::ENUM_CACHE_HIT));
+  mock_sas_discard_messages();
+  mock_sas_collect_messages(false);
+
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+}
+
+TEST_F(DNSEnumServiceTest, CacheExpiryTest)
+{
+  cwtest_completely_control_time();
+  FakeDNSResolver::_ttl = 10;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 100);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+
+  cwtest_advance_time_ms(9000);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+
+  // Once the TTL has passed, the domain is queried again.
+  cwtest_advance_time_ms(1001);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+  cwtest_reset_time();
+}
+
+TEST_F(DNSEnumServiceTest, ZeroTtlNotCachedTest)
+{
+  FakeDNSResolver::_ttl = 0;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 100);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, NegativeCacheTest)
+{
+  cwtest_completely_control_time();
+  AlarmManager am;
+  MockCommunicationMonitor cm_(&am);
+  EXPECT_CALL(cm_, inform_success(_)).Times(3);
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), &cm_, 100);
+  ET("1234", "").test(enum_);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+
+  cwtest_advance_time_ms(60001);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+  cwtest_reset_time();
+}
+
+TEST_F(DNSEnumServiceTest, ServerFailureNotCachedTest)
+{
+  AlarmManager am;
+  MockCommunicationMonitor cm_(&am);
+  EXPECT_CALL(cm_, inform_failure(_)).Times(2);
+  DNSEnumService enum_(_servers, ".e164.arpa", new BrokenDNSResolverFactory(), &cm_, 100);
+  ET("1234", "").test(enum_);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, CacheEvictionTest)
+{
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("8.7.6.5.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 1);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("5678", "sip:5678@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 3);
+}
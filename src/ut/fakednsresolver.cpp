@@ -21,12 +21,13 @@
 
 
 int FakeDNSResolver::_num_calls = 0;
+int FakeDNSResolver::_ttl = FakeDNSResolver::DEFAULT_TTL;
 std::map<std::string,struct ares_naptr_reply*> FakeDNSResolver::_database = std::map<std::string,struct ares_naptr_reply*>();
 // By default, expect requests for 127.0.0.1.
 struct IP46Address FakeDNSResolverFactory::_expected_server = {AF_INET, {{htonl(0x7f000001)}}};
 
 
-int FakeDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int FakeDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
   ++_num_calls;
   // Look up the query domain and return the reply if found.
@@ -34,6 +35,7 @@ int FakeDNSResolver::perform_naptr_query(const std::string& domain, struct ares_
   if (i != _database.end())
   {
     naptr_reply = i->second;
+    ttl = _ttl;
     return ARES_SUCCESS;
   }
   else
@@ -56,8 +58,10 @@ DNSResolver* FakeDNSResolverFactory::new_resolver(const std::vector<struct IP46A
   return new FakeDNSResolver(servers);
 }
 
-int BrokenDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int BrokenDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
+  // Calls are counted along with those to FakeDNSResolver.
+  ++FakeDNSResolver::_num_calls;
   return ARES_ESERVFAIL;
 }
 
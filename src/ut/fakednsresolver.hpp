@@ -21,13 +21,16 @@ class FakeDNSResolver : public DNSResolver
 {
 public:
   inline FakeDNSResolver(const std::vector<struct IP46Address>& servers) : DNSResolver(servers) {};
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
   // Reset the static data.
-  static inline void reset() { _num_calls = 0; _database.clear(); };
+  static inline void reset() { _num_calls = 0; _database.clear(); _ttl = DEFAULT_TTL; };
 
   // Number of calls that have been made so far.
   static int _num_calls;
+  // TTL to return with successful responses.
+  static const int DEFAULT_TTL = 300;
+  static int _ttl;
   // Database mapping domain names to NAPTR responses.
   static std::map<std::string,struct ares_naptr_reply*> _database;
 
@@ -50,7 +53,7 @@ class BrokenDNSResolver : public DNSResolver
 {
 public:
   inline BrokenDNSResolver(const std::vector<struct IP46Address>& servers) : DNSResolver(servers) {};
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
 };
 
@@ -35,7 +35,8 @@ FakeHSSConnection::FakeHSSConnection(MockHSSConnection* hss_connection_observer)
                 &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
                 NULL,
                 NULL,
-                0)
+                0),
+  _defer_async(false)
 {
   _hss_connection_observer = hss_connection_observer;
 }
@@ -50,6 +51,32 @@ void FakeHSSConnection::flush_all()
 {
   _results.clear();
   _calls.clear();
+  _defer_async = false;
+}
+
+void FakeHSSConnection::run_async(std::function<void()> request,
+                                  PJUtils::Callback* on_complete)
+{
+  if (_defer_async)
+  {
+    _deferred.push_back(std::make_pair(request, on_complete));
+  }
+  else
+  {
+    HSSConnection::run_async(request, on_complete);
+  }
+}
+
+void FakeHSSConnection::complete_async_queries()
+{
+  _defer_async = false;
+
+  std::vector<std::pair<std::function<void()>, PJUtils::Callback*>> deferred;
+  deferred.swap(_deferred);
+  for (std::pair<std::function<void()>, PJUtils::Callback*>& query : deferred)
+  {
+    HSSConnection::run_async(query.first, query.second);
+  }
 }
 
 void FakeHSSConnection::set_result(const std::string& url,
@@ -168,6 +195,11 @@ long FakeHSSConnection::get_json_object(const std::string& path,
                                         rapidjson::Document*& object,
                                         SAS::TrailId trail)
 {
+  if (_request_hook)
+  {
+    _request_hook();
+  }
+
   _calls.insert(UrlBody(path, ""));
   HTTPCode http_code = HTTP_NOT_FOUND;
 
@@ -220,6 +252,11 @@ long FakeHSSConnection::get_xml_object(const std::string& path,
                                        rapidxml::xml_document<>*& root,
                                        SAS::TrailId trail)
 {
+  if (_request_hook)
+  {
+    _request_hook();
+  }
+
   _calls.insert(UrlBody(path, body));
   HTTPCode http_code = HTTP_NOT_FOUND;
 
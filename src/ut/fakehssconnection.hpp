@@ -11,8 +11,11 @@
 
 #pragma once
 
+#include <functional>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 #include "log.h"
 #include "sas.h"
 #include "hssconnection.h"
@@ -58,10 +61,30 @@ public:
     return _calls.size();
   }
 
+  /// Sets a function that is called at the start of every request to the
+  /// fake Homestead, e.g. to hold up a request while a test does something
+  /// else.
+  void set_request_hook(std::function<void()> hook)
+  {
+    _request_hook = hook;
+  }
+
   HTTPCode update_registration_state(const HSSConnection::irs_query& irs_query,
                                      HSSConnection::irs_info& irs_info,
                                      SAS::TrailId trail);
 
+  /// Makes asynchronous queries (and runs their callbacks) before returning,
+  /// unless queries are being deferred.
+  virtual void run_async(std::function<void()> request,
+                         PJUtils::Callback* on_complete) override;
+
+  /// Holds asynchronous queries until complete_async_queries is called, so
+  /// that tests can act while a query is outstanding.
+  void defer_async_queries() { _defer_async = true; }
+
+  /// Makes any held asynchronous queries, and stops holding new ones.
+  void complete_async_queries();
+
 private:
   void set_impu_result_internal(const std::string&,
                                 const std::string&,
@@ -81,6 +104,9 @@ private:
   std::map<std::string, std::string> _results;
   std::map<std::string, long> _rcs;
   std::set<UrlBody> _calls;
+  std::function<void()> _request_hook;
+  bool _defer_async;
+  std::vector<std::pair<std::function<void()>, PJUtils::Callback*>> _deferred;
 
   // Optional MockHSSConnection object.  May be NULL if the creator of the
   // FakeHSSConnection  does not want to explicitly check method invocation.
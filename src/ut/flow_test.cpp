@@ -11,6 +11,8 @@
 ///----------------------------------------------------------------------------
 
 #include <string>
+#include <vector>
+#include <pthread.h>
 #include "gtest/gtest.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/lexical_cast.hpp>
@@ -131,3 +133,135 @@ TEST_F(FlowTest, FlowUnQuiesceMidDialog)
   EXPECT_FALSE(flow->should_quiesce());
 }
 
+
+// Test that a flow can be found by address and by token, and that it is
+// removed from the table when its last reference is released.
+TEST_F(FlowTest, FindFlow)
+{
+  pjsip_transport* tp = TransportFlow::udp_transport(stack_data.pcscf_untrusted_port);
+  pj_sockaddr other_addr;
+  pj_sockaddr_init(PJ_AF_INET, &other_addr, NULL, 5060);
+
+  EXPECT_EQ(1u, ft->flow_count());
+  EXPECT_TRUE(ft->find_flow(tp, &other_addr) == NULL);
+
+  Flow* other_flow = ft->find_create_flow(tp, &other_addr);
+  ASSERT_TRUE(other_flow != NULL);
+  EXPECT_NE(flow, other_flow);
+  EXPECT_EQ(2u, ft->flow_count());
+
+  EXPECT_EQ(other_flow, ft->find_create_flow(tp, &other_addr));
+  EXPECT_EQ(other_flow, ft->find_flow(tp, &other_addr));
+  EXPECT_EQ(other_flow, ft->find_flow(other_flow->token()));
+  EXPECT_EQ(flow, ft->find_flow(flow->token()));
+  flow->dec_ref();
+  EXPECT_TRUE(ft->find_flow("unknown") == NULL);
+
+  // Release the references taken above, then the one held by the idle timer.
+  other_flow->dec_ref();
+  other_flow->dec_ref();
+  other_flow->dec_ref();
+  other_flow->dec_ref();
+  std::string token = other_flow->token();
+  other_flow->dec_ref();
+  EXPECT_EQ(1u, ft->flow_count());
+  EXPECT_TRUE(ft->find_flow(tp, &other_addr) == NULL);
+  EXPECT_TRUE(ft->find_flow(token) == NULL);
+}
+
+struct FlowLookupThreadData
+{
+  FlowTable* flow_table;
+  pjsip_transport* transport;
+  const std::vector<pj_sockaddr>* addrs;
+  const std::vector<std::string>* tokens;
+  int first;
+  int num_lookups;
+};
+
+static void* flow_lookup_thread(void* p)
+{
+  FlowLookupThreadData* data = (FlowLookupThreadData*)p;
+  int num_flows = data->addrs->size();
+
+  for (int ii = 0; ii < data->num_lookups; ++ii)
+  {
+    int index = (data->first + ii * 7919) % num_flows;
+    Flow* flow = (ii % 2 == 0) ?
+      data->flow_table->find_flow(data->transport, &(*data->addrs)[index]) :
+      data->flow_table->find_flow((*data->tokens)[index]);
+    flow->dec_ref();
+  }
+
+  return NULL;
+}
+
+// Times creating 1,000,000 flows, then looking them up by address and token
+// from several threads, first with a single shard (equivalent to a single
+// lock) and then with the default number of shards.  Disabled by default -
+// run with --gtest_also_run_disabled_tests to see the results.
+TEST_F(FlowTest, DISABLED_MillionFlowBenchmark)
+{
+  const int NUM_FLOWS = 1000000;
+  const int NUM_THREADS = 8;
+  const int LOOKUPS_PER_THREAD = 250000;
+
+  pjsip_transport* tp = TransportFlow::udp_transport(stack_data.pcscf_untrusted_port);
+  std::vector<pj_sockaddr> addrs(NUM_FLOWS);
+
+  for (int ii = 0; ii < NUM_FLOWS; ++ii)
+  {
+    pj_sockaddr_init(PJ_AF_INET, &addrs[ii], NULL, 1024 + ii % 60000);
+    addrs[ii].ipv4.sin_addr.s_addr = pj_htonl(0x0a000000 + ii / 60000);
+  }
+
+  int shard_counts[] = {1, FlowTable::DEFAULT_NUM_SHARDS};
+
+  for (int num_shards : shard_counts)
+  {
+    SNMP::U32Scalar connection_count("", "");
+    FlowTable* flow_table = new FlowTable(NULL, &connection_count, num_shards);
+    std::vector<std::string> tokens(NUM_FLOWS);
+
+    Utils::StopWatch sw;
+    sw.start();
+
+    for (int ii = 0; ii < NUM_FLOWS; ++ii)
+    {
+      Flow* flow = flow_table->find_create_flow(tp, &addrs[ii]);
+      tokens[ii] = flow->token();
+      flow->dec_ref();
+    }
+
+    unsigned long create_us = 0;
+    sw.read(create_us);
+    EXPECT_EQ((size_t)NUM_FLOWS, flow_table->flow_count());
+
+    pthread_t threads[NUM_THREADS];
+    FlowLookupThreadData data[NUM_THREADS];
+
+    for (int ii = 0; ii < NUM_THREADS; ++ii)
+    {
+      data[ii] = {flow_table, tp, &addrs, &tokens, ii * 1000, LOOKUPS_PER_THREAD};
+      pthread_create(&threads[ii], NULL, &flow_lookup_thread, &data[ii]);
+    }
+
+    for (int ii = 0; ii < NUM_THREADS; ++ii)
+    {
+      pthread_join(threads[ii], NULL);
+    }
+
+    unsigned long total_us = 0;
+    sw.read(total_us);
+
+    printf("%d shards: created %d flows in %luus, %d lookups on %d threads took %luus\n",
+           num_shards,
+           NUM_FLOWS,
+           create_us,
+           NUM_THREADS * LOOKUPS_PER_THREAD,
+           NUM_THREADS,
+           total_us - create_us);
+
+    delete flow_table;
+  }
+}
@@ -14,12 +14,17 @@
 
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 #include "utils.h"
 #include "sas.h"
 #include "fakehttpresolver.hpp"
+#include "fakehssconnection.hpp"
 #include "hssconnection.h"
+#include "pjutils.h"
 #include "basetest.hpp"
 #include "fakecurl.hpp"
 #include "fakesnmp.hpp"
@@ -869,6 +874,246 @@ TEST_F(HssConnectionTest, LocationNotFound)
   delete actual;
 }
 
+// Test that, with no HSS threads, asynchronous queries complete before
+// returning.
+TEST_F(HssConnectionTest, AsyncLocationInline)
+{
+  rapidjson::Document* actual = NULL;
+  HTTPCode rc = 0;
+  bool complete = false;
+  _hss.get_location_data_async("pubid44", false, "", rc, actual, 0,
+                               new PJUtils::FunctorCallback([&complete]()
+                               {
+                                 complete = true;
+                               }));
+  EXPECT_TRUE(complete);
+  EXPECT_EQ(HTTP_OK, rc);
+  ASSERT_TRUE(actual != NULL);
+  EXPECT_EQ(std::string("server-name"), (*actual)["scscf"].GetString());
+  delete actual;
+}
+
+// Test that asynchronous queries are made on the HSS threads, and that the
+// callback is run once the result has been filled in.
+TEST_F(HssConnectionTest, AsyncUserAuthOnHssThread)
+{
+  HSSConnection hss("narcissus",
+                    &_resolver,
+                    NULL,
+                    &SNMP::FAKE_IP_COUNT_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &_cm,
+                    NULL,
+                    500,
+                    1);
+
+  rapidjson::Document* actual = NULL;
+  HTTPCode rc = 0;
+  std::atomic<bool> complete(false);
+  pthread_t caller = pthread_self();
+  bool on_other_thread = false;
+  hss.get_user_auth_status_async("privid69", "pubid44", "", "", false, rc, actual, 0,
+                                 new PJUtils::FunctorCallback([&]()
+                                 {
+                                   on_other_thread = !pthread_equal(caller, pthread_self());
+                                   complete = true;
+                                 }));
+
+  for (int ii = 0; (ii < 1000) && (!complete); ++ii)
+  {
+    usleep(1000);
+  }
+
+  ASSERT_TRUE(complete);
+  EXPECT_TRUE(on_other_thread);
+  EXPECT_EQ(HTTP_OK, rc);
+  ASSERT_TRUE(actual != NULL);
+  EXPECT_EQ(std::string("server-name"), (*actual)["scscf"].GetString());
+  delete actual;
+}
+
+// Test that asynchronous queries fail straight away, rather than blocking the
+// caller, once there are too many pending.
+TEST_F(HssConnectionTest, AsyncFailsWhenTooManyPending)
+{
+  HSSConnection hss("narcissus",
+                    &_resolver,
+                    NULL,
+                    &SNMP::FAKE_IP_COUNT_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &_cm,
+                    NULL,
+                    500,
+                    1);
+
+  // Fill up the queue with queries that don't complete until we say so.
+  std::atomic<bool> release(false);
+  std::atomic<uint64_t> completed(0);
+  for (uint64_t ii = 0; ii < HSSConnection::MAX_PENDING_REQUESTS; ++ii)
+  {
+    hss.run_async([&release]()
+                  {
+                    while (!release)
+                    {
+                      usleep(1000);
+                    }
+                  },
+                  new PJUtils::FunctorCallback([&completed]()
+                  {
+                    ++completed;
+                  }));
+  }
+
+  rapidjson::Document* actual = NULL;
+  HTTPCode rc = 0;
+  bool complete = false;
+  hss.get_location_data_async("pubid44", false, "", rc, actual, 0,
+                              new PJUtils::FunctorCallback([&complete]()
+                              {
+                                complete = true;
+                              }));
+  EXPECT_TRUE(complete);
+  EXPECT_EQ(HTTP_SERVER_UNAVAILABLE, rc);
+  EXPECT_TRUE(actual == NULL);
+
+  release = true;
+  for (int ii = 0;
+       (ii < 1000) && (completed < HSSConnection::MAX_PENDING_REQUESTS);
+       ++ii)
+  {
+    usleep(1000);
+  }
+
+  EXPECT_EQ(HSSConnection::MAX_PENDING_REQUESTS, completed.load());
+}
+
+struct CoalescedQuery
+{
+  FakeHSSConnection* hss;
+  HSSConnection::irs_info irs_info;
+  HTTPCode rc;
+  bool threw;
+};
+
+static void* coalesced_query_thread(void* arg)
+{
+  CoalescedQuery* query = (CoalescedQuery*)arg;
+  try
+  {
+    query->rc = query->hss->get_registration_data("sip:6505550001@homedomain",
+                                                  query->irs_info,
+                                                  0);
+  }
+  catch (std::runtime_error&)
+  {
+    query->threw = true;
+  }
+  return NULL;
+}
+
+// Test that concurrent identical queries share a single request to
+// Homestead.
+TEST_F(HssConnectionTest, CoalesceConcurrentQueries)
+{
+  FakeHSSConnection hss;
+  hss.set_impu_result("sip:6505550001@homedomain", "call", "REGISTERED", "");
+
+  // Hold up the request to Homestead until the other query has joined it.
+  hss.set_request_hook([&hss]()
+  {
+    for (int ii = 0; (ii < 1000) && (hss.coalesced_requests() == 0); ++ii)
+    {
+      usleep(1000);
+    }
+  });
+
+  CoalescedQuery queries[2];
+  pthread_t threads[2];
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    queries[ii].hss = &hss;
+    queries[ii].rc = 0;
+    queries[ii].threw = false;
+    pthread_create(&threads[ii], NULL, &coalesced_query_thread, &queries[ii]);
+  }
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    pthread_join(threads[ii], NULL);
+    EXPECT_FALSE(queries[ii].threw);
+    EXPECT_EQ(HTTP_OK, queries[ii].rc);
+    EXPECT_EQ("REGISTERED", queries[ii].irs_info._regstate);
+  }
+
+  EXPECT_EQ(1u, hss.issued_requests());
+  EXPECT_EQ(1u, hss.coalesced_requests());
+  EXPECT_EQ(1, hss.request_count());
+
+  // Once the request has completed, the next query is sent to Homestead.
+  hss.set_request_hook(nullptr);
+  HSSConnection::irs_info irs_info;
+  EXPECT_EQ(HTTP_OK, hss.get_registration_data("sip:6505550001@homedomain",
+                                               irs_info,
+                                               0));
+  EXPECT_EQ(2u, hss.issued_requests());
+}
+
+// Test that a query waiting for another's request to Homestead doesn't hang
+// if that request throws, but sends the request itself.
+TEST_F(HssConnectionTest, CoalescedQueryRetriesIfRequestThrows)
+{
+  FakeHSSConnection hss;
+  hss.set_impu_result("sip:6505550001@homedomain", "call", "REGISTERED", "");
+
+  // Fail the first request to Homestead once the other query has joined it.
+  std::atomic<int> hook_calls(0);
+  hss.set_request_hook([&hss, &hook_calls]()
+  {
+    if (hook_calls++ == 0)
+    {
+      for (int ii = 0; (ii < 1000) && (hss.coalesced_requests() == 0); ++ii)
+      {
+        usleep(1000);
+      }
+      throw std::runtime_error("Request failed");
+    }
+  });
+
+  CoalescedQuery queries[2];
+  pthread_t threads[2];
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    queries[ii].hss = &hss;
+    queries[ii].rc = 0;
+    queries[ii].threw = false;
+    pthread_create(&threads[ii], NULL, &coalesced_query_thread, &queries[ii]);
+  }
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    pthread_join(threads[ii], NULL);
+  }
+
+  // One query saw the exception, and the other sent its own request.
+  EXPECT_NE(queries[0].threw, queries[1].threw);
+  int succeeded = queries[0].threw ? 1 : 0;
+  EXPECT_EQ(HTTP_OK, queries[succeeded].rc);
+  EXPECT_EQ("REGISTERED", queries[succeeded].irs_info._regstate);
+
+  EXPECT_EQ(2u, hss.issued_requests());
+  EXPECT_EQ(1u, hss.coalesced_requests());
+}
+
 TEST_F(HssConnectionTest, SimpleAliases)
 {
   HSSConnection::irs_query irs_query;
@@ -1258,7 +1503,7 @@ TEST_F(HssWithSifcTest, SimpleSiFC)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of one shared iFC set, with set id 10.
   const std::set<int32_t> ids = {10};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that two iFCs are now present in the map.
@@ -1281,7 +1526,7 @@ TEST_F(HssWithSifcTest, SifcWithIfc)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of one shared iFC set with set id of 0.
   const std::set<int32_t> ids = {0};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that three iFCs are now present in the map,
@@ -1320,7 +1565,7 @@ TEST_F(HssWithSifcTest, MultipleExtensions)
   // anything at this point.
   std::multimap<int32_t, Ifc> ifc_list_one;
   const std::set<int32_t> set_list_one = {1, 2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifc_list_one)));
 
   // Any iFCs from the first Shared iFC sets will be passed into this function.
@@ -1331,7 +1576,7 @@ TEST_F(HssWithSifcTest, MultipleExtensions)
   ifc_list_two.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   ifc_list_two.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   const std::set<int32_t> set_list_two = {10};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_two, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_two, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifc_list_two)));
 
   // Send in a message, and check that three iFCs are now in the iFC map.
@@ -1354,7 +1599,7 @@ TEST_F(HssWithSifcTest, MultipleSifcs)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of two shared iFC sets, with set ids 1 and 2.
   const std::set<int32_t> ids = {1, 2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that two iFCs are now in the iFC map.
@@ -1380,9 +1625,9 @@ TEST_F(HssWithSifcTest, MultiplePubIdsWithSifcs)
   // profile, and 2 for the other.
   const std::set<int32_t> id_set_one = {1};
   const std::set<int32_t> id_set_two = {2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_two, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_two, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // The iFC map composes of keys, which are public ids, and their values, which
@@ -1412,7 +1657,7 @@ TEST_F(HssWithSifcTest, ComplexSifcIfcMix)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of two shared iFC sets, with ids 3 and 4.
   const std::set<int32_t> id_set_one = {3, 4};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check the expected number of iFCs are present, as
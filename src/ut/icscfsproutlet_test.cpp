@@ -20,6 +20,7 @@
 #include "utils.h"
 #include "test_utils.hpp"
 #include "icscfsproutlet.h"
+#include "scscf_assignment_cache.h"
 #include "mock_sas.h"
 #include "fakehssconnection.hpp"
 #include "test_interposer.hpp"
@@ -65,7 +66,8 @@ public:
     SipTest::TearDownTestCase();
   }
 
-  ICSCFSproutletTestBase()
+  ICSCFSproutletTestBase(SCSCFAssignmentCache* assignment_cache = NULL) :
+    _assignment_cache(assignment_cache)
   {
     _log_traffic = PrintingTestLogger::DEFAULT.isPrinting(); // true to see all traffic
     _hss_connection->flush_all();
@@ -83,7 +85,8 @@ public:
                                           NULL,
                                           NULL,
                                           false,
-                                          ICSCF_PORT);
+                                          ICSCF_PORT,
+                                          _assignment_cache);
     _icscf_sproutlet->init();
     std::list<Sproutlet*> sproutlets;
     sproutlets.push_back(_icscf_sproutlet);
@@ -127,6 +130,7 @@ public:
 
     delete _icscf_proxy; _icscf_proxy = NULL;
     delete _icscf_sproutlet; _icscf_sproutlet = NULL;
+    delete _assignment_cache; _assignment_cache = NULL;
   }
 
   /// Check that we logged an ICID to SAS.
@@ -151,6 +155,7 @@ protected:
   static FakeHSSConnection* _hss_connection;
   static SCSCFSelector* _scscf_selector;
   static JSONEnumService* _enum_service;
+  SCSCFAssignmentCache* _assignment_cache;
   ICSCFSproutlet* _icscf_sproutlet;
   SproutletProxy* _icscf_proxy;
 };
@@ -181,7 +186,8 @@ public:
     ICSCFSproutletTestBase::TearDownTestCase();
   }
 
-  ICSCFSproutletTest()
+  ICSCFSproutletTest(SCSCFAssignmentCache* assignment_cache = NULL) :
+    ICSCFSproutletTestBase(assignment_cache)
   {
   }
 
@@ -2538,6 +2544,75 @@ TEST_F(ICSCFSproutletTest, RouteTermInviteCancel)
 }
 
 
+TEST_F(ICSCFSproutletTest, RouteTermInviteCancelDuringHSSQuery)
+{
+  // Tests handling of a CANCEL request that arrives while the I-CSCF is still
+  // waiting for the LIR, before the INVITE has been forwarded.
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the I-CSCF listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        ICSCF_PORT,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Set up the HSS response for the terminating location query, but hold the
+  // query until the CANCEL has been received.
+  _hss_connection->set_result("/impu/sip%3A6505551234%40homedomain/location",
+                              "{\"result-code\": 2001,"
+                              " \"scscf\": \"sip:scscf1.homedomain:5058;transport=TCP\"}");
+  _hss_connection->defer_async_queries();
+
+  // Inject a terminating INVITE request with a P-Served-User header.
+  Message msg1;
+  msg1._first_hop = true;
+  msg1._method = "INVITE";
+  msg1._via = tp->to_string(false);
+  msg1._extra = "Contact: sip:6505551000@" +
+                tp->to_string(true) +
+                ";ob;expires=300;+sip.ice;reg-id=1;+sip.instance=\"<urn:uuid:00000000-0000-0000-0000-b665231f1213>\"\r\n";
+  msg1._extra += "P-Served-User: <sip:6505551000@homedomain>";
+  msg1._route = "Route: <sip:homedomain>";
+  inject_msg(msg1.get_request(), tp);
+
+  // Expecting only the 100 Trying, as the INVITE can't be routed yet.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(100).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // Build and send a CANCEL chasing the INVITE.
+  Message msg2;
+  msg2._first_hop = true;
+  msg2._method = "CANCEL";
+  msg2._via = tp->to_string(false);
+  msg2._unique = msg1._unique;    // Make sure branch and call-id are same as the INVITE
+  inject_msg(msg2.get_request(), tp);
+
+  // Expect the 200 OK response to the CANCEL.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(200).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // Now let the LIR complete.  The INVITE isn't forwarded, and is rejected
+  // with a 487 instead.
+  _hss_connection->complete_async_queries();
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(487).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+  ASSERT_EQ(0, txdata_count());
+
+  _hss_connection->delete_result("/impu/sip%3A6505551234%40homedomain/location");
+
+  delete tp;
+}
+
+
 TEST_F(ICSCFSproutletTest, RouteTermInviteHSSCaps)
 {
   pjsip_tx_data* tdata;
@@ -3896,3 +3971,121 @@ TEST_F(ICSCFSproutletTest, ICSCFHandlesEnumInvalid)
   // Clean up.
   delete tp;
 }
+
+
+/// Fixture for tests of the I-CSCF with an S-CSCF assignment cache.
+class ICSCFSproutletCacheTest : public ICSCFSproutletTest
+{
+public:
+  ICSCFSproutletCacheTest() :
+    ICSCFSproutletTest(new SCSCFAssignmentCache(100, 300))
+  {
+  }
+};
+
+
+// Test that HSS responses that only return capabilities are not cached, so
+// that once the subscriber registers, later requests are routed to the
+// S-CSCF assigned by the HSS rather than one selected from stale
+// capabilities.
+TEST_F(ICSCFSproutletCacheTest, RegisterThenTermInvite)
+{
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the I-CSCF listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        ICSCF_PORT,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Before the subscriber registers, the LIR returns capabilities, which
+  // select scscf3.
+  _hss_connection->set_result("/impu/sip%3A6505551234%40homedomain/location",
+                              "{\"result-code\": 2001,"
+                              " \"mandatory-capabilities\": [567],"
+                              " \"optional-capabilities\": [789, 567]}");
+
+  Message msg1;
+  msg1._first_hop = true;
+  msg1._method = "INVITE";
+  msg1._via = tp->to_string(false);
+  msg1._extra = "P-Served-User: <sip:6505551000@homedomain>";
+  msg1._route = "Route: <sip:homedomain>";
+  inject_msg(msg1.get_request(), tp);
+
+  ASSERT_EQ(2, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(100).matches(tdata->msg);
+  free_txdata();
+  tdata = current_txdata();
+  expect_target("TCP", "10.10.10.3", 5058, tdata);
+  ReqMatcher("INVITE").matches(tdata->msg);
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(200).matches(current_txdata()->msg);
+  free_txdata();
+
+  // The capabilities-only response must not have been cached.
+  EXPECT_EQ(0u, _assignment_cache->size());
+
+  // The subscriber now registers, and the HSS assigns it scscf2.
+  _hss_connection->set_result("/impi/6505551234%40homedomain/registration-status?impu=sip%3A6505551234%40homedomain&visited-network=homedomain&auth-type=REG",
+                              "{\"result-code\": 2001,"
+                              " \"scscf\": \"sip:scscf2.homedomain:5058;transport=TCP\"}");
+
+  Message msg2;
+  msg2._first_hop = true;
+  msg2._method = "REGISTER";
+  msg2._requri = "sip:homedomain";
+  msg2._from = "6505551234";
+  msg2._to = msg2._from;
+  msg2._via = tp->to_string(false);
+  msg2._extra = "Contact: sip:6505551234@" +
+                tp->to_string(true) +
+                ";ob;expires=300;+sip.ice;reg-id=1;+sip.instance=\"<urn:uuid:00000000-0000-0000-0000-b665231f1213>\"";
+  inject_msg(msg2.get_request(), tp);
+
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  expect_target("TCP", "10.10.10.2", 5058, tdata);
+  ReqMatcher("REGISTER").matches(tdata->msg);
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(200).matches(current_txdata()->msg);
+  free_txdata();
+
+  // The LIR now returns the assigned S-CSCF.  The next terminating INVITE
+  // must query the HSS again and be routed to scscf2, rather than reusing
+  // the earlier capabilities.
+  _hss_connection->set_result("/impu/sip%3A6505551234%40homedomain/location",
+                              "{\"result-code\": 2001,"
+                              " \"scscf\": \"sip:scscf2.homedomain:5058;transport=TCP\"}");
+
+  Message msg3;
+  msg3._first_hop = true;
+  msg3._method = "INVITE";
+  msg3._via = tp->to_string(false);
+  msg3._extra = "P-Served-User: <sip:6505551000@homedomain>";
+  msg3._route = "Route: <sip:homedomain>";
+  inject_msg(msg3.get_request(), tp);
+
+  ASSERT_EQ(2, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(100).matches(tdata->msg);
+  free_txdata();
+  tdata = current_txdata();
+  expect_target("TCP", "10.10.10.2", 5058, tdata);
+  ReqMatcher("INVITE").matches(tdata->msg);
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(200).matches(current_txdata()->msg);
+  free_txdata();
+
+  // Both responses that named an S-CSCF are cached.
+  EXPECT_EQ(2u, _assignment_cache->size());
+
+  _hss_connection->delete_result("/impi/6505551234%40homedomain/registration-status?impu=sip%3A6505551234%40homedomain&visited-network=homedomain&auth-type=REG");
+  _hss_connection->delete_result("/impu/sip%3A6505551234%40homedomain/location");
+
+  delete tp;
+}
@@ -2354,6 +2354,69 @@ TEST_F(IfcHandlerTest, SDPNoEqualsSign)
 }
 
 
+// Test that an iFC built from a string owns its compiled form, so copies of it
+// can be evaluated repeatedly after the original has gone.
+TEST_F(IfcHandlerTest, CompiledIfcCopies)
+{
+  std::vector<Ifc> ifcs;
+
+  {
+    Ifc ifc("<InitialFilterCriteria>\n"
+            "  <Priority>1</Priority>\n"
+            "  <TriggerPoint>\n"
+            "    <ConditionTypeCNF>0</ConditionTypeCNF>\n"
+            "    <SPT>\n"
+            "      <ConditionNegated>0</ConditionNegated>\n"
+            "      <Group>0</Group>\n"
+            "      <SIPHeader><Header>Call-Info</Header><Content>bar</Content></SIPHeader>\n"
+            "    </SPT>\n"
+            "  </TriggerPoint>\n"
+            "  <ApplicationServer>\n"
+            "    <ServerName>sip:1.2.3.4:56789;transport=UDP</ServerName>\n"
+            "    <DefaultHandling>1</DefaultHandling>\n"
+            "    <ServiceInfo>info</ServiceInfo>\n"
+            "  </ApplicationServer>\n"
+            "</InitialFilterCriteria>");
+    ifcs.push_back(ifc);
+    ifcs.push_back(ifc);
+  }
+
+  for (const Ifc& ifc : ifcs)
+  {
+    EXPECT_TRUE(ifc.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0));
+    EXPECT_TRUE(ifc.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0));
+
+    AsInvocation as = ifc.as_invocation();
+    EXPECT_EQ("sip:1.2.3.4:56789;transport=UDP", as.server_name);
+    EXPECT_EQ(SESSION_TERMINATED, as.default_handling);
+    EXPECT_EQ("info", as.service_info);
+    EXPECT_FALSE(as.include_register_request);
+    EXPECT_FALSE(as.include_register_response);
+  }
+}
+
+// Test that an invalid Content regex is only reported when the content needs
+// to be matched, even though the iFC is compiled up front.
+TEST_F(IfcHandlerTest, BadContentRegexNotEvaluated)
+{
+  CapturingTestLogger log;
+  doTest("",
+         "    <TriggerPoint>\n"
+         "    <ConditionTypeCNF>1</ConditionTypeCNF>\n"
+         "    <SPT>\n"
+         "      <ConditionNegated>0</ConditionNegated>\n"
+         "      <Group>0</Group>\n"
+         "      <SIPHeader><Header>P-No-Such-Header</Header><Content>?</Content></SIPHeader>\n"
+         "      <Extension></Extension>\n"
+         "    </SPT>\n"
+         "  </TriggerPoint>\n",
+         true,
+         SessionCase::Terminating,
+         false);
+  EXPECT_FALSE(log.contains("Invalid regular expression"));
+}
+
+
 // @@@ iFC XML parse error
 // @@@ lookup_ifcs gets no served user
 // @@@ lookup_ifcs finds empty iFCs
@@ -0,0 +1,240 @@
+/**
+ * @file impi_replicator_test.cpp UT for the ImpiReplicator class.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include <unistd.h>
+#include <pthread.h>
+#include "gtest/gtest.h"
+
+#include "localstore.h"
+#include "astaire_impistore.h"
+#include "impi_replicator.h"
+#include "fakesnmp.hpp"
+
+using namespace std;
+
+static const std::string IMPI = "6505550001@homedomain";
+
+/// IMPI store whose reads block until the test releases them.
+class BlockingImpiStore : public ImpiStore
+{
+public:
+  BlockingImpiStore(ImpiStore* store) : _store(store), _released(false)
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+  }
+
+  virtual ~BlockingImpiStore()
+  {
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  void release()
+  {
+    pthread_mutex_lock(&_lock);
+    _released = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  virtual Store::Status set_impi(Impi* impi, SAS::TrailId trail)
+  {
+    return _store->set_impi(impi, trail);
+  }
+
+  virtual Impi* get_impi(const std::string& impi,
+                         SAS::TrailId trail,
+                         bool include_expired = false)
+  {
+    pthread_mutex_lock(&_lock);
+    while (!_released)
+    {
+      pthread_cond_wait(&_cond, &_lock);
+    }
+    pthread_mutex_unlock(&_lock);
+
+    return _store->get_impi(impi, trail, include_expired);
+  }
+
+  virtual Store::Status delete_impi(Impi* impi, SAS::TrailId trail)
+  {
+    return _store->delete_impi(impi, trail);
+  }
+
+private:
+  ImpiStore* _store;
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  bool _released;
+};
+
+/// Fixture for ImpiReplicatorTest.
+class ImpiReplicatorTest : public ::testing::Test
+{
+public:
+  ImpiReplicatorTest()
+  {
+    for (int ii = 0; ii < 2; ++ii)
+    {
+      _data_stores.push_back(new LocalStore());
+      _stores.push_back(new AstaireImpiStore(_data_stores.back()));
+      _latency_tbls.push_back(new SNMP::FakeEventAccumulatorTable());
+    }
+  }
+
+  virtual ~ImpiReplicatorTest()
+  {
+    for (ImpiStore* store : _stores) { delete store; }
+    for (LocalStore* store : _data_stores) { delete store; }
+    for (SNMP::FakeEventAccumulatorTable* tbl : _latency_tbls) { delete tbl; }
+  }
+
+  std::vector<SNMP::EventAccumulatorTable*> latency_tbls()
+  {
+    return std::vector<SNMP::EventAccumulatorTable*>(_latency_tbls.begin(),
+                                                     _latency_tbls.end());
+  }
+
+  static void write_challenge(ImpiStore* store, const std::string& nonce)
+  {
+    ImpiStore::Impi* impi_obj = store->get_impi(IMPI, 0);
+    impi_obj->auth_challenges.push_back(
+      new ImpiStore::DigestAuthChallenge(nonce, "homedomain", "auth", "ha1", time(NULL) + 40));
+    store->set_impi(impi_obj, 0);
+    delete impi_obj;
+  }
+
+  static void wait_for(ImpiReplicator& replicator)
+  {
+    for (int ii = 0; (ii < 1000) && (replicator.pending() > 0); ++ii)
+    {
+      usleep(1000);
+    }
+    ASSERT_EQ(0u, replicator.pending());
+  }
+
+  std::vector<LocalStore*> _data_stores;
+  std::vector<ImpiStore*> _stores;
+  std::vector<SNMP::FakeEventAccumulatorTable*> _latency_tbls;
+};
+
+// Test that writes are made to every remote store, and that the latency of
+// each store is recorded.
+TEST_F(ImpiReplicatorTest, WriteToEveryStore)
+{
+  ImpiReplicator replicator(_stores, latency_tbls(), NULL, 2);
+
+  replicator.write([](ImpiStore* store) { write_challenge(store, "nonce"); });
+  wait_for(replicator);
+
+  for (size_t ii = 0; ii < _stores.size(); ++ii)
+  {
+    ImpiStore::Impi* impi_obj = _stores[ii]->get_impi(IMPI, 0);
+    EXPECT_NE((ImpiStore::AuthChallenge*)NULL, impi_obj->get_auth_challenge("nonce"));
+    delete impi_obj;
+
+    EXPECT_EQ(1, _latency_tbls[ii]->_count);
+  }
+}
+
+// Test that a read returns the IMPI from whichever store has challenges.
+TEST_F(ImpiReplicatorTest, ReadFromAnyStore)
+{
+  ImpiReplicator replicator(_stores, latency_tbls(), NULL, 2);
+  write_challenge(_stores[1], "nonce");
+
+  ImpiStore::Impi* impi_obj = replicator.read_impi(IMPI, 0);
+  ASSERT_NE((ImpiStore::Impi*)NULL, impi_obj);
+  EXPECT_NE((ImpiStore::AuthChallenge*)NULL, impi_obj->get_auth_challenge("nonce"));
+  delete impi_obj;
+
+  wait_for(replicator);
+}
+
+// Test that a read returns NULL if no store has any challenges.
+TEST_F(ImpiReplicatorTest, ReadMiss)
+{
+  ImpiReplicator replicator(_stores, latency_tbls(), NULL, 2);
+
+  EXPECT_EQ((ImpiStore::Impi*)NULL, replicator.read_impi(IMPI, 0));
+  wait_for(replicator);
+}
+
+// Test that a read returns as soon as one store finds the IMPI, without
+// waiting for slower stores.
+TEST_F(ImpiReplicatorTest, ReadDoesntWaitForSlowStore)
+{
+  BlockingImpiStore slow_store(_stores[0]);
+  std::vector<ImpiStore*> stores = {&slow_store, _stores[1]};
+  ImpiReplicator replicator(stores, latency_tbls(), NULL, 2);
+  write_challenge(_stores[1], "nonce");
+
+  ImpiStore::Impi* impi_obj = replicator.read_impi(IMPI, 0);
+
+  // The slow store is still being read from.
+  EXPECT_LE(1u, replicator.pending());
+
+  slow_store.release();
+  wait_for(replicator);
+
+  ASSERT_NE((ImpiStore::Impi*)NULL, impi_obj);
+  EXPECT_NE((ImpiStore::AuthChallenge*)NULL, impi_obj->get_auth_challenge("nonce"));
+  delete impi_obj;
+}
+
+// Test that reads don't wait behind writes that are held up.
+TEST_F(ImpiReplicatorTest, ReadDoesntWaitForWrites)
+{
+  std::vector<ImpiStore*> stores = {_stores[0]};
+  ImpiReplicator replicator(stores, latency_tbls(), NULL, 1);
+  write_challenge(_stores[0], "nonce");
+
+  // Hold up the only write thread.
+  std::atomic<bool> released(false);
+  replicator.write([&released](ImpiStore*)
+                   {
+                     while (!released)
+                     {
+                       usleep(1000);
+                     }
+                   });
+
+  ImpiStore::Impi* impi_obj = replicator.read_impi(IMPI, 0);
+  ASSERT_NE((ImpiStore::Impi*)NULL, impi_obj);
+  EXPECT_NE((ImpiStore::AuthChallenge*)NULL, impi_obj->get_auth_challenge("nonce"));
+  delete impi_obj;
+
+  released = true;
+  wait_for(replicator);
+}
+
+// Test that writes are dropped and counted, rather than blocking the caller,
+// once too many are waiting for a slow store.
+TEST_F(ImpiReplicatorTest, DropWritesToSlowStore)
+{
+  BlockingImpiStore slow_store(_stores[0]);
+  std::vector<ImpiStore*> stores = {&slow_store};
+  SNMP::FakeCounterTable dropped_tbl;
+  ImpiReplicator replicator(stores, latency_tbls(), NULL, 1, &dropped_tbl);
+
+  for (uint64_t ii = 0; ii < ImpiReplicator::MAX_PENDING_WRITES + 5; ++ii)
+  {
+    replicator.write([](ImpiStore* store) { write_challenge(store, "nonce"); });
+  }
+
+  EXPECT_EQ(5u, replicator.dropped_writes());
+  EXPECT_EQ(5, dropped_tbl._count);
+
+  slow_store.release();
+  wait_for(replicator);
+}
@@ -0,0 +1,134 @@
+/**
+ * @file irs_info_cache_test.cpp UT for the IrsInfoCache class.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+
+#include "test_interposer.hpp"
+#include "irs_info_cache.h"
+
+using namespace std;
+
+static const std::string DEFAULT_ID = "sip:6505550001@homedomain";
+static const std::string OTHER_ID = "tel:6505550001";
+
+/// Fixture for IrsInfoCacheTest.
+class IrsInfoCacheTest : public ::testing::Test
+{
+public:
+  IrsInfoCacheTest() : _cache(10, 300, 2)
+  {
+    cwtest_completely_control_time();
+
+    _irs_info._regstate = "REGISTERED";
+    _irs_info._associated_uris.add_uri(DEFAULT_ID, false);
+    _irs_info._associated_uris.add_uri(OTHER_ID, false);
+  }
+
+  virtual ~IrsInfoCacheTest()
+  {
+    cwtest_reset_time();
+  }
+
+  IrsInfoCache _cache;
+  HSSConnection::irs_info _irs_info;
+};
+
+// Test that cached data other than the registration state is returned, and
+// that the hit statistics are updated.
+TEST_F(IrsInfoCacheTest, Hit)
+{
+  HSSConnection::irs_info irs_info;
+  EXPECT_FALSE(_cache.get(DEFAULT_ID, irs_info));
+
+  _cache.put(DEFAULT_ID, _irs_info, _cache.start_query());
+  EXPECT_TRUE(_cache.get(DEFAULT_ID, irs_info));
+  EXPECT_EQ("", irs_info._regstate);
+  EXPECT_EQ(2u, irs_info._associated_uris.get_all_uris().size());
+
+  EXPECT_EQ(1u, _cache.hits());
+  EXPECT_EQ(1u, _cache.misses());
+  EXPECT_EQ(1u, _cache.size());
+}
+
+// Test that cached data expires.
+TEST_F(IrsInfoCacheTest, Expiry)
+{
+  HSSConnection::irs_info irs_info;
+  _cache.put(DEFAULT_ID, _irs_info, _cache.start_query());
+
+  cwtest_advance_time_ms(299 * 1000);
+  EXPECT_TRUE(_cache.get(DEFAULT_ID, irs_info));
+
+  cwtest_advance_time_ms(1000);
+  EXPECT_FALSE(_cache.get(DEFAULT_ID, irs_info));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// Test that invalidating the default public ID invalidates the rest of the
+// IRS, and that invalidating another public ID in the IRS invalidates the
+// default.
+TEST_F(IrsInfoCacheTest, InvalidateIrs)
+{
+  HSSConnection::irs_info irs_info;
+
+  _cache.put(DEFAULT_ID, _irs_info, _cache.start_query());
+  _cache.put(OTHER_ID, _irs_info, _cache.start_query());
+  _cache.invalidate(DEFAULT_ID);
+  EXPECT_FALSE(_cache.get(DEFAULT_ID, irs_info));
+  EXPECT_FALSE(_cache.get(OTHER_ID, irs_info));
+
+  _cache.put(DEFAULT_ID, _irs_info, _cache.start_query());
+  _cache.put(OTHER_ID, _irs_info, _cache.start_query());
+  _cache.invalidate(OTHER_ID);
+  EXPECT_FALSE(_cache.get(DEFAULT_ID, irs_info));
+  EXPECT_FALSE(_cache.get(OTHER_ID, irs_info));
+}
+
+// Test that data read before an invalidation isn't cached.
+TEST_F(IrsInfoCacheTest, InvalidatedDuringQuery)
+{
+  HSSConnection::irs_info irs_info;
+
+  uint64_t token = _cache.start_query();
+  _cache.invalidate(DEFAULT_ID);
+  _cache.put(DEFAULT_ID, _irs_info, token);
+  _cache.put(OTHER_ID, _irs_info, token);
+  EXPECT_FALSE(_cache.get(DEFAULT_ID, irs_info));
+  EXPECT_FALSE(_cache.get(OTHER_ID, irs_info));
+
+  // Once the query has completed, the next query's data can be cached.
+  _cache.put(DEFAULT_ID, _irs_info, _cache.start_query());
+  EXPECT_TRUE(_cache.get(DEFAULT_ID, irs_info));
+}
+
+// Test that data for a public ID that isn't listed in its IRS (e.g. one that
+// matched a wildcard) isn't cached.
+TEST_F(IrsInfoCacheTest, NotInIrs)
+{
+  HSSConnection::irs_info irs_info;
+  _cache.put("sip:6505550002@homedomain", _irs_info, _cache.start_query());
+  EXPECT_FALSE(_cache.get("sip:6505550002@homedomain", irs_info));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// Test that the least recently used entry is evicted when the cache is full.
+TEST_F(IrsInfoCacheTest, Eviction)
+{
+  IrsInfoCache cache(1, 300, 1);
+  HSSConnection::irs_info irs_info;
+
+  cache.put(DEFAULT_ID, _irs_info, cache.start_query());
+  cache.put(OTHER_ID, _irs_info, cache.start_query());
+  EXPECT_EQ(1u, cache.size());
+  EXPECT_FALSE(cache.get(DEFAULT_ID, irs_info));
+  EXPECT_TRUE(cache.get(OTHER_ID, irs_info));
+}
@@ -10,10 +10,48 @@
  */
 
 #include "mock_subscriber_manager.h"
+#include "pjutils.h"
 
 MockSubscriberManager::MockSubscriberManager() :
-  SubscriberManager(NULL, NULL, NULL, NULL, NULL)
+  SubscriberManager(NULL, NULL, NULL, NULL, NULL),
+  _defer_async(false),
+  _deferred()
 {}
 
 MockSubscriberManager::~MockSubscriberManager()
 {}
+
+void MockSubscriberManager::get_subscriber_state_async(const HSSConnection::irs_query& irs_query,
+                                                       HSSConnection::irs_info& irs_info,
+                                                       HTTPCode& http_code,
+                                                       SAS::TrailId trail,
+                                                       PJUtils::Callback* on_complete)
+{
+  std::function<void()> query = [this, irs_query, &irs_info, &http_code, trail, on_complete]()
+  {
+    http_code = get_subscriber_state(irs_query, irs_info, trail);
+    PJUtils::run_callback_on_worker_thread(on_complete);
+  };
+
+  if (_defer_async)
+  {
+    http_code = HTTP_SERVER_UNAVAILABLE;
+    _deferred.push_back(query);
+  }
+  else
+  {
+    query();
+  }
+}
+
+void MockSubscriberManager::complete_async_queries()
+{
+  _defer_async = false;
+
+  std::vector<std::function<void()>> deferred;
+  deferred.swap(_deferred);
+  for (std::function<void()>& query : deferred)
+  {
+    query();
+  }
+}
@@ -12,6 +12,8 @@
 #ifndef MOCK_SUBSCRIBER_MANAGER_H_
 #define MOCK_SUBSCRIBER_MANAGER_H_
 
+#include <functional>
+#include <vector>
 #include "gmock/gmock.h"
 #include "subscriber_manager.h"
 
@@ -73,6 +75,22 @@ public:
                                               HSSConnection::irs_info& irs_info,
                                               SAS::TrailId trail));
 
+  /// Calls through to the mocked get_subscriber_state.  The query is made
+  /// (and the callback run) before returning, unless queries are being
+  /// deferred.
+  virtual void get_subscriber_state_async(const HSSConnection::irs_query& irs_query,
+                                          HSSConnection::irs_info& irs_info,
+                                          HTTPCode& http_code,
+                                          SAS::TrailId trail,
+                                          PJUtils::Callback* on_complete) override;
+
+  /// Holds asynchronous queries until complete_async_queries is called, so
+  /// that tests can act while a query is outstanding.
+  void defer_async_queries() { _defer_async = true; }
+
+  /// Makes any held asynchronous queries, and stops holding new ones.
+  void complete_async_queries();
+
   MOCK_METHOD3(update_associated_uris, HTTPCode(const std::string& aor_id,
                                                 const AssociatedURIs& associated_uris,
                                                 SAS::TrailId trail));
@@ -87,6 +105,10 @@ public:
                                                        int expires,
                                                        bool is_initial_registration,
                                                        SAS::TrailId trail));
+
+private:
+  bool _defer_async;
+  std::vector<std::function<void()>> _deferred;
 };
 
 // Custom matchers to see what public identity, wildcard, private identity or
@@ -1062,3 +1062,127 @@ TEST_F(NotifySenderTest, NotifyTwoSubscriptionsBindingChange)
   delete orig_aor; orig_aor = NULL;
   delete updated_aor; updated_aor = NULL;
 }
+
+// Test that the NOTIFYs for several subscriptions each have their own
+// registration id, in every registration element, even though the body is
+// only rendered once.
+TEST_F(NotifySenderTest, NotifyRegistrationIdPerSubscription)
+{
+  std::string aor_id = "sip:1234567890@homedomain";
+  int now = time(NULL);
+  AoR* orig_aor = AoRTestUtils::create_simple_aor(aor_id, false);
+  AoR* updated_aor = AoRTestUtils::create_simple_aor(aor_id);
+  updated_aor->_associated_uris.add_uri("sip:1234567891@homedomain", false);
+  Subscription* s = AoRTestUtils::build_subscription("5678&", now);
+  updated_aor->_subscriptions.insert(std::make_pair(AoRTestUtils::SUBSCRIPTION_ID + "2", s));
+
+  _notify_sender->send_notifys(aor_id,
+                               *orig_aor,
+                               *updated_aor,
+                               SubscriberDataUtils::EventTrigger::USER,
+                               time(NULL),
+                               0);
+
+  ASSERT_EQ(2, txdata_count());
+
+  std::vector<std::pair<std::string, bool>> impus;
+  impus.push_back(std::make_pair("sip:1234567890@homedomain", false));
+  impus.push_back(std::make_pair("sip:1234567891@homedomain", false));
+  std::set<std::string> from_tags;
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    pjsip_msg* out = current_txdata()->msg;
+    rapidxml::xml_document<>* doc = parse_notify_body(out);
+    check_notify_registration_nodes(doc, ACTIVE, {ACTIVE_REGISTERED}, impus);
+
+    // The From tag of the NOTIFY is the subscription's To tag, which should be
+    // the id of every registration element.
+    std::string from_tag = get_headers(out, "From");
+    from_tag = from_tag.substr(from_tag.find(";tag=") + 5);
+    from_tags.insert(from_tag);
+
+    rapidxml::xml_node<>* reg_info = doc->first_node("reginfo");
+    ASSERT_TRUE(reg_info);
+    for (rapidxml::xml_node<>* registration = reg_info->first_node("registration");
+         registration;
+         registration = registration->next_sibling("registration"))
+    {
+      EXPECT_EQ(from_tag, std::string(registration->first_attribute("id")->value()));
+    }
+
+    inject_msg(respond_to_current_txdata(200));
+    delete doc;
+  }
+
+  EXPECT_EQ(std::set<std::string>({AoRTestUtils::SUBSCRIPTION_ID, "5678&"}), from_tags);
+
+  // Tidy up
+  delete orig_aor; orig_aor = NULL;
+  delete updated_aor; updated_aor = NULL;
+}
+
+// Times rendering the NOTIFY bodies for AoRs with different numbers of IMPUs,
+// bindings and subscriptions.  Disabled by default - run with
+// --gtest_also_run_disabled_tests to see the results.
+TEST_F(NotifySenderTest, DISABLED_RegInfoBodyBenchmark)
+{
+  const int NUM_UPDATES = 100;
+  std::string aor_id = "sip:1234567890@homedomain";
+  int now = time(NULL);
+
+  for (int num_impus : {1, 10, 50})
+  {
+    AssociatedURIs associated_uris;
+    for (int ii = 0; ii < num_impus; ++ii)
+    {
+      associated_uris.add_uri("sip:" + std::to_string(1234567890 + ii) + "@homedomain", false);
+    }
+
+    for (int num_bindings : {1, 5, 20})
+    {
+      ClassifiedBindings classified_bindings;
+      for (int ii = 0; ii < num_bindings; ++ii)
+      {
+        Binding* b = AoRTestUtils::build_binding(aor_id, now);
+        b->_params["+sip.instance"] = "\"<urn:uuid:00000000-0000-0000-0000-" + std::to_string(100000000000 + ii) + ">\"";
+        classified_bindings.push_back(
+          new SubscriberDataUtils::ClassifiedBinding(std::to_string(ii),
+                                                     b,
+                                                     SubscriberDataUtils::ContactEvent::REGISTERED));
+      }
+
+      for (int num_subscriptions : {1, 5, 10})
+      {
+        Utils::StopWatch sw;
+        sw.start();
+
+        size_t bytes = 0;
+        for (int ii = 0; ii < NUM_UPDATES; ++ii)
+        {
+          NotifySender::RegInfoBody reg_info(associated_uris,
+                                             classified_bindings,
+                                             NotifySender::RegistrationState::ACTIVE,
+                                             0);
+
+          for (int jj = 0; jj < num_subscriptions; ++jj)
+          {
+            bytes += reg_info.render(std::to_string(jj)).length();
+          }
+        }
+
+        unsigned long elapsed_us = 0;
+        sw.read(elapsed_us);
+        printf("%d IMPUs x %d bindings x %d subscriptions: %d updates took %luus (%lu bytes)\n",
+               num_impus, num_bindings, num_subscriptions, NUM_UPDATES, elapsed_us, bytes);
+      }
+
+      for (SubscriberDataUtils::ClassifiedBinding* classified_binding :
+                                                            classified_bindings)
+      {
+        delete classified_binding->_binding;
+      }
+      delete_bindings(classified_bindings);
+    }
+  }
+}
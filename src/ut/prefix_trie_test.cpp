@@ -0,0 +1,100 @@
+/**
+ * @file prefix_trie_test.cpp UT for the PrefixTrie class.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+
+#include "utils.h"
+#include "prefix_trie.h"
+
+using namespace std;
+
+// Test that the longest matching prefix is found.
+TEST(PrefixTrieTest, LongestPrefix)
+{
+  PrefixTrie<string> trie;
+  trie.insert("+22", "two");
+  trie.insert("+2222", "four");
+  trie.insert("+222", "three");
+  trie.insert("+3", "other");
+  EXPECT_EQ(4u, trie.size());
+
+  EXPECT_EQ("four", *trie.find("+22221234"));
+  EXPECT_EQ("three", *trie.find("+2223"));
+  EXPECT_EQ("two", *trie.find("+2234"));
+  EXPECT_EQ("other", *trie.find("+31"));
+  EXPECT_TRUE(trie.find("+4") == NULL);
+  EXPECT_TRUE(trie.find("1") == NULL);
+}
+
+// Test that a number that is a prefix of configured prefixes matches the
+// lexicographically greatest of them, as the std::map scan did.
+TEST(PrefixTrieTest, ShortNumber)
+{
+  PrefixTrie<string> trie;
+  trie.insert("1", "one");
+  trie.insert("1234", "a");
+  trie.insert("1299", "b");
+  trie.insert("129", "c");
+
+  EXPECT_EQ("b", *trie.find("12"));
+  EXPECT_EQ("b", *trie.find("129"));
+  EXPECT_EQ("a", *trie.find("123"));
+  EXPECT_EQ("one", *trie.find("13"));
+  EXPECT_EQ("b", *trie.find(""));
+}
+
+// Test that an empty prefix matches everything, and that the first value for
+// a duplicate prefix is kept.
+TEST(PrefixTrieTest, EmptyAndDuplicatePrefixes)
+{
+  PrefixTrie<string> trie;
+  EXPECT_TRUE(trie.find("123") == NULL);
+
+  trie.insert("", "default");
+  trie.insert("5", "first");
+  trie.insert("5", "second");
+  EXPECT_EQ(2u, trie.size());
+
+  EXPECT_EQ("default", *trie.find("123"));
+  EXPECT_EQ("first", *trie.find("55"));
+}
+
+// Times lookups against 60,000 prefixes.  Disabled by default - run with
+// --gtest_also_run_disabled_tests to see the results.
+TEST(PrefixTrieTest, DISABLED_LookupBenchmark)
+{
+  const int NUM_PREFIXES = 60000;
+  const int NUM_LOOKUPS = 1000000;
+
+  PrefixTrie<int> trie;
+  for (int ii = 0; ii < NUM_PREFIXES; ++ii)
+  {
+    trie.insert("+1650" + to_string(1000000 + ii * 7), ii);
+  }
+
+  Utils::StopWatch sw;
+  sw.start();
+
+  int found = 0;
+  for (int ii = 0; ii < NUM_LOOKUPS; ++ii)
+  {
+    if (trie.find("+1650" + to_string(1000000 + ii % (NUM_PREFIXES * 7)) + "123") != NULL)
+    {
+      ++found;
+    }
+  }
+
+  unsigned long elapsed_us = 0;
+  sw.read(elapsed_us);
+  printf("%d lookups against %d prefixes took %luus (%d matched)\n",
+         NUM_LOOKUPS, NUM_PREFIXES, elapsed_us, found);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file regex_cache_test.cpp UT for the RegexCache class.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+
+#include "regex_cache.h"
+
+using namespace std;
+
+// Test that a pattern is only compiled once, and that the cached regex
+// behaves like a freshly compiled one.
+TEST(RegexCacheTest, Hit)
+{
+  RegexCache cache(10, 2);
+
+  boost::regex regex1 = cache.get("^[0-9]+$");
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  boost::regex regex2 = cache.get("^[0-9]+$");
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+  EXPECT_EQ(1u, cache.size());
+
+  EXPECT_TRUE(boost::regex_match("12345", regex2));
+  EXPECT_FALSE(boost::regex_match("123a5", regex2));
+}
+
+// Test that the flags are part of the key.
+TEST(RegexCacheTest, Flags)
+{
+  RegexCache cache(10, 2);
+
+  boost::regex sensitive = cache.get("abc");
+  boost::regex insensitive = cache.get("abc", boost::regex_constants::icase);
+  EXPECT_EQ(2u, cache.misses());
+  EXPECT_EQ(2u, cache.size());
+
+  EXPECT_FALSE(boost::regex_search("ABC", sensitive));
+  EXPECT_TRUE(boost::regex_search("ABC", insensitive));
+}
+
+// Test that invalid patterns don't throw, and are cached.
+TEST(RegexCacheTest, InvalidPattern)
+{
+  RegexCache cache(10, 2);
+
+  EXPECT_NE(0, cache.get("*").status());
+  EXPECT_NE(0, cache.get("*").status());
+  EXPECT_EQ(1u, cache.hits());
+}
+
+// Test that the least recently used regex is evicted when a shard is full.
+TEST(RegexCacheTest, Eviction)
+{
+  RegexCache cache(2, 1);
+
+  cache.get("a");
+  cache.get("b");
+  cache.get("a");
+  cache.get("c");
+  EXPECT_EQ(1u, cache.evictions());
+  EXPECT_EQ(2u, cache.size());
+
+  // "b" was least recently used, so should have been evicted.
+  cache.get("a");
+  cache.get("c");
+  EXPECT_EQ(3u, cache.hits());
+  cache.get("b");
+  EXPECT_EQ(4u, cache.misses());
+}
+
+// Test that compile uses the process-wide cache if there is one.
+TEST(RegexCacheTest, Instance)
+{
+  EXPECT_NE(0, RegexCache::compile("*").status());
+  EXPECT_TRUE(boost::regex_match("abc", RegexCache::compile("a.c")));
+
+  RegexCache cache(10, 2);
+  RegexCache::set_instance(&cache);
+  RegexCache::compile("a.c");
+  RegexCache::compile("a.c");
+  RegexCache::set_instance(NULL);
+
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+}
@@ -0,0 +1,105 @@
+/**
+ * @file scscf_assignment_cache_test.cpp UT for the SCSCFAssignmentCache class.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+
+#include "test_interposer.hpp"
+#include "scscf_assignment_cache.h"
+
+using namespace std;
+
+static const std::string KEY = "LIR sip:6505550001@homedomain";
+static const std::string OTHER_KEY = "LIR sip:6505550002@homedomain";
+
+/// Fixture for SCSCFAssignmentCacheTest.
+class SCSCFAssignmentCacheTest : public ::testing::Test
+{
+public:
+  SCSCFAssignmentCacheTest() : _cache(10, 30)
+  {
+    cwtest_completely_control_time();
+
+    _caps.scscf = "sip:scscf1.homedomain:5058;transport=TCP";
+    _caps.mandatory_caps = {123};
+    _caps.optional_caps = {345};
+  }
+
+  virtual ~SCSCFAssignmentCacheTest()
+  {
+    cwtest_reset_time();
+  }
+
+  SCSCFAssignmentCache _cache;
+  ServerCapabilities _caps;
+};
+
+// Test that cached results are returned, and that the hit statistics are
+// updated.
+TEST_F(SCSCFAssignmentCacheTest, Hit)
+{
+  ServerCapabilities caps;
+  bool queried_caps = false;
+  EXPECT_FALSE(_cache.get(KEY, caps, queried_caps));
+
+  _cache.put(KEY, _caps, true);
+  EXPECT_TRUE(_cache.get(KEY, caps, queried_caps));
+  EXPECT_EQ(_caps.scscf, caps.scscf);
+  EXPECT_EQ(_caps.mandatory_caps, caps.mandatory_caps);
+  EXPECT_EQ(_caps.optional_caps, caps.optional_caps);
+  EXPECT_TRUE(queried_caps);
+
+  EXPECT_EQ(1u, _cache.hits());
+  EXPECT_EQ(1u, _cache.misses());
+  EXPECT_EQ(1u, _cache.size());
+}
+
+// Test that cached results expire.
+TEST_F(SCSCFAssignmentCacheTest, Expiry)
+{
+  ServerCapabilities caps;
+  bool queried_caps = false;
+  _cache.put(KEY, _caps, false);
+
+  cwtest_advance_time_ms(29 * 1000);
+  EXPECT_TRUE(_cache.get(KEY, caps, queried_caps));
+
+  cwtest_advance_time_ms(1000);
+  EXPECT_FALSE(_cache.get(KEY, caps, queried_caps));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// Test that invalidating a result only removes that result.
+TEST_F(SCSCFAssignmentCacheTest, Invalidate)
+{
+  ServerCapabilities caps;
+  bool queried_caps = false;
+  _cache.put(KEY, _caps, false);
+  _cache.put(OTHER_KEY, _caps, false);
+
+  _cache.invalidate(KEY);
+  EXPECT_FALSE(_cache.get(KEY, caps, queried_caps));
+  EXPECT_TRUE(_cache.get(OTHER_KEY, caps, queried_caps));
+}
+
+// Test that the least recently used entry is evicted when the cache is full.
+TEST_F(SCSCFAssignmentCacheTest, Eviction)
+{
+  SCSCFAssignmentCache cache(1, 30);
+  ServerCapabilities caps;
+  bool queried_caps = false;
+
+  cache.put(KEY, _caps, false);
+  cache.put(OTHER_KEY, _caps, false);
+  EXPECT_EQ(1u, cache.size());
+  EXPECT_FALSE(cache.get(KEY, caps, queried_caps));
+  EXPECT_TRUE(cache.get(OTHER_KEY, caps, queried_caps));
+}
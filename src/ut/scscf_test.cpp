@@ -1349,6 +1349,44 @@ TEST_F(SCSCFTest, TestSimpleMainline)
 }
 
 
+// Test that a CANCEL that arrives while the S-CSCF is still querying the HSS
+// for the served user stops the INVITE from being routed.
+TEST_F(SCSCFTest, TestCancelDuringHSSQuery)
+{
+  SCOPED_TRACE("");
+
+  // Hold the query for the callee's subscriber state until the CANCEL has
+  // been received.  The bindings are never looked up.
+  HSSConnection::irs_info irs_info;
+  setup_irs_info(irs_info, "6505551234", "homedomain");
+  expect_get_subscriber_state(irs_info, "sip:6505551234@homedomain");
+  _sm->defer_async_queries();
+
+  // Send INVITE.  Only the 100 Trying goes back, as the INVITE can't be routed
+  // yet.
+  SCSCFMessage msg;
+  inject_msg(msg.get_request());
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(100).matches(current_txdata()->msg);
+  free_txdata();
+
+  // Send a CANCEL from the caller, which gets OK'd.
+  msg._method = "CANCEL";
+  inject_msg(msg.get_request());
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(200).matches(current_txdata()->msg);
+  free_txdata();
+
+  // Now let the query complete.  The INVITE isn't forwarded, and is rejected
+  // with a 487 instead.
+  _sm->complete_async_queries();
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(487).matches(current_txdata()->msg);
+  free_txdata();
+  ASSERT_EQ(0, txdata_count());
+}
+
+
 // Test route request to Maddr.
 TEST_F(SCSCFTest, TestSimpleMainlineMaddr)
 {
@@ -128,6 +128,21 @@ TEST_F(SCSCFSelectorTest, RejectSCSCFs)
   ST({123, 432}, {654}, {"cw-scscf2.cw-ngv.com"}, "cw-scscf1.cw-ngv.com").test(scscf_);
 }
 
+TEST_F(SCSCFSelectorTest, DuplicateAndUnknownCapabilities)
+{
+  // Parse a valid file.
+  SCSCFSelector scscf_("scscf_uri", string(UT_DIR).append("/test_scscf.json"));
+
+  // Duplicated capabilities are only counted once, and optional capabilities
+  // that no S-CSCF has don't affect the choice.
+  ST({123, 432, 345, 123}, {9999}, {}, "cw-scscf1.cw-ngv.com").test(scscf_);
+  ST({123, 432}, {654, 654, 9999}, {}, "cw-scscf2.cw-ngv.com").test(scscf_);
+
+  // A mandatory capability that no S-CSCF has can't be satisfied, even
+  // alongside ones that can.
+  ST({123, 9999}, {}, {}, "").test(scscf_);
+}
+
 TEST_F(SCSCFSelectorTest, ParseError)
 {
   CapturingTestLogger log;
@@ -0,0 +1,97 @@
+/**
+ * @file sharded_lru_cache_test.cpp UT for the ShardedLruCache template.
+ *
+ * Copyright (C) Metaswitch Networks 2018
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+
+#include "sharded_lru_cache.h"
+#include "fakesnmp.hpp"
+
+using namespace std;
+
+// Test that cached values are returned, and that the statistics are updated.
+TEST(ShardedLruCacheTest, Hit)
+{
+  SNMP::FakeCounterTable hits_tbl;
+  SNMP::FakeCounterTable misses_tbl;
+  ShardedLruCache<string, int> cache(10, 2, &hits_tbl, &misses_tbl);
+  int value = 0;
+
+  EXPECT_FALSE(cache.get("a", value));
+  cache.put("a", 1);
+  EXPECT_TRUE(cache.get("a", value));
+  EXPECT_EQ(1, value);
+
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+  EXPECT_EQ(1, hits_tbl._count);
+  EXPECT_EQ(1, misses_tbl._count);
+  EXPECT_EQ(1u, cache.size());
+}
+
+// Test that putting a key that is already cached replaces its value.
+TEST(ShardedLruCacheTest, Replace)
+{
+  ShardedLruCache<string, int> cache(10, 2);
+  int value = 0;
+
+  cache.put("a", 1);
+  cache.put("a", 2);
+  EXPECT_TRUE(cache.get("a", value));
+  EXPECT_EQ(2, value);
+  EXPECT_EQ(1u, cache.size());
+}
+
+// Test that entries that aren't valid are removed, and count as misses.
+TEST(ShardedLruCacheTest, Invalid)
+{
+  ShardedLruCache<string, int> cache(10, 2);
+  int value = 0;
+
+  cache.put("a", 1);
+  EXPECT_FALSE(cache.get("a", value, [](const int& v) { return v != 1; }));
+  EXPECT_EQ(1u, cache.misses());
+  EXPECT_EQ(0u, cache.size());
+}
+
+// Test that erasing an entry returns its value.
+TEST(ShardedLruCacheTest, Erase)
+{
+  ShardedLruCache<string, int> cache(10, 2);
+  int value = 0;
+
+  cache.put("a", 1);
+  EXPECT_TRUE(cache.erase("a", &value));
+  EXPECT_EQ(1, value);
+  EXPECT_FALSE(cache.erase("a"));
+  EXPECT_FALSE(cache.get("a", value));
+}
+
+// Test that the least recently used entry is evicted when a shard is full.
+TEST(ShardedLruCacheTest, Eviction)
+{
+  SNMP::FakeCounterTable evictions_tbl;
+  ShardedLruCache<string, int> cache(2, 1, NULL, NULL, &evictions_tbl);
+  int value = 0;
+
+  cache.put("a", 1);
+  cache.put("b", 2);
+  cache.get("a", value);
+  cache.put("c", 3);
+  EXPECT_EQ(1u, cache.evictions());
+  EXPECT_EQ(1, evictions_tbl._count);
+  EXPECT_EQ(2u, cache.size());
+
+  // "b" was least recently used, so should have been evicted.
+  EXPECT_TRUE(cache.get("a", value));
+  EXPECT_TRUE(cache.get("c", value));
+  EXPECT_FALSE(cache.get("b", value));
+}
@@ -941,6 +941,21 @@ public:
                                                                 "mock-fwd-nf-2");
     _sproutlets.push_back(_mock_forwarder_sproutlet_nf_2);
 
+    // Create mock SNMP counters.
+    _mock_route_to_remote_alias_counter = new MockSnmpCounterTable();
+    _mock_accept_for_remote_alias_counter = new MockSnmpCounterTable();
+
+    // Create the Sproutlet proxy.
+    _proxy = create_proxy(false, NULL, NULL);
+
+    // Schedule timers.
+    SipTest::poll();
+  }
+
+  static SproutletProxy* create_proxy(bool in_dialog_fast_path,
+                                      SNMP::CounterTable* fast_path_tbl,
+                                      SNMP::CounterTable* requests_tbl)
+  {
     // Create local aliases.
     std::unordered_set<std::string> host_local_aliases;
     host_local_aliases.insert("proxy1.homedomain-alias");
@@ -950,24 +965,21 @@ public:
     std::unordered_set<std::string> host_remote_aliases;
     host_remote_aliases.insert("proxy1.remotedomain");
 
-    // Create mock SNMP counters.
-    _mock_route_to_remote_alias_counter = new MockSnmpCounterTable();
-    _mock_accept_for_remote_alias_counter = new MockSnmpCounterTable();
-
-    // Create the Sproutlet proxy.
-    _proxy = new SproutletProxy(stack_data.endpt,
-                                PJSIP_MOD_PRIORITY_UA_PROXY_LAYER+1,
-                                "proxy1.homedomain",
-                                host_local_aliases,
-                                host_remote_aliases,
-                                false,
-                                _sproutlets,
-                                std::set<std::string>(),
-                                _mock_route_to_remote_alias_counter,
-                                _mock_accept_for_remote_alias_counter);
-
-    // Schedule timers.
-    SipTest::poll();
+    return new SproutletProxy(stack_data.endpt,
+                              PJSIP_MOD_PRIORITY_UA_PROXY_LAYER+1,
+                              "proxy1.homedomain",
+                              host_local_aliases,
+                              host_remote_aliases,
+                              false,
+                              _sproutlets,
+                              std::set<std::string>(),
+                              _mock_route_to_remote_alias_counter,
+                              _mock_accept_for_remote_alias_counter,
+                              SproutletProxy::DEFAULT_MAX_SPROUTLET_DEPTH,
+                              NULL,
+                              in_dialog_fast_path,
+                              fast_path_tbl,
+                              requests_tbl);
   }
 
   static void TearDownTestCase()
@@ -2536,6 +2548,55 @@ TEST_F(SproutletProxyTest, CompositeNetworkFunction)
   delete tp;
 }
 
+TEST_F(SproutletProxyTest, SharedMessageBody)
+{
+  // Tests that a request body shared between the copies of a request passed
+  // through several sproutlets reaches the next hop intact, and that the
+  // request sent on the wire has its own copy of it.
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        stack_data.scscf_port,
+                                        "1.2.3.4",
+                                        49152);
+
+  Message msg1;
+  msg1._method = "INVITE";
+  msg1._requri = "sip:bob@proxy1.awaydomain:5060;transport=TCP";
+  msg1._from = "sip:alice@homedomain";
+  msg1._to = "sip:bob@awaydomain";
+  msg1._via = tp->to_string(false);
+  msg1._route = "Route: <sip:composite1.proxy1.homedomain;transport=TCP;lr>";
+  msg1._content_type = "application/sdp";
+  msg1._body = "v=0\r\no=- 2728 2728 IN IP4 1.2.3.4\r\ns=-\r\nc=IN IP4 1.2.3.4\r\nt=0 0\r\nm=audio 8000 RTP/AVP 0\r\n";
+  inject_msg(msg1.get_request(), tp);
+
+  // Expecting 100 Trying and forwarded INVITE.
+  ASSERT_EQ(2, txdata_count());
+  free_txdata();
+
+  // Check the INVITE carries its own copy of the body.
+  pjsip_tx_data* req = pop_txdata();
+  ReqMatcher("INVITE").matches(req->msg);
+  ASSERT_TRUE(req->msg->body != NULL);
+  EXPECT_FALSE(PJUtils::is_msg_body_shared(req->msg));
+  EXPECT_EQ(msg1._body, std::string((char*)req->msg->body->data, req->msg->body->len));
+
+  // Send a 200 OK response.
+  inject_msg(respond_to_txdata(req, 200));
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(200).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // All done!
+  ASSERT_EQ(0, txdata_count());
+
+  delete tp;
+}
+
 TEST_F(SproutletProxyTest, CompositeNetworkFunctionTelURI)
 {
   // Tests passing a request through a Network Function composed of multiple
@@ -3908,3 +3969,113 @@ TEST_F(SproutletProxyTest, GetLocalHostnameDefaultRoot)
   std::string local_hostname = _proxy->get_local_hostname(uri, true);
   EXPECT_EQ("proxy1.homedomain", local_hostname);
 }
+
+/// Fixture for tests with the in-dialog fast path enabled.
+class SproutletProxyFastPathTest : public SproutletProxyTest
+{
+public:
+  static void SetUpTestCase()
+  {
+    SproutletProxyTest::SetUpTestCase();
+
+    // Replace the Sproutlet proxy with one that uses the fast path.
+    delete _proxy;
+    _mock_fast_path_counter = new MockSnmpCounterTable();
+    _mock_requests_counter = new MockSnmpCounterTable();
+    _proxy = create_proxy(true, _mock_fast_path_counter, _mock_requests_counter);
+  }
+
+  static void TearDownTestCase()
+  {
+    SproutletProxyTest::TearDownTestCase();
+    delete _mock_fast_path_counter;
+    delete _mock_requests_counter;
+  }
+
+protected:
+  static MockSnmpCounterTable* _mock_fast_path_counter;
+  static MockSnmpCounterTable* _mock_requests_counter;
+};
+
+MockSnmpCounterTable* SproutletProxyFastPathTest::_mock_fast_path_counter;
+MockSnmpCounterTable* SproutletProxyFastPathTest::_mock_requests_counter;
+
+TEST_F(SproutletProxyFastPathTest, InDialogFastPath)
+{
+  // Tests that an in-dialog request routed through this node, but not through
+  // any Sproutlets, is forwarded statelessly along with its response.
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        stack_data.scscf_port,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Both BYEs are counted as requests, but only the first takes the fast
+  // path.
+  uint64_t fast_path_requests = _proxy->fast_path_requests();
+  EXPECT_CALL(*_mock_fast_path_counter, increment()).Times(1);
+  EXPECT_CALL(*_mock_requests_counter, increment()).Times(2);
+
+  Message msg1;
+  msg1._method = "BYE";
+  msg1._requri = "sip:bob@awaydomain";
+  msg1._from = "sip:alice@homedomain";
+  msg1._to = "sip:bob@awaydomain";
+  msg1._to_tag = "abcdefg";
+  msg1._via = tp->to_string(false);
+  msg1._route = "Route: <sip:proxy1.homedomain;transport=TCP;lr>\r\nRoute: <sip:proxy1.awaydomain;transport=TCP;lr>";
+  inject_msg(msg1.get_request(), tp);
+
+  // The BYE is forwarded with no 100 Trying, and without the Route header
+  // that refers to this node.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  expect_target("TCP", "10.10.20.1", 5060, tdata);
+  ReqMatcher("BYE").matches(tdata->msg);
+  EXPECT_EQ("sip:bob@awaydomain", str_uri(tdata->msg->line.req.uri));
+  EXPECT_EQ("Route: <sip:proxy1.awaydomain;transport=TCP;lr>",
+            get_headers(tdata->msg, "Route"));
+  EXPECT_EQ("Max-Forwards: 67", get_headers(tdata->msg, "Max-Forwards"));
+  EXPECT_EQ(fast_path_requests + 1, _proxy->fast_path_requests());
+
+  // Send a 200 OK response, which isn't matched to any transaction, and check
+  // it is forwarded back to the source.
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(200).matches(tdata->msg);
+  free_txdata();
+
+  // An in-dialog request for a dialog that a Sproutlet has added itself to is
+  // passed to that Sproutlet.
+  uint64_t sproutlet_requests = _proxy->sproutlet_requests();
+
+  Message msg2;
+  msg2._method = "BYE";
+  msg2._requri = "sip:bob@awaydomain";
+  msg2._from = "sip:alice@homedomain";
+  msg2._to = "sip:bob@awaydomain";
+  msg2._to_tag = "abcdefg";
+  msg2._via = tp->to_string(false) + "2";
+  msg2._route = "Route: <sip:proxy1.homedomain;lr;service=fwdrr/1>\r\nRoute: <sip:proxy1.awaydomain;transport=TCP;lr>";
+  inject_msg(msg2.get_request(), tp);
+
+  ASSERT_EQ(1, txdata_count());
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(200).matches(tdata->msg);
+  free_txdata();
+
+  EXPECT_EQ(fast_path_requests + 1, _proxy->fast_path_requests());
+  EXPECT_EQ(sproutlet_requests + 1, _proxy->sproutlet_requests());
+
+  // All done!
+  ASSERT_EQ(0, txdata_count());
+
+  delete tp;
+}
@@ -1836,3 +1836,170 @@ TEST_F(SubscriberManagerTest, TestGetSubscriberState)
                                                       irs_info_out,
                                                       DUMMY_TRAIL_ID), HTTP_NOT_FOUND);
 }
+
+/// Fixture for tests of SM with a cache of HSS data.
+class SubscriberManagerCacheTest : public SubscriberManagerTest
+{
+public:
+  SubscriberManagerCacheTest() : SubscriberManagerTest()
+  {
+    _irs_info_cache = new IrsInfoCache(10, 300);
+    delete _subscriber_manager;
+    _subscriber_manager = new SubscriberManager(_s4,
+                                                _hss_connection,
+                                                _analytics_logger,
+                                                _notify_sender,
+                                                _registration_sender,
+                                                _irs_info_cache);
+
+    _irs_info._regstate = "REGISTERED";
+    _irs_info._associated_uris.add_uri(DEFAULT_ID, false);
+    _irs_info._associated_uris.add_uri(OTHER_ID, false);
+  }
+
+  virtual ~SubscriberManagerCacheTest()
+  {
+    delete _subscriber_manager; _subscriber_manager = NULL;
+    delete _irs_info_cache; _irs_info_cache = NULL;
+  }
+
+  HSSConnection::irs_query call_query(const std::string& public_id)
+  {
+    HSSConnection::irs_query irs_query;
+    irs_query._public_id = public_id;
+    irs_query._req_type = HSSConnection::CALL;
+    return irs_query;
+  }
+
+  IrsInfoCache* _irs_info_cache;
+  HSSConnection::irs_info _irs_info;
+};
+
+// Test that call queries are answered from the cache once the data has been
+// read from the HSS, with the registration state taken from the bindings in
+// the store.
+TEST_F(SubscriberManagerCacheTest, TestGetSubscriberStateCached)
+{
+  HSSConnection::irs_info irs_info_out;
+  EXPECT_CALL(*_hss_connection, update_registration_state(_, _, DUMMY_TRAIL_ID))
+    .WillOnce(DoAll(SetArgReferee<1>(_irs_info),
+                    Return(HTTP_OK)));
+  AoR* get_aor = AoRTestUtils::create_simple_aor(DEFAULT_ID, false, false);
+  EXPECT_CALL(*_s4, handle_get(DEFAULT_ID, _, _, _))
+    .WillOnce(DoAll(SetArgPointee<1>(get_aor),
+                    Return(HTTP_OK)))
+    .WillOnce(Return(HTTP_NOT_FOUND));
+
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_OK);
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_OK);
+  EXPECT_EQ("REGISTERED", irs_info_out._regstate);
+
+  // The subscriber has since been deregistered through another node.
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_OK);
+  EXPECT_EQ("UNREGISTERED", irs_info_out._regstate);
+  EXPECT_EQ(2u, _irs_info_cache->hits());
+}
+
+// Test that cached data isn't used if the registration state can't be read
+// from the store.
+TEST_F(SubscriberManagerCacheTest, TestGetSubscriberStateStoreFailure)
+{
+  HSSConnection::irs_info irs_info_out;
+  EXPECT_CALL(*_hss_connection, update_registration_state(_, _, DUMMY_TRAIL_ID))
+    .Times(2)
+    .WillRepeatedly(DoAll(SetArgReferee<1>(_irs_info),
+                          Return(HTTP_OK)));
+  EXPECT_CALL(*_s4, handle_get(DEFAULT_ID, _, _, _))
+    .WillOnce(Return(HTTP_SERVER_ERROR));
+
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_OK);
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_OK);
+  EXPECT_EQ("REGISTERED", irs_info_out._regstate);
+}
+
+// Test that failed queries and queries that don't allow cached data aren't
+// answered from the cache.
+TEST_F(SubscriberManagerCacheTest, TestGetSubscriberStateNotCached)
+{
+  HSSConnection::irs_info irs_info_out;
+  EXPECT_CALL(*_hss_connection, update_registration_state(_, _, DUMMY_TRAIL_ID))
+    .WillOnce(Return(HTTP_SERVER_ERROR))
+    .WillOnce(DoAll(SetArgReferee<1>(_irs_info),
+                    Return(HTTP_OK)))
+    .WillOnce(DoAll(SetArgReferee<1>(_irs_info),
+                    Return(HTTP_OK)));
+
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(call_query(DEFAULT_ID),
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_SERVER_ERROR);
+
+  HSSConnection::irs_query irs_query = call_query(DEFAULT_ID);
+  irs_query._cache_allowed = false;
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(irs_query,
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_OK);
+  EXPECT_EQ(_subscriber_manager->get_subscriber_state(irs_query,
+                                                      irs_info_out,
+                                                      DUMMY_TRAIL_ID), HTTP_OK);
+  EXPECT_EQ(0u, _irs_info_cache->hits());
+}
+
+// Test that a registration state change invalidates the cached data for the
+// whole IRS.
+TEST_F(SubscriberManagerCacheTest, TestRegistrationInvalidatesCache)
+{
+  HSSConnection::irs_info irs_info_out;
+  EXPECT_CALL(*_hss_connection, update_registration_state(_, _, DUMMY_TRAIL_ID))
+    .Times(3)
+    .WillRepeatedly(DoAll(SetArgReferee<1>(_irs_info),
+                          Return(HTTP_OK)));
+
+  _subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                            irs_info_out,
+                                            DUMMY_TRAIL_ID);
+
+  HSSConnection::irs_query irs_query;
+  irs_query._public_id = DEFAULT_ID;
+  irs_query._req_type = HSSConnection::DEREG_USER;
+  _subscriber_manager->get_subscriber_state(irs_query,
+                                            irs_info_out,
+                                            DUMMY_TRAIL_ID);
+
+  _subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                            irs_info_out,
+                                            DUMMY_TRAIL_ID);
+  EXPECT_EQ(0u, _irs_info_cache->hits());
+}
+
+// Test that a Push Profile Request invalidates the cached data for the IRS.
+TEST_F(SubscriberManagerCacheTest, TestUpdateAssociatedURIsInvalidatesCache)
+{
+  HSSConnection::irs_info irs_info_out;
+  EXPECT_CALL(*_hss_connection, update_registration_state(_, _, DUMMY_TRAIL_ID))
+    .Times(2)
+    .WillRepeatedly(DoAll(SetArgReferee<1>(_irs_info),
+                          Return(HTTP_OK)));
+  EXPECT_CALL(*_s4, handle_get(DEFAULT_ID, _, _, _))
+    .WillOnce(Return(HTTP_NOT_FOUND));
+
+  _subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                            irs_info_out,
+                                            DUMMY_TRAIL_ID);
+  _subscriber_manager->update_associated_uris(DEFAULT_ID,
+                                              _irs_info._associated_uris,
+                                              DUMMY_TRAIL_ID);
+  _subscriber_manager->get_subscriber_state(call_query(OTHER_ID),
+                                            irs_info_out,
+                                            DUMMY_TRAIL_ID);
+  EXPECT_EQ(0u, _irs_info_cache->hits());
+}
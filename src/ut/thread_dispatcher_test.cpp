@@ -18,6 +18,7 @@
 #include "mock_pjsip_module.h"
 #include "siptest.hpp"
 #include "stack.h"
+#include "fakesnmp.hpp"
 
 #include "thread_dispatcher.h"
 
@@ -25,6 +26,7 @@ using ::testing::Return;
 using ::testing::StrictMock;
 using ::testing::_;
 using ::testing::ResultOf;
+using ::testing::AllOf;
 using ::testing::Expectation;
 using ::testing::InvokeWithoutArgs;
 
@@ -42,7 +44,8 @@ class ThreadDispatcherTest : public SipTest
 {
 public:
 
-  ThreadDispatcherTest()
+  ThreadDispatcherTest(bool options_on_transport_thread = false,
+                       SNMP::EventAccumulatorTable* rx_clone_bytes_tbl = NULL)
   {
     mod_mock = new StrictMock<MockPJSipModule>(stack_data.endpt,
                                                "test-module",
@@ -56,7 +59,10 @@ public:
                            &load_monitor,
                            &rph_service,
                            NULL,
-                           REQUEST_ON_QUEUE_TIMEOUT_MS);
+                           REQUEST_ON_QUEUE_TIMEOUT_MS,
+                           0,
+                           rx_clone_bytes_tbl,
+                           options_on_transport_thread);
     mod_thread_dispatcher = get_mod_thread_dispatcher();
 
     cwtest_completely_control_time();
@@ -99,6 +105,11 @@ public:
     return tdata->msg->line.status.code;
   }
 
+  static bool has_allow_hdr(pjsip_tx_data* tdata)
+  {
+    return (pjsip_msg_find_hdr(tdata->msg, PJSIP_H_ALLOW, NULL) != NULL);
+  }
+
   // Helper function for testing the load monitor expectations on various
   // types of requests
   void test_load_monitor_checks_on_requests(TestingCommon::Message& msg,
@@ -497,6 +508,57 @@ TEST_F(ThreadDispatcherTest, PrioritiseOptionsOverOlderTest)
   process_queue_element();
 }
 
+/// Fixture for tests that check the memory used to copy received messages.
+class ThreadDispatcherCloneBytesTest : public ThreadDispatcherTest
+{
+public:
+  ThreadDispatcherCloneBytesTest() : ThreadDispatcherTest(false, &_rx_clone_bytes_tbl) {}
+
+  SNMP::FakeEventAccumulatorTable _rx_clone_bytes_tbl;
+};
+
+// The memory used to copy each received message for the worker threads is
+// reported.
+TEST_F(ThreadDispatcherCloneBytesTest, ReportCloneBytes)
+{
+  TestingCommon::Message msg;
+  msg._method = "INVITE";
+
+  test_load_monitor_checks_on_requests(msg, false);
+  EXPECT_EQ(1, _rx_clone_bytes_tbl._count);
+}
+
+class ThreadDispatcherOptionsTest : public ThreadDispatcherTest
+{
+public:
+  ThreadDispatcherOptionsTest() : ThreadDispatcherTest(true) {}
+};
+
+// OPTIONS polls to this node should be answered on the transport thread,
+// without consulting the load monitor or queuing them to a worker thread.  The
+// response is the same as the OPTIONS module sends, which doesn't list the
+// node's capabilities.
+TEST_F(ThreadDispatcherOptionsTest, AnswerLocalOptions)
+{
+  TestingCommon::Message msg;
+  msg._method = "OPTIONS";
+  msg._requri = "sip:127.0.0.1";
+
+  EXPECT_CALL(*mod_mock, on_tx_response(AllOf(ResultOf(get_tx_status_code, 200),
+                                              ResultOf(has_allow_hdr, false))));
+
+  inject_msg_thread(msg.get_request());
+}
+
+// OPTIONS polls that aren't for this node should still be queued as normal.
+TEST_F(ThreadDispatcherOptionsTest, QueueOtherOptions)
+{
+  TestingCommon::Message msg;
+  msg._method = "OPTIONS";
+
+  test_load_monitor_checks_on_requests(msg, true);
+}
+
 class SipEventQueueTest : public ::testing::Test
 {
 public:
@@ -641,3 +703,284 @@ TEST_F(SipEventQueueTest, QueuePriorityAndTimeOrdering)
   q->pop(e);
   EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
 }
+
+class ShardedSipEventQueueTest : public SipEventQueueTest
+{
+public:
+  ShardedSipEventQueueTest()
+  {
+    sq = new ShardedSipEventQueue(2);
+  }
+
+  virtual ~ShardedSipEventQueueTest()
+  {
+    delete sq; sq = nullptr;
+  }
+
+  ShardedSipEventQueue* sq;
+};
+
+// Test that SipEvents on a single shard are returned in priority, then queue,
+// order.
+TEST_F(ShardedSipEventQueueTest, ShardOrdering)
+{
+  SipEvent e3;
+  e3.type = MESSAGE;
+  e3.event_data.rdata = &rdata_1;
+  e3.priority = SIPEventPriorityLevel::HIGH_PRIORITY_1;
+
+  sq->push(e1, 0);
+  sq->push(e2, 0);
+  sq->push(e3, 0);
+  EXPECT_EQ(3, sq->size());
+
+  SipEvent e;
+
+  // e3 is higher priority so should be returned first, then e1 which was
+  // queued before e2.
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(SIPEventPriorityLevel::HIGH_PRIORITY_1, e.priority);
+
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+
+  EXPECT_EQ(0, sq->size());
+}
+
+// Test that a worker takes an older event from another shard in preference to
+// the head of its own shard.
+TEST_F(ShardedSipEventQueueTest, AgeAcrossShards)
+{
+  sq->push(e1, 1);
+  sq->push(e2, 0);
+
+  SipEvent e;
+
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+}
+
+// Test that a worker takes a higher priority event from another shard in
+// preference to the head of its own shard.
+TEST_F(ShardedSipEventQueueTest, PriorityAcrossShards)
+{
+  e2.priority = SIPEventPriorityLevel::HIGH_PRIORITY_10;
+
+  sq->push(e1, 0);
+  sq->push(e2, 1);
+
+  SipEvent e;
+
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+}
+
+// Test that a worker whose home shard is empty steals from other shards.
+TEST_F(ShardedSipEventQueueTest, WorkStealing)
+{
+  sq->push(e1, 1);
+
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+  EXPECT_EQ(0, sq->size());
+}
+
+// Test that events pushed without a preferred shard are spread across the
+// shards.
+TEST_F(ShardedSipEventQueueTest, PushBalancing)
+{
+  sq->push(e1);
+  sq->push(e2);
+
+  // Each worker should be able to pop an event from its own shard.
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(e, 0));
+  EXPECT_TRUE(sq->pop(e, 1));
+  EXPECT_EQ(0, sq->size());
+}
+
+// Test that terminating the queue returns the remaining events and causes
+// subsequent pops to fail.
+TEST_F(ShardedSipEventQueueTest, Terminate)
+{
+  sq->push(e1, 0);
+  sq->push(e2, 1);
+
+  std::vector<SipEvent> remaining;
+  sq->terminate(remaining);
+  EXPECT_EQ(2u, remaining.size());
+  EXPECT_EQ(0, sq->size());
+
+  SipEvent e;
+  EXPECT_FALSE(sq->pop(e, 0));
+}
+
+// Test that the queue is only considered deadlocked if it is not empty and
+// has not been serviced within the threshold.
+TEST_F(ShardedSipEventQueueTest, DeadlockDetection)
+{
+  sq->set_deadlock_threshold(100);
+  EXPECT_FALSE(sq->is_deadlocked());
+
+  sq->push(e1, 0);
+  sq->push(e2, 1);
+  cwtest_advance_time_ms(50);
+  EXPECT_FALSE(sq->is_deadlocked());
+
+  // Servicing either shard resets the timer.
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(e, 1));
+  cwtest_advance_time_ms(60);
+  EXPECT_FALSE(sq->is_deadlocked());
+
+  cwtest_advance_time_ms(50);
+  EXPECT_TRUE(sq->is_deadlocked());
+
+  EXPECT_TRUE(sq->pop(e, 0));
+  cwtest_advance_time_ms(200);
+  EXPECT_FALSE(sq->is_deadlocked());
+}
+
+class BucketedEventQueueTest : public SipEventQueueTest
+{
+public:
+  BucketedEventQueueTest()
+  {
+    bq = new eventq<struct SipEvent>(0, true, new BucketedEventQueueBackend());
+  }
+
+  virtual ~BucketedEventQueueTest()
+  {
+    delete bq; bq = nullptr;
+  }
+
+  eventq<struct SipEvent>* bq;
+};
+
+// Test that higher priority SipEvents are returned before lower priority ones.
+TEST_F(BucketedEventQueueTest, QueuePriorityOrdering)
+{
+  e2.priority = SIPEventPriorityLevel::HIGH_PRIORITY_10;
+
+  bq->push(e1);
+  bq->push(e2);
+
+  SipEvent e;
+
+  // e2 is higher priority, so should be returned first
+  bq->pop(e);
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+
+  bq->pop(e);
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+}
+
+// Test that SipEvents at the same priority level are returned in the order
+// they were queued.
+TEST_F(BucketedEventQueueTest, QueueFifoOrdering)
+{
+  bq->push(e2);
+  bq->push(e1);
+
+  SipEvent e;
+
+  bq->pop(e);
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+
+  bq->pop(e);
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+  EXPECT_EQ(0, bq->size());
+}
+
+// Test that SipEvents are returned in priority, then queue, order when the
+// levels are interleaved.
+TEST_F(BucketedEventQueueTest, QueueMixedOrdering)
+{
+  BucketedEventQueueBackend backend;
+
+  for (int ii = 0; ii < 32; ++ii)
+  {
+    SipEvent event;
+    event.priority = (SIPEventPriorityLevel)(ii % 4);
+    event.sequence = ii;
+    backend.push(event);
+  }
+
+  EXPECT_EQ(32, backend.size());
+
+  SipEvent prev = backend.front();
+  backend.pop();
+
+  while (!backend.empty())
+  {
+    // Each event should be 'smaller' than the one before it.
+    EXPECT_TRUE(SipEvent::compare_sequence(backend.front(), prev));
+    prev = backend.front();
+    backend.pop();
+  }
+}
+
+// Microbenchmark comparing the cost of filling and draining the priority queue
+// and bucketed queue backends.  Disabled by default - run with
+// --gtest_also_run_disabled_tests to see the timings.
+TEST(EventQueueBackendBenchmark, DISABLED_FillAndDrain)
+{
+  const int DEPTHS[] = {1000, 10000, 100000};
+
+  for (int depth : DEPTHS)
+  {
+    std::vector<SipEvent> events(depth);
+    for (int ii = 0; ii < depth; ++ii)
+    {
+      // Most traffic is normal priority, with a sprinkling of prioritized
+      // requests and OPTIONS polls.
+      events[ii].priority = (ii % 10 == 0) ?
+                              SIPEventPriorityLevel::HIGH_PRIORITY_15 :
+                              SIPEventPriorityLevel::NORMAL_PRIORITY;
+      events[ii].stop_watch.start();
+    }
+
+    PriorityEventQueueBackend priority_backend;
+    BucketedEventQueueBackend bucketed_backend;
+    eventq<SipEvent>::Backend* backends[] = {&priority_backend, &bucketed_backend};
+    const char* names[] = {"PriorityEventQueueBackend", "BucketedEventQueueBackend"};
+
+    for (int jj = 0; jj < 2; ++jj)
+    {
+      Utils::StopWatch sw;
+      sw.start();
+
+      for (const SipEvent& event : events)
+      {
+        backends[jj]->push(event);
+      }
+
+      unsigned long push_us = 0;
+      sw.read(push_us);
+
+      while (!backends[jj]->empty())
+      {
+        backends[jj]->pop();
+      }
+
+      unsigned long total_us = 0;
+      sw.read(total_us);
+
+      printf("%s: %d events, push %luus, pop %luus\n",
+             names[jj],
+             depth,
+             push_us,
+             total_us - push_us);
+    }
+  }
+}